@@ -203,6 +203,19 @@ ATTR(nav_status)
 ATTR(virtual_dpi)
 ATTR(real_dpi)
 ATTR(underground_alpha)
+ATTR(route_expanded_points)
+ATTR(route_graph_peak_size)
+ATTR(isochrone_time)
+ATTR(route_alternatives)
+ATTR(route_graph_items)
+ATTR(route_graph_segments)
+ATTR(route_graph_points)
+ATTR(route_time_graph)
+ATTR(route_time_flood)
+ATTR(route_time_path)
+ATTR(tile_cache_size)
+ATTR(tile_prefetch)
+ATTR(route_expanded_points_dijkstra)
 ATTR2(0x00027500,type_rel_abs_begin)
 /* These attributes are int that can either hold relative or absolute values. See the
  * documentation of ATTR_REL_RELSHIFT for details.
@@ -264,6 +277,11 @@ ATTR(no_warning_if_map_file_missing)
 ATTR(duplicate)
 ATTR(has_menu_button)
 ATTR(oneway)
+ATTR(contraction_hierarchies)
+ATTR(route_heuristic)
+ATTR(thread_safe)
+ATTR(route_overlay)
+ATTR(route_time_dependent)
 ATTR2(0x0002ffff,type_int_end)
 ATTR2(0x00030000,type_string_begin)
 ATTR(type)
@@ -405,6 +423,9 @@ ATTR(exit_to)
 ATTR(street_destination_forward)
 ATTR(street_destination_backward)
 ATTR(outputdir)
+ATTR(route_corridor)
+ATTR(route_graph_snapshot)
+ATTR(tile_cache)
 ATTR2(0x0003ffff,type_string_end)
 ATTR2(0x00040000,type_special_begin)
 ATTR(order)
@@ -420,6 +441,11 @@ ATTR(zipfile_ref_block)
 ATTR(item_id)
 ATTR(pdl_gps_update)
 ATTR(poly_hole)
+ATTR(overlay_cell)
+ATTR(overlay_boundary)
+ATTR(overlay_clique)
+ATTR(overlay_cut)
+ATTR(speed_profile)
 ATTR2(0x0004ffff,type_special_end)
 ATTR2(0x00050000,type_double_begin)
 ATTR(position_height)
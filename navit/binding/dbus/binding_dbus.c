@@ -459,6 +459,28 @@ static int pcoord_get_from_message(DBusMessage *message, DBusMessageIter *iter,
 
 }
 
+static int pcoord_array_get_from_message(DBusMessage *message, DBusMessageIter *iter, struct pcoord **pc,
+        int *count) {
+    DBusMessageIter iter2;
+
+    *pc=NULL;
+    *count=0;
+    if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+        return 0;
+    dbus_message_iter_recurse(iter, &iter2);
+    while (dbus_message_iter_get_arg_type(&iter2) != DBUS_TYPE_INVALID) {
+        *pc=g_renew(struct pcoord, *pc, *count+1);
+        if (!pcoord_get_from_message(message, &iter2, &(*pc)[*count])) {
+            g_free(*pc);
+            *pc=NULL;
+            return 0;
+        }
+        (*count)++;
+        dbus_message_iter_next(&iter2);
+    }
+    return 1;
+}
+
 static void pcoord_encode(DBusMessageIter *iter, struct pcoord *pc) {
     DBusMessageIter iter2;
     dbus_message_iter_open_container(iter,DBUS_TYPE_STRUCT,NULL,&iter2);
@@ -1023,6 +1045,64 @@ static DBusHandlerResult request_route_dup(DBusConnection *connection, DBusMessa
     return request_dup(connection, message, "route", NULL, (void *(*)(void *)) route_dup);
 }
 
+/**
+ * @brief Calculates travel times and distances between several origins and destinations
+ * @param connection The DBusConnection object through which \a message arrived
+ * @param message The DBusMessage containing two arrays of coordinates, the origins and the destinations
+ * @returns An array holding one array per origin, which holds the travel time in seconds and the distance in meters
+ * to each destination, -1 if the destination cannot be reached
+ */
+static DBusHandlerResult request_route_get_travel_matrix(DBusConnection *connection, DBusMessage *message) {
+    struct route *route;
+    struct pcoord *origins,*destinations;
+    int origin_count,destination_count,*times,*lengths,i,j;
+    DBusMessage *reply;
+    DBusMessageIter iter,iter1,iter2,iter3,iter4;
+
+    route=object_get_from_message(message, "route");
+    if (! route)
+        return dbus_error_invalid_object_path(connection, message);
+
+    dbus_message_iter_init(message, &iter);
+    if (!pcoord_array_get_from_message(message, &iter, &origins, &origin_count))
+        return dbus_error_invalid_parameter(connection, message);
+    dbus_message_iter_next(&iter);
+    if (!pcoord_array_get_from_message(message, &iter, &destinations, &destination_count)) {
+        g_free(origins);
+        return dbus_error_invalid_parameter(connection, message);
+    }
+    times=g_new(int, origin_count*destination_count);
+    lengths=g_new(int, origin_count*destination_count);
+    if (!route_get_travel_matrix(route, origins, origin_count, destinations, destination_count, times, lengths)) {
+        g_free(times);
+        g_free(lengths);
+        g_free(origins);
+        g_free(destinations);
+        return dbus_error(connection, message, DBUS_ERROR_FAILED, "route has no mapset or vehicle profile");
+    }
+    reply = dbus_message_new_method_return(message);
+    dbus_message_iter_init_append(reply, &iter1);
+    dbus_message_iter_open_container(&iter1, DBUS_TYPE_ARRAY, "a(ii)", &iter2);
+    for (i = 0 ; i < origin_count ; i++) {
+        dbus_message_iter_open_container(&iter2, DBUS_TYPE_ARRAY, "(ii)", &iter3);
+        for (j = 0 ; j < destination_count ; j++) {
+            dbus_message_iter_open_container(&iter3, DBUS_TYPE_STRUCT, NULL, &iter4);
+            dbus_message_iter_append_basic(&iter4, DBUS_TYPE_INT32, &times[i*destination_count+j]);
+            dbus_message_iter_append_basic(&iter4, DBUS_TYPE_INT32, &lengths[i*destination_count+j]);
+            dbus_message_iter_close_container(&iter3, &iter4);
+        }
+        dbus_message_iter_close_container(&iter2, &iter3);
+    }
+    dbus_message_iter_close_container(&iter1, &iter2);
+    dbus_connection_send (connection, reply, NULL);
+    dbus_message_unref (reply);
+    g_free(times);
+    g_free(lengths);
+    g_free(origins);
+    g_free(destinations);
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 
 /* navit */
 
@@ -2040,6 +2120,7 @@ struct dbus_method {
     {".route",    "remove_attr",       "sv",      "attribute,value",                         "",    "",  request_route_remove_attr},
     {".route",    "destroy",           "",        "",                                        "",    "",  request_route_destroy},
     {".route",    "dup",               "",        "",                                        "",    "",  request_route_dup},
+    {".route",    "get_travel_matrix", "a(iii)a(iii)", "origins,destinations",                  "aa(ii)", "matrix", request_route_get_travel_matrix},
     {".search_list","destroy",         "",        "",                                        "",   "",      request_search_list_destroy},
     {".search_list","destroy",         "",        "",                                        "",   "",      request_search_list_destroy},
     {".search_list","destroy",         "",        "",                                        "",   "",      request_search_list_destroy},
@@ -186,6 +186,27 @@ void cache_entry_destroy(struct cache *cache, void *data) {
     entry->usage--;
 }
 
+/**
+ * @brief Returns the id of an entry created by cache_entry_new()
+ */
+void *cache_entry_get_id(struct cache *cache, void *data) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
+    return entry->id;
+}
+
+/**
+ * @brief Returns the id of an entry created by cache_entry_new() without knowing its cache
+ *
+ * This allows to find the cache of an entry if data is spread over several caches by its id.
+ *
+ * @param data The data of the entry
+ * @param id_size The size of the id, as passed to cache_new()
+ */
+void *cache_entry_get_id_by_size(void *data, int id_size) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-(id_size/4)*sizeof(int)-sizeof(struct cache_entry));
+    return entry->id;
+}
+
 static struct cache_entry *cache_trim(struct cache *cache, struct cache_entry *entry) {
     struct cache_entry *new_entry;
     dbg(lvl_debug,"trim 0x%x 0x%x 0x%x 0x%x 0x%x", entry->id[0], entry->id[1], entry->id[2], entry->id[3], entry->id[4]);
@@ -332,6 +353,38 @@ void *cache_insert_new(struct cache *cache, void *id, int size) {
     return data;
 }
 
+/**
+ * @brief Inserts an entry created by cache_entry_new(), unless an entry with the same id is cached already
+ *
+ * This allows filling an entry without holding the lock protecting the cache, in which case another thread may have
+ * cached the same data meanwhile.
+ *
+ * @return {@code data} if it was inserted, otherwise the cached entry, in which case {@code data} is freed
+ */
+void *cache_insert_unique(struct cache *cache, void *data) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
+    struct cache_entry *old=g_hash_table_lookup(cache->hash, entry->id);
+    if (old && (old->where == &cache->t1 || old->where == &cache->t2)) {
+        cache_entry_free(cache, data);
+        old->usage++;
+        return &old->id[cache->id_size];
+    }
+    if (old) {
+        cache_remove_from_list(old->where, old);
+        cache_remove(cache, old);
+    }
+    cache_insert(cache, data);
+    return data;
+}
+
+/**
+ * @brief Frees an entry created by cache_entry_new() which was never inserted
+ */
+void cache_entry_free(struct cache *cache, void *data) {
+    struct cache_entry *entry=(struct cache_entry *)((char *)data-cache->entry_size);
+    g_slice_free1(entry->size, entry);
+}
+
 static void cache_stats(struct cache *cache) {
     dbg(lvl_debug,"hits %d misses %d hitratio %d size %d entry_size %d id_size %d T1 target %d", cache->hits, cache->misses,
         cache->hits*100/(cache->hits+cache->misses), cache->size, cache->entry_size, cache->id_size, cache->t1_target);
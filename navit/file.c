@@ -31,6 +31,9 @@
 #include <wordexp.h>
 #include <glib.h>
 #include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 #include "debug.h"
 #include "cache.h"
 #include "file.h"
@@ -39,6 +42,7 @@
 #include "util.h"
 #include "types.h"
 #include "zipfile.h"
+#include "thread.h"
 #ifdef HAVE_SOCKET
 #include <sys/socket.h>
 #include <netdb.h>
@@ -48,7 +52,22 @@
 static GHashTable *file_name_hash;
 #endif
 
-static struct cache *file_cache;
+/** Maximum number of shards of the file cache */
+#define FILE_CACHE_SHARDS 4
+
+/**
+ * @brief A part of the file cache with its own lock
+ *
+ * The file cache is split into shards by the id of the cached data, so that threads reading different parts of a map
+ * rarely wait for each other.
+ */
+struct file_cache_shard {
+    struct cache *cache;
+    struct thread_lock *lock;    //!< Protects cache
+};
+
+static struct file_cache_shard file_cache[FILE_CACHE_SHARDS];
+static int file_cache_shards=1;
 
 #ifdef HAVE_PRAGMA_PACK
 #pragma pack(push)
@@ -66,6 +85,18 @@ struct file_cache_id {
 #pragma pack(pop)
 #endif
 
+static struct file_cache_shard *file_cache_shard(struct file_cache_id *id) {
+    unsigned int hash=(unsigned int)(id->offset ^ (id->offset >> 32)) ^ id->file_name_id;
+    return &file_cache[(hash*2654435761U >> 16) % file_cache_shards];
+}
+
+/**
+ * @brief Returns the shard holding data returned from the file cache, by the same hash used for inserting it
+ */
+static struct file_cache_shard *file_cache_shard_of_data(unsigned char *data) {
+    return file_cache_shard(cache_entry_get_id_by_size(data, sizeof(struct file_cache_id)));
+}
+
 #ifdef HAVE_SOCKET
 static int file_socket_connect(char *host, char *service) {
     struct addrinfo hints;
@@ -203,6 +234,7 @@ file_create(char *name, struct attr **options) {
             return NULL;
         }
         dbg(lvl_debug,"fd=%d", file->fd);
+        file->lock=thread_lock_new();
         file->size=lseek(file->fd, 0, SEEK_END);
         if (file->size < 0)
             file->size=0;
@@ -316,27 +348,50 @@ int file_mmap(struct file *file) {
     return 1;
 }
 
+/**
+ * @brief Reads from a file at the given offset
+ *
+ * @return 1 on success, 0 on error
+ */
+static int file_read_at(struct file *file, long long offset, void *data, int size) {
+    int ret;
+    thread_lock_acquire(file->lock);
+    lseek(file->fd, offset, SEEK_SET);
+    ret=read(file->fd, data, size) == size;
+    thread_lock_release(file->lock);
+    return ret;
+}
+
 unsigned char *file_data_read(struct file *file, long long offset, int size) {
+    struct file_cache_id id= {offset,size,file->name_id,0};
+    struct file_cache_shard *shard;
     void *ret;
     if (file->special)
         return NULL;
     if (file->begin)
         return file->begin+offset;
-    if (file->cache) {
-        struct file_cache_id id= {offset,size,file->name_id,0};
-        ret=cache_lookup(file_cache,&id);
-        if (ret)
-            return ret;
-        ret=cache_insert_new(file_cache,&id,size);
-    } else
+    if (!file->cache) {
         ret=g_malloc(size);
-    lseek(file->fd, offset, SEEK_SET);
-    if (read(file->fd, ret, size) != size) {
-        file_data_free(file, ret);
-        ret=NULL;
+        if (!file_read_at(file, offset, ret, size)) {
+            g_free(ret);
+            ret=NULL;
+        }
+        return ret;
     }
+    shard=file_cache_shard(&id);
+    thread_lock_acquire(shard->lock);
+    ret=cache_lookup(shard->cache,&id);
+    if (!ret) {
+        ret=cache_entry_new(shard->cache,&id,size);
+        if (file_read_at(file, offset, ret, size))
+            cache_insert(shard->cache, ret);
+        else {
+            cache_entry_free(shard->cache, ret);
+            ret=NULL;
+        }
+    }
+    thread_lock_release(shard->lock);
     return ret;
-
 }
 
 static void file_process_headers(struct file *file, unsigned char *headers) {
@@ -431,15 +486,22 @@ unsigned char *file_data_read_all(struct file *file) {
 void file_data_flush(struct file *file, long long offset, int size) {
     if (file->cache) {
         struct file_cache_id id= {offset,size,file->name_id,0};
-        cache_flush(file_cache,&id);
+        struct file_cache_shard *shard=file_cache_shard(&id);
+        thread_lock_acquire(shard->lock);
+        cache_flush(shard->cache,&id);
+        thread_lock_release(shard->lock);
         dbg(lvl_debug,"Flushing "LONGLONG_FMT" %d bytes",offset,size);
     }
 }
 
 int file_data_write(struct file *file, long long offset, int size, const void *data) {
+    int ok;
     file_data_flush(file, offset, size);
+    thread_lock_acquire(file->lock);
     lseek(file->fd, offset, SEEK_SET);
-    if (write(file->fd, data, size) != size)
+    ok=write(file->fd, data, size) == size;
+    thread_lock_release(file->lock);
+    if (!ok)
         return 0;
     if (file->size < offset+size)
         file->size=offset+size;
@@ -487,38 +549,92 @@ static int uncompress_int(Bytef *dest, uLongf *destLen, const Bytef *source, uLo
     return err;
 }
 
-unsigned char *file_data_read_compressed(struct file *file, long long offset, int size, int size_uncomp) {
-    void *ret;
-    char *buffer = 0;
+/**
+ * @brief Uncompresses a zip member
+ *
+ * @param dest Buffer receiving the uncompressed data
+ * @param size_uncomp Size of the uncompressed data
+ * @param src The compressed data
+ * @param size Size of the compressed data
+ * @param method The zip compression method of the data, {@code zip_method_deflate} or
+ * {@code zip_method_zstd} (only if built with libzstd)
+ * @return 1 on success, 0 if the data is corrupt or the method is not supported
+ */
+int file_data_uncompress(unsigned char *dest, int size_uncomp, unsigned char *src, int size, int method) {
     uLongf destLen=size_uncomp;
 
+    switch (method) {
+    case zip_method_deflate:
+        return uncompress_int(dest, &destLen, src, size) == Z_OK;
+#ifdef HAVE_ZSTD
+    case zip_method_zstd: {
+        size_t ret=ZSTD_decompress(dest, size_uncomp, src, size);
+        if (ZSTD_isError(ret)) {
+            dbg(lvl_error,"zstd: %s", ZSTD_getErrorName(ret));
+            return 0;
+        }
+        return ret == size_uncomp;
+    }
+#endif
+    default:
+        dbg(lvl_error,"compression method %d not supported", method);
+        return 0;
+    }
+}
+
+/**
+ * @brief Reads and uncompresses a zip member
+ *
+ * No lock is held while uncompressing, so that several threads can uncompress at the same time.
+ *
+ * @return The uncompressed data, to be freed with {@code file_data_free()}, or NULL on error
+ */
+unsigned char *file_data_read_compressed(struct file *file, long long offset, int size, int size_uncomp, int method) {
+    struct file_cache_id id= {offset,size,file->name_id,method};
+    struct file_cache_shard *shard=file_cache_shard(&id);
+    void *ret;
+    char *buffer;
+    int ok;
+
     if (file->cache) {
-        struct file_cache_id id= {offset,size,file->name_id,1};
-        ret=cache_lookup(file_cache,&id);
-        if (ret)
+        thread_lock_acquire(shard->lock);
+        ret=cache_lookup(shard->cache,&id);
+        if (ret) {
+            thread_lock_release(shard->lock);
             return ret;
-        ret=cache_insert_new(file_cache,&id,size_uncomp);
+        }
+        ret=cache_entry_new(shard->cache,&id,size_uncomp);
+        thread_lock_release(shard->lock);
     } else
         ret=g_malloc(size_uncomp);
-    lseek(file->fd, offset, SEEK_SET);
 
     buffer = (char *)g_malloc(size);
-    if (read(file->fd, buffer, size) != size) {
-        g_free(ret);
-        ret=NULL;
-    } else {
-        if (uncompress_int(ret, &destLen, (Bytef *)buffer, size) != Z_OK) {
-            dbg(lvl_error,"uncompress failed");
+    ok=file_read_at(file, offset, buffer, size);
+    if (ok && !file_data_uncompress(ret, size_uncomp, (unsigned char *)buffer, size, method)) {
+        dbg(lvl_error,"uncompress failed");
+        ok=0;
+    }
+    g_free(buffer);
+    if (!file->cache) {
+        if (!ok) {
             g_free(ret);
             ret=NULL;
         }
+        return ret;
     }
-    g_free(buffer);
-
+    thread_lock_acquire(shard->lock);
+    if (ok)
+        ret=cache_insert_unique(shard->cache, ret);
+    else {
+        cache_entry_free(shard->cache, ret);
+        ret=NULL;
+    }
+    thread_lock_release(shard->lock);
     return ret;
 }
 
 void file_data_free(struct file *file, unsigned char *data) {
+    struct file_cache_shard *shard;
     if (file->begin) {
         if (data == file->begin)
             return;
@@ -526,7 +642,10 @@ void file_data_free(struct file *file, unsigned char *data) {
             return;
     }
     if (file->cache && data) {
-        cache_entry_destroy(file_cache, data);
+        shard=file_cache_shard_of_data(data);
+        thread_lock_acquire(shard->lock);
+        cache_entry_destroy(shard->cache, data);
+        thread_lock_release(shard->lock);
     } else
         g_free(data);
 }
@@ -539,7 +658,10 @@ void file_data_remove(struct file *file, unsigned char *data) {
             return;
     }
     if (file->cache && data) {
-        cache_flush_data(file_cache, data);
+        struct file_cache_shard *shard=file_cache_shard_of_data(data);
+        thread_lock_acquire(shard->lock);
+        cache_flush_data(shard->cache, data);
+        thread_lock_release(shard->lock);
     } else
         g_free(data);
 }
@@ -673,6 +795,7 @@ void file_destroy(struct file *f) {
         file_unmap( f );
     }
 
+    thread_lock_destroy(f->lock);
     g_free(f->buffer);
     g_free(f->name);
     g_free(f);
@@ -720,7 +843,10 @@ int file_version(struct file *file, int mode) {
     struct stat st;
     int error;
     if (mode == 3) {
-        long long size=lseek(file->fd, 0, SEEK_END);
+        long long size;
+        thread_lock_acquire(file->lock);
+        size=lseek(file->fd, 0, SEEK_END);
+        thread_lock_release(file->lock);
         if (file->begin && file->begin+size > file->mmap_end) {
             file->version++;
         } else {
@@ -752,7 +878,12 @@ void *file_get_os_handle(struct file *file) {
 
 int file_set_cache_size(int cache_size) {
 #ifdef CACHE_SIZE
-    cache_resize(file_cache, cache_size);
+    int i;
+    for (i = 0 ; i < file_cache_shards ; i++) {
+        thread_lock_acquire(file_cache[i].lock);
+        cache_resize(file_cache[i].cache, cache_size/file_cache_shards);
+        thread_lock_release(file_cache[i].lock);
+    }
     return 1;
 #else
     return 0;
@@ -760,10 +891,17 @@ int file_set_cache_size(int cache_size) {
 }
 
 void file_init(void) {
+    int i;
 #ifdef CACHE_SIZE
     file_name_hash=g_hash_table_new(g_str_hash, g_str_equal);
-    file_cache=cache_new(sizeof(struct file_cache_id), CACHE_SIZE);
 #endif
+    file_cache_shards=MAX(MIN(thread_cpu_count(), FILE_CACHE_SHARDS), 1);
+    for (i = 0 ; i < file_cache_shards ; i++) {
+#ifdef CACHE_SIZE
+        file_cache[i].cache=cache_new(sizeof(struct file_cache_id), CACHE_SIZE/file_cache_shards);
+#endif
+        file_cache[i].lock=thread_lock_new();
+    }
     if(sizeof(off_t)<8)
         dbg(lvl_error,"Maps larger than 2GB are not supported by this binary, sizeof(off_t)=%zu",sizeof(off_t));
 }
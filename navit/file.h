@@ -33,6 +33,8 @@ extern "C" {
 #include "param.h"
 #include <stdio.h>
 
+struct thread_lock;
+
 struct file {
 	struct file *next;
 	unsigned char *begin;
@@ -53,6 +55,7 @@ struct file {
 	char *name;
 	int special;
 	int cache;
+	struct thread_lock *lock;	/**< Protects the file position, so that the file can be read from several threads */
 	int requests;
 	unsigned char *buffer;
 	int buffer_len;
@@ -76,7 +79,8 @@ unsigned char *file_data_read_all(struct file *file);
 void file_data_flush(struct file *file, long long offset, int size);
 int file_data_write(struct file *file, long long offset, int size, const void *data);
 int file_get_contents(char *name, unsigned char **buffer, int *size);
-unsigned char *file_data_read_compressed(struct file *file, long long offset, int size, int size_uncomp);
+int file_data_uncompress(unsigned char *dest, int size_uncomp, unsigned char *src, int size, int method);
+unsigned char *file_data_read_compressed(struct file *file, long long offset, int size, int size_uncomp, int method);
 void file_data_free(struct file *file, unsigned char *data);
 int file_exists(char const *name);
 void file_remap_readonly(struct file *f);
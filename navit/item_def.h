@@ -367,6 +367,8 @@ ITEM(nav_keep_left)
 ITEM(nav_keep_right)
 ITEM(poi_cave)
 ITEM(poi_archaeological_site)
+ITEM(isochrone_point)
+ITEM(route_overlay_cell)
 ITEM2(0x7fffffe0,poi_customg)
 ITEM(poi_customh)
 ITEM(poi_customi)
@@ -529,6 +531,8 @@ ITEM(former_itinerary_part)
 ITEM(cliff)
 ITEM(sports_track)
 ITEM(archaeological_site)
+ITEM(isochrone_segment)
+ITEM(street_route_alternative)
 /* Area */
 ITEM2(0xc0000000,area)
 ITEM2(0xc0000001,area_unspecified)
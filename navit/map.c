@@ -275,6 +275,25 @@ void map_destroy(struct map *m) {
     g_free(m);
 }
 
+/**
+ * @brief Takes a reference to a map
+ *
+ * @param m The map
+ * @return The map
+ */
+struct map *map_ref(struct map *m) {
+    return (struct map *)navit_object_ref((struct navit_object *)m);
+}
+
+/**
+ * @brief Releases a reference to a map, destroying it if it was the last one
+ *
+ * @param m The map
+ */
+void map_unref(struct map *m) {
+    navit_object_unref((struct navit_object *)m);
+}
+
 /**
  * @brief Creates a new map rect
  *
@@ -39,6 +39,8 @@
 #include "callback.h"
 #include "types.h"
 #include "geom.h"
+#include "thread.h"
+#include "tile_cache.h"
 
 static int map_id;
 
@@ -81,7 +83,7 @@ struct tile {
     int *pos_next;          //!< Pointer to the next item (the item which follows the "current item" as indicated by *pos).
     struct file *fi;        //!< The file from which this tile was loaded.
     int zipfile_num;
-    int mode;
+    int mode;               //!< 0: whole map file, 1: read from the map file, 2: in memory, 3: from the tile cache
 };
 
 
@@ -114,13 +116,11 @@ struct map_priv {
     struct zip_eoc *eoc;
     struct zip64_eoc *eoc64;
     int zip_members;
-    unsigned char *search_data;
-    int search_offset;
-    int search_size;
     int version;
     int check_version;
     int map_version;
-    GHashTable *changes;
+    GHashTable *changes;         //!< Modified items, see binfile_item_dup()
+    struct thread_lock *changes_lock; //!< Protects changes
     char *map_release;
     int flags;
     char *url;
@@ -132,6 +132,50 @@ struct map_priv {
     long download_enabled;
     int last_searched_town_id_hi;
     int last_searched_town_id_lo;
+    char *tile_cache_file;       //!< File holding decompressed tiles, see tile_cache.c
+    int tile_cache_size;         //!< Size of the tile cache in bytes
+    struct tile_cache *tile_cache;
+    int prefetch_threads;        //!< Number of threads decompressing tiles ahead of a map rect, 0 to disable
+    struct thread_lock *tiles_lock; //!< Protects tiles
+    struct binfile_tile *tiles;  //!< Quadtree of the tiles of the map, see binfile_select_tiles()
+    int tile_count;              //!< Number of tiles, -1 if not yet read
+};
+
+/**
+ * @brief An entry of the quadtree of the tiles of a map, see {@code struct zip_tiledir}
+ */
+struct binfile_tile {
+    struct coord_rect r;         //!< Bounding box of the tile
+    int order;                   //!< Minimum order at which the tile is used
+    int zipfile;                 //!< Number of the zip member, -1 if the tile only contains other tiles
+    int next;                    //!< Index of the first tile not inside of this tile
+};
+
+/**
+ * @brief A tile to prefetch, as listed in the zip central directory
+ */
+struct binfile_prefetch_tile {
+    int zipfile;                 //!< Number of the zip member
+    int disk;                    //!< Disk of a split map holding the tile
+    long long offset;            //!< Offset of the local file header
+    int size;                    //!< Uncompressed size
+};
+
+/**
+ * @brief Decompresses the tiles needed by a map rect into the file cache, on several threads
+ *
+ * The map rect mostly reads the tiles in the order of their zip members, so the threads start with the last tile and
+ * the map rect claims each tile it reaches, to keep both from decompressing the same tile.
+ */
+struct binfile_prefetch {
+    struct map_priv *m;
+    struct thread_lock *lock;    //!< Protects taken and cancel
+    struct binfile_prefetch_tile *tiles; //!< Tiles to prefetch, ordered by zip member
+    char *taken;                 //!< Whether a tile was taken by a thread or claimed by the map rect
+    int count;
+    int cancel;
+    struct thread **threads;
+    int thread_count;
 };
 
 struct map_rect_priv {
@@ -151,6 +195,7 @@ struct map_rect_priv {
     struct attr attrs[8];
     int status;
     struct map_search_priv *msp;
+    struct binfile_prefetch *prefetch;
 #ifdef DEBUG_SIZE
     int size;
 #endif
@@ -182,6 +227,9 @@ static void setup_pos(struct map_rect_priv *mr);
 static void map_binfile_close(struct map_priv *m);
 static int map_binfile_open(struct map_priv *m);
 static void map_binfile_destroy(struct map_priv *m);
+static void tile_bbox(char *tile, int len, struct coord_rect *r);
+static int selection_contains(struct map_selection *sel, struct coord_rect *r, struct range *mima);
+static void binfile_prefetch_claim(struct binfile_prefetch *p, int zipfile);
 
 static void lfh_to_cpu(struct zip_lfh *lfh) {
     dbg_assert(lfh != NULL);
@@ -351,13 +399,16 @@ static unsigned char *binfile_read_content(struct map_priv *m, struct file *fi,
 
     offset+=sizeof(struct zip_lfh)+lfh->zipfnln;
     switch (lfh->zipmthd) {
-    case 0:
+    case zip_method_stored:
         offset+=lfh->zipxtraln;
         ret=file_data_read(fi,offset, lfh->zipuncmp);
         break;
-    case 8:
+    case zip_method_deflate:
+#ifdef HAVE_ZSTD
+    case zip_method_zstd:
+#endif
         offset+=lfh->zipxtraln;
-        ret=file_data_read_compressed(fi,offset, lfh->zipsize, lfh->zipuncmp);
+        ret=file_data_read_compressed(fi,offset, lfh->zipsize, lfh->zipuncmp, lfh->zipmthd);
         break;
     default:
         dbg(lvl_error,"map file %s: unknown compression method %d", fi->name, lfh->zipmthd);
@@ -370,42 +421,47 @@ static int binfile_search_cd(struct map_priv *m, int offset, char *name, int par
     int end=m->eoc64?m->eoc64->zip64ecsz:m->eoc->zipecsz;
     int len=strlen(name);
     long long cdoffset=m->eoc64?m->eoc64->zip64eofst:m->eoc->zipeofst;
+    unsigned char *search_data=NULL;
+    int search_offset=0,search_size=0;
     struct zip_cd *cd;
 #if 0
     dbg(lvl_debug,"end=%d",end);
 #endif
     while (offset < end) {
-        cd=(struct zip_cd *)(m->search_data+offset-m->search_offset);
-        if (! m->search_data ||
-                m->search_offset > offset ||
-                offset-m->search_offset+sizeof(*cd) > m->search_size ||
-                offset-m->search_offset+sizeof(*cd)+cd->zipcfnl+cd->zipcxtl > m->search_size
+        cd=(struct zip_cd *)(search_data+offset-search_offset);
+        if (! search_data ||
+                search_offset > offset ||
+                offset-search_offset+sizeof(*cd) > search_size ||
+                offset-search_offset+sizeof(*cd)+cd->zipcfnl+cd->zipcxtl > search_size
            ) {
 #if 0
-            dbg(lvl_debug,"reload %p %d %d", m->search_data, m->search_offset, offset);
+            dbg(lvl_debug,"reload %p %d %d", search_data, search_offset, offset);
 #endif
-            if (m->search_data)
-                file_data_free(m->fi,m->search_data);
-            m->search_offset=offset;
-            m->search_size=end-offset;
-            if (m->search_size > size)
-                m->search_size=size;
-            m->search_data=file_data_read(m->fi,cdoffset+m->search_offset,m->search_size);
-            cd=(struct zip_cd *)m->search_data;
+            if (search_data)
+                file_data_free(m->fi,search_data);
+            search_offset=offset;
+            search_size=end-offset;
+            if (search_size > size)
+                search_size=size;
+            search_data=file_data_read(m->fi,cdoffset+search_offset,search_size);
+            cd=(struct zip_cd *)search_data;
         }
 #if 0
-        dbg(lvl_debug,"offset=%d search_offset=%d search_size=%d search_data=%p cd=%p", offset, m->search_offset,
-            m->search_size, m->search_data, cd);
+        dbg(lvl_debug,"offset=%d search_offset=%d search_size=%d search_data=%p cd=%p", offset, search_offset,
+            search_size, search_data, cd);
         dbg(lvl_debug,"offset=%d fn='%s'",offset,cd->zipcfn);
 #endif
         if (!skip &&
                 (partial || cd->zipcfnl == len) &&
-                !strncmp(cd->zipcfn, name, len))
+                !strncmp(cd->zipcfn, name, len)) {
+            file_data_free(m->fi, search_data);
             return offset;
+        }
         skip=0;
         offset+=sizeof(*cd)+cd->zipcfnl+cd->zipcxtl+cd->zipccml;
         ;
     }
+    file_data_free(m->fi, search_data);
     return -1;
 }
 
@@ -546,6 +602,13 @@ static int binfile_attr_get(void *priv_data, enum attr_type attr_type, struct at
             mr->label_attr[3]=t->pos_attr;
         if (type == attr_town_name && mr->item.type < type_line)
             mr->label_attr[4]=t->pos_attr;
+        /* the number of intervals of a speed profile must fit into the attribute */
+        if (type == attr_speed_profile && (size < 2
+                                           || le32_to_cpu(t->pos_attr[1]) > (unsigned int)(size-2)*sizeof(int))) {
+            dbg(lvl_warning,"ignoring damaged speed profile");
+            t->pos_attr+=size;
+            continue;
+        }
         if (type == attr_type || attr_type == attr_any) {
             if (attr_type == attr_any) {
                 dbg(lvl_debug,"pos %p attr %s size %d", t->pos_attr-1, attr_to_name(type), size);
@@ -623,9 +686,11 @@ static int *binfile_item_dup(struct map_priv *m, struct item *item, struct tile
     dbg(lvl_debug,"id 0x%x,0x%x",entry->id.id_hi,entry->id.id_lo);
 
     memcpy(ret, t->pos, (size+1)*sizeof(int));
+    thread_lock_acquire(m->changes_lock);
     if (!m->changes)
         m->changes=g_hash_table_new_full(binfile_hash_entry_hash, binfile_hash_entry_equal, g_free, NULL);
     g_hash_table_replace(m->changes, entry, entry);
+    thread_lock_release(m->changes_lock);
     dbg(lvl_debug,"ret %p",ret);
     return ret;
 }
@@ -858,6 +923,8 @@ static int pop_tile(struct map_rect_priv *mr) {
         return 0;
     if (mr->t->mode < 2)
         file_data_free(mr->m->fi, (unsigned char *)(mr->t->start));
+    else if (mr->t->mode == 3)
+        tile_cache_release(mr->m->tile_cache, (unsigned char *)(mr->t->start));
 #ifdef DEBUG_SIZE
 #if DEBUG_SIZE > 0
     dbg(lvl_debug,"leave %d",mr->t->zipfile_num);
@@ -881,13 +948,28 @@ static int zipfile_to_tile(struct map_priv *m, struct zip_cd *cd, struct tile *t
         fi=m->fis[cd->zipdsk];
     else
         fi=m->fi;
+    t->fi=fi;
+    if (m->tile_cache && cd->zipcmthd != zip_method_stored
+            && (t->start=(int *)tile_cache_get(m->tile_cache, t->zipfile_num, cd->zipccrc, cd->zipcunc))) {
+        t->end=t->start+cd->zipcunc/4;
+        t->mode=3;
+        return 1;
+    }
     lfh=binfile_read_lfh(fi, binfile_cd_offset(cd));
     zipfn=(char *)(file_data_read(fi,binfile_cd_offset(cd)+sizeof(struct zip_lfh), lfh->zipfnln));
     strncpy(buffer, zipfn, lfh->zipfnln);
     buffer[lfh->zipfnln]='\0';
     t->start=(int *)binfile_read_content(m, fi, binfile_cd_offset(cd), lfh);
+    if (t->start && m->tile_cache && lfh->zipmthd != zip_method_stored) {
+        int *cached=(int *)tile_cache_put(m->tile_cache, t->zipfile_num, cd->zipccrc, (unsigned char *)t->start,
+                                          lfh->zipuncmp);
+        if (cached) {
+            file_data_free(fi, (unsigned char *)t->start);
+            t->start=cached;
+            t->mode=3;
+        }
+    }
     t->end=t->start+lfh->zipuncmp/4;
-    t->fi=fi;
     file_data_free(fi, (unsigned char *)zipfn);
     file_data_free(fi, (unsigned char *)lfh);
     return t->start != NULL;
@@ -1379,6 +1461,8 @@ static int push_zipfile_tile(struct map_rect_priv *mr, int zipfile, int offset,
     struct zip_cd *cd=(struct zip_cd *)(file_data_read(f, cdoffset + zipfile*m->cde_size, m->cde_size));
     dbg(lvl_debug,"read from "LONGLONG_FMT" %d bytes",cdoffset + zipfile*m->cde_size, m->cde_size);
     cd_to_cpu(cd);
+    if (mr->prefetch)
+        binfile_prefetch_claim(mr->prefetch, zipfile);
     if (!cd->zipcunc && m->url) {
         cd=download(m, mr, cd, zipfile, offset, length, async);
         if (!cd)
@@ -1445,28 +1529,293 @@ static void tile_bbox(char *tile, int len, struct coord_rect *r) {
     }
 }
 
-static int map_download_selection_check(struct zip_cd *cd, struct map_selection *sel) {
-    struct coord_rect cd_rect;
-    if (cd->zipcunc)
+/**
+ * @brief Reads the tile directory of a map, see {@code struct zip_tiledir}
+ *
+ * @return 1 on success, 0 if the map has no usable tile directory
+ */
+static int binfile_read_tiledir(struct map_priv *m) {
+    struct zip_cd *cd;
+    struct zip_lfh *lfh=NULL;
+    struct zip_tiledir *tiledir=NULL;
+    struct zip_tiledir_entry *entry;
+    struct binfile_tile *t;
+    struct file *fi;
+    int i,len=strlen(zip_tiledir_name),count,ret=0;
+
+    if (m->zip_members < 2)
+        return 0;
+    cd=binfile_read_cd(m, (m->zip_members-2)*m->cde_size, -1);
+    if (!cd)
+        return 0;
+    for (i = len ; i < cd->zipcfnl && cd->zipcfn[i] == '_' ; i++);
+    if (i != cd->zipcfnl || strncmp(cd->zipcfn, zip_tiledir_name, len) || !cd->zipcunc) {
+        file_data_free(m->fi, (unsigned char *)cd);
         return 0;
-    tile_bbox((char *)(cd+1), cd->zipcfnl, &cd_rect);
-    while (sel) {
-        if (coord_rect_overlap(&cd_rect, &sel->u.c_rect))
-            return 1;
-        sel=sel->next;
     }
-    return 0;
+    fi=m->fis ? m->fis[cd->zipdsk] : m->fi;
+    lfh=binfile_read_lfh(fi, binfile_cd_offset(cd));
+    if (lfh && lfh->zipuncmp >= sizeof(*tiledir))
+        tiledir=(struct zip_tiledir *)binfile_read_content(m, fi, binfile_cd_offset(cd), lfh);
+    if (tiledir && le32_to_cpu(tiledir->ziptdsig) == zip_tiledir_sig
+            && le32_to_cpu(tiledir->ziptdver) == zip_tiledir_version) {
+        count=le32_to_cpu(tiledir->ziptdnum);
+        entry=(struct zip_tiledir_entry *)(tiledir+1);
+        if (count >= 0 && count <= (lfh->zipuncmp-sizeof(*tiledir))/sizeof(*entry)) {
+            m->tiles=g_new(struct binfile_tile, count);
+            for (i = 0 ; i < count ; i++) {
+                t=&m->tiles[i];
+                t->r.lu.x=le32_to_cpu(entry[i].ziptdlx);
+                t->r.lu.y=le32_to_cpu(entry[i].ziptdhy);
+                t->r.rl.x=le32_to_cpu(entry[i].ziptdhx);
+                t->r.rl.y=le32_to_cpu(entry[i].ziptdly);
+                t->order=le16_to_cpu(entry[i].ziptdorder);
+                t->zipfile=le32_to_cpu(entry[i].ziptdfile);
+                t->next=le32_to_cpu(entry[i].ziptdnext);
+                if (t->zipfile < -1 || t->zipfile >= m->zip_members || t->next <= i || t->next > count)
+                    break;
+            }
+            if (i == count) {
+                m->tile_count=count;
+                ret=1;
+            } else {
+                g_free(m->tiles);
+                m->tiles=NULL;
+            }
+        }
+    }
+    if (!ret)
+        dbg(lvl_error,"map file %s: invalid tile directory", m->filename);
+    file_data_free(fi, (unsigned char *)tiledir);
+    file_data_free(fi, (unsigned char *)lfh);
+    file_data_free(m->fi, (unsigned char *)cd);
+    return ret;
+}
+
+/**
+ * @brief Lists the tiles of a map without tile directory
+ *
+ * The names of the tiles in the zip central directory give their bounding box and the minimum order at which they are
+ * used. Members whose name only starts with a tile name are listed with order 255, like in the tile directory.
+ * The tiles are not sorted into a quadtree, so each of them has to be checked against a selection.
+ */
+static void binfile_read_tile_names(struct map_priv *m) {
+    long long cdoffset=m->eoc64?m->eoc64->zip64eofst:m->eoc->zipeofst;
+    int chunk=256,count=0,i,j,n,len,depth;
+    unsigned char *data;
+    struct zip_cd *cd;
+    struct binfile_tile *t;
+    char *name;
+
+    m->tiles=g_new(struct binfile_tile, m->zip_members);
+    for (i = 0 ; i < m->zip_members ; i+=chunk) {
+        n=MIN(chunk, m->zip_members-i);
+        data=file_data_read(m->fi, cdoffset+(long long)i*m->cde_size, n*m->cde_size);
+        if (!data)
+            break;
+        for (j = 0 ; j < n ; j++) {
+            cd=(struct zip_cd *)(data+j*m->cde_size);
+            cd_to_cpu(cd);
+            if (cd->zipcensig != zip_cd_sig)
+                continue;
+            name=(char *)(cd+1);
+            for (depth = 0 ; depth < cd->zipcfnl && name[depth] >= 'a' && name[depth] <= 'd' ; depth++);
+            for (len = cd->zipcfnl ; len > depth && name[len-1] == '_' ; len--);
+            if (!depth)
+                continue;
+            t=&m->tiles[count];
+            tile_bbox(name, depth, &t->r);
+            if (len > depth)
+                t->order=255;
+            else
+                t->order=depth > 4 ? depth-4 : 0;
+            t->zipfile=i+j;
+            t->next=++count;
+        }
+        file_data_remove(m->fi, data);
+    }
+    m->tile_count=count;
+}
+
+static int binfile_zipfile_cmp(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * @brief Finds the tiles of a map intersecting a selection
+ *
+ * The tiles are read from the tile directory, or from the tile names of older maps, when a map is first used.
+ * Tiles outside of the selection or only used at higher orders are skipped together with all tiles inside of them.
+ *
+ * @param m The map
+ * @param sel The selection
+ * @param count Receives the number of tiles found
+ * @return The zip members of the tiles in ascending order, to be freed with g_free()
+ */
+static int *binfile_select_tiles(struct map_priv *m, struct map_selection *sel, int *count) {
+    struct binfile_tile *t;
+    struct range mima;
+    int i=0,*ret;
+
+    thread_lock_acquire(m->tiles_lock);
+    if (m->tile_count < 0 && !binfile_read_tiledir(m))
+        binfile_read_tile_names(m);
+    thread_lock_release(m->tiles_lock);
+    ret=g_new(int, m->tile_count);
+    *count=0;
+    mima.max=255;
+    while (i < m->tile_count) {
+        t=&m->tiles[i];
+        mima.min=t->order;
+        if (!selection_contains(sel, &t->r, &mima)) {
+            i=t->next;
+            continue;
+        }
+        if (t->zipfile >= 0)
+            ret[(*count)++]=t->zipfile;
+        i++;
+    }
+    qsort(ret, *count, sizeof(*ret), binfile_zipfile_cmp);
+    dbg(lvl_debug,"%d of %d tiles selected", *count, m->tile_count);
+    return ret;
 }
 
 static void map_download_selection(struct map_priv *m, struct map_rect_priv *mr, struct map_selection *sel) {
+    int i,count,*zipfiles=binfile_select_tiles(m, sel, &count);
+    struct zip_cd *cd;
+    for (i = 0 ; i < count ; i++) {
+        cd=binfile_read_cd(m, m->cde_size*zipfiles[i], -1);
+        if (!cd)
+            continue;
+        if (!cd->zipcunc)
+            download(m, mr, cd, zipfiles[i], 0, 0, 0);
+        file_data_free(m->fi, (unsigned char *)cd);
+    }
+    g_free(zipfiles);
+}
+
+static void binfile_prefetch_tile(struct map_priv *m, struct binfile_prefetch_tile *tile) {
+    struct file *fi=m->fis ? m->fis[tile->disk] : m->fi;
+    struct zip_lfh *lfh;
+    unsigned char *data;
+
+    lfh=binfile_read_lfh(fi, tile->offset);
+    if (!lfh)
+        return;
+    data=binfile_read_content(m, fi, tile->offset, lfh);
+    file_data_free(fi, data);
+    file_data_free(fi, (unsigned char *)lfh);
+}
+
+/**
+ * @brief Main function of the threads prefetching tiles
+ *
+ * Each thread takes the last tile not yet taken until all tiles are taken or the prefetch is cancelled.
+ */
+static int binfile_prefetch_thread(void *data) {
+    struct binfile_prefetch *p=data;
     int i;
+
+    for (;;) {
+        thread_lock_acquire(p->lock);
+        for (i = p->cancel ? -1 : p->count-1 ; i >= 0 && p->taken[i] ; i--);
+        if (i >= 0)
+            p->taken[i]=1;
+        thread_lock_release(p->lock);
+        if (i < 0)
+            return 1;
+        binfile_prefetch_tile(p->m, &p->tiles[i]);
+    }
+}
+
+/**
+ * @brief Claims a tile the map rect is about to read, so that no prefetch thread starts decompressing it
+ */
+static void binfile_prefetch_claim(struct binfile_prefetch *p, int zipfile) {
+    int lo=0,hi=p->count,mid;
+    while (lo < hi) {
+        mid=(lo+hi)/2;
+        if (p->tiles[mid].zipfile < zipfile)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+    if (lo < p->count && p->tiles[lo].zipfile == zipfile) {
+        thread_lock_acquire(p->lock);
+        p->taken[lo]=1;
+        thread_lock_release(p->lock);
+    }
+}
+
+/**
+ * @brief Starts decompressing the tiles a new map rect will need
+ *
+ * The tiles intersecting the selection are decompressed into the file cache by up to {@code prefetch_threads}
+ * threads, while the map rect reads the index and the first tiles. To keep the prefetched tiles from pushing each
+ * other out of the cache, at most half of the cache is prefetched.
+ *
+ * @return The prefetch, or NULL if there is nothing to prefetch
+ */
+static struct binfile_prefetch *binfile_prefetch_new(struct map_priv *m, struct map_selection *sel) {
+    struct binfile_prefetch *p;
+    struct binfile_prefetch_tile *tile;
     struct zip_cd *cd;
-    for (i = 0 ; i < m->zip_members ; i++) {
-        cd=binfile_read_cd(m, m->cde_size*i, -1);
-        if (map_download_selection_check(cd, sel))
-            download(m, mr, cd, i, 0, 0, 0);
+    int i,n,*zipfiles,size=0,count=0;
+
+    if (!sel || !m->eoc || m->url || m->tile_cache || m->prefetch_threads <= 0)
+        return NULL;
+    zipfiles=binfile_select_tiles(m, sel, &n);
+    p=g_new0(struct binfile_prefetch, 1);
+    p->tiles=g_new(struct binfile_prefetch_tile, n);
+    for (i = 0 ; i < n && size <= CACHE_SIZE/2 ; i++) {
+        cd=binfile_read_cd(m, zipfiles[i]*m->cde_size, m->cde_size-sizeof(*cd));
+        if (!cd)
+            continue;
+        size+=cd->zipcunc;
+        if (cd->zipcunc && size <= CACHE_SIZE/2) {
+            tile=&p->tiles[count++];
+            tile->zipfile=zipfiles[i];
+            tile->disk=cd->zipdsk;
+            tile->offset=binfile_cd_offset(cd);
+            tile->size=cd->zipcunc;
+        }
         file_data_free(m->fi, (unsigned char *)cd);
     }
+    g_free(zipfiles);
+    if (!count) {
+        g_free(p->tiles);
+        g_free(p);
+        return NULL;
+    }
+    p->m=m;
+    p->count=count;
+    p->taken=g_new0(char, count);
+    p->lock=thread_lock_new();
+    p->threads=g_new0(struct thread *, m->prefetch_threads);
+    for (i = 0 ; i < m->prefetch_threads && i < count ; i++) {
+        if (!(p->threads[i]=thread_new(binfile_prefetch_thread, p, "binfile_prefetch")))
+            break;
+    }
+    p->thread_count=i;
+    dbg(lvl_debug,"prefetching %d tiles on %d threads", count, p->thread_count);
+    return p;
+}
+
+/**
+ * @brief Cancels a prefetch and waits for its threads
+ */
+static void binfile_prefetch_destroy(struct binfile_prefetch *p) {
+    int i;
+    thread_lock_acquire(p->lock);
+    p->cancel=1;
+    thread_lock_release(p->lock);
+    for (i = 0 ; i < p->thread_count ; i++)
+        thread_join(p->threads[i]);
+    thread_lock_destroy(p->lock);
+    g_free(p->threads);
+    g_free(p->tiles);
+    g_free(p->taken);
+    g_free(p);
 }
 
 static struct map_rect_priv *map_rect_new_binfile(struct map_priv *map, struct map_selection *sel) {
@@ -1476,9 +1825,10 @@ static struct map_rect_priv *map_rect_new_binfile(struct map_priv *map, struct m
     if (map->url && map->fi && sel && sel->order == 255) {
         map_download_selection(map, mr, sel);
     }
-    if (map->eoc)
+    if (map->eoc) {
         mr->status=1;
-    else {
+        mr->prefetch=binfile_prefetch_new(map, sel);
+    } else {
         unsigned char *d;
         if (map->fi) {
             d=file_data_read(map->fi, 0, map->fi->size);
@@ -1513,7 +1863,9 @@ static void write_changes(struct map_priv *m) {
         return;
     changes_file=g_strdup_printf("%s.log",m->filename);
     changes=fopen(changes_file,"ab");
+    thread_lock_acquire(m->changes_lock);
     g_hash_table_foreach(m->changes, write_changes_do, changes);
+    thread_lock_release(m->changes_lock);
     fclose(changes);
     g_free(changes_file);
 }
@@ -1546,12 +1898,16 @@ static void load_changes(struct map_priv *m) {
 
 
 static void map_rect_destroy_binfile(struct map_rect_priv *mr) {
+    if (mr->prefetch)
+        binfile_prefetch_destroy(mr->prefetch);
     write_changes(mr->m);
     while (pop_tile(mr));
 #ifdef DEBUG_SIZE
     dbg(lvl_debug,"size=%d kb",mr->size/1024);
 #endif
-    if (mr->tiles[0].fi && mr->tiles[0].start)
+    if (mr->tiles[0].mode == 3)
+        tile_cache_release(mr->m->tile_cache, (unsigned char *)(mr->tiles[0].start));
+    else if (mr->tiles[0].fi && mr->tiles[0].start)
         file_data_free(mr->tiles[0].fi, (unsigned char *)(mr->tiles[0].start));
     g_free(mr->url);
     map_binfile_http_close(mr->m);
@@ -1660,7 +2016,9 @@ static int push_modified_item(struct map_rect_priv *mr) {
     struct binfile_hash_entry *entry;
     id.id_hi=mr->item.id_hi;
     id.id_lo=mr->item.id_lo;
+    thread_lock_acquire(mr->m->changes_lock);
     entry=g_hash_table_lookup(mr->m->changes, &id);
+    thread_lock_release(mr->m->changes_lock);
     if (entry) {
         struct tile tn;
         tn.pos_next=tn.pos=tn.start=entry->data;
@@ -2346,6 +2704,11 @@ static int binmap_get_attr(struct map_priv *m, enum attr_type type, struct attr
             attr->u.str=m->progress;
             return 1;
         }
+        break;
+    case attr_thread_safe:
+        /* maps which are downloaded or reopened when they change on disk modify their state while being read */
+        attr->u.num=!m->url && !m->check_version;
+        return 1;
     default:
         break;
     }
@@ -2580,6 +2943,8 @@ static int map_binfile_open(struct map_priv *m) {
     } else
         file_mmap(m->fi);
     file_data_free(m->fi, (unsigned char *)magic);
+    if (m->tile_cache_file && m->eoc && !m->url)
+        m->tile_cache=tile_cache_new(m->tile_cache_file, m->filename, m->tile_cache_size);
     m->cachedir=g_strdup("/tmp/navit");
     m->map_version=0;
     mr=map_rect_new_binfile(m, NULL);
@@ -2615,6 +2980,12 @@ static void map_binfile_close(struct map_priv *m) {
     file_data_free(m->fi, (unsigned char *)m->eoc64);
     g_free(m->cachedir);
     g_free(m->map_release);
+    if (m->tile_cache)
+        tile_cache_destroy(m->tile_cache);
+    m->tile_cache=NULL;
+    g_free(m->tiles);
+    m->tiles=NULL;
+    m->tile_count=-1;
     if (m->fis) {
         for (i = 0 ; i < m->eoc->zipedsk ; i++) {
             file_destroy(m->fis[i]);
@@ -2627,6 +2998,9 @@ static void map_binfile_destroy(struct map_priv *m) {
     g_free(m->filename);
     g_free(m->url);
     g_free(m->progress);
+    g_free(m->tile_cache_file);
+    thread_lock_destroy(m->tiles_lock);
+    thread_lock_destroy(m->changes_lock);
     g_free(m);
 }
 
@@ -2648,9 +3022,10 @@ static void binfile_check_version(struct map_priv *m) {
 static struct map_priv *map_new_binfile(struct map_methods *meth, struct attr **attrs, struct callback_list *cbl) {
     struct map_priv *m;
     struct attr *data=attr_search(attrs, attr_data);
-    struct attr *check_version,*flags,*url,*download_enabled;
+    struct attr *check_version,*flags,*url,*download_enabled,*tile_cache,*tile_cache_size,*tile_prefetch;
     struct file_wordexp *wexp;
     char **wexp_data;
+    long long size;
     if (! data)
         return NULL;
 
@@ -2676,6 +3051,25 @@ static struct map_priv *map_new_binfile(struct map_methods *meth, struct attr **
     download_enabled = attr_search(attrs, attr_update);
     if (download_enabled)
         m->download_enabled=download_enabled->u.num;
+    tile_cache=attr_search(attrs, attr_tile_cache);
+    if (tile_cache) {
+        m->tile_cache_file=g_strdup(tile_cache->u.str);
+        tile_cache_size=attr_search(attrs, attr_tile_cache_size);
+        size=tile_cache_size ? tile_cache_size->u.num : 64;
+        if (size < 1 || size > TILE_CACHE_MAX_SIZE) {
+            dbg(lvl_error,"tile_cache_size %lld out of range, using %d MB", size, size < 1 ? 1 : TILE_CACHE_MAX_SIZE);
+            size=size < 1 ? 1 : TILE_CACHE_MAX_SIZE;
+        }
+        m->tile_cache_size=size*1024*1024;
+    }
+    tile_prefetch=attr_search(attrs, attr_tile_prefetch);
+    if (tile_prefetch)
+        m->prefetch_threads=tile_prefetch->u.num;
+    else
+        m->prefetch_threads=MIN(thread_cpu_count()-1, 4);
+    m->tiles_lock=thread_lock_new();
+    m->changes_lock=thread_lock_new();
+    m->tile_count=-1;
 
     if (!map_binfile_open(m) && !m->check_version && !m->url) {
         map_binfile_destroy(m);
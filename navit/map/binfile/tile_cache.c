@@ -0,0 +1,392 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Persistent cache of decompressed tiles of a binfile map
+ *
+ * The cache is a file next to (or anywhere away from) the map, which is mapped into memory as a whole. It holds a
+ * header, a fixed number of slots and a data area of the configured size. Each slot describes one decompressed zip
+ * member of the map: its number, its CRC (as a check against a different member with the same number), and the
+ * position of its data in the data area. Tiles found in the cache are handed out as pointers into the mapping, so
+ * they are neither inflated nor copied again, not even after Navit has been restarted.
+ *
+ * Space in the data area is allocated first fit. If no gap is large enough, the least recently used tile which is not
+ * in use is evicted until one is. The cache is emptied whenever the size or modification time of the map differs from
+ * the one recorded in its header, i.e. when the map has been replaced.
+ *
+ * A cache file must only be used by one map in one process at a time.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <glib.h>
+#include "config.h"
+#include "navit_lfs.h"
+#include <sys/stat.h>
+#ifndef HAVE_API_WIN32_BASE
+#include <sys/mman.h>
+#endif
+#include "debug.h"
+#include "thread.h"
+#include "tile_cache.h"
+
+#define TILE_CACHE_VERSION 1
+#define TILE_CACHE_ALIGN(x) (((x)+7)&~7)      /**< Tiles are aligned to 8 bytes in the data area */
+#define TILE_CACHE_SLOT_SIZE 8192             /**< Average size of a tile assumed to get the number of slots */
+
+/**
+ * @brief Header of a tile cache file, followed by the slots and the data area
+ */
+struct tile_cache_header {
+    char magic[4];                  /**< "NTCF" */
+    int version;                    /**< {@code TILE_CACHE_VERSION} */
+    char map[256];                  /**< Name of the map file, possibly truncated */
+    long long map_size;             /**< Size of the map file */
+    long long map_mtime;            /**< Modification time of the map file */
+    int slot_count;                 /**< Number of slots */
+    int data_size;                  /**< Size of the data area in bytes */
+    unsigned int clock;             /**< Increased with each use of a tile */
+};
+
+/**
+ * @brief A tile in the cache
+ */
+struct tile_cache_slot {
+    int member;                     /**< Number of the zip member plus one, 0 if the slot is free */
+    unsigned int crc;               /**< CRC-32 of the tile from the zip directory */
+    int offset;                     /**< Position of the tile in the data area */
+    int size;                       /**< Size of the tile in bytes */
+    unsigned int used;              /**< Value of the clock when the tile was last used */
+};
+
+struct tile_cache {
+    char *filename;
+    int fd;
+    unsigned char *begin;           /**< Start of the mapping */
+    long long size;                 /**< Size of the mapping */
+    struct tile_cache_header *header;
+    struct tile_cache_slot *slots;
+    unsigned char *data;            /**< Start of the data area */
+    int *pins;                      /**< Number of map rects using the tile of each slot */
+    int *order;                     /**< Used slots, sorted by the position of their tiles */
+    int order_count;                /**< Number of used slots */
+    GHashTable *members;            /**< Slot plus one by member */
+    struct thread_lock *lock;
+};
+
+#ifndef HAVE_API_WIN32_BASE
+
+struct tile_cache_extent {
+    int offset;
+    int slot;
+};
+
+static int tile_cache_compare_extent(const void *a, const void *b) {
+    return ((struct tile_cache_extent *)a)->offset-((struct tile_cache_extent *)b)->offset;
+}
+
+/**
+ * @brief Builds the in-memory index of the slots, dropping invalid ones
+ */
+static void tile_cache_index(struct tile_cache *this_) {
+    struct tile_cache_extent *extents=g_new(struct tile_cache_extent, this_->header->slot_count);
+    struct tile_cache_slot *s;
+    int i,end=0;
+
+    for (i = 0 ; i < this_->header->slot_count ; i++) {
+        s=&this_->slots[i];
+        if (!s->member)
+            continue;
+        if (s->offset < 0 || s->size <= 0 || s->offset > this_->header->data_size-s->size
+                || g_hash_table_lookup(this_->members, GINT_TO_POINTER(s->member))) {
+            s->member=0;
+            continue;
+        }
+        g_hash_table_insert(this_->members, GINT_TO_POINTER(s->member), GINT_TO_POINTER(i+1));
+        extents[this_->order_count].offset=s->offset;
+        extents[this_->order_count++].slot=i;
+    }
+    qsort(extents, this_->order_count, sizeof(*extents), tile_cache_compare_extent);
+    for (i = 0 ; i < this_->order_count ; i++)
+        this_->order[i]=extents[i].slot;
+    g_free(extents);
+    /* overlapping tiles can only be left by a crash while writing, drop them */
+    for (i = 0 ; i < this_->order_count ; i++) {
+        s=&this_->slots[this_->order[i]];
+        if (s->offset < end) {
+            g_hash_table_remove(this_->members, GINT_TO_POINTER(s->member));
+            s->member=0;
+            memmove(this_->order+i, this_->order+i+1, (--this_->order_count-i)*sizeof(int));
+            i--;
+        } else
+            end=s->offset+TILE_CACHE_ALIGN(s->size);
+    }
+}
+
+/**
+ * @brief Opens a tile cache, creating or emptying it if needed
+ *
+ * @param filename The cache file
+ * @param map The map file whose tiles are cached
+ * @param size Size of the data area in bytes
+ * @return The cache, or NULL if the cache file cannot be used
+ */
+struct tile_cache *tile_cache_new(const char *filename, const char *map, int size) {
+    struct tile_cache *this_;
+    struct tile_cache_header header,old;
+    struct stat st;
+    int data_start;
+
+    if (stat(map, &st)) {
+        dbg(lvl_error,"cannot stat map %s", map);
+        return NULL;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "NTCF", 4);
+    header.version=TILE_CACHE_VERSION;
+    g_strlcpy(header.map, map, sizeof(header.map));
+    header.map_size=st.st_size;
+    header.map_mtime=st.st_mtime;
+    header.data_size=TILE_CACHE_ALIGN(size);
+    header.slot_count=header.data_size/TILE_CACHE_SLOT_SIZE;
+    if (header.slot_count < 64)
+        header.slot_count=64;
+    this_=g_new0(struct tile_cache, 1);
+    this_->fd=open(filename, O_RDWR|O_CREAT|O_BINARY, 0666);
+    if (this_->fd == -1) {
+        dbg(lvl_error,"cannot open tile cache %s", filename);
+        g_free(this_);
+        return NULL;
+    }
+    data_start=TILE_CACHE_ALIGN(sizeof(header)+header.slot_count*sizeof(struct tile_cache_slot));
+    this_->size=data_start+header.data_size;
+    if (fstat(this_->fd, &st) || st.st_size != this_->size
+            || read(this_->fd, &old, sizeof(old)) != sizeof(old)
+            || memcmp(&old, &header, offsetof(struct tile_cache_header, clock))) {
+        /* different map, map changed or size changed, start over */
+        dbg(lvl_debug,"initializing tile cache %s for %s", filename, map);
+        if (ftruncate(this_->fd, 0) || ftruncate(this_->fd, this_->size) || lseek(this_->fd, 0, SEEK_SET)
+                || write(this_->fd, &header, sizeof(header)) != sizeof(header)) {
+            dbg(lvl_error,"cannot initialize tile cache %s", filename);
+            close(this_->fd);
+            g_free(this_);
+            return NULL;
+        }
+    }
+    this_->begin=mmap(NULL, this_->size, PROT_READ|PROT_WRITE, MAP_SHARED, this_->fd, 0);
+    if (this_->begin == MAP_FAILED) {
+        dbg(lvl_error,"cannot map tile cache %s", filename);
+        close(this_->fd);
+        g_free(this_);
+        return NULL;
+    }
+    this_->filename=g_strdup(filename);
+    this_->header=(struct tile_cache_header *)this_->begin;
+    this_->slots=(struct tile_cache_slot *)(this_->header+1);
+    this_->data=this_->begin+data_start;
+    this_->pins=g_new0(int, header.slot_count);
+    this_->order=g_new(int, header.slot_count);
+    this_->members=g_hash_table_new(NULL, NULL);
+    this_->lock=thread_lock_new();
+    tile_cache_index(this_);
+    dbg(lvl_debug,"tile cache %s: %d tiles", filename, this_->order_count);
+    return this_;
+}
+
+/**
+ * @brief Closes a tile cache
+ *
+ * The cache must not be in use by any map rect any more.
+ */
+void tile_cache_destroy(struct tile_cache *this_) {
+    munmap(this_->begin, this_->size);
+    close(this_->fd);
+    g_hash_table_destroy(this_->members);
+    thread_lock_destroy(this_->lock);
+    g_free(this_->pins);
+    g_free(this_->order);
+    g_free(this_->filename);
+    g_free(this_);
+}
+
+/**
+ * @brief Removes the tile of a slot from the cache
+ *
+ * @param this_ The cache
+ * @param pos Position of the slot in `order`
+ */
+static void tile_cache_evict(struct tile_cache *this_, int pos) {
+    struct tile_cache_slot *s=&this_->slots[this_->order[pos]];
+
+    g_hash_table_remove(this_->members, GINT_TO_POINTER(s->member));
+    s->member=0;
+    memmove(this_->order+pos, this_->order+pos+1, (--this_->order_count-pos)*sizeof(int));
+}
+
+/**
+ * @brief Looks up a tile in the cache
+ *
+ * A tile returned must be handed back to tile_cache_release() once it is no longer needed.
+ *
+ * @param this_ The cache
+ * @param member Number of the zip member of the tile
+ * @param crc CRC-32 of the tile from the zip directory
+ * @param size Size of the decompressed tile
+ * @return The tile, or NULL if it is not in the cache
+ */
+unsigned char *tile_cache_get(struct tile_cache *this_, int member, unsigned int crc, int size) {
+    struct tile_cache_slot *s;
+    unsigned char *ret=NULL;
+    int slot;
+
+    thread_lock_acquire(this_->lock);
+    slot=GPOINTER_TO_INT(g_hash_table_lookup(this_->members, GINT_TO_POINTER(member+1)))-1;
+    if (slot >= 0) {
+        s=&this_->slots[slot];
+        if (s->crc == crc && s->size == size) {
+            s->used=++this_->header->clock;
+            this_->pins[slot]++;
+            ret=this_->data+s->offset;
+        }
+    }
+    thread_lock_release(this_->lock);
+    return ret;
+}
+
+/**
+ * @brief Stores a tile in the cache
+ *
+ * Least recently used tiles are evicted if needed. The tile is in use afterwards, as if it had been returned by
+ * tile_cache_get().
+ *
+ * @param this_ The cache
+ * @param member Number of the zip member of the tile
+ * @param crc CRC-32 of the tile from the zip directory
+ * @param data The decompressed tile, which is copied
+ * @param size Size of `data`
+ * @return The copy of the tile in the cache, or NULL if it could not be stored
+ */
+unsigned char *tile_cache_put(struct tile_cache *this_, int member, unsigned int crc, unsigned char *data, int size) {
+    struct tile_cache_slot *s;
+    int i,pos,end,slot=-1,lru,need=TILE_CACHE_ALIGN(size);
+
+    /* a single tile must not flush most of the cache */
+    if (size <= 0 || need > this_->header->data_size/4)
+        return NULL;
+    thread_lock_acquire(this_->lock);
+    slot=GPOINTER_TO_INT(g_hash_table_lookup(this_->members, GINT_TO_POINTER(member+1)))-1;
+    if (slot >= 0) {
+        /* outdated copy of the tile, replace it unless it is still in use */
+        for (pos = 0 ; this_->order[pos] != slot ; pos++);
+        if (this_->pins[slot]) {
+            thread_lock_release(this_->lock);
+            return NULL;
+        }
+        tile_cache_evict(this_, pos);
+    }
+    for (;;) {
+        if (this_->order_count < this_->header->slot_count) {
+            /* find the first gap large enough */
+            end=0;
+            for (pos = 0 ; pos < this_->order_count ; pos++) {
+                s=&this_->slots[this_->order[pos]];
+                if (s->offset-end >= need)
+                    break;
+                end=s->offset+TILE_CACHE_ALIGN(s->size);
+            }
+            if (pos < this_->order_count || this_->header->data_size-end >= need)
+                break;
+        }
+        lru=-1;
+        for (i = 0 ; i < this_->order_count ; i++) {
+            s=&this_->slots[this_->order[i]];
+            if (!this_->pins[this_->order[i]] && (lru < 0 || (int)(s->used-this_->slots[this_->order[lru]].used) < 0))
+                lru=i;
+        }
+        if (lru < 0) {
+            thread_lock_release(this_->lock);
+            return NULL;
+        }
+        tile_cache_evict(this_, lru);
+    }
+    for (slot = 0 ; this_->slots[slot].member ; slot++);
+    s=&this_->slots[slot];
+    memcpy(this_->data+end, data, size);
+    s->crc=crc;
+    s->offset=end;
+    s->size=size;
+    s->used=++this_->header->clock;
+    /* set last, so that the slot is only valid once the tile has been written */
+    s->member=member+1;
+    memmove(this_->order+pos+1, this_->order+pos, (this_->order_count++-pos)*sizeof(int));
+    this_->order[pos]=slot;
+    this_->pins[slot]++;
+    g_hash_table_insert(this_->members, GINT_TO_POINTER(member+1), GINT_TO_POINTER(slot+1));
+    thread_lock_release(this_->lock);
+    return this_->data+end;
+}
+
+/**
+ * @brief Hands back a tile returned by tile_cache_get() or tile_cache_put()
+ *
+ * @param this_ The cache
+ * @param data The tile
+ */
+void tile_cache_release(struct tile_cache *this_, unsigned char *data) {
+    int low=0,high,mid,offset=data-this_->data;
+
+    thread_lock_acquire(this_->lock);
+    high=this_->order_count-1;
+    while (low <= high) {
+        mid=(low+high)/2;
+        if (this_->slots[this_->order[mid]].offset < offset)
+            low=mid+1;
+        else if (this_->slots[this_->order[mid]].offset > offset)
+            high=mid-1;
+        else {
+            this_->pins[this_->order[mid]]--;
+            break;
+        }
+    }
+    thread_lock_release(this_->lock);
+}
+
+#else
+
+struct tile_cache *tile_cache_new(const char *filename, const char *map, int size) {
+    dbg(lvl_error,"tile cache not supported on this platform");
+    return NULL;
+}
+
+void tile_cache_destroy(struct tile_cache *this_) {
+}
+
+unsigned char *tile_cache_get(struct tile_cache *this_, int member, unsigned int crc, int size) {
+    return NULL;
+}
+
+unsigned char *tile_cache_put(struct tile_cache *this_, int member, unsigned int crc, unsigned char *data, int size) {
+    return NULL;
+}
+
+void tile_cache_release(struct tile_cache *this_, unsigned char *data) {
+}
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef NAVIT_BINFILE_TILE_CACHE_H
+#define NAVIT_BINFILE_TILE_CACHE_H
+
+#define TILE_CACHE_MAX_SIZE 1024             /**< Maximum size of the data area in megabytes, as offsets into it are ints */
+
+struct tile_cache;
+
+/* prototypes */
+struct tile_cache *tile_cache_new(const char *filename, const char *map, int size);
+void tile_cache_destroy(struct tile_cache *this_);
+unsigned char *tile_cache_get(struct tile_cache *this_, int member, unsigned int crc, int size);
+unsigned char *tile_cache_put(struct tile_cache *this_, int member, unsigned int crc, unsigned char *data, int size);
+void tile_cache_release(struct tile_cache *this_, unsigned char *data);
+/* end of prototypes */
+
+#endif
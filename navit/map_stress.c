@@ -0,0 +1,348 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Reads one binfile map from several threads at once and checks that all of them see the same items
+ *
+ * Usage: `navit-map-stress [-c <navit.xml>] [-d <level>] [-p <threads>] [-r <rounds>] [-t <threads>] <map.bin>`
+ *
+ * The configuration is only used for loading the plugins, so a file holding just the `<plugins>` section of
+ * navit.xml will do.
+ *
+ * The bounding box of the map is divided into a grid of rectangles, which are read the way the rendering does (at
+ * order 8 with all item types) and the way the routing does (at order 18 with the street types only). Each rectangle
+ * is first read from a single thread, in order to get the number of items and a checksum of their ids, coordinates
+ * and attribute types. Then `-t` threads read all of the rectangles `-r` times, half of them rendering style and the
+ * other half routing style, all on the same map, and compare their results with the single threaded ones.
+ *
+ * For each style, one line is printed with the number of threads, the number of rectangles read, the number of items
+ * delivered, the time spent (in microseconds) and the number of rectangles with results differing from the single
+ * threaded ones. `-p` sets the number of threads prefetching tiles, see `attr_tile_prefetch`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "config.h"
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#else
+#include <XGetopt.h>
+#endif
+#include <sys/time.h>
+#include "config_.h"
+#include "item.h"
+#include "attr.h"
+#include "coord.h"
+#include "map.h"
+#include "main.h"
+#include "debug.h"
+#include "event.h"
+#include "event_glib.h"
+#include "xmlconfig.h"
+#include "file.h"
+#include "atom.h"
+#include "geom.h"
+#include "thread.h"
+#include "types.h"
+
+#ifndef USE_PLUGINS
+extern void builtin_init(void);
+#endif /* USE_PLUGINS*/
+
+#ifndef HAVE_GLIB
+extern void _g_slice_thread_init_nomessage(void);
+#endif
+
+#define STRESS_GRID 8
+
+enum stress_style {
+    stress_render,
+    stress_route,
+    stress_styles,
+};
+
+/**
+ * @brief The items found in one rectangle
+ */
+struct stress_result {
+    int items;
+    unsigned int checksum;
+};
+
+/**
+ * @brief One rectangle to read, with the results of reading it from a single thread
+ */
+struct stress_rect {
+    struct map_selection sel[stress_styles];
+    struct stress_result expected[stress_styles];
+};
+
+struct stress_thread {
+    struct map *map;
+    struct stress_rect *rects;
+    enum stress_style style;
+    int rounds;
+    long long items;
+    long long time;
+    int errors;
+    struct thread *thread;
+};
+
+static char *stress_style_names[]= {"render","route"};
+
+static void print_usage(void) {
+    fprintf(stderr, "navit-map-stress usage:\n"
+            "navit-map-stress [options] <map.bin>\n"
+            "\t-c <file>: use <file> as config file, instead of navit.xml.\n"
+            "\t-d <n>: set the global debug output level to <n>.\n"
+            "\t-p <n>: use <n> threads for prefetching tiles.\n"
+            "\t-r <n>: let each thread read all rectangles <n> times.\n"
+            "\t-t <n>: read the map from <n> threads at once.\n"
+            "\t-h: print this usage info and exit.\n");
+}
+
+static unsigned int stress_hash(unsigned int hash, int value) {
+    return hash*31+value;
+}
+
+/**
+ * @brief Reads all items of a selection
+ *
+ * @param map The map
+ * @param sel The selection, NULL for the whole map
+ * @param bbox If not NULL, extended by the coordinates of the items
+ * @param result Receives the number of items and their checksum
+ */
+static void stress_read(struct map *map, struct map_selection *sel, struct coord_rect *bbox,
+                        struct stress_result *result) {
+    struct map_rect *mr;
+    struct item *item;
+    struct coord c;
+    struct attr attr;
+
+    result->items=0;
+    result->checksum=0;
+    mr=map_rect_new(map, sel);
+    if (!mr)
+        return;
+    while ((item=map_rect_get_item(mr))) {
+        result->items++;
+        result->checksum=stress_hash(result->checksum, item->type);
+        result->checksum=stress_hash(result->checksum, item->id_hi);
+        result->checksum=stress_hash(result->checksum, item->id_lo);
+        while (item_coord_get(item, &c, 1)) {
+            result->checksum=stress_hash(result->checksum, c.x);
+            result->checksum=stress_hash(result->checksum, c.y);
+            if (bbox) {
+                if (result->items == 1 && bbox->lu.x > bbox->rl.x) {
+                    bbox->lu=c;
+                    bbox->rl=c;
+                } else
+                    coord_rect_extend(bbox, &c);
+            }
+        }
+        while (item_attr_get(item, attr_any, &attr))
+            result->checksum=stress_hash(result->checksum, attr.type);
+    }
+    map_rect_destroy(mr);
+}
+
+/**
+ * @brief Divides the bounding box of a map into rectangles and reads them from a single thread
+ *
+ * @return The rectangles, NULL if the map has no items
+ */
+static struct stress_rect *stress_rects_new(struct map *map) {
+    struct coord_rect bbox;
+    struct stress_result all;
+    struct stress_rect *rects;
+    int i,dx,dy;
+
+    bbox.lu.x=1;
+    bbox.rl.x=0;
+    stress_read(map, NULL, &bbox, &all);
+    if (!all.items)
+        return NULL;
+    dx=(bbox.rl.x-bbox.lu.x)/STRESS_GRID+1;
+    dy=(bbox.lu.y-bbox.rl.y)/STRESS_GRID+1;
+    rects=g_new0(struct stress_rect, STRESS_GRID*STRESS_GRID);
+    for (i = 0 ; i < STRESS_GRID*STRESS_GRID ; i++) {
+        struct map_selection *sel=&rects[i].sel[stress_render];
+        sel->u.c_rect.lu.x=bbox.lu.x+(i%STRESS_GRID)*dx;
+        sel->u.c_rect.lu.y=bbox.lu.y-(i/STRESS_GRID)*dy;
+        sel->u.c_rect.rl.x=sel->u.c_rect.lu.x+dx;
+        sel->u.c_rect.rl.y=sel->u.c_rect.lu.y-dy;
+        sel->order=8;
+        sel->range=item_range_all;
+        sel=&rects[i].sel[stress_route];
+        *sel=rects[i].sel[stress_render];
+        sel->order=18;
+        sel->range.min=route_item_first;
+        sel->range.max=route_item_last;
+        stress_read(map, &rects[i].sel[stress_render], NULL, &rects[i].expected[stress_render]);
+        stress_read(map, &rects[i].sel[stress_route], NULL, &rects[i].expected[stress_route]);
+    }
+    return rects;
+}
+
+static int stress_thread_main(void *data) {
+    struct stress_thread *this_=data;
+    struct stress_result result;
+    struct timeval start,end;
+    int i,j;
+
+    gettimeofday(&start, NULL);
+    for (i = 0 ; i < this_->rounds ; i++) {
+        for (j = 0 ; j < STRESS_GRID*STRESS_GRID ; j++) {
+            struct stress_rect *rect=&this_->rects[j];
+            stress_read(this_->map, &rect->sel[this_->style], NULL, &result);
+            this_->items+=result.items;
+            if (result.items != rect->expected[this_->style].items
+                    || result.checksum != rect->expected[this_->style].checksum)
+                this_->errors++;
+        }
+    }
+    gettimeofday(&end, NULL);
+    this_->time=(end.tv_sec-start.tv_sec)*1000000LL+end.tv_usec-start.tv_usec;
+    return 0;
+}
+
+/**
+ * @brief Reads the map from several threads and prints one line per style
+ *
+ * @return The number of rectangles with results differing from the single threaded ones
+ */
+static int stress_map(struct map *map, struct stress_rect *rects, int threads, int rounds) {
+    struct stress_thread *t=g_new0(struct stress_thread, threads);
+    long long items[stress_styles]= {0},time[stress_styles]= {0};
+    int i,reads[stress_styles]= {0},errors[stress_styles]= {0},ret=0;
+
+    for (i = 0 ; i < threads ; i++) {
+        t[i].map=map;
+        t[i].rects=rects;
+        t[i].style=i%stress_styles;
+        t[i].rounds=rounds;
+    }
+    for (i = 1 ; i < threads ; i++) {
+        t[i].thread=thread_new(stress_thread_main, &t[i], "map_stress");
+        if (!t[i].thread)
+            stress_thread_main(&t[i]);
+    }
+    stress_thread_main(&t[0]);
+    for (i = 0 ; i < threads ; i++) {
+        if (t[i].thread)
+            thread_join(t[i].thread);
+        reads[t[i].style]+=rounds*STRESS_GRID*STRESS_GRID;
+        items[t[i].style]+=t[i].items;
+        time[t[i].style]=MAX(time[t[i].style], t[i].time);
+        errors[t[i].style]+=t[i].errors;
+    }
+    for (i = 0 ; i < stress_styles ; i++) {
+        if (!reads[i])
+            continue;
+        printf("%s,%d,%d,"LONGLONG_FMT","LONGLONG_FMT",%d\n", stress_style_names[i], threads, reads[i], items[i], time[i],
+               errors[i]);
+        ret+=errors[i];
+    }
+    fflush(stdout);
+    g_free(t);
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    xmlerror *error = NULL;
+    char *config_file="navit.xml";
+    struct attr type,data,prefetch,*attrs[4];
+    struct map *map;
+    struct stress_rect *rects;
+    int opt,threads=MAX(thread_cpu_count(), 2),rounds=1,ret;
+
+#ifdef HAVE_GLIB
+    event_glib_init();
+#else
+    _g_slice_thread_init_nomessage();
+#endif
+    atom_init();
+    main_init(argv[0]);
+    debug_init(argv[0]);
+    file_init();
+    geom_init();
+#ifndef USE_PLUGINS
+    builtin_init();
+#endif
+    prefetch.type=attr_none;
+    while((opt = getopt(argc, argv, "hc:d:p:r:t:")) != -1) {
+        switch(opt) {
+        case 'c':
+            config_file=optarg;
+            break;
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'p':
+            prefetch.type=attr_tile_prefetch;
+            prefetch.u.num=atoi(optarg);
+            break;
+        case 'r':
+            rounds=atoi(optarg);
+            break;
+        case 't':
+            threads=atoi(optarg);
+            break;
+        case 'h':
+        default:
+            print_usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc-1 || rounds < 1 || threads < 1) {
+        print_usage();
+        return 2;
+    }
+    if (!config_load(config_file, &error)) {
+        fprintf(stderr, "Error parsing config file '%s': %s\n", config_file, error ? error->message : "");
+        return 4;
+    }
+    type.type=attr_type;
+    type.u.str="binfile";
+    data.type=attr_data;
+    data.u.str=argv[optind];
+    attrs[0]=&type;
+    attrs[1]=&data;
+    attrs[2]=prefetch.type == attr_none ? NULL : &prefetch;
+    attrs[3]=NULL;
+    map=map_new(NULL, attrs);
+    if (!map) {
+        fprintf(stderr, "Failed to open %s\n", argv[optind]);
+        return 3;
+    }
+    rects=stress_rects_new(map);
+    if (!rects) {
+        fprintf(stderr, "%s has no items\n", argv[optind]);
+        map_destroy(map);
+        return 3;
+    }
+    printf("style,threads,reads,items,time,errors\n");
+    ret=stress_map(map, rects, threads, rounds);
+    g_free(rects);
+    map_destroy(map);
+    return ret ? 1 : 0;
+}
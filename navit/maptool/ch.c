@@ -19,6 +19,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "maptool.h"
 #include "coord.h"
 #include "file.h"
@@ -47,7 +48,7 @@ int node_count;
 struct edge {
     unsigned target:26;
     unsigned scedge1:6;
-    unsigned weight:28;
+    unsigned weight;
     unsigned type:2;
     unsigned flags:2;
     unsigned int edge_count;
@@ -80,7 +81,7 @@ GHashTable *sgr_nodes_hash;
 
 static int ch_levels=14;
 
-static int road_speed(enum item_type type) {
+int road_speed(enum item_type type) {
     switch (type) {
     case type_street_0:
     case type_street_1_city:
@@ -183,7 +184,8 @@ static void ch_generate_ddsg(FILE *in, FILE *ref, FILE *idx, FILE *ddsg) {
     while ((ib=read_item(in))) {
         int i,ccount=ib->clen/2;
         struct coord *c=(struct coord *)(ib+1);
-        int n1,n2,speed=road_speed(ib->type);
+        int n1,n2,dir,speed=road_speed(ib->type);
+        int *flags;
         struct item_id road_id;
         double l;
 
@@ -201,7 +203,10 @@ static void ch_generate_ddsg(FILE *in, FILE *ref, FILE *idx, FILE *ddsg) {
             for (i = 0 ; i < ccount-1 ; i++) {
                 l+=sqrt(sq(c[i+1].x-c[i].x)+sq(c[i+1].y-c[i].y));
             }
-            fprintf(ddsg,"%d %d %d 0\n", n1-1, n2-1, (int)(l*36/speed));
+            /* ddsg directions: 0 both, 1 forward only, 2 backward only, 3 closed */
+            flags=item_bin_get_attr(ib, attr_flags, NULL);
+            dir=flags ? (*flags & AF_ONEWAYMASK) : 0;
+            fprintf(ddsg,"%d %d %d %d\n", n1-1, n2-1, (int)(l*36/speed), dir);
             hi->first=n1-1;
             hi->last=n2-1;
             g_hash_table_insert(edge_hash, hi, id);
@@ -210,27 +215,65 @@ static void ch_generate_ddsg(FILE *in, FILE *ref, FILE *idx, FILE *ddsg) {
     g_hash_table_destroy(hash);
 }
 
-static void ch_generate_sgr(char *suffix) {
-#ifndef HAVE_API_WIN32_CE
-    char command[1024];
-    int system_result;
-    sprintf(command,
-            "./contraction-hierarchies-20080621/main -s -p -f ddsg_%s.tmp -o hcn_%s.tmp -l hcn_log_%s.tmp -x 190 -y 1 -e 600 -p 1000 -k 1,3.3,2,10,3,10,5",
-            suffix,suffix,suffix);
-    printf("%s\n",command);
-    system_result = system(command);
-    if (system_result == -1) {
-        dbg(lvl_warning, "Running main failed");
+#define CH_NO_MIDDLE 67108863
+
+static void ch_write_sgr(struct ch_graph *g, FILE *out) {
+    int n=g->node_count;
+    int *order=g_new(int, n);
+    struct node *nodes=g_new0(struct node, n+1);
+    struct newnode *newnodes=g_new0(struct newnode, n);
+    struct edge *edges;
+    int i,j,count=0,node_count=n+1;
+
+    for (i = 0 ; i < n ; i++) {
+        order[g->rank[i]]=i;
+        newnodes[i].newnode=g->rank[i];
+        count+=g->up[i].count;
     }
-    sprintf(command,
-            "./contraction-hierarchies-20080621/main -c -f ddsg_%s.tmp -h hcn_%s.tmp -k 1,3.3,2,10,3,10,5 -C ch_%s.tmp -O 1 -z sgr_%s.tmp",
-            suffix,suffix,suffix,suffix);
-    printf("%s\n",command);
-    system_result = system(command);
-    if (system_result == -1) {
-        dbg(lvl_warning, "Running main failed");
+    edges=g_new0(struct edge, count);
+    count=0;
+    for (i = 0 ; i < n ; i++) {
+        struct ch_up_edges *up=&g->up[order[i]];
+        nodes[i].first_edge=count;
+        for (j = 0 ; j < up->count ; j++) {
+            struct edge *e=&edges[count++];
+            e->target=g->rank[up->edge[j].target];
+            e->weight=up->edge[j].weight;
+            e->flags=up->edge[j].flags;
+            e->scmiddle=up->edge[j].middle == -1 ? CH_NO_MIDDLE : g->rank[up->edge[j].middle];
+        }
     }
-#endif
+    nodes[n].first_edge=count;
+    fwrite(&node_count, sizeof(node_count), 1, out);
+    fwrite(nodes, sizeof(struct node), n+1, out);
+    fwrite(&count, sizeof(count), 1, out);
+    fwrite(edges, sizeof(struct edge), count, out);
+    fwrite(&n, sizeof(n), 1, out);
+    fwrite(newnodes, sizeof(struct newnode), n, out);
+    g_free(order);
+    g_free(nodes);
+    g_free(newnodes);
+    g_free(edges);
+}
+
+static void ch_generate_sgr(char *suffix) {
+    FILE *ddsg,*sgr_out;
+    struct ch_graph *g;
+
+    ddsg=tempfile(suffix,"ddsg",0);
+    if (!ddsg) {
+        fprintf(stderr,"ch: failed to open ddsg file\n");
+        exit(1);
+    }
+    g=ch_graph_read_ddsg(ddsg);
+    fclose(ddsg);
+    if (!g)
+        exit(1);
+    ch_contract_graph(g, thread_count);
+    sgr_out=tempfile(suffix,"sgr",1);
+    ch_write_sgr(g, sgr_out);
+    fclose(sgr_out);
+    ch_graph_destroy(g);
 }
 
 static void ch_process_node(FILE *out, int node, int resolve) {
@@ -342,7 +385,7 @@ static void ch_setup(char *suffix) {
         newnode_count=*data;
         offset+=size;
 
-        size=edge_count*sizeof(struct newnode);
+        size=newnode_count*sizeof(struct newnode);
         newnodes=(struct newnode *)file_data_read(sgr, offset, size);
         offset+=size;
 
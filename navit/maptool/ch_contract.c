@@ -0,0 +1,479 @@
+/*
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2011 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief In-process node contraction for the contraction hierarchies of maptool
+ *
+ * The graph written by ch_generate_ddsg() is contracted node by node. In each round, all nodes whose priority is
+ * lower than that of each of their neighbours form an independent set. The witness searches for this set are spread
+ * over the worker threads, and the resulting shortcuts are merged in node order, so the result does not depend on
+ * the number of threads. ch.c writes the result in the sgr layout read by ch_setup().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "maptool.h"
+#include "debug.h"
+#include "thread.h"
+
+#define CH_WITNESS_SETTLE_LIMIT 1000
+
+struct ch_shortcut {
+    int from;
+    int to;
+    int weight;
+    int middle;
+};
+
+struct ch_worker {
+    int number;
+    struct ch_graph *graph;
+    int *items;
+    int item_count;
+    int simulate;
+    int *sc_start;              /**< Per item: first shortcut in the buffer of the worker processing it */
+    int *sc_end;
+    int *dist;
+    int *touched;
+    int touched_count;
+    struct ch_heap heap;
+    struct ch_shortcut *shortcuts;
+    int shortcut_count;
+    int shortcut_size;
+    struct thread *thread;
+};
+
+static int ch_threads;
+
+static void ch_arcs_add(struct ch_arcs *arcs, int node, int weight, int middle) {
+    if (arcs->count == arcs->size) {
+        arcs->size=arcs->size ? arcs->size*2 : 4;
+        arcs->arc=g_renew(struct ch_arc, arcs->arc, arcs->size);
+    }
+    arcs->arc[arcs->count].node=node;
+    arcs->arc[arcs->count].weight=weight;
+    arcs->arc[arcs->count].middle=middle;
+    arcs->count++;
+}
+
+static struct ch_arc *ch_arcs_find(struct ch_arcs *arcs, int node) {
+    int i;
+    for (i = 0 ; i < arcs->count ; i++) {
+        if (arcs->arc[i].node == node)
+            return &arcs->arc[i];
+    }
+    return NULL;
+}
+
+static void ch_arcs_remove(struct ch_arcs *arcs, int node) {
+    int i;
+    for (i = 0 ; i < arcs->count ; i++) {
+        if (arcs->arc[i].node == node) {
+            memmove(&arcs->arc[i], &arcs->arc[i+1], (arcs->count-i-1)*sizeof(struct ch_arc));
+            arcs->count--;
+            return;
+        }
+    }
+}
+
+void ch_graph_add_arc(struct ch_graph *g, int from, int to, int weight, int middle) {
+    struct ch_arc *arc;
+    if (from == to)
+        return;
+    arc=ch_arcs_find(&g->out[from], to);
+    if (arc) {
+        if (arc->weight <= weight)
+            return;
+        arc->weight=weight;
+        arc->middle=middle;
+        arc=ch_arcs_find(&g->in[to], from);
+        arc->weight=weight;
+        arc->middle=middle;
+        return;
+    }
+    ch_arcs_add(&g->out[from], to, weight, middle);
+    ch_arcs_add(&g->in[to], from, weight, middle);
+}
+
+/**
+ * @brief Creates a graph without arcs
+ *
+ * @param nodes The number of nodes
+ * @return The graph, to be filled with ch_graph_add_arc()
+ */
+struct ch_graph *ch_graph_new(int nodes) {
+    struct ch_graph *g=g_new0(struct ch_graph, 1);
+    g->node_count=nodes;
+    g->out=g_new0(struct ch_arcs, nodes);
+    g->in=g_new0(struct ch_arcs, nodes);
+    g->up=g_new0(struct ch_up_edges, nodes);
+    g->rank=g_new(int, nodes);
+    g->deleted=g_new0(int, nodes);
+    g->priority=g_new0(int, nodes);
+    g->contracting=g_new0(char, nodes);
+    memset(g->rank, -1, nodes*sizeof(int));
+    return g;
+}
+
+/**
+ * @brief Reads a graph in the ddsg format written by ch_generate_ddsg()
+ *
+ * @return The graph, NULL if the file is no ddsg file
+ */
+struct ch_graph *ch_graph_read_ddsg(FILE *ddsg) {
+    struct ch_graph *g;
+    char type[16];
+    int nodes,edges,from,to,weight,dir;
+
+    if (fscanf(ddsg, "%15s", type) != 1 || strcmp(type,"d") || fscanf(ddsg, "%d %d", &nodes, &edges) != 2) {
+        fprintf(stderr,"ch: invalid ddsg header\n");
+        return NULL;
+    }
+    g=ch_graph_new(nodes);
+    while (fscanf(ddsg, "%d %d %d %d", &from, &to, &weight, &dir) == 4) {
+        if (from < 0 || to < 0 || from >= nodes || to >= nodes) {
+            dbg(lvl_warning,"edge %d-%d out of range",from,to);
+            continue;
+        }
+        /* ddsg directions: 0 both, 1 forward only, 2 backward only, 3 closed */
+        if (dir == 0 || dir == 1)
+            ch_graph_add_arc(g, from, to, weight, -1);
+        if (dir == 0 || dir == 2)
+            ch_graph_add_arc(g, to, from, weight, -1);
+    }
+    return g;
+}
+
+void ch_graph_destroy(struct ch_graph *g) {
+    int i;
+    for (i = 0 ; i < g->node_count ; i++) {
+        g_free(g->out[i].arc);
+        g_free(g->in[i].arc);
+        g_free(g->up[i].edge);
+    }
+    g_free(g->out);
+    g_free(g->in);
+    g_free(g->up);
+    g_free(g->rank);
+    g_free(g->deleted);
+    g_free(g->priority);
+    g_free(g->contracting);
+    g_free(g);
+}
+
+void ch_heap_push(struct ch_heap *heap, int dist, int node) {
+    int pos;
+    if (heap->count == heap->size) {
+        heap->size=heap->size ? heap->size*2 : 256;
+        heap->entry=g_renew(struct ch_heap_entry, heap->entry, heap->size);
+    }
+    pos=heap->count++;
+    while (pos && heap->entry[(pos-1)/2].dist > dist) {
+        heap->entry[pos]=heap->entry[(pos-1)/2];
+        pos=(pos-1)/2;
+    }
+    heap->entry[pos].dist=dist;
+    heap->entry[pos].node=node;
+}
+
+struct ch_heap_entry ch_heap_pop(struct ch_heap *heap) {
+    struct ch_heap_entry ret=heap->entry[0],last=heap->entry[--heap->count];
+    int pos=0,child;
+    while ((child=pos*2+1) < heap->count) {
+        if (child+1 < heap->count && heap->entry[child+1].dist < heap->entry[child].dist)
+            child++;
+        if (heap->entry[child].dist >= last.dist)
+            break;
+        heap->entry[pos]=heap->entry[child];
+        pos=child;
+    }
+    heap->entry[pos]=last;
+    return ret;
+}
+
+/**
+ * @brief Searches for paths from source which do not pass through skip, up to a cost of limit
+ *
+ * Nodes of the independent set being contracted are skipped as well: they are removed together with skip, so a path
+ * through one of them is no witness for a path through another one.
+ *
+ * On return, w->dist holds the distances of all nodes reached, INT_MAX for all others.
+ */
+static void ch_witness_search(struct ch_worker *w, int source, int skip, int limit) {
+    struct ch_graph *g=w->graph;
+    int i,settled=0;
+
+    for (i = 0 ; i < w->touched_count ; i++)
+        w->dist[w->touched[i]]=INT_MAX;
+    w->touched_count=0;
+    w->heap.count=0;
+    w->dist[source]=0;
+    w->touched[w->touched_count++]=source;
+    ch_heap_push(&w->heap, 0, source);
+    while (w->heap.count) {
+        struct ch_heap_entry e=ch_heap_pop(&w->heap);
+        struct ch_arcs *out;
+        if (e.dist > w->dist[e.node])
+            continue;
+        if (e.dist > limit || ++settled > CH_WITNESS_SETTLE_LIMIT)
+            break;
+        out=&g->out[e.node];
+        for (i = 0 ; i < out->count ; i++) {
+            int node=out->arc[i].node;
+            int dist=e.dist+out->arc[i].weight;
+            if (node == skip || g->contracting[node] || dist >= w->dist[node])
+                continue;
+            if (w->dist[node] == INT_MAX)
+                w->touched[w->touched_count++]=node;
+            w->dist[node]=dist;
+            ch_heap_push(&w->heap, dist, node);
+        }
+    }
+}
+
+/**
+ * @brief Determines the shortcuts needed to contract node v
+ *
+ * @return The number of shortcuts. Unless the worker only simulates, the shortcuts are appended to its buffer.
+ */
+static int ch_contract_node(struct ch_worker *w, int v) {
+    struct ch_graph *g=w->graph;
+    struct ch_arcs *in=&g->in[v],*out=&g->out[v];
+    int i,j,max_out=0,ret=0;
+
+    for (j = 0 ; j < out->count ; j++) {
+        if (out->arc[j].weight > max_out)
+            max_out=out->arc[j].weight;
+    }
+    for (i = 0 ; i < in->count ; i++) {
+        int x=in->arc[i].node;
+        ch_witness_search(w, x, v, in->arc[i].weight+max_out);
+        for (j = 0 ; j < out->count ; j++) {
+            int y=out->arc[j].node;
+            int via=in->arc[i].weight+out->arc[j].weight;
+            if (y == x || w->dist[y] <= via)
+                continue;
+            ret++;
+            if (w->simulate)
+                continue;
+            if (w->shortcut_count == w->shortcut_size) {
+                w->shortcut_size=w->shortcut_size ? w->shortcut_size*2 : 1024;
+                w->shortcuts=g_renew(struct ch_shortcut, w->shortcuts, w->shortcut_size);
+            }
+            w->shortcuts[w->shortcut_count].from=x;
+            w->shortcuts[w->shortcut_count].to=y;
+            w->shortcuts[w->shortcut_count].weight=via;
+            w->shortcuts[w->shortcut_count].middle=v;
+            w->shortcut_count++;
+        }
+    }
+    return ret;
+}
+
+static int ch_worker_thread(void *data) {
+    struct ch_worker *w=data;
+    struct ch_graph *g=w->graph;
+    int i;
+
+    w->shortcut_count=0;
+    for (i = w->number ; i < w->item_count ; i+=ch_threads) {
+        int v=w->items[i];
+        w->sc_start[i]=w->shortcut_count;
+        if (w->simulate)
+            g->priority[v]=ch_contract_node(w, v)-g->in[v].count-g->out[v].count+g->deleted[v];
+        else
+            ch_contract_node(w, v);
+        w->sc_end[i]=w->shortcut_count;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs ch_contract_node() on all items, either to update their priority or to collect their shortcuts
+ */
+static void ch_run_workers(struct ch_worker *workers, int *items, int item_count, int simulate) {
+    int i;
+    for (i = 0 ; i < ch_threads ; i++) {
+        workers[i].items=items;
+        workers[i].item_count=item_count;
+        workers[i].simulate=simulate;
+        workers[i].thread=thread_new(ch_worker_thread, &workers[i], "ch_worker");
+        if (!workers[i].thread)
+            ch_worker_thread(&workers[i]);
+    }
+    for (i = 0 ; i < ch_threads ; i++) {
+        if (workers[i].thread)
+            thread_join(workers[i].thread);
+    }
+}
+
+static int ch_is_local_minimum(struct ch_graph *g, int v) {
+    struct ch_arcs *arcs[2]= {&g->out[v], &g->in[v]};
+    int i,j;
+    for (i = 0 ; i < 2 ; i++) {
+        for (j = 0 ; j < arcs[i]->count ; j++) {
+            int w=arcs[i]->arc[j].node;
+            if (g->priority[w] < g->priority[v] || (g->priority[w] == g->priority[v] && w < v))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static void ch_up_edge_add(struct ch_up_edges *up, int target, int weight, int middle, int flags) {
+    int i;
+    for (i = 0 ; i < up->count ; i++) {
+        struct ch_up_edge *e=&up->edge[i];
+        if (e->target == target && e->weight == weight && e->middle == middle) {
+            e->flags|=flags;
+            return;
+        }
+    }
+    up->edge=g_renew(struct ch_up_edge, up->edge, up->count+1);
+    up->edge[up->count].target=target;
+    up->edge[up->count].weight=weight;
+    up->edge[up->count].middle=middle;
+    up->edge[up->count].flags=flags;
+    up->count++;
+}
+
+/**
+ * @brief Removes node v from the graph, recording its remaining arcs as edges to higher ranked nodes
+ */
+static void ch_remove_node(struct ch_graph *g, int v, int rank, int *affected, int *affected_count, char *mark) {
+    struct ch_arcs *out=&g->out[v],*in=&g->in[v];
+    int i;
+
+    g->rank[v]=rank;
+    for (i = 0 ; i < out->count ; i++) {
+        int y=out->arc[i].node;
+        ch_up_edge_add(&g->up[v], y, out->arc[i].weight, out->arc[i].middle, 1);
+        ch_arcs_remove(&g->in[y], v);
+        if (!mark[y]) {
+            mark[y]=1;
+            g->deleted[y]++;
+            affected[(*affected_count)++]=y;
+        }
+    }
+    for (i = 0 ; i < in->count ; i++) {
+        int x=in->arc[i].node;
+        ch_up_edge_add(&g->up[v], x, in->arc[i].weight, in->arc[i].middle, 2);
+        ch_arcs_remove(&g->out[x], v);
+        if (!mark[x]) {
+            mark[x]=1;
+            g->deleted[x]++;
+            affected[(*affected_count)++]=x;
+        }
+    }
+    g_free(out->arc);
+    g_free(in->arc);
+    memset(out, 0, sizeof(*out));
+    memset(in, 0, sizeof(*in));
+}
+
+/**
+ * @brief Contracts all nodes of a graph
+ *
+ * On return, the rank and the edges to higher ranked nodes are set for every node, and no arcs are left.
+ *
+ * @param g The graph
+ * @param threads The number of threads searching for witnesses
+ */
+void ch_contract_graph(struct ch_graph *g, int threads) {
+    struct ch_worker *workers;
+    int n=g->node_count;
+    int *remaining=g_new(int, n);
+    int *set=g_new(int, n);
+    int *affected=g_new(int, n);
+    int *sc_start=g_new(int, n);
+    int *sc_end=g_new(int, n);
+    char *mark=g_new0(char, n);
+    int remaining_count=n,rank=0,rounds=0,shortcuts=0;
+    int i,j;
+
+    ch_threads=threads > 0 ? threads : 1;
+    workers=g_new0(struct ch_worker, ch_threads);
+    for (i = 0 ; i < ch_threads ; i++) {
+        workers[i].number=i;
+        workers[i].graph=g;
+        workers[i].sc_start=sc_start;
+        workers[i].sc_end=sc_end;
+        workers[i].dist=g_new(int, n);
+        workers[i].touched=g_new(int, n);
+        for (j = 0 ; j < n ; j++)
+            workers[i].dist[j]=INT_MAX;
+    }
+    for (i = 0 ; i < n ; i++)
+        remaining[i]=i;
+    ch_run_workers(workers, remaining, n, 1);
+
+    while (remaining_count) {
+        int set_count=0,affected_count=0,count=0;
+
+        for (i = 0 ; i < remaining_count ; i++) {
+            if (ch_is_local_minimum(g, remaining[i]))
+                set[set_count++]=remaining[i];
+        }
+        for (i = 0 ; i < set_count ; i++)
+            g->contracting[set[i]]=1;
+        ch_run_workers(workers, set, set_count, 0);
+        for (i = 0 ; i < set_count ; i++) {
+            struct ch_worker *w=&workers[i%ch_threads];
+            g->contracting[set[i]]=0;
+            ch_remove_node(g, set[i], rank++, affected, &affected_count, mark);
+            for (j = sc_start[i] ; j < sc_end[i] ; j++) {
+                struct ch_shortcut *sc=&w->shortcuts[j];
+                ch_graph_add_arc(g, sc->from, sc->to, sc->weight, sc->middle);
+                shortcuts++;
+            }
+        }
+        for (i = 0 ; i < affected_count ; i++)
+            mark[affected[i]]=0;
+        for (i = 0 ; i < remaining_count ; i++) {
+            if (g->rank[remaining[i]] == -1)
+                remaining[count++]=remaining[i];
+        }
+        remaining_count=count;
+        count=0;
+        for (i = 0 ; i < affected_count ; i++) {
+            if (g->rank[affected[i]] == -1)
+                affected[count++]=affected[i];
+        }
+        ch_run_workers(workers, affected, count, 1);
+        if (!(++rounds % 50) || !remaining_count)
+            fprintf(stderr,"ch: round %d, %d of %d nodes contracted, %d shortcuts\n", rounds, n-remaining_count, n, shortcuts);
+    }
+
+    for (i = 0 ; i < ch_threads ; i++) {
+        g_free(workers[i].dist);
+        g_free(workers[i].touched);
+        g_free(workers[i].heap.entry);
+        g_free(workers[i].shortcuts);
+    }
+    g_free(workers);
+    g_free(remaining);
+    g_free(set);
+    g_free(affected);
+    g_free(sc_start);
+    g_free(sc_end);
+    g_free(mark);
+}
+
@@ -0,0 +1,225 @@
+/*
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2011 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Checks the node contraction of ch_contract.c against plain Dijkstra
+ *
+ * Small graphs are contracted, and the distances between all pairs of nodes found by a bidirectional search on the
+ * edges to higher ranked nodes are compared with those found by Dijkstra on the original graph. The graphs have many
+ * paths of equal cost, as these are where witness searches go wrong most easily, and some of them have oneways.
+ *
+ * Prints one line per graph and returns nonzero if any distance differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "maptool.h"
+#include "debug.h"
+
+struct test_edge {
+    int from;
+    int to;
+    int weight;
+};
+
+struct test_graph {
+    char *name;
+    int node_count;
+    struct test_edge *edges;
+    int edge_count;
+};
+
+static unsigned int test_random_state=1;
+
+static int test_random(int max) {
+    test_random_state=test_random_state*1103515245+12345;
+    return (test_random_state >> 16) % max;
+}
+
+static void test_add_edge(struct test_graph *t, int from, int to, int weight, int oneway) {
+    t->edges=g_renew(struct test_edge, t->edges, t->edge_count+2);
+    t->edges[t->edge_count].from=from;
+    t->edges[t->edge_count].to=to;
+    t->edges[t->edge_count].weight=weight;
+    t->edge_count++;
+    if (oneway)
+        return;
+    t->edges[t->edge_count].from=to;
+    t->edges[t->edge_count].to=from;
+    t->edges[t->edge_count].weight=weight;
+    t->edge_count++;
+}
+
+/**
+ * @brief Two paths of equal cost from node 0 to node 3, through node 1 and through node 2
+ */
+static void test_graph_diamond(struct test_graph *t) {
+    t->name="diamond";
+    t->node_count=4;
+    test_add_edge(t, 0, 1, 5, 0);
+    test_add_edge(t, 1, 3, 5, 0);
+    test_add_edge(t, 0, 2, 5, 0);
+    test_add_edge(t, 2, 3, 5, 0);
+}
+
+/**
+ * @brief A grid with edges of equal weight, so most pairs of nodes are connected by many shortest paths
+ */
+static void test_graph_grid(struct test_graph *t, int size) {
+    int x,y;
+    t->name="grid";
+    t->node_count=size*size;
+    for (y = 0 ; y < size ; y++) {
+        for (x = 0 ; x < size ; x++) {
+            if (x+1 < size)
+                test_add_edge(t, y*size+x, y*size+x+1, 10, 0);
+            if (y+1 < size)
+                test_add_edge(t, y*size+x, (y+1)*size+x, 10, 0);
+        }
+    }
+}
+
+/**
+ * @brief A random graph with few distinct weights and some oneways
+ */
+static void test_graph_random(struct test_graph *t, int nodes, int edges) {
+    int i;
+    t->name="random";
+    t->node_count=nodes;
+    for (i = 1 ; i < nodes ; i++)
+        test_add_edge(t, test_random(i), i, 1+test_random(3), 0);
+    for (i = nodes-1 ; i < edges ; i++)
+        test_add_edge(t, test_random(nodes), test_random(nodes), 1+test_random(3), !test_random(4));
+}
+
+/**
+ * @brief Computes the distances from source with Dijkstra on the original edges
+ */
+static void test_dijkstra(struct test_graph *t, int source, int *dist) {
+    struct ch_heap heap= {NULL,0,0};
+    int i;
+
+    for (i = 0 ; i < t->node_count ; i++)
+        dist[i]=INT_MAX;
+    dist[source]=0;
+    ch_heap_push(&heap, 0, source);
+    while (heap.count) {
+        struct ch_heap_entry e=ch_heap_pop(&heap);
+        if (e.dist > dist[e.node])
+            continue;
+        for (i = 0 ; i < t->edge_count ; i++) {
+            struct test_edge *edge=&t->edges[i];
+            if (edge->from == e.node && e.dist+edge->weight < dist[edge->to]) {
+                dist[edge->to]=e.dist+edge->weight;
+                ch_heap_push(&heap, dist[edge->to], edge->to);
+            }
+        }
+    }
+    g_free(heap.entry);
+}
+
+/**
+ * @brief Computes the distances from source on the edges to higher ranked nodes
+ *
+ * @param flags 1 to follow the edges in their direction, 2 to follow them backwards
+ */
+static void test_ch_search(struct ch_graph *g, int source, int flags, int *dist) {
+    struct ch_heap heap= {NULL,0,0};
+    int i;
+
+    for (i = 0 ; i < g->node_count ; i++)
+        dist[i]=INT_MAX;
+    dist[source]=0;
+    ch_heap_push(&heap, 0, source);
+    while (heap.count) {
+        struct ch_heap_entry e=ch_heap_pop(&heap);
+        struct ch_up_edges *up=&g->up[e.node];
+        if (e.dist > dist[e.node])
+            continue;
+        for (i = 0 ; i < up->count ; i++) {
+            struct ch_up_edge *edge=&up->edge[i];
+            if ((edge->flags & flags) && e.dist+edge->weight < dist[edge->target]) {
+                dist[edge->target]=e.dist+edge->weight;
+                ch_heap_push(&heap, dist[edge->target], edge->target);
+            }
+        }
+    }
+    g_free(heap.entry);
+}
+
+/**
+ * @brief Contracts a graph and compares the distances between all pairs of nodes
+ *
+ * @return The number of pairs with differing distances
+ */
+static int test_graph_check(struct test_graph *t, int threads) {
+    struct ch_graph *g=ch_graph_new(t->node_count);
+    int *expected=g_new(int, t->node_count);
+    int *fwd=g_new(int, t->node_count);
+    int *bwd=g_new(int, t->node_count);
+    int i,s,d,errors=0;
+
+    for (i = 0 ; i < t->edge_count ; i++)
+        ch_graph_add_arc(g, t->edges[i].from, t->edges[i].to, t->edges[i].weight, -1);
+    ch_contract_graph(g, threads);
+    for (s = 0 ; s < t->node_count ; s++) {
+        test_dijkstra(t, s, expected);
+        test_ch_search(g, s, 1, fwd);
+        for (d = 0 ; d < t->node_count ; d++) {
+            int dist=INT_MAX;
+            test_ch_search(g, d, 2, bwd);
+            for (i = 0 ; i < t->node_count ; i++) {
+                if (fwd[i] != INT_MAX && bwd[i] != INT_MAX && fwd[i]+bwd[i] < dist)
+                    dist=fwd[i]+bwd[i];
+            }
+            if (dist != expected[d]) {
+                if (errors < 10)
+                    fprintf(stderr, "%s: distance %d-%d is %d, expected %d\n", t->name, s, d, dist, expected[d]);
+                errors++;
+            }
+        }
+    }
+    printf("%s,%d,%d,%d,%d\n", t->name, threads, t->node_count, t->edge_count, errors);
+    g_free(expected);
+    g_free(fwd);
+    g_free(bwd);
+    ch_graph_destroy(g);
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    struct test_graph graphs[4];
+    int i,threads,errors=0;
+
+    debug_init(argv[0]);
+    memset(graphs, 0, sizeof(graphs));
+    test_graph_diamond(&graphs[0]);
+    test_graph_grid(&graphs[1], 7);
+    test_graph_random(&graphs[2], 40, 100);
+    test_graph_random(&graphs[3], 80, 120);
+    printf("graph,threads,nodes,edges,errors\n");
+    for (i = 0 ; i < sizeof(graphs)/sizeof(graphs[0]) ; i++) {
+        for (threads = 1 ; threads <= 3 ; threads+=2)
+            errors+=test_graph_check(&graphs[i], threads);
+        g_free(graphs[i].edges);
+    }
+    return errors != 0;
+}
@@ -58,6 +58,7 @@ int phase;
 int slices;
 int unknown_country;
 char ch_suffix[] ="r"; /* Used to make compiler happy due to Bug 35903 in gcc */
+char overlay_suffix[] ="o";
 /** Textual description of available experimental features, or NULL (=none available). */
 char* experimental_feature_description =
     "Move coastline data to order 6 tiles. Makes map look more smooth, but may affect drawing/searching performance."; /* add description here */
@@ -283,6 +284,7 @@ static void usage(void) {
     fprintf(f,"-6 (--64bit)                      : set zip 64 bit compression (default)\n");
     fprintf(f,"-a (--attr-debug-level)  <level>  : control which data is included in the debug attribute\n");
     fprintf(f,"-c (--dump-coordinates)           : dump coordinates after phase 1\n");
+    fprintf(f,"-C (--contraction-hierarchies)    : add contraction hierarchies data for routing (uses --threads)\n");
 #ifdef HAVE_POSTGRESQL
     fprintf(f,
             "-d (--db) <conn. string>          : get osm data out of a postgresql database with osm simple scheme and given connect string\n");
@@ -291,8 +293,10 @@ static void usage(void) {
     fprintf(f,"-e (--end) <phase>                : end at specified phase\n");
     fprintf(f,"-E (--experimental)               : Enable experimental features (%s)\n",
             experimental_feature_description ? experimental_feature_description : "-not available in this version-");
+    fprintf(f,"-H (--speed-profiles) <file>      : add historic speeds of ways from specified file for time-dependent routing\n");
     fprintf(f,"-i (--input-file) <file>          : specify the input file name (OSM), overrules default stdin\n");
     fprintf(f,"-k (--keep-tmpfiles)              : do not delete tmp files after processing. useful to reuse them\n");
+    fprintf(f,"-L (--route-overlay)              : add a multi-level overlay for traffic-aware routing (uses --threads)\n");
     fprintf(f,"-M (--o5m)                        : input data is in o5m format\n");
     fprintf(f,"-n (--ignore-unknown)             : do not output ways and nodes with unknown type\n");
     fprintf(f,"-N (--nodes-only)                 : process only nodes\n");
@@ -310,6 +314,7 @@ static void usage(void) {
     fprintf(f,"-U (--unknown-country)            : add objects with unknown country to index\n");
     fprintf(f,"-x (--index-size)                 : set maximum country index size in bytes\n");
     fprintf(f,"-z (--compression-level) <level>  : set the compression level\n");
+    fprintf(f,"-Z (--zstd)                       : compress tiles with Zstandard instead of deflate, for faster decoding\n");
     fprintf(f,"Internal options (undocumented):\n");
     fprintf(f,"-b (--binfile)\n");
     fprintf(f,"-B \n");
@@ -334,8 +339,11 @@ struct maptool_params {
     int dump;
     int o5m;
     int compression_level;
+    int compression_method;
     int protobuf;
     int dump_coordinates;
+    int ch;
+    int overlay;
     int input;
     GList *map_handles;
     FILE* input_file;
@@ -364,6 +372,7 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
         {"attr-debug-level", 1, 0, 'a'},
         {"binfile", 0, 0, 'b'},
         {"compression-level", 1, 0, 'z'},
+        {"contraction-hierarchies", 0, 0, 'C'},
 #ifdef HAVE_POSTGRESQL
         {"db", 1, 0, 'd'},
 #endif
@@ -384,19 +393,22 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
         {"threads", 1, 0, 'T'},
         {"input-file", 1, 0, 'i'},
         {"rule-file", 1, 0, 'r'},
+        {"route-overlay", 0, 0, 'L'},
+        {"speed-profiles", 1, 0, 'H'},
         {"ignore-unknown", 0, 0, 'n'},
         {"url", 1, 0, 'u'},
         {"ways-only", 0, 0, 'W'},
         {"slice-size", 1, 0, 'S'},
         {"unknown-country", 0, 0, 'U'},
         {"index-size", 0, 0, 'x'},
+        {"zstd", 0, 0, 'Z'},
         {0, 0, 0, 0}
     };
-    c = getopt_long (argc, argv, "36B:DEMNO:PS:Wa:bc"
+    c = getopt_long (argc, argv, "36B:CDELMNO:PS:Wa:bc"
 #ifdef HAVE_POSTGRESQL
                      "d:"
 #endif
-                     "e:hi:knm:p:r:s:t:T:wu:z:Ux:", long_options, option_index);
+                     "e:hH:i:knm:p:r:s:t:T:wu:z:ZUx:", long_options, option_index);
     if (c == -1)
         return 1;
     switch (c) {
@@ -409,12 +421,18 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
     case 'B':
         p->protobufdb=optarg;
         break;
+    case 'C':
+        p->ch=1;
+        break;
     case 'D':
         p->dump=1;
         break;
     case 'E':
         experimental=1;
         break;
+    case 'L':
+        p->overlay=1;
+        break;
     case 'M':
         p->o5m=1;
         break;
@@ -514,6 +532,16 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
             exit( 1 );
         }
         break;
+    case 'H': {
+        FILE *speed_profiles_file=fopen(optarg, "r");
+        if (speed_profiles_file == NULL) {
+            fprintf(stderr, "\nSpeed profile file (%s) not found\n", optarg);
+            exit(1);
+        }
+        osm_load_speed_profiles(speed_profiles_file);
+        fclose(speed_profiles_file);
+        break;
+    }
     case 'r':
         p->rule_file = fopen( optarg, "r" );
         if (p->rule_file ==  NULL ) {
@@ -531,6 +559,14 @@ static int parse_option(struct maptool_params *p, char **argv, int argc, int *op
     case 'z':
         p->compression_level=atoi(optarg);
         break;
+#endif
+    case 'Z':
+#ifdef HAVE_ZSTD
+        p->compression_method=zip_method_zstd;
+        break;
+#else
+        fprintf(stderr,"maptool was built without Zstandard support\n");
+        exit(1);
 #endif
     case '?':
     default:
@@ -780,7 +816,7 @@ static void maptool_dump(struct maptool_params *p, char *suffix) {
 static void maptool_generate_tiles(struct maptool_params *p, char *suffix, char **filenames, int filename_count,
                                    int first,
                                    char *suffix0) {
-    struct zip_info *zip_info;
+    static struct zip_info *zip_info;
     FILE *tilesdir;
     FILE *files[10];
     int zipnum, f;
@@ -793,6 +829,8 @@ static void maptool_generate_tiles(struct maptool_params *p, char *suffix, char
     tilesdir=tempfile(suffix,"tilesdir",1);
     if (!g_strcmp0(suffix,ch_suffix)) { /* Makes compiler happy due to bug 35903 in gcc */
         ch_generate_tiles(suffix0,suffix,tilesdir,zip_info);
+    } else if (!g_strcmp0(suffix,overlay_suffix)) {
+        overlay_generate_tiles(suffix0,suffix,tilesdir,zip_info);
     } else {
         for (f = 0 ; f < filename_count ; f++)
             files[f]=tempfile(suffix,filenames[f],0);
@@ -810,7 +848,7 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
                                  int filename_count, int first, int last, char *suffix0) {
     FILE *files[10];
     FILE *references[10];
-    struct zip_info *zip_info;
+    static struct zip_info *zip_info;
     int zipnum,f;
 
     if (first) {
@@ -821,6 +859,7 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
         zip_set_timestamp(zip_info, p->timestamp);
         zip_set_maxnamelen(zip_info, 14+strlen(suffix0));
         zip_set_compression_level(zip_info, p->compression_level);
+        zip_set_compression_method(zip_info, p->compression_method);
         if(!zip_open(zip_info, p->result, zipdir, zipindex)) {
             fprintf(stderr,"Fatal: Could not write output file.\n");
             exit(1);
@@ -835,6 +874,8 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
     }
     if (!g_strcmp0(suffix,ch_suffix)) {  /* Makes compiler happy due to bug 35903 in gcc */
         ch_assemble_map(suffix0,suffix,zip_info);
+    } else if (!g_strcmp0(suffix,overlay_suffix)) {
+        overlay_assemble_map(suffix0,suffix,zip_info);
     } else {
         for (f = 0 ; f < filename_count ; f++) {
             files[f]=tempfile(suffix, filenames[f], 0);
@@ -855,10 +896,8 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
         tempfile_unlink(suffix,"relations");
         tempfile_unlink(suffix,"multipolygons_out");
         tempfile_unlink(suffix,"nodes");
-        tempfile_unlink(suffix,"ways_split");
         tempfile_unlink(suffix,"poly2poi_resolved");
         tempfile_unlink(suffix,"line2poi_resolved");
-        tempfile_unlink(suffix,"ways_split_ref");
         tempfile_unlink(suffix,"coastline");
         tempfile_unlink(suffix,"turn_restrictions");
         tempfile_unlink(suffix,"multipolygons");
@@ -869,6 +908,11 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
         tempfile_unlink(suffix,"coastline_result");
         tempfile_unlink(suffix,"towns_poly");
         unlink("coords.tmp");
+        /* the contraction hierarchies and overlay passes still need the ways of the first pass */
+        if (last) {
+            tempfile_unlink(suffix0,"ways_split");
+            tempfile_unlink(suffix0,"ways_split_ref");
+        }
     }
     if (last) {
         zipnum=zip_get_zipnum(zip_info);
@@ -876,6 +920,7 @@ static void maptool_assemble_map(struct maptool_params *p, char *suffix, char **
         write_countrydir(zip_info,p->max_index_size);
         zip_set_zipnum(zip_info, zipnum);
         write_aux_tiles(zip_info);
+        zip_write_tiledir(zip_info);
         zip_write_index(zip_info);
         zip_write_directory(zip_info);
         zip_close(zip_info);
@@ -914,13 +959,13 @@ static void maptool_load_tilesdir(struct maptool_params *p, char *suffix) {
 
 int main(int argc, char **argv) {
     struct maptool_params p;
-    char *suffixes[]= {""};
+    char *suffixes[3]= {""};
     char *suffix=suffixes[0];
     char *filenames[20];
     char *referencenames[20];
     int filename_count=0;
 
-    int suffix_count=sizeof(suffixes)/sizeof(char *);
+    int suffix_count;
     int i;
     int suffix_start=0;
     int option_index=0;
@@ -935,6 +980,7 @@ int main(int argc, char **argv) {
 #ifdef HAVE_ZLIB
     p.compression_level=9;
 #endif
+    p.compression_method=zip_method_deflate;
     p.start=1;
     p.end=99;
     p.input_file=stdin;
@@ -978,6 +1024,11 @@ int main(int argc, char **argv) {
     }
 
     p.result=argv[optind];
+    suffix_count=1;
+    if (p.ch)
+        suffixes[suffix_count++]=ch_suffix;
+    if (p.overlay)
+        suffixes[suffix_count++]=overlay_suffix;
 
 
     // initialize plugins and OSM mappings
@@ -1101,7 +1152,7 @@ int main(int argc, char **argv) {
     }
     if (p.process_ways) {
         filenames[filename_count]="ways_split";
-        referencenames[filename_count++]=NULL;
+        referencenames[filename_count++]=p.ch ? "ways_split_ref" : NULL;
         filenames[filename_count]="coastline_result";
         referencenames[filename_count++]=NULL;
     }
@@ -183,9 +183,66 @@ long long sizeof_buffer(char *filename);
 
 /* ch.c */
 
+int road_speed(enum item_type type);
 void ch_generate_tiles(char *map_suffix, char *suffix, FILE *tilesdir_out, struct zip_info *zip_info);
 void ch_assemble_map(char *map_suffix, char *suffix, struct zip_info *zip_info);
 
+/* ch_contract.c */
+
+struct ch_arc {
+    int node;
+    int weight;
+    int middle;
+};
+
+struct ch_arcs {
+    struct ch_arc *arc;
+    int count;
+    int size;
+};
+
+struct ch_up_edge {
+    int target;
+    int weight;
+    int middle;                 /**< Node bypassed by a shortcut, -1 for an edge of the original graph */
+    int flags;                  /**< 1: the edge leads to target, 2: the edge leads from target */
+};
+
+struct ch_up_edges {
+    struct ch_up_edge *edge;
+    int count;
+};
+
+struct ch_graph {
+    int node_count;
+    struct ch_arcs *out;        /**< out[u] holds the arcs from u to arc.node */
+    struct ch_arcs *in;         /**< in[u] holds the arcs from arc.node to u */
+    struct ch_up_edges *up;     /**< Edges to higher ranked nodes, recorded when a node is contracted */
+    int *rank;                  /**< Contraction order, -1 as long as the node is not contracted */
+    char *contracting;          /**< Nodes of the independent set being contracted, excluded from witness searches */
+    int *deleted;               /**< Number of contracted neighbours */
+    int *priority;
+};
+
+struct ch_heap_entry {
+    int dist;
+    int node;
+};
+
+struct ch_heap {
+    struct ch_heap_entry *entry;
+    int count;
+    int size;
+};
+
+void ch_heap_push(struct ch_heap *heap, int dist, int node);
+struct ch_heap_entry ch_heap_pop(struct ch_heap *heap);
+struct ch_graph *ch_graph_new(int nodes);
+void ch_graph_add_arc(struct ch_graph *g, int from, int to, int weight, int middle);
+struct ch_graph *ch_graph_read_ddsg(FILE *ddsg);
+void ch_graph_destroy(struct ch_graph *g);
+void ch_contract_graph(struct ch_graph *g, int threads);
+
 /* coastline.c */
 
 void process_coastlines(FILE *in, FILE *out);
@@ -306,6 +363,7 @@ void osm_add_relation(osmid id);
 void osm_end_relation(struct maptool_osm *osm);
 void osm_add_member(enum relation_member_type type, osmid ref, char *role);
 void osm_end_way(struct maptool_osm *osm);
+void osm_load_speed_profiles(FILE *in);
 void osm_end_node(struct maptool_osm *osm);
 void osm_add_nd(osmid ref);
 osmid item_bin_get_id(struct item_bin *ib);
@@ -359,6 +417,10 @@ int osm_xml_get_attribute(char *xml, char *attribute, char *buffer, int buffer_s
 void osm_xml_decode_entities(char *buffer);
 int map_collect_data_osm(FILE *in, struct maptool_osm *osm);
 
+/* overlay.c */
+
+void overlay_generate_tiles(char *map_suffix, char *suffix, FILE *tilesdir_out, struct zip_info *zip_info);
+void overlay_assemble_map(char *map_suffix, char *suffix, struct zip_info *zip_info);
 
 /* sourcesink.c */
 
@@ -413,10 +475,12 @@ void index_submap_add(struct tile_info *info, struct tile_head *th);
 /* zip.c */
 void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *data, int data_size);
 int zip_write_index(struct zip_info *info);
+int zip_write_tiledir(struct zip_info *info);
 int zip_write_directory(struct zip_info *info);
 struct zip_info *zip_new(void);
 void zip_set_zip64(struct zip_info *info, int on);
 void zip_set_compression_level(struct zip_info *info, int level);
+void zip_set_compression_method(struct zip_info *info, int method);
 void zip_set_maxnamelen(struct zip_info *info, int max);
 int zip_get_maxnamelen(struct zip_info *info);
 int zip_add_member(struct zip_info *info);
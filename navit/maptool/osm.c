@@ -64,6 +64,9 @@ int flags_attr_value;
 struct attr_bin osmid_attr;
 long long osmid_attr_value;
 
+/** Historic speeds by way id (a pointer to a gint64), see osm_load_speed_profiles() */
+static GHashTable *speed_profiles;
+
 char is_in_buffer[BUFFER_SIZE];
 
 char attr_strings_buffer[BUFFER_SIZE*16];
@@ -1859,6 +1862,15 @@ void osm_end_way(struct maptool_osm *osm) {
         item_bin_add_attr_longlong(item_bin, attr_osm_wayid, osmid_attr_value);
         if (debug_attr_buffer[0])
             item_bin_add_attr_string(item_bin, attr_debug, debug_attr_buffer);
+        if (def_flags && speed_profiles) {
+            gint64 wayid=osmid_attr_value;
+            int *profile=g_hash_table_lookup(speed_profiles, &wayid);
+            if (profile) {
+                item_bin_add_attr_data(item_bin, attr_speed_profile, profile, sizeof(int)+*profile);
+                flags_attr_value|=AF_SPEED_PROFILE;
+                add_flags=1;
+            }
+        }
         if (add_flags)
             item_bin_add_attr_int(item_bin, attr_flags, flags_attr_value);
         if (maxspeed_attr_value)
@@ -4227,3 +4239,56 @@ void osm_init(FILE* rule_file) {
     build_countrytable();
 }
 
+/**
+ * @brief Reads historic speeds of ways
+ *
+ * Each line holds the id of a way followed by its speeds in km/h, separated by white space. The speeds divide the week,
+ * starting on Monday 00:00 local time, into buckets of equal length, so 24 speeds give one profile for each hour of
+ * the day and 168 one for each hour of the week. A speed of 0 means that the speed is not known for a bucket. Empty
+ * lines and lines starting with `#` are ignored.
+ *
+ * Routable ways listed in the file get their speeds as {@code attr_speed_profile}, an int holding the number of
+ * buckets followed by one byte per bucket, and the {@code AF_SPEED_PROFILE} flag.
+ *
+ * @param in The file
+ */
+void osm_load_speed_profiles(FILE *in) {
+    char line[4096],*pos,*end;
+    unsigned char speeds[7*24*4];
+    long long id;
+    int count,lines=0;
+
+    if (!speed_profiles)
+        speed_profiles=g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+    while (fgets(line, sizeof(line), in)) {
+        int *profile;
+        gint64 *key;
+        lines++;
+        id=strtoll(line, &end, 10);
+        if (end == line) {
+            for (pos=line ; isspace(*pos) ; pos++);
+            if (*pos && *pos != '#')
+                fprintf(stderr,"speed profiles: invalid line %d\n", lines);
+            continue;
+        }
+        count=0;
+        for (pos=end ; count < sizeof(speeds) ; pos=end) {
+            long speed=strtol(pos, &end, 10);
+            if (end == pos)
+                break;
+            speeds[count++]=speed < 0 ? 0 : (speed > 255 ? 255 : speed);
+        }
+        if (!count) {
+            fprintf(stderr,"speed profiles: no speeds for way "LONGLONG_FMT" in line %d\n", id, lines);
+            continue;
+        }
+        profile=g_malloc(sizeof(int)+count);
+        *profile=count;
+        memcpy(profile+1, speeds, count);
+        key=g_new(gint64, 1);
+        *key=id;
+        g_hash_table_replace(speed_profiles, key, profile);
+    }
+    fprintf(stderr,"speed profiles: %d ways\n", g_hash_table_size(speed_profiles));
+}
+
@@ -0,0 +1,569 @@
+/*
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Multi-level overlay of the routing graph
+ *
+ * The nodes of the routing graph (the end points of all streets) are partitioned into cells by recursive bisection
+ * of their coordinates. Cells are nested: each cell of level n+1 is made up of cells of level n, level 1 holding the
+ * smallest cells. A node is a boundary node of a cell if one of its edges leaves the cell. For each cell, the cost
+ * between each pair of its boundary nodes (its clique) is computed without leaving the cell, from the edges of the
+ * graph for cells of level 1 and from the cliques of the cells one level below for all others.
+ *
+ * Each cell is written as a {@code type_route_overlay_cell} item with its rectangle as coordinates. Cells of level 1
+ * also hold the edges which leave them (cut edges). As with the contraction hierarchy, costs are derived from a fixed
+ * speed for each street type and all streets are taken to be two-way. As these costs do not match those of any vehicle
+ * profile, navit recomputes the cliques of all cells from the costs of its vehicle profile before using the overlay,
+ * see route_overlay_customize() in route.c.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "maptool.h"
+#include "coord.h"
+#include "debug.h"
+
+#define OVERLAY_LEVELS 3
+
+/** Maximum number of nodes in a cell of each level */
+static int overlay_cell_size[OVERLAY_LEVELS]= {1<<11, 1<<14, 1<<17};
+
+/** Header of a cell, stored as {@code attr_overlay_cell} */
+struct overlay_cell_data {
+    int level;                  /**< Level of the cell, starting at 1 */
+    int id;                     /**< Number of the cell */
+    int parent;                 /**< Number of the enclosing cell one level up, -1 for the top level */
+    int boundary_count;         /**< Number of boundary nodes, stored as {@code attr_overlay_boundary} */
+    int cut_count;              /**< Number of cut edges, stored as {@code attr_overlay_cut} */
+};
+
+/** An edge leaving a cell of level 1, stored as {@code attr_overlay_cut} */
+struct overlay_cut {
+    int from;                   /**< Position of the node in the boundary of the cell */
+    struct coord to;            /**< The node in the other cell */
+    int weight;
+};
+
+struct overlay_edge {
+    int target;
+    int weight;
+};
+
+struct overlay_cell {
+    struct rect r;              /**< Area of the cell, including `l` but not `h` */
+    int level;                  /**< Level of the cell, starting at 0 */
+    int parent;
+    int start;                  /**< Position of the first node of the cell in `order` */
+    int count;                  /**< Number of nodes of the cell */
+    int *boundary;
+    int boundary_count;
+    int *clique;                /**< Cost from each boundary node (row) to each other one (column), INT_MAX if there
+                                 *   is no path within the cell */
+};
+
+struct overlay_graph {
+    int node_count;
+    struct coord *coord;
+    int *first_edge;            /**< The edges of node n are those from first_edge[n] to first_edge[n+1]-1 */
+    struct overlay_edge *edges;
+    int *order;                 /**< The nodes, ordered so that the nodes of each cell follow each other */
+    int *cell[OVERLAY_LEVELS];  /**< Cell of each level of each node */
+    int *pos[OVERLAY_LEVELS];   /**< Position of each node in the boundary of its cell of each level, or -1 */
+    struct overlay_cell *cells;
+    int cell_count;
+    int cell_size;
+};
+
+struct overlay_worker {
+    int number;
+    int level;
+    struct overlay_graph *graph;
+    int *dist;
+    int *touched;
+    int touched_count;
+    struct ch_heap heap;        /**< See ch_contract.c */
+    GThread *thread;
+};
+
+static int overlay_threads;
+
+static void overlay_coord_free(void *data) {
+    g_free(data);
+}
+
+static int overlay_get_node(GHashTable *hash, struct coord *c, struct coord **coords, int *count, int *size) {
+    int ret=GPOINTER_TO_INT(g_hash_table_lookup(hash, c));
+    if (!ret) {
+        struct coord *key=g_new(struct coord, 1);
+        if (*count == *size) {
+            *size=*size ? *size*2 : 65536;
+            *coords=g_renew(struct coord, *coords, *size);
+        }
+        *key=*c;
+        (*coords)[(*count)++]=*c;
+        ret=*count;
+        g_hash_table_insert(hash, key, GINT_TO_POINTER(ret));
+    }
+    return ret-1;
+}
+
+/**
+ * @brief Reads the streets of the map into an undirected graph
+ *
+ * Only the end points of each street become nodes, as in ch_generate_ddsg().
+ */
+static struct overlay_graph *overlay_graph_read(FILE *in) {
+    struct overlay_graph *g=g_new0(struct overlay_graph, 1);
+    GHashTable *hash=g_hash_table_new_full(coord_hash, coord_equal, overlay_coord_free, NULL);
+    struct item_bin *ib;
+    int *from=NULL,*to=NULL,*weight=NULL,*fill;
+    int i,count=0,size=0,node_size=0;
+
+    while ((ib=read_item(in))) {
+        int ccount=ib->clen/2;
+        struct coord *c=(struct coord *)(ib+1);
+        int n1,n2,speed=road_speed(ib->type);
+        double l=0;
+
+        if (!speed || ccount < 2)
+            continue;
+        n1=overlay_get_node(hash, &c[0], &g->coord, &g->node_count, &node_size);
+        n2=overlay_get_node(hash, &c[ccount-1], &g->coord, &g->node_count, &node_size);
+        if (n1 == n2)
+            continue;
+        for (i = 0 ; i < ccount-1 ; i++)
+            l+=sqrt(sq(c[i+1].x-c[i].x)+sq(c[i+1].y-c[i].y));
+        if (count == size) {
+            size=size ? size*2 : 65536;
+            from=g_renew(int, from, size);
+            to=g_renew(int, to, size);
+            weight=g_renew(int, weight, size);
+        }
+        from[count]=n1;
+        to[count]=n2;
+        weight[count]=l*36/speed;
+        count++;
+    }
+    g_hash_table_destroy(hash);
+    g->first_edge=g_new0(int, g->node_count+1);
+    g->edges=g_new(struct overlay_edge, count*2);
+    for (i = 0 ; i < count ; i++) {
+        g->first_edge[from[i]+1]++;
+        g->first_edge[to[i]+1]++;
+    }
+    for (i = 0 ; i < g->node_count ; i++)
+        g->first_edge[i+1]+=g->first_edge[i];
+    fill=g_new(int, g->node_count);
+    memcpy(fill, g->first_edge, g->node_count*sizeof(int));
+    for (i = 0 ; i < count ; i++) {
+        struct overlay_edge *e=&g->edges[fill[from[i]]++];
+        e->target=to[i];
+        e->weight=weight[i];
+        e=&g->edges[fill[to[i]]++];
+        e->target=from[i];
+        e->weight=weight[i];
+    }
+    g_free(fill);
+    g_free(from);
+    g_free(to);
+    g_free(weight);
+    fprintf(stderr,"overlay: %d nodes, %d edges\n", g->node_count, count);
+    return g;
+}
+
+static struct overlay_graph *overlay_sort_graph;
+static int overlay_sort_axis;
+
+static int overlay_value(struct coord *c, int axis) {
+    return axis ? c->y : c->x;
+}
+
+static int overlay_compare(const void *a, const void *b) {
+    int va=overlay_value(&overlay_sort_graph->coord[*(const int *)a], overlay_sort_axis);
+    int vb=overlay_value(&overlay_sort_graph->coord[*(const int *)b], overlay_sort_axis);
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+/**
+ * @brief Splits a range of `order` at a coordinate along one axis
+ *
+ * @return The number of nodes below the split coordinate, which is written to `split`, or 0 if all nodes share the
+ * same coordinate
+ */
+static int overlay_bisect(struct overlay_graph *g, int start, int count, int axis, int *split) {
+    int *order=g->order+start;
+    int i,m;
+
+    overlay_sort_graph=g;
+    overlay_sort_axis=axis;
+    qsort(order, count, sizeof(int), overlay_compare);
+    m=overlay_value(&g->coord[order[count/2]], axis);
+    for (i = 0 ; i < count && overlay_value(&g->coord[order[i]], axis) < m ; i++);
+    if (!i) {
+        while (i < count && overlay_value(&g->coord[order[i]], axis) == m)
+            i++;
+        if (i == count)
+            return 0;
+        m=overlay_value(&g->coord[order[i]], axis);
+    }
+    *split=m;
+    return i;
+}
+
+static void overlay_split(struct overlay_graph *g, int start, int count, struct rect *r, int level, int parent);
+
+static void overlay_add_cell(struct overlay_graph *g, int start, int count, struct rect *r, int level, int parent) {
+    struct overlay_cell *cell;
+    int i,id=g->cell_count;
+
+    if (g->cell_count == g->cell_size) {
+        g->cell_size=g->cell_size ? g->cell_size*2 : 256;
+        g->cells=g_renew(struct overlay_cell, g->cells, g->cell_size);
+    }
+    cell=&g->cells[g->cell_count++];
+    memset(cell, 0, sizeof(*cell));
+    cell->r=*r;
+    cell->level=level;
+    cell->parent=parent;
+    cell->start=start;
+    cell->count=count;
+    for (i = start ; i < start+count ; i++)
+        g->cell[level][g->order[i]]=id;
+    if (level)
+        overlay_split(g, start, count, r, level-1, id);
+}
+
+/**
+ * @brief Bisects a range of `order` until each part fits into a cell of a level
+ */
+static void overlay_split(struct overlay_graph *g, int start, int count, struct rect *r, int level, int parent) {
+    struct rect r1,r2;
+    int axis=0,split=0,left=0;
+
+    if (count > overlay_cell_size[level]) {
+        axis=(r->h.y-r->l.y > r->h.x-r->l.x);
+        left=overlay_bisect(g, start, count, axis, &split);
+        if (!left) {
+            axis=!axis;
+            left=overlay_bisect(g, start, count, axis, &split);
+        }
+    }
+    if (!left) {
+        overlay_add_cell(g, start, count, r, level, parent);
+        return;
+    }
+    r1=*r;
+    r2=*r;
+    if (axis) {
+        r1.h.y=split;
+        r2.l.y=split;
+    } else {
+        r1.h.x=split;
+        r2.l.x=split;
+    }
+    overlay_split(g, start, left, &r1, level, parent);
+    overlay_split(g, start+left, count-left, &r2, level, parent);
+}
+
+static void overlay_partition(struct overlay_graph *g) {
+    struct rect r;
+    int i,j,level;
+
+    g->order=g_new(int, g->node_count);
+    for (level = 0 ; level < OVERLAY_LEVELS ; level++) {
+        g->cell[level]=g_new(int, g->node_count);
+        g->pos[level]=g_new(int, g->node_count);
+    }
+    for (i = 0 ; i < g->node_count ; i++)
+        g->order[i]=i;
+    if (g->node_count) {
+        bbox(g->coord, g->node_count, &r);
+        r.h.x++;
+        r.h.y++;
+        overlay_split(g, 0, g->node_count, &r, OVERLAY_LEVELS-1, -1);
+    }
+    for (i = 0 ; i < g->cell_count ; i++) {
+        struct overlay_cell *cell=&g->cells[i];
+        int *cell_of=g->cell[cell->level];
+        for (j = cell->start ; j < cell->start+cell->count ; j++) {
+            int e,n=g->order[j];
+            g->pos[cell->level][n]=-1;
+            for (e = g->first_edge[n] ; e < g->first_edge[n+1] ; e++) {
+                if (cell_of[g->edges[e].target] != i) {
+                    cell->boundary=g_renew(int, cell->boundary, cell->boundary_count+1);
+                    g->pos[cell->level][n]=cell->boundary_count;
+                    cell->boundary[cell->boundary_count++]=n;
+                    break;
+                }
+            }
+        }
+    }
+    fprintf(stderr,"overlay: %d cells\n", g->cell_count);
+}
+
+static void overlay_relax(struct overlay_worker *w, int node, int dist) {
+    if (dist >= w->dist[node])
+        return;
+    if (w->dist[node] == INT_MAX)
+        w->touched[w->touched_count++]=node;
+    w->dist[node]=dist;
+    ch_heap_push(&w->heap, dist, node);
+}
+
+/**
+ * @brief Computes the cost from a boundary node of a cell to all nodes of the cell
+ *
+ * On level 0 the edges within the cell are followed. On higher levels, the search moves between the boundary nodes of
+ * the cells one level below, following their cliques and the edges between them.
+ */
+static void overlay_search(struct overlay_worker *w, int id, int source) {
+    struct overlay_graph *g=w->graph;
+    int level=g->cells[id].level;
+
+    overlay_relax(w, source, 0);
+    while (w->heap.count) {
+        struct ch_heap_entry top=ch_heap_pop(&w->heap);
+        int e,u=top.node;
+        if (top.dist > w->dist[u])
+            continue;
+        if (level) {
+            struct overlay_cell *sub=&g->cells[g->cell[level-1][u]];
+            int j,*row=sub->clique+g->pos[level-1][u]*sub->boundary_count;
+            for (j = 0 ; j < sub->boundary_count ; j++) {
+                if (row[j] != INT_MAX)
+                    overlay_relax(w, sub->boundary[j], top.dist+row[j]);
+            }
+        }
+        for (e = g->first_edge[u] ; e < g->first_edge[u+1] ; e++) {
+            int t=g->edges[e].target;
+            if (g->cell[level][t] != id || (level && g->cell[level-1][t] == g->cell[level-1][u]))
+                continue;
+            overlay_relax(w, t, top.dist+g->edges[e].weight);
+        }
+    }
+}
+
+static void overlay_customize_cell(struct overlay_worker *w, int id) {
+    struct overlay_cell *cell=&w->graph->cells[id];
+    int i,j,b=cell->boundary_count;
+
+    cell->clique=g_new(int, b*b);
+    for (i = 0 ; i < b ; i++) {
+        overlay_search(w, id, cell->boundary[i]);
+        for (j = 0 ; j < b ; j++)
+            cell->clique[i*b+j]=w->dist[cell->boundary[j]];
+        for (j = 0 ; j < w->touched_count ; j++)
+            w->dist[w->touched[j]]=INT_MAX;
+        w->touched_count=0;
+    }
+}
+
+static gpointer overlay_worker_thread(gpointer data) {
+    struct overlay_worker *w=data;
+    struct overlay_graph *g=w->graph;
+    int i,count=0;
+
+    for (i = 0 ; i < g->cell_count ; i++) {
+        if (g->cells[i].level == w->level && count++ % overlay_threads == w->number)
+            overlay_customize_cell(w, i);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Computes the cliques of all cells, level by level
+ */
+static void overlay_customize(struct overlay_graph *g) {
+    struct overlay_worker *workers;
+    int i,j,level;
+
+    overlay_threads=thread_count > 0 ? thread_count : 1;
+    workers=g_new0(struct overlay_worker, overlay_threads);
+    for (i = 0 ; i < overlay_threads ; i++) {
+        workers[i].number=i;
+        workers[i].graph=g;
+        workers[i].dist=g_new(int, g->node_count);
+        workers[i].touched=g_new(int, g->node_count);
+        for (j = 0 ; j < g->node_count ; j++)
+            workers[i].dist[j]=INT_MAX;
+    }
+    for (level = 0 ; level < OVERLAY_LEVELS ; level++) {
+        for (i = 0 ; i < overlay_threads ; i++) {
+            workers[i].level=level;
+            workers[i].thread=g_thread_new("overlay_worker", overlay_worker_thread, &workers[i]);
+        }
+        for (i = 0 ; i < overlay_threads ; i++)
+            g_thread_join(workers[i].thread);
+        fprintf(stderr,"overlay: level %d customized\n", level+1);
+    }
+    for (i = 0 ; i < overlay_threads ; i++) {
+        g_free(workers[i].dist);
+        g_free(workers[i].touched);
+        g_free(workers[i].heap.entry);
+    }
+    g_free(workers);
+}
+
+static void overlay_write(struct overlay_graph *g, FILE *out) {
+    int i,j,k;
+
+    for (i = 0 ; i < g->cell_count ; i++) {
+        struct overlay_cell *cell=&g->cells[i];
+        struct overlay_cell_data data;
+        struct overlay_cut *cuts=NULL;
+        struct coord *boundary=g_new(struct coord, cell->boundary_count);
+        struct item_bin *ib;
+        int b=cell->boundary_count;
+
+        data.level=cell->level+1;
+        data.id=i;
+        data.parent=cell->parent;
+        data.boundary_count=b;
+        data.cut_count=0;
+        for (j = 0 ; j < b ; j++) {
+            int n=cell->boundary[j];
+            boundary[j]=g->coord[n];
+            for (k = g->first_edge[n] ; !cell->level && k < g->first_edge[n+1] ; k++) {
+                struct overlay_edge *e=&g->edges[k];
+                if (g->cell[0][e->target] == i)
+                    continue;
+                cuts=g_renew(struct overlay_cut, cuts, data.cut_count+1);
+                cuts[data.cut_count].from=j;
+                cuts[data.cut_count].to=g->coord[e->target];
+                cuts[data.cut_count].weight=e->weight;
+                data.cut_count++;
+            }
+        }
+        if (((long long)b*b+b*2+data.cut_count*4)*4 > 16000000) {
+            fprintf(stderr,"overlay: cell %d has too many boundary nodes (%d)\n", i, b);
+            exit(1);
+        }
+        ib=init_item(type_route_overlay_cell);
+        item_bin_add_coord_rect(ib, &cell->r);
+        item_bin_add_attr_data(ib, attr_overlay_cell, &data, sizeof(data));
+        if (b) {
+            item_bin_add_attr_data(ib, attr_overlay_boundary, boundary, b*sizeof(struct coord));
+            item_bin_add_attr_data(ib, attr_overlay_clique, cell->clique, b*b*sizeof(int));
+        }
+        if (data.cut_count)
+            item_bin_add_attr_data(ib, attr_overlay_cut, cuts, data.cut_count*sizeof(struct overlay_cut));
+        item_bin_write(ib, out);
+        g_free(boundary);
+        g_free(cuts);
+    }
+}
+
+static void overlay_graph_destroy(struct overlay_graph *g) {
+    int i;
+
+    for (i = 0 ; i < g->cell_count ; i++) {
+        g_free(g->cells[i].boundary);
+        g_free(g->cells[i].clique);
+    }
+    for (i = 0 ; i < OVERLAY_LEVELS ; i++) {
+        g_free(g->cell[i]);
+        g_free(g->pos[i]);
+    }
+    g_free(g->cells);
+    g_free(g->order);
+    g_free(g->edges);
+    g_free(g->first_edge);
+    g_free(g->coord);
+    g_free(g);
+}
+
+/**
+ * @brief Writes all cells into the top level tile, as they are read all at once
+ */
+static void overlay_copy_to_tiles(char *suffix, struct tile_info *info) {
+    struct item_bin *ib;
+    FILE *f=tempfile(suffix, "overlay", 0);
+
+    while ((ib=read_item(f)))
+        tile_write_item_minmax(info, ib, NULL, 0, 0);
+    fclose(f);
+}
+
+void overlay_generate_tiles(char *map_suffix, char *suffix, FILE *tilesdir_out, struct zip_info *zip_info) {
+    struct tile_info info;
+    struct overlay_graph *g;
+    FILE *in,*out;
+
+    info.write=0;
+    info.maxlen=0;
+    info.suffix=suffix;
+    info.tiles_list=NULL;
+    info.tilesdir_out=tilesdir_out;
+
+    in=tempfile(map_suffix,"ways_split",0);
+    g=overlay_graph_read(in);
+    fclose(in);
+    overlay_partition(g);
+    overlay_customize(g);
+    out=tempfile(suffix,"overlay",1);
+    overlay_write(g, out);
+    fclose(out);
+    overlay_graph_destroy(g);
+
+    tile_hash=g_hash_table_new(g_str_hash, g_str_equal);
+    overlay_copy_to_tiles(suffix, &info);
+    merge_tiles(&info);
+
+    write_tilesdir(&info, zip_info, tilesdir_out);
+}
+
+void overlay_assemble_map(char *map_suffix, char *suffix, struct zip_info *zip_info) {
+    struct tile_info info;
+    struct tile_head *th;
+
+    info.write=1;
+    info.maxlen=zip_get_maxnamelen(zip_info);
+    info.suffix=suffix;
+    info.tiles_list=NULL;
+    info.tilesdir_out=NULL;
+
+    create_tile_hash();
+
+    th=tile_head_root;
+    while (th) {
+        th->zip_data=g_malloc(th->total_size);
+        th->total_size_used=0;
+        th->process=1;
+        th=th->next;
+    }
+    overlay_copy_to_tiles(suffix, &info);
+    write_tilesdir(&info, zip_info, NULL);
+
+    th=tile_head_root;
+    while (th) {
+        if (th->name[0]) {
+            if (th->total_size != th->total_size_used) {
+                fprintf(stderr,"Size error '%s': %d vs %d\n", th->name, th->total_size, th->total_size_used);
+                exit(1);
+            }
+            write_zipmember(zip_info, th->name, zip_get_maxnamelen(zip_info), th->zip_data, th->total_size);
+        } else {
+            fwrite(th->zip_data, th->total_size, 1, zip_get_index(zip_info));
+        }
+        g_free(th->zip_data);
+        th=th->next;
+    }
+}
@@ -24,12 +24,16 @@
 #include "maptool.h"
 #include "config.h"
 #include "zipfile.h"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 struct zip_info {
     int zipnum;
     int dir_size;
     long long offset;
     int compression_level;
+    int compression_method;
     int maxnamelen;
     int zip64;
     short date;
@@ -120,19 +124,41 @@ void write_zipmember(struct zip_info *zip_info, char *name, int filelen, char *d
     uLongf destlen=data_size+data_size/500+12;
     char *compbuffer;
 
+#ifdef HAVE_ZSTD
+    if (zip_info->compression_method == zip_method_zstd)
+        destlen=ZSTD_compressBound(data_size);
+#endif
     compbuffer = g_malloc(destlen);
     crc=crc32(0, NULL, 0);
     crc=crc32(crc, (unsigned char *)data, data_size);
-    lfh.zipmthd=zip_info->compression_level ? 8:0;
+    lfh.zipmthd=zip_info->compression_level ? zip_info->compression_method:zip_method_stored;
+#ifdef HAVE_ZSTD
+    if (lfh.zipmthd == zip_method_zstd) {
+        size_t ret=ZSTD_compress(compbuffer, destlen, data, data_size, zip_info->compression_level);
+        if (!ZSTD_isError(ret)) {
+            if (ret < data_size) {
+                data=compbuffer;
+                comp_size=ret;
+                /* Zstandard members need version 6.3 of the ZIP specification */
+                lfh.zipver=63;
+                cd.zipcvxt=63;
+            } else
+                lfh.zipmthd=zip_method_stored;
+        } else {
+            fprintf(stderr,"ZSTD_compress failed: %s\n", ZSTD_getErrorName(ret));
+            lfh.zipmthd=zip_method_stored;
+        }
+    }
+#endif
 #ifdef HAVE_ZLIB
-    if (zip_info->compression_level) {
+    if (lfh.zipmthd == zip_method_deflate) {
         int error=compress2_int((Byte *)compbuffer, &destlen, (Bytef *)data, data_size, zip_info->compression_level);
         if (error == Z_OK) {
             if (destlen < data_size) {
                 data=compbuffer;
                 comp_size=destlen;
             } else
-                lfh.zipmthd=0;
+                lfh.zipmthd=zip_method_stored;
         } else {
             fprintf(stderr,"compress2 returned %d\n", error);
         }
@@ -189,6 +215,123 @@ int zip_write_index(struct zip_info *info) {
     return 0;
 }
 
+struct zip_tiledir_node {
+    char *name;
+    int zipfile;
+    int depth;
+    int order;
+};
+
+static struct zip_tiledir_node *zip_tiledir_node(GHashTable *nodes, char *name, int len) {
+    struct zip_tiledir_node *node;
+    char *key=g_strndup(name, len);
+
+    node=g_hash_table_lookup(nodes, key);
+    if (node) {
+        g_free(key);
+        return node;
+    }
+    node=g_new0(struct zip_tiledir_node, 1);
+    node->name=key;
+    node->zipfile=-1;
+    node->depth=tile_len(key);
+    node->order=node->depth > 4 ? node->depth-4 : 0;
+    g_hash_table_insert(nodes, key, node);
+    return node;
+}
+
+static gint zip_tiledir_node_cmp(gconstpointer a, gconstpointer b) {
+    return strcmp(((const struct zip_tiledir_node *)a)->name, ((const struct zip_tiledir_node *)b)->name);
+}
+
+/**
+ * @brief Writes the tile directory member, see {@code struct zip_tiledir}
+ *
+ * The directory is built from the members written so far. Members named after a tile are listed with the minimum
+ * order of the tile, members whose name only starts with a tile name (like the parts of the country indexes) are
+ * listed inside of that tile with order 255, so only selections for downloading maps find them.
+ * Must be called just before {@code zip_write_index()}.
+ */
+int zip_write_tiledir(struct zip_info *info) {
+    GHashTable *nodes=g_hash_table_new(g_str_hash, g_str_equal);
+    GList *list=NULL,*l;
+    struct zip_tiledir_node *node;
+    struct zip_tiledir *tiledir;
+    struct zip_tiledir_entry *entry;
+    struct zip_cd *cd;
+    struct rect r;
+    char *dir,*name;
+    int pos=0,zipfile=0,count,depth,len,size,i,sp=0,*stack;
+
+    dir=g_malloc(info->dir_size);
+    fseek(info->dir, 0, SEEK_SET);
+    if (info->dir_size && fread(dir, info->dir_size, 1, info->dir) != 1) {
+        dbg(lvl_warning, "fread failed");
+        g_free(dir);
+        fseek(info->dir, 0, SEEK_END);
+        return 1;
+    }
+    fseek(info->dir, 0, SEEK_END);
+    while (pos+(int)sizeof(*cd) <= info->dir_size) {
+        cd=(struct zip_cd *)(dir+pos);
+        name=(char *)(cd+1);
+        for (depth = 0 ; depth < cd->zipcfnl && name[depth] >= 'a' && name[depth] <= 'd' ; depth++);
+        for (len = cd->zipcfnl ; len > depth && name[len-1] == '_' ; len--);
+        if (depth) {
+            for (i = 1 ; i < depth ; i++)
+                zip_tiledir_node(nodes, name, i);
+            node=zip_tiledir_node(nodes, name, depth);
+            if (len > depth) {
+                node=zip_tiledir_node(nodes, name, len);
+                node->depth=depth+1;
+                node->order=255;
+            }
+            node->zipfile=zipfile;
+        }
+        pos+=sizeof(*cd)+cd->zipcfnl+cd->zipcxtl+cd->zipccml;
+        zipfile++;
+    }
+    g_free(dir);
+
+    count=g_hash_table_size(nodes);
+    size=sizeof(*tiledir)+count*sizeof(*entry);
+    tiledir=g_malloc(size);
+    tiledir->ziptdsig=zip_tiledir_sig;
+    tiledir->ziptdver=zip_tiledir_version;
+    tiledir->ziptdnum=count;
+    entry=(struct zip_tiledir_entry *)(tiledir+1);
+    stack=g_new(int, count);
+    list=g_hash_table_get_values(nodes);
+    list=g_list_sort(list, zip_tiledir_node_cmp);
+    for (l = list, i = 0 ; l ; l = g_list_next(l), i++) {
+        node=l->data;
+        while (sp && entry[stack[sp-1]].ziptddepth >= node->depth)
+            entry[stack[--sp]].ziptdnext=i;
+        stack[sp++]=i;
+        name=g_strndup(node->name, tile_len(node->name));
+        tile_bbox(name, &r, overlap);
+        g_free(name);
+        entry[i].ziptdlx=r.l.x;
+        entry[i].ziptdly=r.l.y;
+        entry[i].ziptdhx=r.h.x;
+        entry[i].ziptdhy=r.h.y;
+        entry[i].ziptdfile=node->zipfile;
+        entry[i].ziptddepth=node->depth;
+        entry[i].ziptdorder=node->order;
+        g_free(node->name);
+        g_free(node);
+    }
+    while (sp)
+        entry[stack[--sp]].ziptdnext=count;
+    g_free(stack);
+    g_list_free(list);
+    g_hash_table_destroy(nodes);
+    write_zipmember(info, zip_tiledir_name, zip_get_maxnamelen(info), (char *)tiledir, size);
+    info->zipnum++;
+    g_free(tiledir);
+    return 0;
+}
+
 static void zip_write_file_data(struct zip_info *info, FILE *in) {
     size_t size;
     char buffer[4096];
@@ -262,7 +405,9 @@ int zip_write_directory(struct zip_info *info) {
 
 struct zip_info *
 zip_new(void) {
-    return g_new0(struct zip_info, 1);
+    struct zip_info *info=g_new0(struct zip_info, 1);
+    info->compression_method=zip_method_deflate;
+    return info;
 }
 
 void zip_set_zip64(struct zip_info *info, int on) {
@@ -273,6 +418,10 @@ void zip_set_compression_level(struct zip_info *info, int level) {
     info->compression_level=level;
 }
 
+void zip_set_compression_method(struct zip_info *info, int method) {
+    info->compression_method=method;
+}
+
 void zip_set_maxnamelen(struct zip_info *info, int max) {
     info->maxnamelen=max;
 }
@@ -1287,6 +1287,164 @@ static int navit_cmd_route_remove_last_waypoint(struct navit *this, char *functi
 }
 
 
+/**
+ * Parses a list of coordinates separated by semicolons
+ *
+ * @param this The navit instance, whose projection is used
+ * @param str The coordinates
+ * @param count Receives the number of coordinates
+ * @returns The coordinates, or NULL if one of them is invalid
+ */
+static struct pcoord *navit_parse_coord_list(struct navit *this, char *str, int *count) {
+    char **coords=g_strsplit(str, ";", 0);
+    struct pcoord *ret;
+    int i;
+
+    *count=g_strv_length(coords);
+    ret=g_new(struct pcoord, *count);
+    for (i = 0 ; i < *count ; i++) {
+        if (!pcoord_parse(coords[i], transform_get_projection(this->trans), &ret[i])) {
+            dbg(lvl_error,"invalid coordinate '%s'", coords[i]);
+            g_free(ret);
+            ret=NULL;
+            break;
+        }
+    }
+    g_strfreev(coords);
+    return ret;
+}
+
+/**
+ * Calculates travel times and distances between several origins and destinations
+ *
+ * @param navit The navit instance
+ * @param function unused (needed to match command function signature)
+ * @param in input attributes in[0] - origins, in[1] - destinations, each a string of coordinates separated by
+ * semicolons
+ * @param out output attribute, a string with one line per origin, holding `seconds,meters` for each destination
+ * separated by spaces, -1 if the destination cannot be reached
+ * @returns 0
+ */
+static int navit_cmd_route_travel_matrix(struct navit *this, char *function, struct attr **in, struct attr ***out) {
+    struct pcoord *origins=NULL,*destinations=NULL;
+    int origin_count,destination_count,*times,*lengths,i,j;
+    struct attr attr;
+    char *ret,*pos;
+
+    if (!this->route || !in || !in[0] || !in[1] || !ATTR_IS_STRING(in[0]->type) || !ATTR_IS_STRING(in[1]->type)) {
+        dbg(lvl_error,"usage: route_travel_matrix(\"origins\",\"destinations\")");
+        return 0;
+    }
+    origins=navit_parse_coord_list(this, in[0]->u.str, &origin_count);
+    destinations=navit_parse_coord_list(this, in[1]->u.str, &destination_count);
+    if (!origins || !destinations) {
+        g_free(origins);
+        g_free(destinations);
+        return 0;
+    }
+    times=g_new(int, origin_count*destination_count);
+    lengths=g_new(int, origin_count*destination_count);
+    if (route_get_travel_matrix(this->route, origins, origin_count, destinations, destination_count, times, lengths)) {
+        /* at most 11 characters for each number, a comma and a separator for each pair */
+        pos=ret=g_malloc(origin_count*(destination_count*24+1)+1);
+        *pos='\0';
+        for (i = 0 ; i < origin_count ; i++) {
+            for (j = 0 ; j < destination_count ; j++)
+                pos+=sprintf(pos, "%s%d,%d", j ? " " : "", times[i*destination_count+j], lengths[i*destination_count+j]);
+            *pos++='\n';
+            *pos='\0';
+        }
+        attr.type=attr_type_string_begin;
+        attr.u.str=ret;
+        if (out)
+            *out=attr_generic_add_attr(*out, &attr);
+        g_free(ret);
+    }
+    g_free(times);
+    g_free(lengths);
+    g_free(origins);
+    g_free(destinations);
+    return 0;
+}
+
+/**
+ * @brief Returns the description under which an itinerary was stored as a former destination
+ *
+ * Like bookmarks_append_destinations(), this tells itineraries apart by their final destination.
+ *
+ * @param this_ The navit instance
+ * @param pc The destinations of the itinerary
+ * @param count Number of destinations
+ * @return The description, which must be freed with g_free(), or NULL if the itinerary was not stored
+ */
+static char *navit_get_itinerary_description(struct navit *this_, struct pcoord *pc, int count) {
+    struct map_rect *mr;
+    struct item *item;
+    struct attr attr;
+    struct coord c,last;
+    char *label,*ret=NULL;
+    int found;
+
+    if (!this_->former_destination || !count || !(mr=map_rect_new(this_->former_destination, NULL)))
+        return NULL;
+    c.x=pc[count-1].x;
+    c.y=pc[count-1].y;
+    transform_from_to(&c, pc[count-1].pro, &last, map_projection(this_->former_destination));
+    while ((item=map_rect_get_item(mr))) {
+        if (item->type != type_former_itinerary && item->type != type_former_itinerary_part)
+            continue;
+        label=item_attr_get(item, attr_label, &attr) ? attr.u.str : NULL;
+        found=0;
+        while (item_coord_get(item, &c, 1))
+            found=1;
+        if (found && label && coord_equal(&c, &last)) {
+            g_free(ret);
+            ret=g_strdup(label);
+        }
+    }
+    map_rect_destroy(mr);
+    return ret;
+}
+
+/**
+ * Reorders the destinations of the route so that visiting all of them takes the least time, and routes along them
+ *
+ * @param navit The navit instance
+ * @param function unused (needed to match command function signature)
+ * @param in input attributes in[0] - (optional) nonzero to keep the final destination last, in[1] - (optional) time in
+ * milliseconds allowed for improving the order
+ * @param out output attribute, 0 if the order could not be optimized, else 1
+ * @returns 0
+ */
+static int navit_cmd_route_optimize_destinations(struct navit *this, char *function, struct attr **in,
+        struct attr ***out) {
+    struct pcoord *pc;
+    struct attr attr;
+    char *description;
+    int count,keep_last=0,budget=1000;
+
+    if (in && in[0] && ATTR_IS_INT(in[0]->type)) {
+        keep_last=in[0]->u.num;
+        if (in[1] && ATTR_IS_INT(in[1]->type))
+            budget=in[1]->u.num;
+    }
+    count=navit_get_destination_count(this);
+    pc=g_new(struct pcoord, count+1);
+    count=navit_get_destinations(this, pc, count);
+    /* the reordered itinerary replaces the current one in the former destinations, keep its description */
+    description=navit_get_itinerary_description(this, pc, count);
+    attr.type=attr_type_int_begin;
+    attr.u.num=count > 1 && route_optimize_destinations(this->route, pc, count, keep_last, budget);
+    if (attr.u.num)
+        navit_set_destinations(this, pc, count, description, 1);
+    g_free(description);
+    if (out)
+        *out=attr_generic_add_attr(*out, &attr);
+    g_free(pc);
+    return 0;
+}
+
+
 static int navit_cmd_set_center(struct navit *this, char *function, struct attr **in, struct attr ***out) {
     struct pcoord pc;
     int set_timeout=0;
@@ -1425,6 +1583,8 @@ static struct command_table commands[] = {
     {"set_position",command_cast(navit_cmd_set_position)},
     {"route_remove_next_waypoint",command_cast(navit_cmd_route_remove_next_waypoint)},
     {"route_remove_last_waypoint",command_cast(navit_cmd_route_remove_last_waypoint)},
+    {"route_travel_matrix",command_cast(navit_cmd_route_travel_matrix)},
+    {"route_optimize_destinations",command_cast(navit_cmd_route_optimize_destinations)},
     {"set_position",command_cast(navit_cmd_set_position)},
     {"announcer_toggle",command_cast(navit_cmd_announcer_toggle)},
     {"fmt_coordinates",command_cast(navit_cmd_fmt_coordinates)},
@@ -2140,6 +2300,24 @@ int navit_init(struct navit *this_) {
                 mapset_add_attr(ms, &map_a);
                 map_set_attr(map, &active);
             }
+            if ((map=route_get_alternatives_map(this_->route))) {
+                struct attr map_a,active;
+                map_a.type=attr_map;
+                map_a.u.map=map;
+                active.type=attr_active;
+                active.u.num=0;
+                mapset_add_attr(ms, &map_a);
+                map_set_attr(map, &active);
+            }
+            if ((map=route_get_isochrone_map(this_->route))) {
+                struct attr map_a,active;
+                map_a.type=attr_map;
+                map_a.u.map=map;
+                active.type=attr_active;
+                active.u.num=0;
+                mapset_add_attr(ms, &map_a);
+                map_set_attr(map, &active);
+            }
             route_set_mapset(this_->route, ms);
             route_set_projection(this_->route, transform_get_projection(this_->trans));
         }
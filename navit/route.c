@@ -50,8 +50,10 @@
  * introduced, as it became necessary to do fast partial recalculations of the route when the traffic situation
  * changes. Navit’s LPA* implementation differs from the canonical implementation in two important ways:
  *
- * \li The heuristic is not used (or assumed to be zero), for the reasons discussed above. However, this is not set in
- * stone and can be revisited if we find using a heuristic provides a true benefit.
+ * \li By default the heuristic is not used (or assumed to be zero), for the reasons discussed above. Setting the
+ * `route_heuristic` attribute of the vehicle profile enables it, see `route_graph_set_start()`. The number of points
+ * expanded is available as the `route_expanded_points` attribute of the route, and the number of points expanded
+ * without the heuristic as `route_expanded_points_dijkstra`, in order to compare both modes.
  * \li Since the destination point may be off-road, Navit may initialize the route graph with multiple candidates for
  * the destination point, each of which will get a nonzero cost (which may still decrease if routing later determines
  * that it is cheaper to route from that candidate point to a different candidate point).
@@ -83,8 +85,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
 #include "navit_nls.h"
 #include "glib_slice.h"
 #include "config.h"
@@ -102,13 +109,16 @@
 #include "track.h"
 #include "transform.h"
 #include "plugin.h"
-#include "fib.h"
+#include "route_heap.h"
+#include "thread.h"
 #include "event.h"
 #include "callback.h"
 #include "vehicle.h"
 #include "vehicleprofile.h"
 #include "roadprofile.h"
+#include "file.h"
 #include "debug.h"
+#include "util.h"
 
 struct map_priv {
     struct route *route;
@@ -121,6 +131,12 @@ int debug_route=0;
 #define RSD_SIZE_WEIGHT(x) *((struct size_weight_limit *)route_segment_data_field_pos((x), attr_vehicle_width))
 #define RSD_DANGEROUS_GOODS(x) *((int *)route_segment_data_field_pos((x), attr_vehicle_dangerous_goods))
 
+#define ROUTE_WEEK (7*24*60*60)         /**< Length of the period covered by speed profiles, in seconds */
+#define ROUTE_ARRIVAL_SPEED 40          /**< Average speed in km/h along the straight line to the destination from
+                                         *   which the arrival is estimated before the route is known */
+#define ROUTE_ARRIVAL_TOLERANCE 600     /**< Difference in seconds between the estimated and the calculated travel
+                                         *   time above which a time-dependent route is calculated again */
+
 
 /**
  * @brief A traffic distortion
@@ -184,6 +200,8 @@ struct route_path {
     int update_required;					/**< The path needs to be updated after it is no longer in use */
     int updated;						/**< The path has only been updated */
     int path_time;						/**< Time to pass the path */
+    int path_delay;						/**< Extra time to pass the path due to historic speeds, see
+												 *  route_graph_speed_delay() */
     int path_len;						/**< Length of the path */
     struct route_path_segment *path;			/**< The first segment in the path, i.e. the segment one should
 												 *  drive in next */
@@ -193,6 +211,16 @@ struct route_path {
     struct route_path *next;				/**< Next route path in case of intermediate destinations */
 };
 
+/**
+ * @brief Phases of a route calculation, see route_timing()
+ */
+enum route_timing_phase {
+    route_timing_none,          /**< No route calculation in progress */
+    route_timing_graph,         /**< Building the route graph */
+    route_timing_flood,         /**< Flooding the route graph */
+    route_timing_path,          /**< Building the route path */
+};
+
 /**
  * @brief A complete route
  *
@@ -211,6 +239,17 @@ struct route {
     struct route_path *path2;	/**< Pointer to the route path */
     struct map *map;            /**< The map containing the route path */
     struct map *graph_map;      /**< The map containing the route graph */
+    struct map *isochrone_map;  /**< The map containing the isochrone, see route_get_isochrone_map() */
+    int isochrone_time;         /**< Travel time to the destination in seconds up to which points are part of the
+                                 *   isochrone */
+    int alternatives;           /**< Maximum number of alternative routes to calculate, 0 to disable them */
+    struct route_path *alternative_paths; /**< Alternative routes to the next destination, linked through
+                                           *   `next` */
+    struct map *alternatives_map; /**< The map containing the alternative routes */
+    int graph_coarse;           /**< The graph is being built from the coarse selection, see
+                                 *   route_graph_add_corridor() */
+    char *graph_snapshot;       /**< File to which the route graph is saved, see route_graph_snapshot_save() */
+    int graph_snapshot_save;    /**< The graph is being built from the maps and is to be saved when done */
     struct callback * route_graph_done_cb ; /**< Callback when route graph is done */
     struct callback * route_graph_flood_done_cb ; /**< Callback when route graph flooding is done */
     struct callback_list *cbl2;	/**< Callback list to call when route changes */
@@ -218,11 +257,40 @@ struct route {
     struct vehicleprofile *vehicleprofile; /**< Routing preferences */
     int route_status;		/**< Route Status */
     int link_path;			/**< Link paths over multiple waypoints together */
+    int ch_failed;			/**< No path could be found in the last graph built from the contraction hierarchy or
+                                 *   the overlay */
+    int traffic_active;		/**< Whether a traffic map reports traffic distortions, -1 if unknown, see
+                                 *   route_ch_traffic_active() */
+    struct route_overlay *overlay;	/**< The overlay of the map of the current position, see route_overlay_selection() */
+    long timing[3];			/**< Time spent in each phase of the last route calculation in microseconds, see
+                                 *   route_timing() */
+    enum route_timing_phase timing_phase; /**< Phase of the route calculation currently being timed */
+    struct timeval timing_start;	/**< Start of the current phase */
+    int arrival_estimate;		/**< Travel time in seconds from which the arrival for time-dependent costs has been
+                                 *   estimated, -1 once it has been corrected, see route_graph_set_arrival() */
     struct pcoord pc;
     struct vehicle *v;
 };
 
-#define HASHCOORD(c) ((((c)->x +(c)->y) * 2654435761UL) & (HASH_SIZE-1))
+#define HASHCOORD(c,size) ((((c)->x +(c)->y) * 2654435761UL) & ((size)-1))
+
+/**
+ * @brief State of the A* heuristic of a route graph
+ *
+ * The heuristic of a point is the straight-line distance from the point to `c`, traveled at `speed`. This never
+ * overestimates the cost from the point to the start of the route. `c` stays fixed while the graph is flooded. If
+ * the start moves away from it, keys in the heap may overestimate by up to `shift`, which is therefore subtracted
+ * from the keys before comparing them with the cost of the start.
+ */
+struct route_graph_heuristic {
+    int speed;                              /**< Fastest speed of the vehicle in km/h */
+    enum projection pro;                    /**< Projection of the coordinates of the graph */
+    struct coord c;                         /**< The position of the start when flooding began */
+    int shift;                              /**< Heuristic cost between `c` and the current start */
+    int count;                              /**< Number of candidate points for the start */
+    struct route_graph_point **p;           /**< Candidate points from which the start can be reached */
+    int *cost;                              /**< Cost from each candidate to the start */
+};
 
 /**
  * @brief Iterator to iterate through all route graph segments in a route graph point
@@ -262,6 +330,19 @@ static int route_value_seg(struct vehicleprofile *profile, struct route_graph_po
                            int dir);
 static void route_graph_init(struct route_graph *this, struct route_info *dst, struct vehicleprofile *profile);
 static void route_graph_reset(struct route_graph *this);
+static void route_graph_set_arrival(struct route *this, int duration);
+static int route_graph_restart_time_dependent(struct route *this);
+static int route_graph_build_thread_running(struct route_graph *graph);
+static void route_graph_set_start(struct route_graph *this, struct route_info *pos, struct vehicleprofile *profile,
+                                  int reset);
+static int route_graph_segment_match(struct route_graph_segment *s1, struct route_graph_segment *s2);
+static int route_value_add(int val1, int val2);
+static void route_alternatives_update(struct route *this, int recalculate);
+static int route_graph_extend(struct route *this);
+static void route_overlay_destroy(struct route_overlay *this);
+static void route_overlay_invalidate(struct route_overlay *this, struct item *item);
+static struct map_selection *route_overlay_selection(struct route *this, int async);
+static int route_overlay_extend(struct route *this);
 
 
 /**
@@ -422,7 +503,16 @@ route_new(struct attr *parent, struct attr **attrs) {
     } else {
         this->destination_distance = 50; // Default value
     }
+    if (attr_generic_get_attr(attrs, NULL, attr_isochrone_time, &dest_attr, NULL))
+        this->isochrone_time = dest_attr.u.num;
+    else
+        this->isochrone_time = 900;
+    if (attr_generic_get_attr(attrs, NULL, attr_route_alternatives, &dest_attr, NULL))
+        this->alternatives = dest_attr.u.num;
+    if (attr_generic_get_attr(attrs, NULL, attr_route_graph_snapshot, &dest_attr, NULL))
+        this->graph_snapshot = g_strdup(dest_attr.u.str);
     this->cbl2=callback_list_new();
+    this->traffic_active=-1;
 
     return this;
 }
@@ -440,9 +530,13 @@ route_dup(struct route *orig) {
     navit_object_ref((struct navit_object *)this);
     this->cbl2=callback_list_new();
     this->destination_distance=orig->destination_distance;
+    this->isochrone_time=orig->isochrone_time;
+    this->alternatives=orig->alternatives;
+    this->graph_snapshot=g_strdup(orig->graph_snapshot);
     this->ms=orig->ms;
     this->flags=orig->flags;
     this->vehicleprofile=orig->vehicleprofile;
+    this->traffic_active=-1;
 
     return this;
 }
@@ -529,6 +623,7 @@ static int route_check_roundabout(struct route_graph_segment *seg, int level, in
  */
 void route_set_mapset(struct route *this, struct mapset *ms) {
     this->ms=ms;
+    this->traffic_active=-1;
 }
 
 /**
@@ -690,6 +785,49 @@ static struct route_info *route_previous_destination(struct route *this) {
     return l->data;
 }
 
+/**
+ * @brief Sets the total time and length of a route path from its segments
+ *
+ * @param this The route path
+ * @param profile The vehicle profile
+ */
+static void route_path_set_totals(struct route_path *this, struct vehicleprofile *profile) {
+    struct route_path_segment *seg=this->path;
+    int path_time=0,path_len=0;
+    while (seg) {
+        /* FIXME */
+        int seg_time=route_time_seg(profile, seg->data, NULL);
+        if (seg_time == INT_MAX) {
+            dbg(lvl_debug,"error");
+        } else
+            path_time+=seg_time;
+        path_len+=seg->data->len;
+        seg=seg->next;
+    }
+    this->path_time=path_time+this->path_delay;
+    this->path_len=path_len;
+}
+
+/**
+ * @brief Switches the phase of the route calculation which is being timed
+ *
+ * The time since the last switch is added to the previous phase. The times are available as the `route_time_graph`,
+ * `route_time_flood` and `route_time_path` attributes of the route.
+ *
+ * @param this The route
+ * @param phase The new phase, {@code route_timing_none} to stop timing
+ */
+static void route_timing(struct route *this, enum route_timing_phase phase) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    if (this->timing_phase != route_timing_none)
+        this->timing[this->timing_phase-1]+=(now.tv_sec-this->timing_start.tv_sec)*1000000L
+                                            +now.tv_usec-this->timing_start.tv_usec;
+    this->timing_phase=phase;
+    this->timing_start=now;
+}
+
 /**
  * @brief Updates or recreates the route graph.
  *
@@ -715,6 +853,15 @@ static void route_path_update_done(struct route *this, int new_graph) {
     route_status.u.num=route_status_building_path;
     route_set_attr(this, &route_status);
     prev_dst=route_previous_destination(this);
+    if (this->graph->heuristic) {
+        /* the graph has only been flooded up to the previous start, expand it until the current one is reached */
+        route_graph_set_start(this->graph, prev_dst, this->vehicleprofile, 0);
+        route_graph_compute_shortest_path(this->graph, this->vehicleprofile, NULL);
+    }
+    /* an update of the path alone is timed on its own */
+    if (this->timing_phase == route_timing_none)
+        memset(this->timing, 0, sizeof(this->timing));
+    route_timing(this, route_timing_path);
     if (this->link_path) {
         this->path2=route_path_new(this->graph, NULL, prev_dst, this->current_dst, this->vehicleprofile);
         if (this->path2)
@@ -729,35 +876,51 @@ static void route_path_update_done(struct route *this, int new_graph) {
         }
     }
     if (this->path2) {
-        struct route_path_segment *seg=this->path2->path;
-        int path_time=0,path_len=0;
-        while (seg) {
-            /* FIXME */
-            int seg_time=route_time_seg(this->vehicleprofile, seg->data, NULL);
-            if (seg_time == INT_MAX) {
-                dbg(lvl_debug,"error");
-            } else
-                path_time+=seg_time;
-            path_len+=seg->data->len;
-            seg=seg->next;
+        route_path_set_totals(this->path2, this->vehicleprofile);
+        if (new_graph && prev_dst == this->pos && !this->link_path && this->graph->time_dependent
+                && this->arrival_estimate >= 0
+                && abs(this->path2->path_time/10-this->arrival_estimate) > ROUTE_ARRIVAL_TOLERANCE) {
+            /* the historic speeds were looked up for a wrong time, flood again for the time the path takes */
+            route_graph_set_arrival(this, this->path2->path_time/10);
+            this->arrival_estimate=-1;
+            route_graph_reset(this->graph);
+            route_graph_set_start(this->graph, prev_dst, this->vehicleprofile, 1);
+            route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
+            route_timing(this, route_timing_flood);
+            route_graph_compute_shortest_path(this->graph, this->vehicleprofile, this->route_graph_flood_done_cb);
+            return;
         }
-        this->path2->path_time=path_time;
-        this->path2->path_len=path_len;
         if (prev_dst != this->pos) {
             this->link_path=1;
             this->current_dst=prev_dst;
             route_graph_reset(this->graph);
+            route_graph_set_arrival(this, -1);
+            route_graph_set_start(this->graph, route_previous_destination(this), this->vehicleprofile, 1);
             route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
+            route_timing(this, route_timing_flood);
             route_graph_compute_shortest_path(this->graph, this->vehicleprofile, this->route_graph_flood_done_cb);
             return;
         }
         if (!new_graph && this->path2->updated)
             route_status.u.num=route_status_path_done_incremental;
-        else
+        else {
             route_status.u.num=route_status_path_done_new;
-    } else
+            route_alternatives_update(this, 1);
+        }
+    } else {
+        if (new_graph && (this->graph->ch || this->graph->overlay)) {
+            dbg(lvl_debug,"no path in graph from contraction hierarchy or overlay, building full graph");
+            route_path_destroy(this->path2,1);
+            this->path2=NULL;
+            this->link_path=0;
+            this->ch_failed=1;
+            route_graph_update(this, this->route_graph_flood_done_cb, !!(this->flags & route_path_flag_async));
+            return;
+        }
         route_status.u.num=route_status_not_found;
+    }
     this->link_path=0;
+    route_timing(this, route_timing_none);
     route_set_attr(this, &route_status);
 }
 
@@ -804,6 +967,13 @@ static void route_path_update_flags(struct route *this, enum route_path_flags fl
         // we can try to update
         dbg(lvl_debug,"try update");
         route_path_update_done(this, 0);
+        if (!this->path2 && !(flags & route_path_flag_no_rebuild) && route_graph_extend(this)) {
+            dbg(lvl_debug,"extended graph");
+            if (!route_graph_restart_time_dependent(this))
+                route_graph_set_start(this->graph, route_previous_destination(this), this->vehicleprofile, 0);
+            route_graph_compute_shortest_path(this->graph, this->vehicleprofile, NULL);
+            route_path_update_done(this, 0);
+        }
     } else {
         route_path_destroy(this->path2,1);
         this->path2 = NULL;
@@ -1011,13 +1181,19 @@ static struct map_selection *route_rect_add(struct map_selection *sel, int order
  * Returns a list of  map selections useable to get a map rect from which items can be
  * retrieved to build a route graph.
  *
+ * If `coarse` is true, only the selections relative to the bounding box of all points are returned, along with the
+ * selection with the highest order around each point. This is the first pass of building a route graph along a
+ * corridor, see route_graph_add_corridor().
+ *
  * @param c Array containing route points, including start, intermediate and destination ones.
  * @param count number of route points
  * @param proifle vehicleprofile
+ * @param coarse Whether to return the coarse selection only
  */
-static struct map_selection *route_calc_selection(struct coord *c, int count, struct vehicleprofile *profile) {
+static struct map_selection *route_calc_selection(struct coord *c, int count, struct vehicleprofile *profile,
+        int coarse) {
     struct map_selection *ret=NULL;
-    int i;
+    int i,max_order=-1;
     struct coord_rect r;
     char *depth, *str, *tok;
 
@@ -1031,6 +1207,15 @@ static struct map_selection *route_calc_selection(struct coord *c, int count, st
     depth=profile->route_depth;
     if (!depth)
         depth="4:25%,8:40000,18:10000";
+    if (coarse) {
+        str=g_strdup(depth);
+        for (tok=strtok(str,",") ; tok ; tok=strtok(NULL,",")) {
+            int order=0;
+            if (!strchr(tok,'%') && sscanf(tok,"%d",&order) == 1 && order > max_order)
+                max_order=order;
+        }
+        g_free(str);
+    }
     depth=str=g_strdup(depth);
 
     while((tok=strtok(str,","))!=NULL) {
@@ -1038,7 +1223,7 @@ static struct map_selection *route_calc_selection(struct coord *c, int count, st
         sscanf(tok,"%d:%d",&order,&dist);
         if(strchr(tok,'%'))
             ret=route_rect_add(ret, order, &r.lu, &r.rl, dist, 0);
-        else
+        else if (!coarse || order == max_order)
             for (i = 0 ; i < count ; i++) {
                 ret=route_rect_add(ret, order, &c[i], &c[i], 0, dist);
             }
@@ -1066,7 +1251,7 @@ struct map_selection * route_get_selection(struct route * this_) {
         c[i++] = dst->c;
         tmp = g_list_next(tmp);
     }
-    return route_calc_selection(c, i, this_->vehicleprofile);
+    return route_calc_selection(c, i, this_->vehicleprofile, 0);
 }
 
 /**
@@ -1084,6 +1269,87 @@ void route_free_selection(struct map_selection *sel) {
 }
 
 
+/**
+ * @brief Returns the parts of a selection rectangle which are not covered by another one
+ *
+ * @param sel The rectangle, which is freed
+ * @param cover The covering rectangle
+ * @return A list of up to four rectangles with the order and range of `sel`
+ */
+static struct map_selection *route_rect_subtract(struct map_selection *sel, struct map_selection *cover) {
+    struct coord_rect *r=&sel->u.c_rect, i;
+    struct map_selection *ret=NULL, *part;
+    struct coord_rect parts[4];
+    int j,count=0;
+
+    i.lu.x=MAX(r->lu.x, cover->u.c_rect.lu.x);
+    i.lu.y=MIN(r->lu.y, cover->u.c_rect.lu.y);
+    i.rl.x=MIN(r->rl.x, cover->u.c_rect.rl.x);
+    i.rl.y=MAX(r->rl.y, cover->u.c_rect.rl.y);
+    if (cover->order < sel->order || i.lu.x > i.rl.x || i.rl.y > i.lu.y) {
+        sel->next=NULL;
+        return sel;
+    }
+    if (r->lu.x < i.lu.x) {
+        parts[count]=*r;
+        parts[count++].rl.x=i.lu.x;
+    }
+    if (i.rl.x < r->rl.x) {
+        parts[count]=*r;
+        parts[count++].lu.x=i.rl.x;
+    }
+    if (i.lu.y < r->lu.y) {
+        parts[count].lu.x=i.lu.x;
+        parts[count].rl.x=i.rl.x;
+        parts[count].lu.y=r->lu.y;
+        parts[count++].rl.y=i.lu.y;
+    }
+    if (r->rl.y < i.rl.y) {
+        parts[count].lu.x=i.lu.x;
+        parts[count].rl.x=i.rl.x;
+        parts[count].lu.y=i.rl.y;
+        parts[count++].rl.y=r->rl.y;
+    }
+    for (j = 0 ; j < count ; j++) {
+        part=g_new(struct map_selection, 1);
+        *part=*sel;
+        part->u.c_rect=parts[j];
+        part->next=ret;
+        ret=part;
+    }
+    g_free(sel);
+    return ret;
+}
+
+/**
+ * @brief Returns the parts of a selection which are not covered by another selection
+ *
+ * A rectangle of `sel` is covered by a rectangle of `cover` if the latter has at least the same order, as all items
+ * of the former are then also delivered for the latter.
+ *
+ * @param sel The selection, which is freed
+ * @param cover The covering selection
+ * @return The remaining rectangles of `sel`, NULL if `cover` covers all of `sel`
+ */
+static struct map_selection *route_selection_subtract(struct map_selection *sel, struct map_selection *cover) {
+    struct map_selection *ret, *next, *parts, *last;
+
+    for ( ; cover && sel ; cover=cover->next) {
+        ret=NULL;
+        for ( ; sel ; sel=next) {
+            next=sel->next;
+            parts=route_rect_subtract(sel, cover);
+            if (parts) {
+                for (last=parts ; last->next ; last=last->next);
+                last->next=ret;
+                ret=parts;
+            }
+        }
+        sel=ret;
+    }
+    return sel;
+}
+
 /* for compatibility to GFunc */
 static void route_info_free_g(struct route_info *inf, void * unused) {
     route_info_free(inf);
@@ -1116,6 +1382,7 @@ void route_set_destinations(struct route *this, struct pcoord *dst, int count, i
 
     profile(0,NULL);
     route_clear_destinations(this);
+    memset(this->timing, 0, sizeof(this->timing));
     if (dst && count) {
         for (i = 0 ; i < count ; i++) {
             dsti=route_find_nearest_street(this->vehicleprofile, this->ms, &dst[i]);
@@ -1311,6 +1578,8 @@ void route_remove_waypoint(struct route *this) {
         route_graph_reset(this->graph);
         this->current_dst = this->destinations->data;
         route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
+        memset(this->timing, 0, sizeof(this->timing));
+        route_timing(this, route_timing_flood);
         route_graph_compute_shortest_path(this->graph, this->vehicleprofile, this->route_graph_flood_done_cb);
     }
 }
@@ -1327,8 +1596,10 @@ void route_remove_waypoint(struct route *this) {
 struct route_graph_point *route_graph_get_point_next(struct route_graph *this, struct coord *c,
         struct route_graph_point *last) {
     struct route_graph_point *p;
-    int seen=0,hashval=HASHCOORD(c);
-    p=this->hash[hashval];
+    int seen=0;
+    if (!this->hash)
+        return NULL;
+    p=this->hash[HASHCOORD(c, this->hash_size)];
     while (p) {
         if (p->c.x == c->x && p->c.y == c->y) {
             if (!last || seen)
@@ -1361,8 +1632,9 @@ struct route_graph_point * route_graph_get_point(struct route_graph *this, struc
  */
 static struct route_graph_point *route_graph_get_point_last(struct route_graph *this, struct coord *c) {
     struct route_graph_point *p,*ret=NULL;
-    int hashval=HASHCOORD(c);
-    p=this->hash[hashval];
+    if (!this->hash)
+        return NULL;
+    p=this->hash[HASHCOORD(c, this->hash_size)];
     while (p) {
         if (p->c.x == c->x && p->c.y == c->y)
             ret=p;
@@ -1373,9 +1645,115 @@ static struct route_graph_point *route_graph_get_point_last(struct route_graph *
 
 
 
+/**
+ * @brief A chunk of memory of a route graph arena
+ */
+struct route_graph_arena_chunk {
+    struct route_graph_arena_chunk *next;   /**< The next chunk */
+    int size;                               /**< Usable size of the chunk in bytes */
+    int used;                               /**< Bytes allocated from the chunk */
+    void *data[0];                          /**< The memory of the chunk */
+};
+
+#define ROUTE_GRAPH_ARENA_CHUNK_MIN 65536
+#define ROUTE_GRAPH_ARENA_CHUNK_MAX 4194304
+
+/**
+ * @brief Allocates zeroed memory from an arena of a route graph
+ *
+ * Chunks start at 64 KiB and double in size up to 4 MiB. A request larger than the next chunk gets a chunk of its
+ * own, which is placed behind the current one so that the remainder of the current chunk is still used.
+ *
+ * @param this The route graph, whose peak arena size is updated
+ * @param arena The arena to allocate from
+ * @param size The number of bytes to allocate
+ * @return The memory, aligned for pointers
+ */
+static void *route_graph_arena_alloc(struct route_graph *this, struct route_graph_arena *arena, int size) {
+    struct route_graph_arena_chunk *chunk=arena->chunks;
+    void *ret;
+
+    size=(size+sizeof(void *)-1) & ~(sizeof(void *)-1);
+    if (!chunk || chunk->used+size > chunk->size) {
+        int chunk_size=arena->chunk_size ? arena->chunk_size : ROUTE_GRAPH_ARENA_CHUNK_MIN;
+        struct route_graph_arena_chunk *new;
+        int dedicated=(size > chunk_size);
+        if (dedicated)
+            chunk_size=size;
+        else
+            arena->chunk_size=MIN(chunk_size*2, ROUTE_GRAPH_ARENA_CHUNK_MAX);
+        new=g_malloc0(sizeof(struct route_graph_arena_chunk)+chunk_size);
+        new->size=chunk_size;
+        arena->size+=chunk_size;
+        if (chunk && dedicated) {
+            new->next=chunk->next;
+            chunk->next=new;
+        } else {
+            new->next=chunk;
+            arena->chunks=new;
+        }
+        if (this->point_arena.size+this->segment_arena.size > this->arena_peak)
+            this->arena_peak=this->point_arena.size+this->segment_arena.size;
+        chunk=new;
+    }
+    ret=(char *)chunk->data+chunk->used;
+    chunk->used+=size;
+    return ret;
+}
+
+/**
+ * @brief Releases all memory of an arena of a route graph
+ *
+ * @param arena The arena
+ */
+static void route_graph_arena_free(struct route_graph_arena *arena) {
+    struct route_graph_arena_chunk *chunk,*next;
+    for (chunk = arena->chunks ; chunk ; chunk = next) {
+        next=chunk->next;
+        g_free(chunk);
+    }
+    arena->chunks=NULL;
+    arena->size=0;
+    arena->chunk_size=0;
+}
+
+/**
+ * @brief Changes the number of buckets of the point hash of a route graph
+ *
+ * Points with the same coordinates keep their relative order, as route_graph_get_point() returns the first of them.
+ *
+ * @param this The route graph
+ * @param size The new number of buckets, must be a power of two
+ */
+static void route_graph_rehash(struct route_graph *this, int size) {
+    struct route_graph_point **hash=g_new0(struct route_graph_point *, size);
+    struct route_graph_point **tail=g_new0(struct route_graph_point *, size);
+    struct route_graph_point *p,*next;
+    int i,hashval;
+
+    for (i = 0 ; i < this->hash_size ; i++) {
+        for (p = this->hash[i] ; p ; p = next) {
+            next=p->hash_next;
+            hashval=HASHCOORD(&p->c, size);
+            p->hash_next=NULL;
+            if (tail[hashval])
+                tail[hashval]->hash_next=p;
+            else
+                hash[hashval]=p;
+            tail[hashval]=p;
+        }
+    }
+    g_free(tail);
+    g_free(this->hash);
+    this->hash=hash;
+    this->hash_size=size;
+}
+
 /**
  * @brief Create a new point for the route graph with the specified coordinates
  *
+ * The point hash grows as points are added, so that chains stay short even for large graphs.
+ *
  * @param this The route to insert the point into
  * @param f The coordinates at which the point should be created
  * @return The point created
@@ -1385,12 +1763,17 @@ static struct route_graph_point *route_graph_point_new(struct route_graph *this,
     int hashval;
     struct route_graph_point *p;
 
-    hashval=HASHCOORD(f);
+    if (!this->hash)
+        route_graph_rehash(this, HASH_SIZE);
+    else if (this->point_count >= this->hash_size)
+        route_graph_rehash(this, this->hash_size*4);
+    hashval=HASHCOORD(f, this->hash_size);
     if (debug_route)
         printf("p (0x%x,0x%x)\n", f->x, f->y);
-    p=g_slice_new0(struct route_graph_point);
+    p=route_graph_arena_alloc(this, &this->point_arena, sizeof(struct route_graph_point));
     p->hash_next=this->hash[hashval];
     this->hash[hashval]=p;
+    this->point_count++;
     p->value=INT_MAX;
     p->dst_val = INT_MAX;
     p->c=*f;
@@ -1422,19 +1805,136 @@ struct route_graph_point * route_graph_add_point(struct route_graph *this, struc
 /**
  * @brief Frees all the memory used for points in the route graph passed
  *
+ * All points are released at once along with their arena.
+ *
  * @param this The route graph to delete all points from
  */
 void route_graph_free_points(struct route_graph *this) {
-    struct route_graph_point *curr,*next;
-    int i;
-    for (i = 0 ; i < HASH_SIZE ; i++) {
-        curr=this->hash[i];
-        while (curr) {
-            next=curr->hash_next;
-            g_slice_free(struct route_graph_point, curr);
-            curr=next;
+    route_graph_arena_free(&this->point_arena);
+    g_free(this->hash);
+    this->hash=NULL;
+    this->hash_size=0;
+    this->point_count=0;
+    this->frozen_points=NULL;
+    this->frozen_point_count=0;
+    g_free(this->restrictions);
+    this->restrictions=NULL;
+    this->restriction_count=0;
+    this->restriction_size=0;
+}
+
+/**
+ * @brief Returns the heuristic cost between two coordinates
+ *
+ * The straight-line distance in meters at `heuristic->speed` in km/h gives the cost in tenths of seconds. As the
+ * lengths of segments are rounded, the cost is rounded down and reduced by one so that it stays a lower bound.
+ *
+ * @param heuristic The heuristic
+ * @param c1 The first coordinate
+ * @param c2 The second coordinate
+ * @param upper True to round up instead, for an upper bound of the cost
+ * @return The cost
+ */
+static int route_graph_heuristic_cost(struct route_graph_heuristic *heuristic, struct coord *c1, struct coord *c2,
+                                      int upper) {
+    double cost=transform_distance(heuristic->pro, c1, c2)*36/heuristic->speed;
+
+    if (upper)
+        return ceil(cost)+1;
+    return cost >= 1 ? floor(cost)-1 : 0;
+}
+
+/**
+ * @brief Returns the heap key of a point
+ *
+ * The key is the lower of the point's `value` and `rhs`. If the graph uses the A* heuristic, the heuristic cost from
+ * the point to the start is added.
+ *
+ * @param this The route graph
+ * @param p The point
+ * @return The key
+ */
+static int route_graph_point_key(struct route_graph *this, struct route_graph_point *p) {
+    int key=MIN(p->rhs, p->value);
+    if (this->heuristic)
+        key=route_value_add(key, route_graph_heuristic_cost(this->heuristic, &p->c, &this->heuristic->c, 0));
+    return key;
+}
+
+static void route_graph_heuristic_destroy(struct route_graph *this) {
+    if (!this->heuristic)
+        return;
+    g_free(this->heuristic->p);
+    g_free(this->heuristic->cost);
+    g_free(this->heuristic);
+    this->heuristic=NULL;
+}
+
+static void route_graph_heuristic_add_candidate(struct route_graph_heuristic *heuristic, struct route_graph_point *p,
+        int cost) {
+    heuristic->p=g_renew(struct route_graph_point *, heuristic->p, heuristic->count+1);
+    heuristic->cost=g_renew(int, heuristic->cost, heuristic->count+1);
+    heuristic->p[heuristic->count]=p;
+    heuristic->cost[heuristic->count]=cost;
+    heuristic->count++;
+}
+
+/**
+ * @brief Sets the start of the route for the A* heuristic
+ *
+ * Without a heuristic, the whole graph is flooded and this function does nothing. If the vehicle profile enables the
+ * heuristic, the points from which `pos` can be reached are recorded, so that flooding can stop as soon as the cost
+ * from the start is final (see route_graph_is_path_computed()).
+ *
+ * The heuristic uses the fastest route weight of the vehicle profile, or the highest maxspeed of the graph if
+ * maxspeeds are enforced and higher, so it never overestimates the cost.
+ *
+ * @param this The route graph
+ * @param pos The start of the route, i.e. the current position or the previous waypoint
+ * @param profile The vehicle profile
+ * @param reset True if flooding starts from scratch, i.e. the heap is empty. The heuristic is then computed relative
+ * to `pos`. Otherwise it stays relative to the old start, and the distance to the new start is taken into account.
+ */
+static void route_graph_set_start(struct route_graph *this, struct route_info *pos, struct vehicleprofile *profile,
+                                  int reset) {
+    struct route_graph_heuristic *heuristic;
+    struct route_graph_segment *s=NULL;
+    int speed,val;
+
+    if (reset || !profile->route_heuristic || !pos->street)
+        route_graph_heuristic_destroy(this);
+    if (!profile->route_heuristic || !pos->street)
+        return;
+    if (!this->heuristic) {
+        speed=vehicleprofile_get_max_route_weight(profile);
+        if (profile->maxspeed_handling == maxspeed_enforce && this->maxspeed > speed)
+            speed=this->maxspeed;
+        if (speed <= 0)
+            return;
+        this->heuristic=g_new0(struct route_graph_heuristic, 1);
+        this->heuristic->speed=speed;
+        this->heuristic->pro=map_projection(pos->street->item.map);
+        this->heuristic->c=pos->lp;
+    }
+    heuristic=this->heuristic;
+    heuristic->shift=route_graph_heuristic_cost(heuristic, &heuristic->c, &pos->lp, 1);
+    heuristic->count=0;
+    /* same candidates and costs as in route_path_new() */
+    while ((s=route_graph_get_segment(this, pos->street, s))) {
+        val=route_value_seg(profile, NULL, s, 2);
+        if (val != INT_MAX) {
+            val=val*(100-pos->percent)/100;
+            if (route_graph_segment_match(s,this->avoid_seg) && pos->street_direction < 0)
+                val+=profile->turn_around_penalty;
+            route_graph_heuristic_add_candidate(heuristic, s->end, val);
+        }
+        val=route_value_seg(profile, NULL, s, -2);
+        if (val != INT_MAX) {
+            val=val*pos->percent/100;
+            if (route_graph_segment_match(s,this->avoid_seg) && pos->street_direction > 0)
+                val+=profile->turn_around_penalty;
+            route_graph_heuristic_add_candidate(heuristic, s->start, val);
         }
-        this->hash[i]=NULL;
     }
 }
 
@@ -1462,7 +1962,10 @@ static void route_graph_init(struct route_graph *this, struct route_info *dst, s
             s->end->dst_seg = s;
             s->end->rhs = val;
             s->end->dst_val = val;
-            s->end->el = fh_insertkey(this->heap, MIN(s->end->rhs, s->end->value), s->end);
+            if (s->end->el)
+                route_heap_change_key(this->heap, s->end, route_graph_point_key(this, s->end));
+            else
+                route_heap_insert(this->heap, s->end, route_graph_point_key(this, s->end));
         }
         val = route_value_seg(profile, NULL, s, 1);
         if (val != INT_MAX) {
@@ -1471,7 +1974,10 @@ static void route_graph_init(struct route_graph *this, struct route_info *dst, s
             s->start->dst_seg = s;
             s->start->rhs = val;
             s->start->dst_val = val;
-            s->start->el = fh_insertkey(this->heap, MIN(s->start->rhs, s->start->value), s->start);
+            if (s->start->el)
+                route_heap_change_key(this->heap, s->start, route_graph_point_key(this, s->start));
+            else
+                route_heap_insert(this->heap, s->start, route_graph_point_key(this, s->start));
         }
     }
 }
@@ -1482,11 +1988,9 @@ static void route_graph_init(struct route_graph *this, struct route_info *dst, s
  * This iterates through all the points in the route graph, resetting them to their initial state.
  * The `value` (cost to reach the destination via `seg`) and `dst_val` (cost to destination if this point is the last
  * in the route) members of each point are reset to`INT_MAX`, the `seg` member (cheapest way to destination) is reset
- * to `NULL` and the `el` member (pointer to element in Fibonacci heap) is also reset to `NULL`.
+ * to `NULL`.
  *
- * The Fibonacci heap is also cleared. Inconsistencies between `el` and Fibonacci heap membership are handled
- * gracefully, i.e. `el` is reset even if it is invalid, and points are removed from the heap regardless of their `el`
- * value.
+ * The heap is also cleared, which resets the `el` member (position on the heap) of each point on it.
  *
  * After this method returns, the caller should call
  * {@link route_graph_init(struct route_graph *, struct route_info *, struct vehicleprofile *)} to initialize potential
@@ -1501,7 +2005,7 @@ static void route_graph_reset(struct route_graph *this) {
     struct route_graph_point *curr;
     int i;
 
-    for (i = 0 ; i < HASH_SIZE ; i++) {
+    for (i = 0 ; i < this->hash_size ; i++) {
         curr=this->hash[i];
         while (curr) {
             curr->value=INT_MAX;
@@ -1509,14 +2013,11 @@ static void route_graph_reset(struct route_graph *this) {
             curr->rhs = INT_MAX;
             curr->seg=NULL;
             curr->dst_seg = NULL;
-            curr->el=NULL;
             curr=curr->hash_next;
         }
     }
 
-    while (fh_extractmin(this->heap)) {
-        // no operation, just remove all items (`el` has already been reset)
-    }
+    route_heap_clear(this->heap);
 }
 
 /**
@@ -1621,11 +2122,7 @@ void route_graph_add_segment(struct route_graph *this, struct route_graph_point
     int size;
 
     size = sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(data->flags);
-    s = g_slice_alloc0(size);
-    if (!s) {
-        printf("%s:Out of memory\n", __FUNCTION__);
-        return;
-    }
+    s = route_graph_arena_alloc(this, &this->segment_arena, size);
     s->start=start;
     s->start_next=start->start;
     start->start=s;
@@ -1638,8 +2135,11 @@ void route_graph_add_segment(struct route_graph *this, struct route_graph_point
     s->data.flags=data->flags;
     s->data.score = data->score;
 
-    if (data->flags & AF_SPEED_LIMIT)
+    if (data->flags & AF_SPEED_LIMIT) {
         RSD_MAXSPEED(&s->data)=data->maxspeed;
+        if (data->maxspeed > this->maxspeed)
+            this->maxspeed=data->maxspeed;
+    }
     if (data->flags & AF_SEGMENTED)
         RSD_OFFSET(&s->data)=data->offset;
     if (data->flags & AF_SIZE_OR_WEIGHT_LIMIT)
@@ -1649,10 +2149,60 @@ void route_graph_add_segment(struct route_graph *this, struct route_graph_point
 
     s->next=this->route_segments;
     this->route_segments=s;
+    s->index=this->segment_count++;
     if (debug_route)
         printf("l (0x%x,0x%x)-(0x%x,0x%x)\n", start->c.x, start->c.y, end->c.x, end->c.y);
 }
 
+/**
+ * @brief Returns the historic speeds of a segment of a route graph
+ *
+ * @param this The route graph
+ * @param s The segment
+ * @return The speed profile, NULL if the segment has none
+ */
+static struct route_speed_profile *route_graph_get_speed_profile(struct route_graph *this,
+        struct route_graph_segment *s) {
+    if (s->index >= this->speed_profiles_size)
+        return NULL;
+    return this->speed_profiles[s->index];
+}
+
+/**
+ * @brief Attaches historic speeds to a segment of a route graph
+ *
+ * The graph keeps its own copy of the profile, as the attribute it has been read from is only valid as long as
+ * its item. The map driver must only return profiles whose intervals fit into the attribute (see binfile_attr_get()).
+ *
+ * @param this The route graph
+ * @param s The segment
+ * @param profile The speed profile, NULL to do nothing
+ */
+static void route_graph_set_speed_profile(struct route_graph *this, struct route_graph_segment *s,
+        struct route_speed_profile *profile) {
+    int size=this->speed_profiles_size;
+
+    if (!profile || profile->count <= 0 || profile->count > ROUTE_WEEK)
+        return;
+    if (s->index >= size) {
+        if (!size)
+            size=1024;
+        while (size <= s->index)
+            size*=2;
+        this->speed_profiles=g_renew(struct route_speed_profile *, this->speed_profiles, size);
+        this->speed_delays=g_renew(int *, this->speed_delays, size);
+        memset(this->speed_profiles+this->speed_profiles_size, 0,
+               (size-this->speed_profiles_size)*sizeof(struct route_speed_profile *));
+        memset(this->speed_delays+this->speed_profiles_size, 0, (size-this->speed_profiles_size)*sizeof(int *));
+        this->speed_profiles_size=size;
+    }
+    g_free(this->speed_profiles[s->index]);
+    g_free(this->speed_delays[s->index]);
+    this->speed_profiles[s->index]=g_memdup(profile, sizeof(*profile)+profile->count);
+    this->speed_delays[s->index]=g_new(int, profile->count);
+    memset(this->speed_delays[s->index], -1, profile->count*sizeof(int));
+}
+
 /**
  * @brief Returns and removes one segment from a path
  *
@@ -1866,19 +2416,28 @@ linkold:
 /**
  * @brief Destroys all segments of a route graph
  *
+ * All segments are released at once along with their arena.
+ *
  * @param this The graph to destroy all segments from
  */
 void route_graph_free_segments(struct route_graph *this) {
-    struct route_graph_segment *curr,*next;
-    int size;
-    curr=this->route_segments;
-    while (curr) {
-        next=curr->next;
-        size = sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(curr->data.flags);
-        g_slice_free1(size, curr);
-        curr=next;
-    }
+    route_graph_arena_free(&this->segment_arena);
     this->route_segments=NULL;
+    this->frozen_segments=NULL;
+    this->frozen_segments_size=0;
+    g_free(this->costs);
+    this->costs=NULL;
+    this->costs_count=0;
+    this->costs_profile=NULL;
+    while (this->speed_profiles_size) {
+        this->speed_profiles_size--;
+        g_free(this->speed_profiles[this->speed_profiles_size]);
+        g_free(this->speed_delays[this->speed_profiles_size]);
+    }
+    g_free(this->speed_profiles);
+    g_free(this->speed_delays);
+    this->speed_profiles=NULL;
+    this->speed_delays=NULL;
 }
 
 /**
@@ -1891,7 +2450,9 @@ static void route_graph_destroy(struct route_graph *this) {
         route_graph_build_done(this, 1);
         route_graph_free_points(this);
         route_graph_free_segments(this);
-        fh_deleteheap(this->heap);
+        route_free_selection(this->extent);
+        route_heap_destroy(this->heap);
+        route_graph_heuristic_destroy(this);
         g_free(this);
     }
 }
@@ -2044,6 +2605,28 @@ static int route_through_traffic_allowed(struct vehicleprofile *profile, struct
     return (seg->data.flags & AF_THROUGH_TRAFFIC_LIMIT) == 0;
 }
 
+/**
+ * @brief Applies the parts of the cost of a segment which depend on the next segment
+ *
+ * @param profile The routing preferences
+ * @param from The point at which we leave the segment (or NULL), see route_value_seg()
+ * @param over The segment we are using
+ * @param ret The cost of `over` regardless of the next segment
+ *
+ * @return The cost of `over` when followed by `from->seg`
+ */
+static int route_value_seg_from(struct vehicleprofile *profile, struct route_graph_point *from,
+                                struct route_graph_segment *over, int ret) {
+    if (ret == INT_MAX || !from)
+        return ret;
+    if (over->start == over->end || from->seg == over)
+        return INT_MAX;
+    if (!route_through_traffic_allowed(profile, over) && from->seg
+            && route_through_traffic_allowed(profile, from->seg))
+        ret+=profile->through_traffic_penalty;
+    return ret;
+}
+
 /**
  * @brief Returns the "cost" of traveling along segment `over` in direction `dir`
  *
@@ -2080,16 +2663,12 @@ static int route_value_seg(struct vehicleprofile *profile, struct route_graph_po
         dbg(lvl_warning, "dir is zero, assuming positive");
         dir = 1;
     }
-    if (from && (over->start == over->end))
-        return INT_MAX;
     if ((over->data.flags & (dir >= 0 ? profile->flags_forward_mask : profile->flags_reverse_mask)) != profile->flags)
         return INT_MAX;
     if (dir > 0 && (over->start->flags & RP_TURN_RESTRICTION))
         return INT_MAX;
     if (dir < 0 && (over->end->flags & RP_TURN_RESTRICTION))
         return INT_MAX;
-    if (from && from->seg == over)
-        return INT_MAX;
     if (over->data.item.type == type_traffic_distortion)
         return INT_MAX;
     if ((over->start->flags & RP_TRAFFIC_DISTORTION) && (over->end->flags & RP_TRAFFIC_DISTORTION) &&
@@ -2098,12 +2677,147 @@ static int route_value_seg(struct vehicleprofile *profile, struct route_graph_po
         distp=&dist;
     }
     ret=route_time_seg(profile, &over->data, distp);
-    if (ret == INT_MAX)
-        return ret;
-    if (!route_through_traffic_allowed(profile, over) && from && from->seg
-            && route_through_traffic_allowed(profile, from->seg))
-        ret+=profile->through_traffic_penalty;
-    return ret;
+    return route_value_seg_from(profile, from, over, ret);
+}
+
+/**
+ * @brief Fills the cost cache of a route graph for a vehicle profile
+ *
+ * Relaxing a segment during flooding needs its cost in one direction, which depends on the roadprofile for its
+ * type and on the fields following its data (maxspeed, size and weight limits, see route_seg_speed()). As this is
+ * the same for every relaxation of the segment until the vehicle profile or a traffic distortion changes, it is
+ * calculated once for all segments and looked up by route_graph_value_seg(). The cache is filled again when the
+ * generation of the vehicle profile changes.
+ *
+ * The delays from historic speeds (see route_graph_speed_delay()) are cached for each interval of the speed profile
+ * of a segment, and are marked for recalculation here as well.
+ *
+ * Costs of segments at points with traffic distortions are invalidated when distortions change, see
+ * route_graph_costs_invalidate(). Segments added after the cache has been filled are not covered by it.
+ *
+ * @param graph The route graph
+ * @param profile The vehicle profile
+ */
+static void route_graph_costs_update(struct route_graph *graph, struct vehicleprofile *profile) {
+    struct route_graph_segment *s;
+    int i;
+
+    if (graph->costs_count != graph->segment_count) {
+        g_free(graph->costs);
+        graph->costs=g_new(int, graph->segment_count*2);
+        graph->costs_count=graph->segment_count;
+    }
+    graph->costs_profile=profile;
+    graph->costs_generation=profile->generation;
+    for (s = graph->route_segments ; s ; s = s->next) {
+        if (s->index >= graph->costs_count)
+            continue;
+        graph->costs[s->index*2]=route_value_seg(profile, NULL, s, 1);
+        graph->costs[s->index*2+1]=route_value_seg(profile, NULL, s, -1);
+    }
+    for (i = 0 ; i < graph->speed_profiles_size ; i++) {
+        if (graph->speed_profiles[i])
+            memset(graph->speed_delays[i], -1, graph->speed_profiles[i]->count*sizeof(int));
+    }
+}
+
+/**
+ * @brief Marks the cached costs of all segments at a point for recalculation
+ *
+ * @param graph The route graph
+ * @param p The point
+ */
+static void route_graph_costs_invalidate(struct route_graph *graph, struct route_graph_point *p) {
+    struct route_graph_segment *s;
+
+    if (!graph->costs)
+        return;
+    for (s = p->start ; s ; s = s->start_next)
+        if (s->index < graph->costs_count)
+            graph->costs[s->index*2]=graph->costs[s->index*2+1]=-1;
+    for (s = p->end ; s ; s = s->end_next)
+        if (s->index < graph->costs_count)
+            graph->costs[s->index*2]=graph->costs[s->index*2+1]=-1;
+}
+
+/**
+ * @brief Returns the extra time needed to pass a segment at the time of day given by its historic speeds
+ *
+ * The graph is flooded backwards from the destination, so the time at which a segment is passed is known relative to
+ * the estimated arrival only: it is left at the arrival minus the cost of `from` to the destination. The speed profile
+ * of the segment is looked up for that time. Historic speeds only ever slow down a segment, so that the straight-line
+ * heuristic remains a lower bound of the cost. Segments with traffic distortions are left alone, as current traffic
+ * reports take precedence over historic data.
+ *
+ * The delay of each interval of the speed profile is cached while the cost cache is valid for `profile`, see
+ * route_graph_costs_update().
+ *
+ * @param graph The route graph
+ * @param profile The routing preferences
+ * @param from The point at which the segment is left, NULL to look up the arrival time itself
+ * @param over The segment
+ * @return The delay in tenths of a second
+ */
+static int route_graph_speed_delay(struct route_graph *graph, struct vehicleprofile *profile,
+                                   struct route_graph_point *from, struct route_graph_segment *over) {
+    struct route_speed_profile *sp;
+    int t,speed,historic,interval,*delay=NULL;
+
+    if (over->index >= graph->speed_profiles_size || !(sp=graph->speed_profiles[over->index]))
+        return 0;
+    if ((over->start->flags & RP_TRAFFIC_DISTORTION) && (over->end->flags & RP_TRAFFIC_DISTORTION))
+        return 0;
+    t=graph->arrival;
+    if (from && from->value != INT_MAX)
+        t-=from->value/10;
+    t%=ROUTE_WEEK;
+    if (t < 0)
+        t+=ROUTE_WEEK;
+    interval=(long long)t*sp->count/ROUTE_WEEK;
+    if (graph->costs_profile == profile && graph->costs_generation == profile->generation) {
+        delay=&graph->speed_delays[over->index][interval];
+        if (*delay >= 0)
+            return *delay;
+    }
+    historic=sp->speed[interval];
+    speed=route_seg_speed(profile, &over->data, NULL);
+    t=(!historic || historic >= speed) ? 0 : over->data.len*36/historic-over->data.len*36/speed;
+    if (delay)
+        *delay=t;
+    return t;
+}
+
+/**
+ * @brief Returns the cost of traveling along a segment of a route graph, using its cost cache
+ *
+ * This is equivalent to route_value_seg() for a `dir` of 1 or -1, plus the delay from historic speeds if the graph
+ * is time-dependent.
+ *
+ * @param graph The route graph
+ * @param profile The routing preferences
+ * @param from The point at which we leave the segment, see route_value_seg()
+ * @param over The segment we are using
+ * @param dir The direction of travel, 1 along the segment or -1 against it
+ *
+ * @return The cost needed to travel along the segment
+ */
+static int route_graph_value_seg(struct route_graph *graph, struct vehicleprofile *profile,
+                                 struct route_graph_point *from, struct route_graph_segment *over, int dir) {
+    int *cost,val;
+
+    if (graph->costs_profile != profile || graph->costs_generation != profile->generation)
+        route_graph_costs_update(graph, profile);
+    if (over->index >= graph->costs_count)
+        val=route_value_seg(profile, NULL, over, dir);
+    else {
+        cost=&graph->costs[over->index*2+(dir < 0)];
+        if (*cost < 0)
+            *cost=route_value_seg(profile, NULL, over, dir);
+        val=*cost;
+    }
+    if (val != INT_MAX && graph->time_dependent)
+        val+=route_graph_speed_delay(graph, profile, from, over);
+    return route_value_seg_from(profile, from, over, val);
 }
 
 /**
@@ -2155,10 +2869,10 @@ static int route_value_add(int val1, int val2) {
  * @param profile The vehicle profile to use for routing. This determines which ways are passable and how their costs
  * are calculated.
  * @param p The point to evaluate
- * @param heap The heap
+ * @param graph The route graph holding the heap
  */
 static void route_graph_point_update(struct vehicleprofile *profile, struct route_graph_point * p,
-                                     struct fibheap * heap) {
+                                     struct route_graph *graph) {
     struct route_graph_segment *s = NULL;
     int new, val;
 
@@ -2166,7 +2880,7 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
     p->seg = p->dst_seg;
 
     for (s = p->start; s; s = s->start_next) { /* Iterate over all the segments leading away from our point */
-        val = route_value_seg(profile, s->end, s, 1);
+        val = route_graph_value_seg(graph, profile, s->end, s, 1);
         if (val != INT_MAX && s->end->seg && item_is_equal(s->data.item, s->end->seg->data.item)) {
             if (profile->turn_around_penalty2)
                 val += profile->turn_around_penalty2;
@@ -2183,7 +2897,7 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
     }
 
     for (s = p->end; s; s = s->end_next) { /* Iterate over all the segments leading towards our point */
-        val = route_value_seg(profile, s->start, s, -1);
+        val = route_graph_value_seg(graph, profile, s->start, s, -1);
         if (val != INT_MAX && s->start->seg && item_is_equal(s->data.item, s->start->seg->data.item)) {
             if (profile->turn_around_penalty2)
                 val += profile->turn_around_penalty2;
@@ -2199,17 +2913,14 @@ static void route_graph_point_update(struct vehicleprofile *profile, struct rout
         }
     }
 
-    if (p->el) {
-        /* Due to a limitation of the Fibonacci heap implementation, which causes fh_replacekey() to fail if the new
-         * key is greater than the current one, we always remove the point from the heap (and, if locally inconsistent,
-         * re-add it afterwards). */
-        fh_delete(heap, p->el);
-        p->el = NULL;
-    }
-
-    if (p->rhs != p->value)
-        /* The point is locally inconsistent, add (or re-add) it to the heap */
-        p->el = fh_insertkey(heap, MIN(p->rhs, p->value), p);
+    if (p->rhs != p->value) {
+        /* The point is locally inconsistent, add it to the heap or update its key */
+        if (p->el)
+            route_heap_change_key(graph->heap, p, route_graph_point_key(graph, p));
+        else
+            route_heap_insert(graph->heap, p, route_graph_point_key(graph, p));
+    } else if (p->el)
+        route_heap_remove(graph->heap, p);
 }
 
 /**
@@ -2230,15 +2941,15 @@ static void route_graph_compute_shortest_path(struct route_graph * graph, struct
     struct route_graph_point *p_min;
     struct route_graph_segment *s = NULL;
 
-    while (!route_graph_is_path_computed(graph) && (p_min = fh_extractmin(graph->heap))) {
-        p_min->el = NULL;
+    while (!route_graph_is_path_computed(graph) && (p_min = route_heap_extract_min(graph->heap))) {
+        graph->expanded++;
         if (p_min->value > p_min->rhs)
             /* cost has decreased, update point value */
             p_min->value = p_min->rhs;
         else {
             /* cost has increased, re-evaluate */
             p_min->value = INT_MAX;
-            route_graph_point_update(profile, p_min, graph->heap);
+            route_graph_point_update(profile, p_min, graph);
         }
 
         /* in any case, update rhs of predecessors (nodes from which we can reach p_min via a single segment) */
@@ -2246,13 +2957,14 @@ static void route_graph_compute_shortest_path(struct route_graph * graph, struct
             if ((s->start == s->end) || (s->data.item.type < route_item_first) || (s->data.item.type > route_item_last))
                 continue;
             else if (route_value_seg(profile, NULL, s, -2) != INT_MAX)
-                route_graph_point_update(profile, s->end, graph->heap);
+                route_graph_point_update(profile, s->end, graph);
         for (s = p_min->end; s; s = s->end_next)
             if ((s->start == s->end) || (s->data.item.type < route_item_first) || (s->data.item.type > route_item_last))
                 continue;
             else if (route_value_seg(profile, NULL, s, 2) != INT_MAX)
-                route_graph_point_update(profile, s->start, graph->heap);
+                route_graph_point_update(profile, s->start, graph);
     }
+    dbg(lvl_debug,"%d points expanded%s", graph->expanded, graph->heuristic ? " with heuristic" : "");
     if (cb)
         callback_call_0(cb);
 }
@@ -2342,11 +3054,12 @@ static void route_graph_add_traffic_distortion(struct route_graph *this, struct
         if (item_attr_get(item, attr_delay, &delay_attr))
             data.len=delay_attr.u.num;
         route_graph_add_segment(this, s_pnt, e_pnt, &data);
+        route_graph_costs_invalidate(this, s_pnt);
         if (update) {
             if (!(data.flags & AF_ONEWAYREV))
-                route_graph_point_update(profile, s_pnt, this->heap);
+                route_graph_point_update(profile, s_pnt, this);
             if (!(data.flags & AF_ONEWAY))
-                route_graph_point_update(profile, e_pnt, this->heap);
+                route_graph_point_update(profile, e_pnt, this);
         }
     }
 }
@@ -2388,6 +3101,7 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
         for (curr = e_pnt->end; curr; curr = curr->end_next)
             if (curr->data.item.type == type_traffic_distortion)
                 e_pnt->flags |= RP_TRAFFIC_DISTORTION;
+        route_graph_costs_invalidate(this, s_pnt);
 #else
         struct route_graph_segment *found = NULL, *prev;
         /* this frees up memory but is slower */
@@ -2446,14 +3160,13 @@ static void route_graph_remove_traffic_distortion(struct route_graph *this, stru
             curr = prev->end_next;
         }
 
-        size = sizeof(struct route_graph_segment) - sizeof(struct route_segment_data)
-               + route_segment_data_size(found->data.flags);
-        g_slice_free1(size, found);
+        /* the memory of the segment is only released along with the segment arena of the graph */
+        route_graph_costs_invalidate(this, s_pnt);
 #endif
 
         /* TODO figure out if we need to update both points */
-        route_graph_point_update(profile, s_pnt, this->heap);
-        route_graph_point_update(profile, e_pnt, this->heap);
+        route_graph_point_update(profile, s_pnt, this);
+        route_graph_point_update(profile, e_pnt, this);
     }
 }
 
@@ -2474,11 +3187,30 @@ static void route_graph_change_traffic_distortion(struct route_graph *this, stru
 }
 
 /**
- * @brief Adds a turn restriction item to the route graph
+ * @brief Marks a point of the route graph as the via point of a turn restriction
  *
- * @param this The route graph to add to
- * @param item The item to add, must be of `type_street_turn_restriction_no` or `type_street_turn_restriction_only`
- */
+ * The point is queued for route_graph_process_restrictions() the first time it is marked.
+ *
+ * @param this The route graph
+ * @param p The point
+ */
+static void route_graph_add_restriction_point(struct route_graph *this, struct route_graph_point *p) {
+    if (p->flags & RP_TURN_RESTRICTION)
+        return;
+    p->flags |= RP_TURN_RESTRICTION;
+    if (this->restriction_count >= this->restriction_size) {
+        this->restriction_size=this->restriction_size ? this->restriction_size*2 : 64;
+        this->restrictions=g_renew(struct route_graph_point *, this->restrictions, this->restriction_size);
+    }
+    this->restrictions[this->restriction_count++]=p;
+}
+
+/**
+ * @brief Adds a turn restriction item to the route graph
+ *
+ * @param this The route graph to add to
+ * @param item The item to add, must be of `type_street_turn_restriction_no` or `type_street_turn_restriction_only`
+ */
 void route_graph_add_turn_restriction(struct route_graph *this, struct item *item) {
     struct route_graph_point *pnt[4];
     struct coord c[5];
@@ -2505,11 +3237,11 @@ void route_graph_add_turn_restriction(struct route_graph *this, struct item *ite
     route_graph_add_segment(this, pnt[1], pnt[2], &data);
 #if 1
     if (count == 4) {
-        pnt[1]->flags |= RP_TURN_RESTRICTION;
-        pnt[2]->flags |= RP_TURN_RESTRICTION;
+        route_graph_add_restriction_point(this, pnt[1]);
+        route_graph_add_restriction_point(this, pnt[2]);
         route_graph_add_segment(this, pnt[2], pnt[3], &data);
     } else
-        pnt[1]->flags |= RP_TURN_RESTRICTION;
+        route_graph_add_restriction_point(this, pnt[1]);
 #endif
 }
 
@@ -2537,6 +3269,7 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
     struct coord c,l; /* Current and previous point */
     struct attr attr;
     struct route_graph_segment_data data;
+    struct route_speed_profile *speed_profile=NULL;
     data.flags=0;
     data.offset=1;
     data.maxspeed=-1;
@@ -2560,6 +3293,8 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
 
         if ((data.flags & AF_SPEED_LIMIT) && (item_attr_get(item, attr_maxspeed, &attr)))
             data.maxspeed = attr.u.num;
+        if ((data.flags & AF_SPEED_PROFILE) && (item_attr_get(item, attr_speed_profile, &attr)))
+            speed_profile = attr.u.data;
         if (data.flags & AF_DANGEROUS_GOODS) {
             if (item_attr_get(item, attr_vehicle_dangerous_goods, &attr))
                 data.dangerous_goods = attr.u.num;
@@ -2598,8 +3333,10 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
             e_pnt=route_graph_add_point(this,&l);
             dbg_assert(len >= 0);
             data.len=len;
-            if (!route_graph_segment_is_duplicate(s_pnt, &data))
+            if (!route_graph_segment_is_duplicate(s_pnt, &data)) {
                 route_graph_add_segment(this, s_pnt, e_pnt, &data);
+                route_graph_set_speed_profile(this, s_pnt->start, speed_profile);
+            }
         } else {
             int isseg,rc;
             int sc = 0;
@@ -2612,8 +3349,10 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
                     if (isseg) {
                         e_pnt=route_graph_add_point(this,&l);
                         data.len=len;
-                        if (!route_graph_segment_is_duplicate(s_pnt, &data))
+                        if (!route_graph_segment_is_duplicate(s_pnt, &data)) {
                             route_graph_add_segment(this, s_pnt, e_pnt, &data);
+                            route_graph_set_speed_profile(this, s_pnt->start, speed_profile);
+                        }
                         data.offset++;
                         s_pnt=route_graph_add_point(this,&l);
                         len = 0;
@@ -2624,8 +3363,10 @@ static void route_graph_add_street(struct route_graph *this, struct item *item,
             dbg_assert(len >= 0);
             sc++;
             data.len=len;
-            if (!route_graph_segment_is_duplicate(s_pnt, &data))
+            if (!route_graph_segment_is_duplicate(s_pnt, &data)) {
                 route_graph_add_segment(this, s_pnt, e_pnt, &data);
+                route_graph_set_speed_profile(this, s_pnt->start, speed_profile);
+            }
         }
     }
 }
@@ -2668,24 +3409,93 @@ static struct route_graph_segment *route_graph_get_segment(struct route_graph *g
  * means that calculation of node cost has proceeded far enough to determine the cost of, and cheapest path from, the
  * start point.
  *
- * The current implementation returns true only when the heap is empty, i.e. all points have been calculated. This is
- * not optimal in terms of efficiency, as the cost of the start point and the cheapest path from there no longer
- * change during the last few cycles. Future versions may report true before the heap is completely empty, as soon as
- * the cost of the start point and the cheapest path are final. However, this needs to be considered for recalculations
- * which happen when the vehicle leaves the cheapest path: right now, any point in the route graph has its final cost
- * and cheapest path, thus no recalculation is needed if the vehicle leaves the cheapest path. In the future, however,
- * a (partial) recalculation may be needed if the vehicle deviates from the cheapest path.
+ * Without a heuristic, this returns true only when the heap is empty, i.e. all points have been calculated. Any point
+ * in the route graph then has its final cost and cheapest path, thus no recalculation is needed if the vehicle leaves
+ * the cheapest path.
+ *
+ * With the A* heuristic (see route_graph_set_start()), this returns true as soon as the cost of the start and the
+ * cheapest path from there are final, which is the case when no key on the heap is lower than the cost of the start.
+ * The remaining points stay on the heap. If the vehicle leaves the cheapest path, route_path_update_done() sets the
+ * new start and resumes flooding from there.
  *
  * @param this_ The route graph
  *
  * @return true if calculation is complete, false if not
  */
 static int route_graph_is_path_computed(struct route_graph *this_) {
-    /* TODO refine exit criterion */
-    if (!fh_min(this_->heap))
+    struct route_graph_heuristic *heuristic=this_->heuristic;
+    struct route_graph_point *best=NULL;
+    int i,val,best_val=INT_MAX;
+
+    if (!route_heap_size(this_->heap))
         return 1;
-    else
+    if (!heuristic)
+        return 0;
+    for (i = 0 ; i < heuristic->count ; i++) {
+        val=route_value_add(heuristic->p[i]->value, heuristic->cost[i]);
+        if (val < best_val) {
+            best_val=val;
+            best=heuristic->p[i];
+        }
+    }
+    /* no point on the heap can lead to a cheaper path than the best candidate, which must be final itself */
+    if (best && !best->el && route_heap_min_key(this_->heap) - heuristic->shift >= best_val)
+        return 1;
+    return 0;
+}
+
+/**
+ * @brief Restarts flooding a time-dependent route graph from scratch
+ *
+ * With historic speeds, the cost of a segment depends on the value of the point at which it is left (see
+ * route_graph_speed_delay()), while the incremental repair of route_graph_compute_shortest_path() assumes the costs
+ * of all segments which did not change to be fixed. After segments have been added or their costs have changed, a
+ * time-dependent graph is therefore flooded again instead of being repaired.
+ *
+ * @param this The route
+ * @return true if the graph has been reset and needs to be flooded, false if the graph is not time-dependent
+ */
+static int route_graph_restart_time_dependent(struct route *this) {
+    if (!this->graph->time_dependent)
         return 0;
+    dbg(lvl_debug,"time-dependent graph, flooding from scratch");
+    route_graph_reset(this->graph);
+    route_graph_set_start(this->graph, route_previous_destination(this), this->vehicleprofile, 1);
+    route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
+    return 1;
+}
+
+/**
+ * @brief Returns the number of points which flooding the route graph expands without the A* heuristic
+ *
+ * If the graph uses the heuristic, it is flooded once without it to count the points, and then flooded again with
+ * it to restore its state. This is meant for comparing both modes and takes as long as two route calculations.
+ *
+ * @param this The route
+ * @return The number of points, or -1 if the graph is not complete
+ */
+static int route_graph_expanded_without_heuristic(struct route *this) {
+    struct route_graph *graph=this->graph;
+    struct vehicleprofile *profile=this->vehicleprofile;
+    int heuristic=profile->route_heuristic,expanded,ret=0,i;
+
+    if (!graph || graph->busy || route_graph_build_thread_running(graph) || !this->current_dst)
+        return -1;
+    if (!graph->heuristic)
+        return graph->expanded;
+    expanded=graph->expanded;
+    for (i = 0 ; i < 2 ; i++) {
+        profile->route_heuristic=i ? heuristic : 0;
+        route_graph_reset(graph);
+        route_graph_set_start(graph, route_previous_destination(this), profile, 1);
+        route_graph_init(graph, this->current_dst, profile);
+        graph->expanded=0;
+        route_graph_compute_shortest_path(graph, profile, NULL);
+        if (!i)
+            ret=graph->expanded;
+    }
+    graph->expanded=expanded;
+    return ret;
 }
 
 /**
@@ -2704,10 +3514,9 @@ static int route_graph_is_path_computed(struct route_graph *this_) {
  *
  * The function uses a modified LPA* algorithm for recalculations. Most modifications were made for compatibility with
  * the old routing algorithm:
- * \li The heuristic is always assumed to be zero (which would turn A* into Dijkstra, formerly the basis of the routing
- * algorithm, and makes our keys one-dimensional)
- * \li Currently, each pass evaluates all locally inconsistent points, leaving an empty heap at the end (though this
- * may change in the future).
+ * \li Unless enabled in the vehicle profile, the heuristic is assumed to be zero (which would turn A* into Dijkstra,
+ * formerly the basis of the routing algorithm). Keys are one-dimensional in either case.
+ * \li Without a heuristic, each pass evaluates all locally inconsistent points, leaving an empty heap at the end.
  *
  * @param this_ The route
  */
@@ -2725,8 +3534,12 @@ void route_recalculate_partial(struct route *this_) {
     if (this_->graph->busy)
         return;
 
+    /* a graph built from the overlay may need more cells after traffic changed, once the cells are customized */
+    if (this_->graph->overlay)
+        route_overlay_extend(this_);
+
     /* exit if there is no need to recalculate */
-    if (route_graph_is_path_computed(this_->graph))
+    if (!route_graph_restart_time_dependent(this_) && route_graph_is_path_computed(this_->graph))
         return;
 
     route_status.type = attr_route_status;
@@ -2911,6 +3724,7 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
             this->avoid_seg=s;
             route_graph_set_traffic_distortion(this, this->avoid_seg, profile->turn_around_penalty);
             route_graph_reset(this);
+            route_graph_set_start(this, pos, profile, 1);
             route_graph_init(this, dst, profile);
             route_graph_compute_shortest_path(this, profile, NULL);
             return route_path_new(this, oldpath, pos, dst, profile);
@@ -2931,12 +3745,16 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
                 dstinfo=dst;
             if (!route_path_add_item_from_graph(ret, oldpath, s, 1, posinfo, dstinfo))
                 ret->updated=0;
+            if (this->time_dependent)
+                ret->path_delay+=route_graph_speed_delay(this, profile, s->end, s);
             start=s->end;
         } else {
             if (item_is_equal(s->data.item, dst->street->item) && (s->start->seg == s || !posinfo))
                 dstinfo=dst;
             if (!route_path_add_item_from_graph(ret, oldpath, s, -1, posinfo, dstinfo))
                 ret->updated=0;
+            if (this->time_dependent)
+                ret->path_delay+=route_graph_speed_delay(this, profile, s->start, s);
             start=s->start;
         }
         posinfo=NULL;
@@ -2948,11 +3766,354 @@ static struct route_path *route_path_new(struct route_graph *this, struct route_
     return ret;
 }
 
+#define ROUTE_ALTERNATIVE_STRETCH 25    /**< Maximum extra cost of an alternative over the best route, in percent */
+#define ROUTE_ALTERNATIVE_SHARING 70    /**< Maximum share of the length of an alternative which may also be part of
+                                         *   the best route or a better alternative, in percent */
+#define ROUTE_ALTERNATIVE_WORK 50       /**< Work allowed for alternatives, in percent of the points expanded when
+                                         *   flooding the graph */
+
+/**
+ * @brief A point reached by the search from the start position for alternative routes
+ */
+struct route_alternative_node {
+    struct route_graph_point *p;
+    struct route_graph_segment *seg;        /**< Segment over which the point is reached */
+    struct route_alternative_node *parent;  /**< Node at the other end of `seg`, NULL if `seg` is the segment of the
+                                             *   start position */
+    int value;                              /**< Cost from the start position */
+    int total;                              /**< Cost of the route from the start position to the destination via
+                                             *   this point */
+    int el;                                 /**< Position on the heap */
+};
+
+/**
+ * @brief State of the calculation of alternative routes
+ */
+struct route_alternatives {
+    GHashTable *nodes;                      /**< All nodes by point */
+    struct route_heap *heap;                /**< Nodes to be expanded */
+    struct vehicleprofile *profile;
+    struct route_info *dst;
+    int best;                               /**< Cost of the best route */
+    int work;                               /**< Work done so far, in points expanded or segments examined */
+    int budget;                             /**< Maximum work */
+};
+
+static void route_alternatives_reach(struct route_alternatives *alt, struct route_alternative_node *parent,
+                                     struct route_graph_segment *s, struct route_graph_point *p, int value) {
+    struct route_alternative_node *n;
+
+    if (value == INT_MAX)
+        return;
+    if (parent)
+        value=route_value_add(parent->value, value);
+    n=g_hash_table_lookup(alt->nodes, p);
+    if (!n) {
+        n=g_new0(struct route_alternative_node, 1);
+        n->p=p;
+        g_hash_table_insert(alt->nodes, p, n);
+        route_heap_insert(alt->heap, n, value);
+    } else if (n->el && value < n->value)
+        route_heap_change_key(alt->heap, n, value);
+    else
+        return;
+    n->seg=s;
+    n->parent=parent;
+    n->value=value;
+}
+
+static int route_alternative_node_cmp(const void *a, const void *b) {
+    const struct route_alternative_node *na=*(struct route_alternative_node **)a, *nb=*(struct route_alternative_node **)b;
+    return na->total < nb->total ? -1 : na->total > nb->total;
+}
+
+/**
+ * @brief Floods the graph from the start position
+ *
+ * This stops once the cost from the start exceeds the cost of any acceptable alternative, or when half of the work
+ * budget has been used up.
+ *
+ * @return All points expanded which are part of the flood towards the destination, sorted by the cost of the route
+ * through them; the number of points is stored in `count`
+ */
+static struct route_alternative_node **route_alternatives_flood(struct route_alternatives *alt,
+        struct route_graph *graph, struct route_info *pos, int *count) {
+    struct route_alternative_node *n, **ret=NULL;
+    struct route_graph_segment *s=NULL;
+    int size=0, limit=INT_MAX;
+
+    *count=0;
+    while ((s=route_graph_get_segment(graph, pos->street, s))) {
+        int val=route_value_seg(alt->profile, NULL, s, 2);
+        if (val != INT_MAX)
+            route_alternatives_reach(alt, NULL, s, s->end, val*(100-pos->percent)/100);
+        val=route_value_seg(alt->profile, NULL, s, -2);
+        if (val != INT_MAX)
+            route_alternatives_reach(alt, NULL, s, s->start, val*pos->percent/100);
+    }
+    while (alt->work < alt->budget/2 && (n=route_heap_extract_min(alt->heap))) {
+        alt->work++;
+        if (n->value > limit)
+            break;
+        if (n->p->value != INT_MAX && n->p->seg) {
+            n->total=route_value_add(n->value, n->p->value);
+            if (n->total < alt->best) {
+                alt->best=n->total;
+                limit=alt->best+alt->best/100*ROUTE_ALTERNATIVE_STRETCH;
+            }
+            if (*count >= size) {
+                size=size ? size*2 : 256;
+                ret=g_renew(struct route_alternative_node *, ret, size);
+            }
+            ret[(*count)++]=n;
+        }
+        for (s=n->p->start ; s ; s=s->start_next)
+            if (s != n->seg && s->start != s->end && s->data.item.type >= route_item_first
+                    && s->data.item.type <= route_item_last)
+                route_alternatives_reach(alt, n, s, s->end, route_value_seg(alt->profile, NULL, s, 1));
+        for (s=n->p->end ; s ; s=s->end_next)
+            if (s != n->seg && s->start != s->end && s->data.item.type >= route_item_first
+                    && s->data.item.type <= route_item_last)
+                route_alternatives_reach(alt, n, s, s->start, route_value_seg(alt->profile, NULL, s, -1));
+    }
+    if (*count)
+        qsort(ret, *count, sizeof(*ret), route_alternative_node_cmp);
+    return ret;
+}
+
+/**
+ * @brief Whether a segment is part of the best route or of one of the alternatives found so far
+ */
+static int route_alternative_segment_shared(struct route_graph_segment *s, struct route_path *best,
+        struct route_path *found) {
+    if (best->path_hash && item_hash_lookup(best->path_hash, &s->data.item))
+        return 1;
+    for ( ; found ; found=found->next)
+        if (found->path_hash && item_hash_lookup(found->path_hash, &s->data.item))
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief Checks whether the route via a point is an acceptable alternative
+ *
+ * The route consists of the path from the start position to the point found by route_alternatives_flood(),
+ * followed by the path from the point to the destination found when flooding the graph. It is accepted if
+ * <ul>
+ * <li>its cost does not exceed that of the best route by more than {@code ROUTE_ALTERNATIVE_STRETCH} percent,</li>
+ * <li>the point is on a plateau, i.e. the segment leaving it towards the destination is also the segment over which
+ * the next point is reached from the start, which makes the route locally optimal, and</li>
+ * <li>it shares no more than {@code ROUTE_ALTERNATIVE_SHARING} percent of its length with better routes.</li>
+ * </ul>
+ */
+static int route_alternative_acceptable(struct route_alternatives *alt, struct route_alternative_node *n,
+                                        struct route_path *best, struct route_path *found) {
+    struct route_alternative_node *next;
+    struct route_graph_segment *s=n->p->seg;
+    struct route_graph_point *p;
+    int len=0, shared=0;
+
+    if (n->total > alt->best+alt->best/100*ROUTE_ALTERNATIVE_STRETCH)
+        return 0;
+    next=g_hash_table_lookup(alt->nodes, s->start == n->p ? s->end : s->start);
+    if (!next || next->parent != n || next->seg != s)
+        return 0;
+    for ( ; n ; n=n->parent) {
+        alt->work++;
+        if (n->parent && item_is_equal(n->seg->data.item, alt->dst->street->item))
+            return 0;
+        len+=n->seg->data.len;
+        if (route_alternative_segment_shared(n->seg, best, found))
+            shared+=n->seg->data.len;
+    }
+    p=next->p;
+    while ((s=p->seg)) {
+        alt->work++;
+        len+=s->data.len;
+        if (route_alternative_segment_shared(s, best, found))
+            shared+=s->data.len;
+        if (s == p->dst_seg && p->value == p->dst_val)
+            break;
+        p=(s->start == p) ? s->end : s->start;
+    }
+    return (long long)shared*100 <= (long long)len*ROUTE_ALTERNATIVE_SHARING;
+}
+
+/**
+ * @brief Creates the route path via a point accepted by route_alternative_acceptable()
+ */
+static struct route_path *route_alternative_path_new(struct route_alternatives *alt, struct route_alternative_node *n,
+        struct route_info *pos) {
+    struct route_alternative_node **chain=NULL, *m;
+    struct route_graph_segment *s;
+    struct route_graph_point *start;
+    struct route_info *dst=alt->dst, *dstinfo=NULL;
+    struct route_path *ret;
+    int count=0, i;
+
+    for (m=n ; m ; m=m->parent)
+        count++;
+    chain=g_new(struct route_alternative_node *, count);
+    for (m=n, i=count ; m ; m=m->parent)
+        chain[--i]=m;
+    ret=g_new0(struct route_path, 1);
+    ret->in_use=1;
+    ret->updated=1;
+    if (pos->lenextra)
+        route_path_add_line(ret, &pos->c, &pos->lp, pos->lenextra);
+    ret->path_hash=item_hash_new();
+    for (i = 0 ; i < count ; i++) {
+        s=chain[i]->seg;
+        route_path_add_item_from_graph(ret, NULL, s, s->end == chain[i]->p ? 1 : -1, i ? NULL : pos, NULL);
+    }
+    g_free(chain);
+    start=n->p;
+    s=start->seg;
+    while (s && !dstinfo) {
+        if (item_is_equal(s->data.item, dst->street->item))
+            dstinfo=dst;
+        if (s->start == start) {
+            route_path_add_item_from_graph(ret, NULL, s, 1, NULL, dstinfo);
+            start=s->end;
+        } else {
+            route_path_add_item_from_graph(ret, NULL, s, -1, NULL, dstinfo);
+            start=s->start;
+        }
+        s=start->seg;
+    }
+    if (dst->lenextra)
+        route_path_add_line(ret, &dst->lp, &dst->c, dst->lenextra);
+    route_path_set_totals(ret, alt->profile);
+    return ret;
+}
+
+/**
+ * @brief Calculates alternative routes from the flooded route graph
+ *
+ * Alternatives are found with the via-point method: the graph is flooded once more, this time from the start
+ * position, and every point which has been reached by both floods is a candidate for a route which leads from the
+ * start to the point and from there to the destination, at the sum of both costs. Candidates are examined in order
+ * of their cost, see route_alternative_acceptable() for the criteria.
+ *
+ * Only the values of the points left by flooding the graph towards the destination are used, so the graph is not
+ * modified. Since the flood towards the destination is not repeated, the additional work is bounded by
+ * {@code ROUTE_ALTERNATIVE_WORK} percent of the points expanded for the best route, which may be less than needed
+ * to find any alternative. With the A* heuristic, only points expanded by the heuristic search are candidates.
+ *
+ * @param graph The flooded route graph
+ * @param best The best route
+ * @param pos The start position
+ * @param dst The destination
+ * @param profile The vehicle profile
+ * @param max The maximum number of alternatives
+ * @return The alternatives, linked through their `next` member, or NULL if there are none
+ */
+static struct route_path *route_alternatives_new(struct route_graph *graph, struct route_path *best,
+        struct route_info *pos, struct route_info *dst, struct vehicleprofile *profile, int max) {
+    struct route_alternatives alt;
+    struct route_alternative_node **candidates;
+    struct route_path *ret=NULL, **last=&ret;
+    int count, found=0, i;
+
+    if (!pos->street || !dst->street || profile->mode == 2 || item_is_equal(pos->street->item, dst->street->item))
+        return NULL;
+    memset(&alt, 0, sizeof(alt));
+    alt.nodes=g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    alt.heap=route_heap_new(offsetof(struct route_alternative_node, el));
+    alt.profile=profile;
+    alt.dst=dst;
+    alt.best=INT_MAX;
+    alt.budget=graph->expanded*ROUTE_ALTERNATIVE_WORK/100;
+    candidates=route_alternatives_flood(&alt, graph, pos, &count);
+    for (i = 0 ; i < count && found < max && alt.work < alt.budget ; i++) {
+        if (route_alternative_acceptable(&alt, candidates[i], best, ret)) {
+            *last=route_alternative_path_new(&alt, candidates[i], pos);
+            last=&(*last)->next;
+            found++;
+        }
+    }
+    dbg(lvl_debug,"%d alternatives from %d candidates, work %d of %d", found, count, alt.work, alt.budget);
+    g_free(candidates);
+    route_heap_destroy(alt.heap);
+    g_hash_table_destroy(alt.nodes);
+    return ret;
+}
+
+/**
+ * @brief Recalculates the alternative routes of a route after a new route path has been found
+ *
+ * Alternatives cannot be changed while the alternatives map is being read. In this case they are marked, and
+ * updated by ra_rect_destroy() once they are released.
+ *
+ * @param this The route
+ * @param recalculate If false, the alternatives are only cleared, e.g. because the path they belong to is being
+ * replaced
+ */
+static void route_alternatives_update(struct route *this, int recalculate) {
+    struct route_path *path;
+    int in_use=0;
+
+    for (path=this->alternative_paths ; path ; path=path->next)
+        if (path->in_use > 1)
+            in_use=1;
+    if (in_use) {
+        for (path=this->alternative_paths ; path ; path=path->next)
+            path->update_required=1;
+        return;
+    }
+    route_path_destroy(this->alternative_paths, 1);
+    this->alternative_paths=NULL;
+    if (recalculate && this->alternatives > 0 && this->path2 && this->current_dst)
+        this->alternative_paths=route_alternatives_new(this->graph, this->path2, this->pos, this->current_dst,
+                                this->vehicleprofile, this->alternatives);
+}
+
+/**
+ * @brief State of building a route graph on worker threads
+ *
+ * Maps which report {@code attr_thread_safe} are read on a worker thread, which adds their streets and turn
+ * restrictions to the graph. While the worker runs, it owns the graph: the main thread must not access the graph
+ * other than through the functions below. Once the worker has finished, all other maps are read on the main loop as
+ * before, and the graph is completed by route_graph_build_done().
+ *
+ * If there are several such maps, the worker starts additional threads, up to one per processor, and each map is
+ * read by one of them. The first map is read into the route graph itself, every other map into a graph of its own.
+ * After all maps have been read, these graphs are merged into the route graph in the order of the mapset, skipping
+ * segments which another map already provided.
+ */
+struct route_graph_build_thread {
+    struct thread *thread;                  /**< The worker, NULL once it has been joined */
+    struct thread_lock *lock;               /**< Protects `cancel`, `done` and `next` */
+    int cancel;                             /**< Set by the main thread to make the worker stop early */
+    int done;                               /**< Set by the worker when it has finished */
+    GList *maps;                            /**< The maps read by the worker, each holding a reference */
+    int map_count;                          /**< Number of maps in `maps` */
+    int next;                               /**< Index of the next map to be read */
+    struct route_graph **graphs;            /**< For each map, the graph to which it is read; the first one is
+                                             *   `rg`, all others are merged into `rg` once they are complete */
+    struct route_graph *rg;                 /**< The graph being built */
+    struct vehicleprofile *profile;         /**< The vehicle profile */
+    struct callback *poll_cb;               /**< Callback polling for the worker to finish */
+    struct event_timeout *poll_ev;          /**< Timeout calling `poll_cb` */
+};
+
+/**
+ * @brief Whether the graph is currently being built on a worker thread
+ *
+ * While this is the case, the graph must not be accessed from the main thread.
+ */
+static int route_graph_build_thread_running(struct route_graph *rg) {
+    return rg && rg->build_thread && rg->build_thread->thread;
+}
+
 static int route_graph_build_next_map(struct route_graph *rg) {
     do {
         rg->m=mapset_next(rg->h, 2);
         if (! rg->m)
             return 0;
+        /* maps read on the worker thread are done already */
+        if (rg->build_thread && g_list_find(rg->build_thread->maps, rg->m))
+            continue;
         map_rect_destroy(rg->mr);
         rg->mr=map_rect_new(rg->m, rg->sel);
     } while (!rg->mr);
@@ -2960,6 +4121,228 @@ static int route_graph_build_next_map(struct route_graph *rg) {
     return 1;
 }
 
+/**
+ * @brief Whether a turn restriction is already part of the route graph
+ *
+ * @param rg The route graph
+ * @param item The turn restriction
+ */
+static int route_graph_has_turn_restriction(struct route_graph *rg, struct item *item) {
+    struct route_graph_segment_data data;
+    struct route_graph_point *p;
+    struct coord c;
+
+    data.item=item;
+    data.flags=0;
+    item_coord_rewind(item);
+    return item_coord_get(item, &c, 1) && (p=route_graph_get_point(rg, &c)) && route_graph_segment_is_duplicate(p, &data);
+}
+
+/**
+ * @brief Adds an item read from a map to the route graph which is being built
+ *
+ * If the graph is being extended (i.e. it has an extent already), turn restrictions which are already part of the
+ * graph are skipped. Streets are never added twice, see route_graph_add_street().
+ */
+static void route_graph_build_add_item(struct route_graph *rg, struct vehicleprofile *profile, struct item *item) {
+    rg->item_count++;
+    if (item->type == type_traffic_distortion)
+        route_graph_add_traffic_distortion(rg, profile, item, 0);
+    else if (item->type == type_street_turn_restriction_no || item->type == type_street_turn_restriction_only) {
+        if (!rg->extent || !route_graph_has_turn_restriction(rg, item))
+            route_graph_add_turn_restriction(rg, item);
+    } else
+        route_graph_add_street(rg, item, profile);
+}
+
+static int route_graph_build_thread_cancelled(struct route_graph_build_thread *bt) {
+    int ret;
+    thread_lock_acquire(bt->lock);
+    ret=bt->cancel;
+    thread_lock_release(bt->lock);
+    return ret;
+}
+
+/**
+ * @brief Merges the points and segments of one route graph into another
+ *
+ * Segments are added in the order in which they were added to `from`, unless `this` already holds the same
+ * segment, as determined by route_graph_segment_is_duplicate(). Turn restrictions are added unconditionally, just as
+ * when they are read from a map.
+ *
+ * @param this The graph to merge into
+ * @param from The graph to merge, its segment list is reversed in the process
+ * @param bt The state of the build, used to check for cancellation
+ * @return True if the graph was merged, false if the build was cancelled
+ */
+static int route_graph_merge(struct route_graph *this, struct route_graph *from,
+                             struct route_graph_build_thread *bt) {
+    struct route_graph_segment *s,*next,*prev=NULL;
+    struct route_graph_point *start,*end;
+    struct route_graph_segment_data data;
+    int count=0;
+
+    /* route_segments holds the most recent segment first */
+    for (s = from->route_segments ; s ; s = next) {
+        next=s->next;
+        s->next=prev;
+        prev=s;
+    }
+    from->route_segments=prev;
+    for (s = from->route_segments ; s ; s = s->next) {
+        if (!(++count % 10000) && route_graph_build_thread_cancelled(bt))
+            return 0;
+        memset(&data, 0, sizeof(data));
+        data.item=&s->data.item;
+        data.flags=s->data.flags;
+        data.len=s->data.len;
+        data.score=s->data.score;
+        data.offset=(s->data.flags & AF_SEGMENTED) ? RSD_OFFSET(&s->data) : 1;
+        data.maxspeed=(s->data.flags & AF_SPEED_LIMIT) ? RSD_MAXSPEED(&s->data) : -1;
+        if (s->data.flags & AF_SIZE_OR_WEIGHT_LIMIT)
+            data.size_weight=RSD_SIZE_WEIGHT(&s->data);
+        if (s->data.flags & AF_DANGEROUS_GOODS)
+            data.dangerous_goods=RSD_DANGEROUS_GOODS(&s->data);
+        start=route_graph_add_point(this, &s->start->c);
+        end=route_graph_add_point(this, &s->end->c);
+        if (s->start->flags & RP_TURN_RESTRICTION)
+            route_graph_add_restriction_point(this, start);
+        if (s->end->flags & RP_TURN_RESTRICTION)
+            route_graph_add_restriction_point(this, end);
+        start->flags |= s->start->flags;
+        end->flags |= s->end->flags;
+        if (s->data.item.type == type_street_turn_restriction_no || s->data.item.type == type_street_turn_restriction_only
+                || !route_graph_segment_is_duplicate(start, &data)) {
+            route_graph_add_segment(this, start, end, &data);
+            route_graph_set_speed_profile(this, start->start, route_graph_get_speed_profile(from, s));
+        }
+    }
+    this->item_count+=from->item_count;
+    return 1;
+}
+
+/**
+ * @brief Reads one map into a route graph
+ *
+ * @return True if the map was read, false if the build was cancelled
+ */
+static int route_graph_build_read_map(struct route_graph_build_thread *bt, struct map *m, struct route_graph *rg) {
+    struct map_rect *mr;
+    struct item *item;
+    int count=0;
+
+    mr=map_rect_new(m, bt->rg->sel);
+    if (!mr)
+        return 1;
+    while ((item=map_rect_get_item(mr))) {
+        route_graph_build_add_item(rg, bt->profile, item);
+        if (!(++count % 1000) && route_graph_build_thread_cancelled(bt)) {
+            map_rect_destroy(mr);
+            return 0;
+        }
+    }
+    map_rect_destroy(mr);
+    dbg(lvl_debug,"read %d items from map %p", count, m);
+    return 1;
+}
+
+/**
+ * @brief Main function of the threads reading maps
+ *
+ * Each thread reads maps until there are no maps left, so that the maps are distributed evenly.
+ *
+ * @param data The state of the build
+ * @return True if all maps were read, false if the build was cancelled
+ */
+static int route_graph_build_thread_read(void *data) {
+    struct route_graph_build_thread *bt=data;
+    int i;
+
+    for (;;) {
+        thread_lock_acquire(bt->lock);
+        i=bt->cancel ? bt->map_count : bt->next++;
+        thread_lock_release(bt->lock);
+        if (i >= bt->map_count)
+            return !route_graph_build_thread_cancelled(bt);
+        if (!route_graph_build_read_map(bt, g_list_nth_data(bt->maps, i), bt->graphs[i]))
+            return 0;
+    }
+}
+
+/**
+ * @brief Main function of the worker thread building the route graph
+ *
+ * @param data The state of the build
+ * @return True if all maps were read, false if the build was cancelled
+ */
+static int route_graph_build_thread_main(void *data) {
+    struct route_graph_build_thread *bt=data;
+    struct thread **threads;
+    int i,count,ret;
+
+    count=MIN(thread_cpu_count(), bt->map_count)-1;
+    threads=g_new0(struct thread *, count+1);
+    for (i = 0 ; i < count ; i++)
+        threads[i]=thread_new(route_graph_build_thread_read, bt, "route_graph_read");
+    ret=route_graph_build_thread_read(bt);
+    for (i = 0 ; i < count ; i++)
+        if (threads[i] && !thread_join(threads[i]))
+            ret=0;
+    g_free(threads);
+    dbg(lvl_debug,"read %d maps on %d threads, ret=%d", bt->map_count, count+1, ret);
+    for (i = 1 ; i < bt->map_count ; i++) {
+        if (ret)
+            ret=route_graph_merge(bt->rg, bt->graphs[i], bt);
+        route_graph_free_points(bt->graphs[i]);
+        route_graph_free_segments(bt->graphs[i]);
+        g_free(bt->graphs[i]);
+        bt->graphs[i]=NULL;
+    }
+    dbg(lvl_debug,"merged graph has %d points", bt->rg->point_count);
+    thread_lock_acquire(bt->lock);
+    bt->done=1;
+    thread_lock_release(bt->lock);
+    return ret;
+}
+
+/**
+ * @brief Waits for the worker thread to finish and stops polling for it
+ *
+ * If the worker is still running, it is cancelled first.
+ */
+static void route_graph_build_thread_stop(struct route_graph_build_thread *bt) {
+    if (bt->thread) {
+        thread_lock_acquire(bt->lock);
+        bt->cancel=1;
+        thread_lock_release(bt->lock);
+        thread_join(bt->thread);
+        bt->thread=NULL;
+    }
+    if (bt->poll_ev)
+        event_remove_timeout(bt->poll_ev);
+    if (bt->poll_cb)
+        callback_destroy(bt->poll_cb);
+    bt->poll_ev=NULL;
+    bt->poll_cb=NULL;
+}
+
+static void route_graph_build_thread_destroy(struct route_graph_build_thread *bt) {
+    GList *l=bt->maps;
+    int i;
+    route_graph_build_thread_stop(bt);
+    /* the graphs of all maps but the first are only left if the worker could not be started */
+    for (i = 1 ; i < bt->map_count ; i++)
+        g_free(bt->graphs[i]);
+    while (l) {
+        map_unref(l->data);
+        l=g_list_next(l);
+    }
+    g_list_free(bt->maps);
+    g_free(bt->graphs);
+    thread_lock_destroy(bt->lock);
+    g_free(bt);
+}
+
 
 static int is_turn_allowed(struct route_graph_point *p, struct route_graph_segment *from,
                            struct route_graph_segment *to) {
@@ -3034,6 +4417,7 @@ static void route_graph_clone_segment(struct route_graph *this, struct route_gra
     dbg(lvl_debug,"cloning segment from %p (0x%x,0x%x) to %p (0x%x,0x%x)",start,start->c.x,start->c.y, end, end->c.x,
         end->c.y);
     route_graph_add_segment(this, start, end, &data);
+    route_graph_set_speed_profile(this, start->start, route_graph_get_speed_profile(this, s));
 }
 
 static void route_graph_process_restriction_segment(struct route_graph *this, struct route_graph_point *p,
@@ -3104,53 +4488,262 @@ static void route_graph_process_restriction_point(struct route_graph *this, stru
     p->flags |= RP_TURN_RESTRICTION_RESOLVED;
 }
 
+/**
+ * @brief Resolves the turn restrictions added to the route graph since the last call
+ *
+ * Only the points queued by route_graph_add_restriction_point() are visited, so that extending a graph does not
+ * sweep all of its points again.
+ *
+ * @param this The route graph
+ */
 static void route_graph_process_restrictions(struct route_graph *this) {
     struct route_graph_point *curr;
     int i;
-    dbg(lvl_debug,"enter");
-    for (i = 0 ; i < HASH_SIZE ; i++) {
-        curr=this->hash[i];
-        while (curr) {
-            if (curr->flags & RP_TURN_RESTRICTION)
-                route_graph_process_restriction_point(this, curr);
-            curr=curr->hash_next;
-        }
+    dbg(lvl_debug,"enter, %d points", this->restriction_count);
+    for (i = 0 ; i < this->restriction_count ; i++) {
+        curr=this->restrictions[i];
+        if (!(curr->flags & RP_TURN_RESTRICTION_RESOLVED))
+            route_graph_process_restriction_point(this, curr);
     }
+    this->restriction_count=0;
 }
 
 /**
- * @brief Releases all resources needed to build the route graph.
- *
- * If `cancel` is false, this function will start processing restrictions and ultimately call the route
- * graph's `done_cb` callback.
+ * @brief Returns the size of a segment in the frozen layout of a route graph
  *
- * The traffic module will always call this method with `cancel` set to true, as it does not process
- * restrictions and has no callback. Inside the routing module, `cancel` will be true if, and only if,
- * navigation has been aborted.
+ * This is the size of the segment including its variable fields, rounded up to keep the next segment aligned.
  *
- * @param rg Points to the route graph
- * @param cancel True if the process was aborted before completing, false if it completed normally
+ * @param s The segment
  */
-void route_graph_build_done(struct route_graph *rg, int cancel) {
-    dbg(lvl_debug,"cancel=%d",cancel);
-    if (rg->idle_ev)
-        event_remove_idle(rg->idle_ev);
-    if (rg->idle_cb)
+static int route_graph_frozen_segment_size(struct route_graph_segment *s) {
+    int size=sizeof(struct route_graph_segment)-sizeof(struct route_segment_data)+route_segment_data_size(s->data.flags);
+    return (size+sizeof(void *)-1) & ~(sizeof(void *)-1);
+}
+
+/**
+ * @brief Moves all points and segments of a route graph into contiguous memory
+ *
+ * During graph building, points and segments are allocated one at a time, in the order in which items are read
+ * from the maps. Flooding the graph then jumps all over the heap and is dominated by cache misses. This function
+ * copies all points into one array and all segments into one buffer, and updates all links between them:
+ *
+ * \li Points are sorted by a 16-bit Morton code of their position within the bounding box of the graph, so that
+ * points which are close to each other on the map are close to each other in memory.
+ * \li Segments are grouped by their start point, in the order of the points. The segments starting at a point are
+ * thus adjacent to each other, and to those of neighboring points.
+ * \li The point hash is resized to hold about one point per bucket.
+ *
+ * All linked lists stay valid and keep their order, so that code iterating over segments, including
+ * `rp_iterator_new()`, and `route_graph_get_point()` work unchanged. The copies are allocated from new arenas and
+ * the arenas used while building are released. Points and segments added later (e.g. for traffic distortions) are
+ * allocated from the new arenas.
+ *
+ * This must be called before any references to points or segments are handed out, i.e. before the graph is flooded.
+ * It may be called again after the graph has been extended, as long as the graph has been reset and no references
+ * are held.
+ *
+ * @param this The route graph
+ */
+static void route_graph_freeze(struct route_graph *this) {
+    struct route_graph_point **order,*p,*points;
+    struct route_graph_segment *s;
+    struct route_graph_arena point_arena,segment_arena;
+    struct coord_rect r;
+    int *count;
+    int i,j,n=this->point_count,size=0,first=1,shift_x=0,shift_y=0;
+    char *segments,*pos;
+
+    if (!n)
+        return;
+
+    /* counting sort of the points by the Morton code of their cell in a 256x256 grid over the graph */
+    for (i = 0 ; i < this->hash_size ; i++) {
+        for (p = this->hash[i] ; p ; p = p->hash_next) {
+            if (first)
+                r.lu=r.rl=p->c;
+            else
+                coord_rect_extend(&r, &p->c);
+            first=0;
+            for (s = p->start ; s ; s = s->start_next)
+                size+=route_graph_frozen_segment_size(s);
+        }
+    }
+    while (((r.rl.x-r.lu.x) >> shift_x) > 255)
+        shift_x++;
+    while (((r.lu.y-r.rl.y) >> shift_y) > 255)
+        shift_y++;
+    count=g_new0(int, 65537);
+    order=g_new(struct route_graph_point *, n);
+    for (j = 0 ; j < 2 ; j++) {
+        for (i = 0 ; i < this->hash_size ; i++) {
+            for (p = this->hash[i] ; p ; p = p->hash_next) {
+                int x=(p->c.x-r.lu.x) >> shift_x, y=(p->c.y-r.rl.y) >> shift_y, cell=0, bit;
+                for (bit = 0 ; bit < 8 ; bit++)
+                    cell|=(((x >> bit) & 1) << (2*bit)) | (((y >> bit) & 1) << (2*bit+1));
+                if (j)
+                    order[count[cell]++]=p;
+                else
+                    count[cell+1]++;
+            }
+        }
+        if (!j)
+            for (i = 0 ; i < 65536 ; i++)
+                count[i+1]+=count[i];
+    }
+    g_free(count);
+
+    /* resize the hash first, as the hash chains are copied along with the points */
+    while (this->hash_size < n)
+        route_graph_rehash(this, this->hash_size*2);
+
+    /* copy points and segments to new arenas, the old ones forward to their copies through hash_next and next. The
+     * old arenas count towards the peak size until they are released. */
+    point_arena=this->point_arena;
+    segment_arena=this->segment_arena;
+    memset(&this->point_arena, 0, sizeof(this->point_arena));
+    memset(&this->segment_arena, 0, sizeof(this->segment_arena));
+    this->point_arena.size=point_arena.size;
+    this->segment_arena.size=segment_arena.size;
+    points=route_graph_arena_alloc(this, &this->point_arena, n*sizeof(struct route_graph_point));
+    segments=size ? route_graph_arena_alloc(this, &this->segment_arena, size) : NULL;
+    this->point_arena.size-=point_arena.size;
+    this->segment_arena.size-=segment_arena.size;
+    pos=segments;
+    for (i = 0 ; i < n ; i++) {
+        points[i]=*order[i];
+        for (s = order[i]->start ; s ; s = s->start_next) {
+            memcpy(pos, s, route_graph_frozen_segment_size(s));
+            s->next=(struct route_graph_segment *)pos;
+            pos+=route_graph_frozen_segment_size(s);
+        }
+    }
+    for (i = 0 ; i < n ; i++)
+        order[i]->hash_next=&points[i];
+#define FORWARD_POINT(p) ((p) ? (p)->hash_next : NULL)
+#define FORWARD_SEGMENT(s) ((s) ? (s)->next : NULL)
+    for (i = 0 ; i < this->hash_size ; i++)
+        this->hash[i]=FORWARD_POINT(this->hash[i]);
+    for (i = 0 ; i < this->restriction_count ; i++)
+        this->restrictions[i]=FORWARD_POINT(this->restrictions[i]);
+    for (i = 0 ; i < n ; i++) {
+        p=&points[i];
+        p->hash_next=FORWARD_POINT(p->hash_next);
+        p->start=FORWARD_SEGMENT(p->start);
+        p->end=FORWARD_SEGMENT(p->end);
+        p->seg=FORWARD_SEGMENT(p->seg);
+        p->dst_seg=FORWARD_SEGMENT(p->dst_seg);
+    }
+    this->avoid_seg=FORWARD_SEGMENT(this->avoid_seg);
+    for (pos = segments ; pos < segments+size ; pos+=route_graph_frozen_segment_size(s)) {
+        s=(struct route_graph_segment *)pos;
+        s->start_next=FORWARD_SEGMENT(s->start_next);
+        s->end_next=FORWARD_SEGMENT(s->end_next);
+        s->start=FORWARD_POINT(s->start);
+        s->end=FORWARD_POINT(s->end);
+        s->next=pos+route_graph_frozen_segment_size(s) < segments+size ?
+                (struct route_graph_segment *)(pos+route_graph_frozen_segment_size(s)) : NULL;
+    }
+#undef FORWARD_POINT
+#undef FORWARD_SEGMENT
+    this->route_segments=size ? (struct route_graph_segment *)segments : NULL;
+
+    /* free the old points and segments */
+    route_graph_arena_free(&point_arena);
+    route_graph_arena_free(&segment_arena);
+    g_free(order);
+    this->frozen_points=points;
+    this->frozen_point_count=n;
+    this->frozen_segments=segments;
+    this->frozen_segments_size=size;
+    dbg(lvl_debug,"froze %d points and %d bytes of segments, %d hash buckets", n, size, this->hash_size);
+}
+
+/**
+ * @brief Logs how many items and segments each rectangle of the selection of a route graph contributed
+ *
+ * Each segment is attributed to the first rectangle of the extent of the graph holding its start point, and each
+ * item to the rectangle of its first segment. This is only done if info messages are enabled, as it takes time
+ * proportional to the number of segments and rectangles.
+ *
+ * @param graph The route graph
+ */
+static void route_graph_log_selection(struct route_graph *graph) {
+    struct map_selection *sel;
+    struct route_graph_segment *s;
+    int i,count=0,*items,*segments;
+
+    if (max_debug_level < lvl_info)
+        return;
+    for (sel=graph->extent ; sel ; sel=sel->next)
+        count++;
+    items=g_new0(int, count+1);
+    segments=g_new0(int, count+1);
+    for (s=graph->route_segments ; s ; s=s->next) {
+        for (i=0, sel=graph->extent ; sel && !coord_rect_contains(&sel->u.c_rect, &s->start->c) ; i++, sel=sel->next);
+        segments[i]++;
+        if (!(s->data.flags & AF_SEGMENTED) || RSD_OFFSET(&s->data) == 1)
+            items[i]++;
+    }
+    for (i=0, sel=graph->extent ; sel ; i++, sel=sel->next)
+        dbg(lvl_info,"order %d (0x%x,0x%x)-(0x%x,0x%x): %d items, %d segments", sel->order, sel->u.c_rect.lu.x,
+            sel->u.c_rect.lu.y, sel->u.c_rect.rl.x, sel->u.c_rect.rl.y, items[i], segments[i]);
+    dbg(lvl_info,"outside of all rectangles: %d items, %d segments", items[count], segments[count]);
+    dbg(lvl_info,"%d items read, %d points, %d segments", graph->item_count, graph->point_count,
+        graph->segment_count);
+    g_free(items);
+    g_free(segments);
+}
+
+/**
+ * @brief Releases all resources needed to build the route graph.
+ *
+ * If `cancel` is false, this function will start processing restrictions and ultimately call the route
+ * graph's `done_cb` callback.
+ *
+ * The traffic module will always call this method with `cancel` set to true, as it does not process
+ * restrictions and has no callback. Inside the routing module, `cancel` will be true if, and only if,
+ * navigation has been aborted.
+ *
+ * @param rg Points to the route graph
+ * @param cancel True if the process was aborted before completing, false if it completed normally
+ */
+void route_graph_build_done(struct route_graph *rg, int cancel) {
+    struct map_selection **last;
+
+    dbg(lvl_debug,"cancel=%d",cancel);
+    if (rg->build_thread)
+        route_graph_build_thread_destroy(rg->build_thread);
+    rg->build_thread=NULL;
+    if (rg->idle_ev)
+        event_remove_idle(rg->idle_ev);
+    if (rg->idle_cb)
         callback_destroy(rg->idle_cb);
     map_rect_destroy(rg->mr);
     mapset_close(rg->h);
-    route_free_selection(rg->sel);
+    if (cancel) {
+        route_free_selection(rg->sel);
+    } else {
+        /* the extent is only set if the graph has been extended, see route_graph_build_start() */
+        for (last=&rg->sel ; *last ; last=&(*last)->next);
+        *last=rg->extent;
+        rg->extent=rg->sel;
+    }
     rg->idle_ev=NULL;
     rg->idle_cb=NULL;
     rg->mr=NULL;
     rg->h=NULL;
     rg->sel=NULL;
+    rg->busy=0;
     if (! cancel) {
         route_graph_process_restrictions(rg);
+        /* new turn restrictions may apply to segments whose costs are cached */
+        rg->costs_profile=NULL;
+        route_graph_freeze(rg);
+        route_graph_log_selection(rg);
+        /* the callback may build the graph further, or destroy it */
         if (rg->done_cb)
             callback_call_0(rg->done_cb);
     }
-    rg->busy=0;
 }
 
 static void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile *profile) {
@@ -3167,92 +4760,2732 @@ static void route_graph_build_idle(struct route_graph *rg, struct vehicleprofile
                 return;
             }
         }
-        if (item->type == type_traffic_distortion)
-            route_graph_add_traffic_distortion(rg, profile, item, 0);
-        else if (item->type == type_street_turn_restriction_no || item->type == type_street_turn_restriction_only)
-            route_graph_add_turn_restriction(rg, item);
-        else
-            route_graph_add_street(rg, item, profile);
-        count--;
+        route_graph_build_add_item(rg, profile, item);
+        count--;
+    }
+}
+
+/**
+ * @brief Checks whether the worker thread has finished, and if so, continues building the graph on the main loop
+ */
+static void route_graph_build_thread_poll(struct route_graph *rg) {
+    struct route_graph_build_thread *bt=rg->build_thread;
+    int done;
+
+    thread_lock_acquire(bt->lock);
+    done=bt->done;
+    thread_lock_release(bt->lock);
+    if (!done)
+        return;
+    route_graph_build_thread_stop(bt);
+    /* read the remaining maps on the main loop */
+    if (route_graph_build_next_map(rg)) {
+        rg->idle_cb=callback_new_2(callback_cast(route_graph_build_idle), rg, bt->profile);
+        rg->idle_ev=event_add_idle(50, rg->idle_cb);
+    } else
+        route_graph_build_done(rg, 0);
+}
+
+/**
+ * @brief Starts reading all thread-safe maps of a mapset on a worker thread
+ *
+ * @param rg The route graph, whose selection must be set
+ * @param ms The mapset
+ * @param profile The vehicle profile
+ * @return True if a worker was started, false if threads are not supported or no map can be read on a thread
+ */
+static int route_graph_build_thread_start(struct route_graph *rg, struct mapset *ms, struct vehicleprofile *profile) {
+    struct route_graph_build_thread *bt;
+    struct mapset_handle *h;
+    struct map *m;
+    struct attr thread_safe;
+    GList *maps=NULL;
+    int i;
+
+    if (!thread_supported())
+        return 0;
+    h=mapset_open(ms);
+    while ((m=mapset_next(h, 2))) {
+        if (map_get_attr(m, attr_thread_safe, &thread_safe, NULL) && thread_safe.u.num)
+            maps=g_list_append(maps, map_ref(m));
+    }
+    mapset_close(h);
+    if (!maps)
+        return 0;
+    bt=g_new0(struct route_graph_build_thread, 1);
+    bt->lock=thread_lock_new();
+    bt->maps=maps;
+    bt->map_count=g_list_length(maps);
+    bt->graphs=g_new0(struct route_graph *, bt->map_count);
+    bt->graphs[0]=rg;
+    for (i = 1 ; i < bt->map_count ; i++)
+        bt->graphs[i]=g_new0(struct route_graph, 1);
+    bt->rg=rg;
+    bt->profile=profile;
+    rg->build_thread=bt;
+    bt->thread=thread_new(route_graph_build_thread_main, bt, "route_graph_build");
+    if (!bt->thread) {
+        route_graph_build_thread_destroy(bt);
+        rg->build_thread=NULL;
+        return 0;
+    }
+    dbg(lvl_debug,"building graph from %d maps on worker thread", bt->map_count);
+    bt->poll_cb=callback_new_1(callback_cast(route_graph_build_thread_poll), rg);
+    bt->poll_ev=event_add_timeout(50, 1, bt->poll_cb);
+    return 1;
+}
+
+/**
+ * @brief Starts reading the items of a selection into a route graph
+ *
+ * This is used for new graphs as well as for adding to a finished graph, in which case the selection should not
+ * overlap the extent of the graph. The graph's `done_cb` is called once all items have been read, and the selection
+ * is added to the extent of the graph.
+ *
+ * @param rg The route graph, which must not be busy
+ * @param ms The mapset to read from
+ * @param sel The selection, which is freed with the graph
+ * @param async Whether to read in the background, see route_graph_build()
+ * @param profile The vehicle profile
+ */
+static void route_graph_build_start(struct route_graph *rg, struct mapset *ms, struct map_selection *sel, int async,
+                                    struct vehicleprofile *profile) {
+    rg->sel=sel;
+    rg->h=mapset_open(ms);
+    rg->busy=1;
+    rg->async=async;
+    if (async && route_graph_build_thread_start(rg, ms, profile))
+        return;
+    if (route_graph_build_next_map(rg)) {
+        if (async) {
+            rg->idle_cb=callback_new_2(callback_cast(route_graph_build_idle), rg, profile);
+            rg->idle_ev=event_add_idle(50, rg->idle_cb);
+        }
+    } else
+        route_graph_build_done(rg, 0);
+}
+
+/**
+ * @brief Builds a new route graph from a mapset
+ *
+ * This function builds a new route graph from a map. Please note that this function does not
+ * add any routing information to the route graph - this has to be done via the route_graph_flood()
+ * function.
+ *
+ * @param ms The mapset to build the route graph from
+ * @param sel The selection from which to read the graph, see route_calc_selection(), which is freed with the graph
+ * @param done_cb The callback which will be called when graph is complete
+ * @param async If true, the graph is built in the background: thread-safe maps are read on a worker thread if
+ * threads are supported, all other maps on the main loop. If false, the caller must call route_graph_build_idle()
+ * until the graph is no longer busy.
+ * @param profile The vehicle profile
+ * @return The new route graph.
+ */
+static struct route_graph *route_graph_build(struct mapset *ms, struct map_selection *sel, struct callback *done_cb,
+        int async,
+        struct vehicleprofile *profile) {
+    struct route_graph *ret=g_new0(struct route_graph, 1);
+
+    dbg(lvl_debug,"enter");
+
+    ret->done_cb=done_cb;
+    ret->heap = route_heap_new(offsetof(struct route_graph_point, el));
+    route_graph_build_start(ret, ms, sel, async, profile);
+    return ret;
+}
+
+/**
+ * @brief An edge of the contraction hierarchy
+ *
+ * maptool stores the edges of each node as {@code attr_ch_edge} attributes of a {@code type_ch_node} item. Each edge
+ * is stored with the lower ranked of its two nodes.
+ */
+struct route_ch_edge {
+    int flags;                  /**< Combination of {@code CH_EDGE_*} flags */
+    int weight;                 /**< Cost of the edge as computed by maptool */
+    struct item_id target;      /**< The node at the other end of the edge */
+    struct item_id middle;      /**< For shortcuts the node which was contracted, otherwise the street item */
+};
+
+#define CH_EDGE_FORWARD 1       /**< The edge can be used from the node to the target */
+#define CH_EDGE_BACKWARD 2      /**< The edge can be used from the target to the node */
+#define CH_EDGE_SHORTCUT 4      /**< The edge is a shortcut over the middle node */
+
+/**
+ * @brief A node visited by a contraction hierarchy query
+ *
+ * Index 0 of each array refers to the search from the start, index 1 to the search from the destination.
+ */
+struct route_ch_node {
+    struct item_id id;
+    int value[2];                       /**< Cost from the start or to the destination */
+    struct route_ch_node *parent[2];    /**< Previous node of the search */
+    struct route_ch_edge edge[2];       /**< Edge between parent and this node */
+    int el[2];                          /**< Position on the heap of each search */
+};
+
+/**
+ * @brief State of a bidirectional query in the contraction hierarchy
+ */
+struct route_ch_query {
+    struct map *map;                    /**< The map holding the contraction hierarchy */
+    struct map_rect *mr;                /**< Map rect to look up items by id */
+    GHashTable *nodes;                  /**< All visited nodes by id */
+    struct route_heap *heap[2];         /**< Nodes to be expanded by each search */
+    struct route_ch_node *meet;         /**< Node of the best path found so far */
+    int best;                           /**< Cost of the best path found so far */
+};
+
+/**
+ * @brief A growing list of street item ids
+ */
+struct route_ch_streets {
+    struct item_id *id;
+    int count;
+    int size;
+};
+
+static void route_ch_streets_add(struct route_ch_streets *streets, struct item_id *id) {
+    if (streets->count == streets->size) {
+        streets->size=streets->size ? streets->size*2 : 64;
+        streets->id=g_renew(struct item_id, streets->id, streets->size);
+    }
+    streets->id[streets->count++]=*id;
+}
+
+static guint route_ch_id_hash(gconstpointer key) {
+    const struct item_id *id=key;
+    return id->id_hi ^ (id->id_lo * 2654435761UL);
+}
+
+static gboolean route_ch_id_equal(gconstpointer a, gconstpointer b) {
+    const struct item_id *id_a=a,*id_b=b;
+    return id_a->id_hi == id_b->id_hi && id_a->id_lo == id_b->id_lo;
+}
+
+/**
+ * @brief Reads all edges of a node of the contraction hierarchy
+ *
+ * @param mr Map rect of the map holding the contraction hierarchy
+ * @param id The id of the {@code type_ch_node} item
+ * @param count Receives the number of edges
+ * @return The edges, to be freed with {@code g_free()}, or NULL if the node does not exist
+ */
+static struct route_ch_edge *route_ch_get_edges(struct map_rect *mr, struct item_id *id, int *count) {
+    struct item *item=map_rect_get_item_byid(mr, id->id_hi, id->id_lo);
+    struct route_ch_edge *ret=NULL;
+    struct attr attr;
+    int size=0;
+
+    *count=0;
+    if (!item || item->type != type_ch_node)
+        return NULL;
+    while (item_attr_get(item, attr_ch_edge, &attr)) {
+        if (*count == size) {
+            size=size ? size*2 : 8;
+            ret=g_renew(struct route_ch_edge, ret, size);
+        }
+        ret[(*count)++]=*(struct route_ch_edge *)attr.u.data;
+    }
+    return ret;
+}
+
+static struct route_ch_node *route_ch_get_node(struct route_ch_query *q, struct item_id *id) {
+    struct route_ch_node *ret=g_hash_table_lookup(q->nodes, id);
+    if (!ret) {
+        ret=g_new0(struct route_ch_node, 1);
+        ret->id=*id;
+        ret->value[0]=ret->value[1]=INT_MAX;
+        g_hash_table_insert(q->nodes, &ret->id, ret);
+    }
+    return ret;
+}
+
+/**
+ * @brief Lowers the cost of a node for one direction of the search
+ */
+static void route_ch_update_node(struct route_ch_query *q, int dir, struct route_ch_node *node, int value,
+                                 struct route_ch_node *parent, struct route_ch_edge *edge) {
+    if (value >= node->value[dir])
+        return;
+    node->value[dir]=value;
+    node->parent[dir]=parent;
+    if (edge)
+        node->edge[dir]=*edge;
+    if (node->el[dir])
+        route_heap_change_key(q->heap[dir], node, value);
+    else
+        route_heap_insert(q->heap[dir], node, value);
+}
+
+/**
+ * @brief Seeds one direction of the search with the end points of the street of a position
+ *
+ * The cost of each end point is estimated from the distance between the position and the end point, the road
+ * profile speed and the oneway flags of the street.
+ *
+ * @param q The query
+ * @param dir 0 to seed the search from the start, 1 to seed the search from the destination
+ * @param ri The start or destination
+ * @param profile The vehicle profile
+ * @return The number of end points which are nodes of the contraction hierarchy
+ */
+static int route_ch_seed(struct route_ch_query *q, int dir, struct route_info *ri, struct vehicleprofile *profile) {
+    struct street_data *sd=ri->street;
+    struct roadprofile *roadprofile=vehicleprofile_get_roadprofile(profile, sd->item.type);
+    struct map_selection sel;
+    struct map_rect *mr;
+    struct item *item;
+    struct coord c;
+    int i,ret=0;
+
+    if (!roadprofile || !roadprofile->route_weight)
+        return 0;
+    for (i = 0 ; i < 2 ; i++) {
+        /* i=0: the start of the street, reached against its direction from the start, or along it to the destination */
+        int forward=(i == 0) == (dir == 1);
+        int len=(i == 0) ? ri->lenneg : ri->lenpos;
+        struct coord *end=(i == 0) ? &sd->c[0] : &sd->c[sd->count-1];
+        if ((sd->flags & (forward ? profile->flags_forward_mask : profile->flags_reverse_mask)) != profile->flags)
+            continue;
+        sel.next=NULL;
+        sel.order=18;
+        sel.range.min=type_ch_node;
+        sel.range.max=type_ch_node;
+        sel.u.c_rect.lu.x=end->x-1;
+        sel.u.c_rect.lu.y=end->y+1;
+        sel.u.c_rect.rl.x=end->x+1;
+        sel.u.c_rect.rl.y=end->y-1;
+        mr=map_rect_new(q->map, &sel);
+        if (!mr)
+            continue;
+        while ((item=map_rect_get_item(mr))) {
+            if (item->type == type_ch_node && item_coord_get(item, &c, 1) && c.x == end->x && c.y == end->y) {
+                struct item_id id;
+                id.id_hi=item->id_hi;
+                id.id_lo=item->id_lo;
+                route_ch_update_node(q, dir, route_ch_get_node(q, &id), len*36/roadprofile->route_weight, NULL, NULL);
+                ret++;
+                break;
+            }
+        }
+        map_rect_destroy(mr);
+    }
+    return ret;
+}
+
+/**
+ * @brief Runs a bidirectional upward search in the contraction hierarchy
+ *
+ * Both searches only follow edges to higher ranked nodes. A direction is stopped as soon as its smallest key is no
+ * lower than the cost of the best path found so far.
+ *
+ * @return true if a path was found
+ */
+static int route_ch_search(struct route_ch_query *q) {
+    for (;;) {
+        struct route_ch_node *node;
+        struct route_ch_edge *edges;
+        int dir,i,count;
+        int min0=route_heap_min_key(q->heap[0]);
+        int min1=route_heap_min_key(q->heap[1]);
+        int active0=min0 != INT_MAX && min0 < q->best;
+        int active1=min1 != INT_MAX && min1 < q->best;
+
+        if (!active0 && !active1)
+            break;
+        dir=(active0 && (!active1 || min0 <= min1)) ? 0 : 1;
+        node=route_heap_extract_min(q->heap[dir]);
+        if (node->value[!dir] != INT_MAX && node->value[0]+node->value[1] < q->best) {
+            q->best=node->value[0]+node->value[1];
+            q->meet=node;
+        }
+        edges=route_ch_get_edges(q->mr, &node->id, &count);
+        for (i = 0 ; i < count ; i++) {
+            if (!(edges[i].flags & (dir ? CH_EDGE_BACKWARD : CH_EDGE_FORWARD)))
+                continue;
+            route_ch_update_node(q, dir, route_ch_get_node(q, &edges[i].target), node->value[dir]+edges[i].weight, node,
+                                 &edges[i]);
+        }
+        g_free(edges);
+    }
+    return q->meet != NULL;
+}
+
+/**
+ * @brief Unpacks an edge of the contraction hierarchy into the street items it consists of
+ *
+ * @param mr Map rect of the map holding the contraction hierarchy
+ * @param from The node at which the edge is entered
+ * @param to The node at which the edge is left
+ * @param edge The edge
+ * @param streets List to which the street items are appended
+ * @return true on success, false if the data of the map is inconsistent
+ */
+static int route_ch_unpack(struct map_rect *mr, struct item_id *from, struct item_id *to, struct route_ch_edge *edge,
+                           struct route_ch_streets *streets) {
+    struct route_ch_edge *edges,*e1=NULL,*e2=NULL;
+    struct item_id middle;
+    int i,j,count,ret;
+
+    if (!(edge->flags & CH_EDGE_SHORTCUT)) {
+        route_ch_streets_add(streets, &edge->middle);
+        return 1;
+    }
+    middle=edge->middle;
+    edges=route_ch_get_edges(mr, &middle, &count);
+    /* the middle node has a backward edge to from and a forward edge to to, adding up to the shortcut */
+    for (i = 0 ; i < count && !e1 ; i++) {
+        if (!(edges[i].flags & CH_EDGE_BACKWARD) || !route_ch_id_equal(&edges[i].target, from))
+            continue;
+        for (j = 0 ; j < count ; j++) {
+            if ((edges[j].flags & CH_EDGE_FORWARD) && route_ch_id_equal(&edges[j].target, to)
+                    && edges[i].weight+edges[j].weight == edge->weight) {
+                e1=&edges[i];
+                e2=&edges[j];
+                break;
+            }
+        }
+    }
+    ret=e1 && route_ch_unpack(mr, from, &middle, e1, streets) && route_ch_unpack(mr, &middle, to, e2, streets);
+    if (!ret)
+        dbg(lvl_error,"cannot unpack shortcut over 0x%x,0x%x", middle.id_hi, middle.id_lo);
+    g_free(edges);
+    return ret;
+}
+
+/**
+ * @brief Finds the streets between two positions in the contraction hierarchy
+ *
+ * @param map The map holding the contraction hierarchy
+ * @param pos The start
+ * @param dst The destination
+ * @param profile The vehicle profile
+ * @param streets List to which the street items along the path are appended
+ * @return true on success, false if no path was found
+ */
+static int route_ch_find_streets(struct map *map, struct route_info *pos, struct route_info *dst,
+                                 struct vehicleprofile *profile, struct route_ch_streets *streets) {
+    struct route_ch_query q;
+    struct route_ch_node *node;
+    int ret=0;
+
+    memset(&q, 0, sizeof(q));
+    q.map=map;
+    q.best=INT_MAX;
+    q.nodes=g_hash_table_new_full(route_ch_id_hash, route_ch_id_equal, NULL, g_free);
+    q.heap[0]=route_heap_new(offsetof(struct route_ch_node, el[0]));
+    q.heap[1]=route_heap_new(offsetof(struct route_ch_node, el[1]));
+    q.mr=map_rect_new(map, NULL);
+    if (q.mr && route_ch_seed(&q, 0, pos, profile) && route_ch_seed(&q, 1, dst, profile) && route_ch_search(&q)) {
+        ret=1;
+        for (node=q.meet ; ret && node->parent[0] ; node=node->parent[0])
+            ret=route_ch_unpack(q.mr, &node->parent[0]->id, &node->id, &node->edge[0], streets);
+        for (node=q.meet ; ret && node->parent[1] ; node=node->parent[1])
+            ret=route_ch_unpack(q.mr, &node->id, &node->parent[1]->id, &node->edge[1], streets);
+        dbg(lvl_debug,"path with cost %d, %d nodes visited", q.best, g_hash_table_size(q.nodes));
+    }
+    map_rect_destroy(q.mr);
+    route_heap_destroy(q.heap[0]);
+    route_heap_destroy(q.heap[1]);
+    g_hash_table_destroy(q.nodes);
+    return ret;
+}
+
+/**
+ * @brief Checks whether traffic distortions are currently reported by a traffic map of the mapset
+ *
+ * The traffic maps are only read if the state is unknown. The traffic module reports every distortion it adds,
+ * changes or removes to the route, which updates the state, see route_add_traffic_distortion().
+ *
+ * @param this The route
+ * @return true if there are traffic distortions, false if not
+ */
+static int route_ch_traffic_active(struct route *this) {
+    struct mapset_handle *h;
+    struct map *m;
+    struct map_rect *mr;
+    struct item *item;
+    struct attr type;
+
+    if (this->traffic_active >= 0)
+        return this->traffic_active;
+    this->traffic_active=0;
+    h=mapset_open(this->ms);
+    while (!this->traffic_active && (m=mapset_next(h, 2))) {
+        if (!map_get_attr(m, attr_type, &type, NULL) || strcmp(type.u.str, "traffic"))
+            continue;
+        mr=map_rect_new(m, NULL);
+        while (mr && (item=map_rect_get_item(mr))) {
+            if (item->type == type_traffic_distortion) {
+                this->traffic_active=1;
+                break;
+            }
+        }
+        map_rect_destroy(mr);
+    }
+    mapset_close(h);
+    return this->traffic_active;
+}
+
+/**
+ * @brief Adds the bounding box of a street to the selection of a graph built from the contraction hierarchy
+ *
+ * The streets are added in the order of the path, so the box is merged into the first rectangle of the selection
+ * as long as this does not grow too large, otherwise a new rectangle is started.
+ *
+ * @param sel The selection, may be NULL
+ * @param r The bounding box of the street
+ * @return The new selection
+ */
+static struct map_selection *route_ch_selection_add(struct map_selection *sel, struct coord_rect *r) {
+    struct coord_rect u;
+
+    if (sel) {
+        u=sel->u.c_rect;
+        coord_rect_extend(&u, &r->lu);
+        coord_rect_extend(&u, &r->rl);
+        if (u.rl.x-u.lu.x <= 10000 && u.lu.y-u.rl.y <= 10000) {
+            sel->u.c_rect=u;
+            return sel;
+        }
+    }
+    sel=route_rect_add(sel, 18, &r->lu, &r->rl, 0, 0);
+    sel->range.min=type_street_turn_restriction_no;
+    sel->range.max=type_street_turn_restriction_only;
+    return sel;
+}
+
+/**
+ * @brief Adds the turn restrictions at the points of a graph built from the contraction hierarchy
+ *
+ * Only restrictions whose via point is part of the graph can apply to it. Restrictions found in more than one
+ * rectangle of the selection are added once.
+ *
+ * @param graph The route graph
+ * @param map The map of the contraction hierarchy
+ * @param sel The selection around the streets of the graph, see route_ch_selection_add()
+ */
+static void route_ch_add_restrictions(struct route_graph *graph, struct map *map, struct map_selection *sel) {
+    struct map_rect *mr;
+    struct item *item;
+    struct coord c[3];
+    struct route_graph_point *p;
+    struct route_graph_segment_data data;
+
+    mr=map_rect_new(map, sel);
+    while (mr && (item=map_rect_get_item(mr))) {
+        if (item->type != type_street_turn_restriction_no && item->type != type_street_turn_restriction_only)
+            continue;
+        if (item_coord_get(item, c, 3) != 3 || !route_graph_get_point(graph, &c[1]))
+            continue;
+        data.item=item;
+        data.flags=0;
+        if ((p=route_graph_get_point(graph, &c[0])) && route_graph_segment_is_duplicate(p, &data))
+            continue;
+        route_graph_add_turn_restriction(graph, item);
+    }
+    map_rect_destroy(mr);
+}
+
+/**
+ * @brief Builds a route graph from a path through the contraction hierarchy of the map
+ *
+ * If the map of the current position carries a contraction hierarchy (see {@code maptool -C}), the path to each
+ * destination is searched in it, and the graph is built only from the streets along these paths. This graph is then
+ * flooded like a regular graph, which determines the exact path, applies the vehicle profile and lets the route path
+ * and route graph maps work unchanged.
+ *
+ * The contraction hierarchy is built with fixed speeds and does not know about traffic distortions. It is therefore
+ * only used if enabled in the vehicle profile and no traffic distortions are reported. If the graph does not contain a
+ * path for the vehicle profile, the full graph is built (see route_path_update_done()).
+ *
+ * Turn restrictions around the streets are added, and the graph is completed by route_graph_build_done() like a
+ * graph read from the maps, but without calling its done callback.
+ *
+ * @param this The route
+ * @return The new graph, or NULL if the contraction hierarchy cannot be used
+ */
+static struct route_graph *route_graph_build_ch(struct route *this) {
+    struct vehicleprofile *profile=this->vehicleprofile;
+    struct route_info *prev=this->pos;
+    struct map *map=this->pos->street->item.map;
+    struct route_graph *ret;
+    struct map_rect *mr;
+    struct item *item;
+    struct route_ch_streets streets= {NULL, 0, 0};
+    struct coord_rect r;
+    struct coord c;
+    GList *tmp;
+    int i;
+
+    if (!profile->contraction_hierarchies || profile->mode == 2 || this->ch_failed)
+        return NULL;
+    for (tmp=this->destinations ; tmp ; tmp=g_list_next(tmp))
+        if (((struct route_info *)tmp->data)->street->item.map != map)
+            return NULL;
+    if (route_ch_traffic_active(this))
+        return NULL;
+    for (tmp=this->destinations ; tmp ; tmp=g_list_next(tmp)) {
+        struct route_info *dst=tmp->data;
+        struct item_id id;
+        id.id_hi=prev->street->item.id_hi;
+        id.id_lo=prev->street->item.id_lo;
+        route_ch_streets_add(&streets, &id);
+        if (!item_is_equal(prev->street->item, dst->street->item)
+                && !route_ch_find_streets(map, prev, dst, profile, &streets)) {
+            dbg(lvl_debug,"no path in contraction hierarchy");
+            g_free(streets.id);
+            return NULL;
+        }
+        id.id_hi=dst->street->item.id_hi;
+        id.id_lo=dst->street->item.id_lo;
+        route_ch_streets_add(&streets, &id);
+        prev=dst;
+    }
+    ret=g_new0(struct route_graph, 1);
+    ret->heap=route_heap_new(offsetof(struct route_graph_point, el));
+    ret->ch=1;
+    ret->busy=1;
+    mr=map_rect_new(map, NULL);
+    for (i = 0 ; i < streets.count ; i++) {
+        if (!(item=map_rect_get_item_byid(mr, streets.id[i].id_hi, streets.id[i].id_lo)))
+            continue;
+        route_graph_add_street(ret, item, profile);
+        item_coord_rewind(item);
+        if (item_coord_get(item, &r.lu, 1)) {
+            r.rl=r.lu;
+            while (item_coord_get(item, &c, 1))
+                coord_rect_extend(&r, &c);
+            ret->sel=route_ch_selection_add(ret->sel, &r);
+        }
+    }
+    map_rect_destroy(mr);
+    route_ch_add_restrictions(ret, map, ret->sel);
+    dbg(lvl_debug,"%d streets from contraction hierarchy", streets.count);
+    g_free(streets.id);
+    /* the caller calls the done callback once the graph is set */
+    route_graph_build_done(ret, 0);
+    return ret;
+}
+
+/**
+ * @brief Reads the items of a selection into a finished route graph
+ *
+ * Turn restrictions which are already part of the graph are skipped, and only those which are new are resolved.
+ * The selection is added to the extent of the graph.
+ *
+ * @param graph The route graph
+ * @param ms The mapset to read from
+ * @param sel The selection, which should not overlap the extent of the graph
+ * @param profile The vehicle profile
+ */
+static void route_graph_read_selection(struct route_graph *graph, struct mapset *ms, struct map_selection *sel,
+                                       struct vehicleprofile *profile) {
+    struct map_selection *last;
+    struct mapset_handle *h;
+    struct map_rect *mr;
+    struct map *m;
+    struct item *item;
+
+    h=mapset_open(ms);
+    while ((m=mapset_next(h, 2))) {
+        mr=map_rect_new(m, sel);
+        if (!mr)
+            continue;
+        while ((item=map_rect_get_item(mr)))
+            route_graph_build_add_item(graph, profile, item);
+        map_rect_destroy(mr);
+    }
+    mapset_close(h);
+    route_graph_process_restrictions(graph);
+    /* new turn restrictions may apply to existing segments */
+    graph->costs_profile=NULL;
+    for (last=sel ; last->next ; last=last->next);
+    last->next=graph->extent;
+    graph->extent=sel;
+}
+
+/**
+ * @brief Adds the items of a selection to a finished route graph
+ *
+ * The points of all segments added are updated, so that the values of the graph are repaired by the next call to
+ * route_graph_compute_shortest_path() rather than by flooding the graph from scratch.
+ *
+ * @param graph The route graph
+ * @param ms The mapset to read from
+ * @param sel The selection, which should not overlap the extent of the graph
+ * @param profile The vehicle profile
+ * @return The number of segments added
+ */
+static int route_graph_add_selection(struct route_graph *graph, struct mapset *ms, struct map_selection *sel,
+                                     struct vehicleprofile *profile) {
+    struct route_graph_segment *old=graph->route_segments, *s;
+    int count=0;
+
+    route_graph_read_selection(graph, ms, sel, profile);
+    for (s=graph->route_segments ; s && s != old ; s=s->next) {
+        route_graph_point_update(profile, s->start, graph);
+        route_graph_point_update(profile, s->end, graph);
+        count++;
+    }
+    dbg(lvl_debug,"extended graph by %d segments", count);
+    return count;
+}
+
+/**
+ * @brief Extends the route graph to the current selection of the route
+ *
+ * When the position leaves the area of the route graph, only the items in those parts of the new selection which
+ * are not part of the area yet are read and added to the graph, see route_graph_add_selection().
+ *
+ * Maps are read synchronously, which is fast as long as the new parts are small compared to the graph. Graphs built
+ * from a contraction hierarchy or along the cells of the overlay are not extended.
+ *
+ * @param this The route
+ * @return True if the graph has been extended, false if there was nothing to add or the graph needs to be rebuilt
+ */
+static int route_graph_extend(struct route *this) {
+    struct route_graph *graph=this->graph;
+    struct map_selection *sel;
+
+    if (graph->busy || graph->ch || graph->overlay || !graph->extent || !this->pos || !this->ms)
+        return 0;
+    sel=route_selection_subtract(route_get_selection(this), graph->extent);
+    if (!sel)
+        return 0;
+    return route_graph_add_selection(graph, this->ms, sel, this->vehicleprofile) > 0;
+}
+
+/**
+ * @brief Header of a cell of the overlay, as written by maptool (see maptool/overlay.c)
+ */
+struct route_overlay_cell_data {
+    int level;                  /**< Level of the cell, starting at 1 for the smallest cells */
+    int id;                     /**< Number of the cell */
+    int parent;                 /**< Number of the enclosing cell one level up, -1 for the top level */
+    int boundary_count;         /**< Number of boundary nodes, stored as {@code attr_overlay_boundary} */
+    int cut_count;              /**< Number of cut edges, stored as {@code attr_overlay_cut} */
+};
+
+/**
+ * @brief An edge leaving a cell of level 1, as written by maptool
+ */
+struct route_overlay_cut_data {
+    int from;                   /**< Position of the node in the boundary of the cell */
+    struct coord to;            /**< The node in the other cell */
+    int weight;                 /**< Cost of the edge */
+};
+
+#define ROUTE_OVERLAY_MAX_LEVELS 8
+
+/**
+ * @brief An edge between boundary nodes of two different cells of level 1
+ */
+struct route_overlay_arc {
+    int to;                     /**< Index of the node at the other end */
+    int weight;                 /**< Cost of the edge, INT_MAX if it cannot be used */
+    int level;                  /**< Highest level on which the two nodes are in different cells */
+};
+
+/**
+ * @brief A boundary node of the overlay
+ *
+ * Index 0 of `cell` and `pos` refers to level 1.
+ */
+struct route_overlay_node {
+    struct coord c;
+    int cell[ROUTE_OVERLAY_MAX_LEVELS]; /**< The cell of each level which contains the node */
+    int pos[ROUTE_OVERLAY_MAX_LEVELS];  /**< Position of the node in the boundary of the cell of each level, -1 if
+                                         *   it is not a boundary node of that cell */
+    struct route_overlay_arc *arcs;     /**< Edges leaving the cell of level 1 */
+    int arc_count;
+    int value;                          /**< Cost from the start of the current search */
+    int parent;                         /**< Previous node of the current search, -1 for none */
+    int via;                            /**< Cell whose clique leads from `parent` to the node, -1 for an arc */
+    int el;                             /**< Position on the heap */
+};
+
+/**
+ * @brief A cell of the overlay
+ */
+struct route_overlay_cell {
+    struct coord_rect r;        /**< Area of the cell, excluding its right and bottom edges */
+    int level;
+    int parent;
+    int *boundary;              /**< Indices of the boundary nodes */
+    int boundary_count;
+    int *clique;                /**< Cost from each boundary node (row) to each other one (column) within the cell,
+                                 *   INT_MAX if there is no path */
+    int dirty;                  /**< The clique needs to be computed again */
+};
+
+/**
+ * @brief The multi-level overlay of a map
+ *
+ * maptool partitions the routing graph into nested cells and stores, for each cell, the costs between its boundary
+ * nodes (see {@code maptool --route-overlay}). A search over the boundary nodes only visits the cells around the start
+ * and destination on the lowest level and ever larger cells in between, which makes it cheap enough to run after each
+ * change of traffic. Its result is the set of cells of level 1 through which the route passes, from which the route
+ * graph is built.
+ *
+ * The cliques stored in the map are computed with fixed speeds, so the cliques of all cells are computed again
+ * (customized) from the costs of the vehicle profile when the overlay is read and whenever the profile changes.
+ * Traffic distortions mark the cells which contain them as dirty, which are customized again along with all cells
+ * enclosing them. Customizing runs on the main loop in the background, see route_overlay_customize_idle(), and the
+ * overlay is not used while cells are dirty.
+ */
+struct route_overlay {
+    struct map *map;                    /**< The map holding the overlay */
+    struct route_overlay_cell *cells;
+    int cell_count;                     /**< Number of cells, 0 if the map has no (usable) overlay */
+    int levels;                         /**< Number of levels */
+    struct route_overlay_node *nodes;
+    int node_count;
+    int *touched;                       /**< Nodes reached by the current search */
+    int touched_count;
+    struct route_heap *heap;
+    int dirty;                          /**< Some cells need to be customized */
+    int customized;                     /**< Cells have been customized since the last selection was made, see
+                                         *   route_overlay_extend() */
+    struct vehicleprofile *profile;     /**< Vehicle profile for which the cells are customized */
+    unsigned int generation;            /**< Generation of `profile` for which the cells are customized */
+    struct callback *idle_cb;           /**< Customizes dirty cells in the background */
+    struct event_idle *idle_ev;
+    struct coord_rect grid_r;           /**< Area covered by the cells of level 1 */
+    long long grid_dx;                  /**< Width of each square of the grid index */
+    long long grid_dy;                  /**< Height of each square of the grid index */
+    int grid_size;                      /**< Number of squares in each row and column of the grid index */
+    int *grid_start;                    /**< Position of the first cell of each square in `grid_cells`, followed by
+                                         *   the total number of entries */
+    int *grid_cells;                    /**< Cells of level 1 overlapping each square of the grid index */
+};
+
+/**
+ * @brief A search over the boundary nodes of the overlay
+ */
+struct route_overlay_query {
+    int limit;                          /**< Cell to which the search is restricted, -1 for none */
+    int target;                         /**< Node at which the search stops, -1 for none */
+    int *s_cell;                        /**< For searches which are not restricted: the cells of each level which
+                                         *   contain the start and the destination */
+    int *t_cell;
+    int *t_cost;                        /**< Cost from each boundary node of `t_cell[0]` to the destination */
+    int best;                           /**< Cost of the best path to the destination */
+    int best_node;                      /**< Last boundary node of the best path to the destination, or -1 */
+};
+
+/**
+ * @brief A clique edge of a path through the overlay which is still to be resolved into cells of level 1
+ */
+struct route_overlay_step {
+    int from;
+    int to;
+    int cell;
+};
+
+static void route_overlay_customize_stop(struct route_overlay *this) {
+    if (this->idle_ev)
+        event_remove_idle(this->idle_ev);
+    if (this->idle_cb)
+        callback_destroy(this->idle_cb);
+    this->idle_ev=NULL;
+    this->idle_cb=NULL;
+}
+
+static void route_overlay_destroy(struct route_overlay *this) {
+    int i;
+
+    if (!this)
+        return;
+    route_overlay_customize_stop(this);
+    for (i = 0 ; i < this->cell_count ; i++) {
+        g_free(this->cells[i].boundary);
+        g_free(this->cells[i].clique);
+    }
+    for (i = 0 ; i < this->node_count ; i++)
+        g_free(this->nodes[i].arcs);
+    g_free(this->cells);
+    g_free(this->nodes);
+    g_free(this->touched);
+    g_free(this->grid_start);
+    g_free(this->grid_cells);
+    route_heap_destroy(this->heap);
+    g_free(this);
+}
+
+/**
+ * @brief Returns the column or row of the grid index holding a coordinate
+ *
+ * @param v The x or y value of the coordinate
+ * @param min The lowest x or y value of the grid
+ * @param d The width or height of a square
+ * @return The column or row, -1 if `v` is outside of the grid
+ */
+static int route_overlay_grid_pos(struct route_overlay *this, int v, int min, long long d) {
+    long long ret;
+
+    if (v < min)
+        return -1;
+    ret=((long long)v-min)/d;
+    return ret < this->grid_size ? ret : -1;
+}
+
+/**
+ * @brief Builds the grid index for looking up the cell of level 1 which contains a coordinate
+ *
+ * The area of the cells of level 1 is divided into about as many squares as there are cells, and each square lists
+ * the cells overlapping it.
+ */
+static void route_overlay_index(struct route_overlay *this) {
+    int i,x,y,pass,count=0;
+
+    for (i = 0 ; i < this->cell_count ; i++) {
+        struct coord_rect *r=&this->cells[i].r;
+        if (this->cells[i].level != 1)
+            continue;
+        if (!count++)
+            this->grid_r=*r;
+        coord_rect_extend(&this->grid_r, &r->lu);
+        coord_rect_extend(&this->grid_r, &r->rl);
+    }
+    for (this->grid_size = 1 ; this->grid_size*this->grid_size < count ; this->grid_size++);
+    this->grid_dx=((long long)this->grid_r.rl.x-this->grid_r.lu.x)/this->grid_size+1;
+    this->grid_dy=((long long)this->grid_r.lu.y-this->grid_r.rl.y)/this->grid_size+1;
+    this->grid_start=g_new0(int, this->grid_size*this->grid_size+1);
+    /* count the cells of each square first, then fill them in */
+    for (pass = 0 ; pass < 2 ; pass++) {
+        for (i = 0 ; i < this->cell_count ; i++) {
+            struct coord_rect *r=&this->cells[i].r;
+            int x0,x1,y0,y1;
+            if (this->cells[i].level != 1 || r->lu.x >= r->rl.x || r->rl.y >= r->lu.y)
+                continue;
+            x0=route_overlay_grid_pos(this, r->lu.x, this->grid_r.lu.x, this->grid_dx);
+            x1=route_overlay_grid_pos(this, r->rl.x-1, this->grid_r.lu.x, this->grid_dx);
+            y0=route_overlay_grid_pos(this, r->rl.y, this->grid_r.rl.y, this->grid_dy);
+            y1=route_overlay_grid_pos(this, r->lu.y-1, this->grid_r.rl.y, this->grid_dy);
+            for (y = y0 ; y <= y1 ; y++) {
+                for (x = x0 ; x <= x1 ; x++) {
+                    if (pass)
+                        this->grid_cells[this->grid_start[y*this->grid_size+x]++]=i;
+                    else
+                        this->grid_start[y*this->grid_size+x]++;
+                }
+            }
+        }
+        /* shift by one square: after counting, the prefix sums give the first position of each square, after
+         * filling, each square starts where the previous one ended again */
+        for (i = this->grid_size*this->grid_size ; i > 0 ; i--)
+            this->grid_start[i]=this->grid_start[i-1];
+        this->grid_start[0]=0;
+        if (!pass) {
+            for (i = 1 ; i <= this->grid_size*this->grid_size ; i++)
+                this->grid_start[i]+=this->grid_start[i-1];
+            this->grid_cells=g_new(int, this->grid_start[this->grid_size*this->grid_size]);
+        }
+    }
+}
+
+/**
+ * @brief Returns the cell of level 1 which contains a coordinate
+ *
+ * @return The cell, or -1 if the coordinate is outside of the overlay
+ */
+static int route_overlay_find_cell(struct route_overlay *this, struct coord *c) {
+    int i,x,y;
+
+    if (!this->grid_start)
+        return -1;
+    x=route_overlay_grid_pos(this, c->x, this->grid_r.lu.x, this->grid_dx);
+    y=route_overlay_grid_pos(this, c->y, this->grid_r.rl.y, this->grid_dy);
+    if (x < 0 || y < 0)
+        return -1;
+    for (i = this->grid_start[y*this->grid_size+x] ; i < this->grid_start[y*this->grid_size+x+1] ; i++) {
+        struct coord_rect *r=&this->cells[this->grid_cells[i]].r;
+        if (c->x >= r->lu.x && c->x < r->rl.x && c->y >= r->rl.y && c->y < r->lu.y)
+            return this->grid_cells[i];
+    }
+    return -1;
+}
+
+/**
+ * @brief Marks the cells which contain the coordinates of a traffic distortion as dirty
+ */
+static void route_overlay_invalidate(struct route_overlay *this, struct item *item) {
+    struct coord c;
+    int cell;
+
+    if (!this || !this->cell_count)
+        return;
+    item_coord_rewind(item);
+    while (item_coord_get(item, &c, 1)) {
+        cell=route_overlay_find_cell(this, &c);
+        if (cell >= 0 && !this->cells[cell].dirty) {
+            this->cells[cell].dirty=1;
+            this->dirty=1;
+        }
+    }
+    item_coord_rewind(item);
+}
+
+/**
+ * @brief Links the cells read from the map through their boundary nodes
+ *
+ * @param this The overlay, with all cells read
+ * @param coords The coordinates of the boundary nodes of each cell
+ * @param cuts The cut edges of each cell of level 1
+ * @param cut_counts The number of cut edges of each cell
+ * @return True on success, false if the cells do not fit together
+ */
+static int route_overlay_setup(struct route_overlay *this, struct coord **coords, struct route_overlay_cut_data **cuts,
+                               int *cut_counts) {
+    GHashTable *hash=g_hash_table_new(coord_hash, coord_equal);
+    struct route_overlay_node *n;
+    int i,j,l,ret=0;
+
+    for (i = 0 ; i < this->cell_count ; i++) {
+        struct route_overlay_cell *cell=&this->cells[i];
+        if (!cell->level || cell->parent >= this->cell_count)
+            goto out;
+        if (cell->level == 1)
+            this->node_count+=cell->boundary_count;
+        if (cell->level > this->levels)
+            this->levels=cell->level;
+    }
+    this->nodes=g_new0(struct route_overlay_node, this->node_count);
+    this->node_count=0;
+    for (i = 0 ; i < this->cell_count ; i++) {
+        struct route_overlay_cell *cell=&this->cells[i];
+        int parent;
+        if (cell->level != 1)
+            continue;
+        for (j = 0 ; j < cell->boundary_count ; j++) {
+            n=&this->nodes[this->node_count];
+            n->c=coords[i][j];
+            if (g_hash_table_lookup(hash, &n->c))
+                goto out;
+            for (l = 0 ; l < ROUTE_OVERLAY_MAX_LEVELS ; l++)
+                n->cell[l]=n->pos[l]=-1;
+            n->cell[0]=i;
+            n->pos[0]=j;
+            for (l=1, parent=cell->parent ; parent >= 0 && l < this->levels ; l++, parent=this->cells[parent].parent) {
+                if (this->cells[parent].level != l+1)
+                    goto out;
+                n->cell[l]=parent;
+            }
+            n->value=INT_MAX;
+            n->parent=-1;
+            cell->boundary[j]=this->node_count++;
+            g_hash_table_insert(hash, &n->c, GINT_TO_POINTER(this->node_count));
+        }
+    }
+    for (i = 0 ; i < this->cell_count ; i++) {
+        struct route_overlay_cell *cell=&this->cells[i];
+        for (j = 0 ; j < cell->boundary_count && cell->level > 1 ; j++) {
+            int node=GPOINTER_TO_INT(g_hash_table_lookup(hash, &coords[i][j]))-1;
+            if (node < 0 || this->nodes[node].cell[cell->level-1] != i)
+                goto out;
+            this->nodes[node].pos[cell->level-1]=j;
+            cell->boundary[j]=node;
+        }
+        for (j = 0 ; j < cut_counts[i] && cell->level == 1 ; j++) {
+            struct route_overlay_cut_data *cut=&cuts[i][j];
+            struct route_overlay_arc *arc;
+            int to=GPOINTER_TO_INT(g_hash_table_lookup(hash, &cut->to))-1;
+            if (cut->from < 0 || cut->from >= cell->boundary_count || to < 0)
+                goto out;
+            n=&this->nodes[cell->boundary[cut->from]];
+            n->arcs=g_renew(struct route_overlay_arc, n->arcs, n->arc_count+1);
+            arc=&n->arcs[n->arc_count++];
+            arc->to=to;
+            arc->weight=cut->weight;
+            arc->level=0;
+            for (l = 0 ; l < this->levels ; l++) {
+                if (n->cell[l] != this->nodes[to].cell[l])
+                    arc->level=l+1;
+            }
+        }
+    }
+    ret=1;
+out:
+    g_hash_table_destroy(hash);
+    return ret;
+}
+
+/**
+ * @brief Reads the overlay of a map
+ *
+ * The cliques stored in the map are not used, the cells still have to be customized.
+ *
+ * @param map The map
+ * @return The overlay, with a `cell_count` of 0 if the map does not hold a usable overlay
+ */
+static struct route_overlay *route_overlay_new(struct map *map) {
+    struct route_overlay *ret=g_new0(struct route_overlay, 1);
+    struct coord **coords=NULL;
+    struct route_overlay_cut_data **cuts=NULL;
+    int *cut_counts=NULL;
+    struct map_selection sel;
+    struct map_rect *mr;
+    struct item *item;
+    struct attr attr;
+    struct coord c[2];
+    int i,size=0;
+
+    ret->map=map;
+    sel.next=NULL;
+    sel.order=0;
+    sel.range.min=type_route_overlay_cell;
+    sel.range.max=type_route_overlay_cell;
+    sel.u.c_rect.lu.x=-0x7fffffff;
+    sel.u.c_rect.lu.y=0x7fffffff;
+    sel.u.c_rect.rl.x=0x7fffffff;
+    sel.u.c_rect.rl.y=-0x7fffffff;
+    mr=map_rect_new(map, &sel);
+    while (mr && (item=map_rect_get_item(mr))) {
+        struct route_overlay_cell_data *data;
+        struct route_overlay_cell *cell;
+        if (item->type != type_route_overlay_cell || item_coord_get(item, c, 2) != 2
+                || !item_attr_get(item, attr_overlay_cell, &attr))
+            continue;
+        data=attr.u.data;
+        if (data->id < 0 || data->level < 1 || data->level > ROUTE_OVERLAY_MAX_LEVELS || data->boundary_count < 0)
+            continue;
+        if (data->id >= size) {
+            int old=size;
+            size=data->id+1 > size*2 ? data->id+1 : size*2;
+            ret->cells=g_renew(struct route_overlay_cell, ret->cells, size);
+            coords=g_renew(struct coord *, coords, size);
+            cuts=g_renew(struct route_overlay_cut_data *, cuts, size);
+            cut_counts=g_renew(int, cut_counts, size);
+            memset(ret->cells+old, 0, (size-old)*sizeof(*ret->cells));
+            memset(coords+old, 0, (size-old)*sizeof(*coords));
+            memset(cuts+old, 0, (size-old)*sizeof(*cuts));
+            memset(cut_counts+old, 0, (size-old)*sizeof(*cut_counts));
+        }
+        if (data->id >= ret->cell_count)
+            ret->cell_count=data->id+1;
+        cell=&ret->cells[data->id];
+        cell->r.lu.x=c[0].x;
+        cell->r.lu.y=c[1].y;
+        cell->r.rl.x=c[1].x;
+        cell->r.rl.y=c[0].y;
+        cell->level=data->level;
+        cell->parent=data->parent;
+        cell->boundary_count=data->boundary_count;
+        cell->boundary=g_new(int, data->boundary_count);
+        cell->clique=g_new(int, data->boundary_count*data->boundary_count);
+        if (data->cut_count > 0 && item_attr_get(item, attr_overlay_cut, &attr)) {
+            cut_counts[data->id]=data->cut_count;
+            cuts[data->id]=g_memdup(attr.u.data, data->cut_count*sizeof(struct route_overlay_cut_data));
+        }
+        if (data->boundary_count && item_attr_get(item, attr_overlay_boundary, &attr))
+            coords[data->id]=g_memdup(attr.u.data, data->boundary_count*sizeof(struct coord));
+    }
+    map_rect_destroy(mr);
+    if (ret->cell_count && !route_overlay_setup(ret, coords, cuts, cut_counts)) {
+        dbg(lvl_error,"overlay of map is inconsistent, not using it");
+        for (i = 0 ; i < ret->cell_count ; i++) {
+            g_free(ret->cells[i].boundary);
+            g_free(ret->cells[i].clique);
+        }
+        for (i = 0 ; i < ret->node_count ; i++)
+            g_free(ret->nodes[i].arcs);
+        g_free(ret->cells);
+        g_free(ret->nodes);
+        ret->cells=NULL;
+        ret->nodes=NULL;
+        ret->cell_count=ret->node_count=0;
+    }
+    for (i = 0 ; i < ret->cell_count ; i++) {
+        g_free(coords[i]);
+        g_free(cuts[i]);
+    }
+    g_free(coords);
+    g_free(cuts);
+    g_free(cut_counts);
+    if (ret->cell_count)
+        route_overlay_index(ret);
+    ret->touched=g_new(int, ret->node_count);
+    ret->heap=route_heap_new(offsetof(struct route_overlay_node, el));
+    dbg(lvl_debug,"%d cells on %d levels, %d boundary nodes", ret->cell_count, ret->levels, ret->node_count);
+    return ret;
+}
+
+/**
+ * @brief Marks all cells as dirty if they have not been customized for the current vehicle profile
+ *
+ * This also covers the cells of a newly read overlay. Traffic distortions which are already present need no
+ * special treatment, as the cells are customized from route graphs which include them.
+ */
+static void route_overlay_check_profile(struct route_overlay *this, struct vehicleprofile *profile) {
+    int i;
+
+    if (this->profile == profile && this->generation == profile->generation)
+        return;
+    for (i = 0 ; i < this->cell_count ; i++)
+        this->cells[i].dirty=1;
+    this->dirty=this->cell_count > 0;
+    this->profile=profile;
+    this->generation=profile->generation;
+}
+
+/**
+ * @brief Returns the overlay of a map, reading it if necessary
+ *
+ * @param this The route
+ * @param map The map
+ * @return The overlay, NULL if the map does not hold one
+ */
+static struct route_overlay *route_overlay_get(struct route *this, struct map *map) {
+    if (!this->overlay || this->overlay->map != map) {
+        route_overlay_destroy(this->overlay);
+        this->overlay=route_overlay_new(map);
+    }
+    route_overlay_check_profile(this->overlay, this->vehicleprofile);
+    return this->overlay->cell_count ? this->overlay : NULL;
+}
+
+/**
+ * @brief Builds a route graph from the area of a cell
+ *
+ * The graph is read synchronously and includes traffic distortions.
+ */
+static struct route_graph *route_overlay_cell_graph(struct route_overlay_cell *cell, struct mapset *ms,
+        struct vehicleprofile *profile) {
+    struct route_graph *ret=g_new0(struct route_graph, 1);
+    struct map_selection *sel=g_new0(struct map_selection, 1);
+
+    ret->heap=route_heap_new(offsetof(struct route_graph_point, el));
+    sel->order=18;
+    sel->range=item_range_all;
+    sel->u.c_rect=cell->r;
+    route_graph_read_selection(ret, ms, sel, profile);
+    return ret;
+}
+
+static void route_overlay_flood_point(struct route_graph *graph, struct route_graph_point *p, int value) {
+    if (value >= p->value)
+        return;
+    p->value=value;
+    if (p->el)
+        route_heap_change_key(graph->heap, p, value);
+    else
+        route_heap_insert(graph->heap, p, value);
+}
+
+/**
+ * @brief Floods a route graph from the points on its heap without leaving a cell
+ *
+ * @param graph The graph, whose points on the heap have their cost set
+ * @param profile The vehicle profile
+ * @param r The area of the cell, points outside of it are not reached
+ * @param forward True to calculate the cost from the points on the heap, false to calculate the cost to them
+ */
+static void route_overlay_flood(struct route_graph *graph, struct vehicleprofile *profile, struct coord_rect *r,
+                                int forward) {
+    struct route_graph_point *p;
+    struct route_graph_segment *s;
+    int val;
+
+    while ((p=route_heap_extract_min(graph->heap))) {
+        for (s=p->start ; s ; s=s->start_next) {
+            val=route_value_seg(profile, NULL, s, forward ? 1 : -1);
+            if (val != INT_MAX && s->end->c.x >= r->lu.x && s->end->c.x < r->rl.x && s->end->c.y >= r->rl.y
+                    && s->end->c.y < r->lu.y)
+                route_overlay_flood_point(graph, s->end, route_value_add(p->value, val));
+        }
+        for (s=p->end ; s ; s=s->end_next) {
+            val=route_value_seg(profile, NULL, s, forward ? -1 : 1);
+            if (val != INT_MAX && s->start->c.x >= r->lu.x && s->start->c.x < r->rl.x && s->start->c.y >= r->rl.y
+                    && s->start->c.y < r->lu.y)
+                route_overlay_flood_point(graph, s->start, route_value_add(p->value, val));
+        }
+    }
+}
+
+/**
+ * @brief Returns the lowest cost of all points of a flooded graph at a coordinate
+ */
+static int route_overlay_flood_value(struct route_graph *graph, struct coord *c) {
+    struct route_graph_point *p=NULL;
+    int ret=INT_MAX;
+
+    while ((p=route_graph_get_point_next(graph, c, p))) {
+        if (p->value < ret)
+            ret=p->value;
+    }
+    return ret;
+}
+
+/**
+ * @brief Computes the clique of a cell of level 1 and the costs of the edges leaving it
+ */
+static void route_overlay_customize_graph(struct route_overlay *this, int id, struct mapset *ms,
+        struct vehicleprofile *profile) {
+    struct route_overlay_cell *cell=&this->cells[id];
+    struct route_graph *graph=route_overlay_cell_graph(cell, ms, profile);
+    struct route_graph_point *p;
+    struct route_graph_segment *s;
+    int i,j,b=cell->boundary_count;
+
+    for (i = 0 ; i < b ; i++) {
+        struct route_overlay_node *n=&this->nodes[cell->boundary[i]];
+        route_graph_reset(graph);
+        for (p=NULL ; (p=route_graph_get_point_next(graph, &n->c, p)) ; )
+            route_overlay_flood_point(graph, p, 0);
+        route_overlay_flood(graph, profile, &cell->r, 1);
+        for (j = 0 ; j < b ; j++)
+            cell->clique[i*b+j]=i == j ? 0 : route_overlay_flood_value(graph, &this->nodes[cell->boundary[j]].c);
+        for (j = 0 ; j < n->arc_count ; j++) {
+            struct route_overlay_arc *arc=&n->arcs[j];
+            struct coord *to=&this->nodes[arc->to].c;
+            int val;
+            arc->weight=INT_MAX;
+            for (p=NULL ; (p=route_graph_get_point_next(graph, &n->c, p)) ; ) {
+                for (s=p->start ; s ; s=s->start_next) {
+                    if (s->end->c.x == to->x && s->end->c.y == to->y
+                            && (val=route_value_seg(profile, NULL, s, 1)) < arc->weight)
+                        arc->weight=val;
+                }
+                for (s=p->end ; s ; s=s->end_next) {
+                    if (s->start->c.x == to->x && s->start->c.y == to->y
+                            && (val=route_value_seg(profile, NULL, s, -1)) < arc->weight)
+                        arc->weight=val;
+                }
+            }
+        }
+    }
+    route_graph_destroy(graph);
+}
+
+static void route_overlay_search_reset(struct route_overlay *this) {
+    int i;
+
+    for (i = 0 ; i < this->touched_count ; i++) {
+        this->nodes[this->touched[i]].value=INT_MAX;
+        this->nodes[this->touched[i]].parent=-1;
+    }
+    this->touched_count=0;
+    route_heap_clear(this->heap);
+}
+
+static void route_overlay_search_update(struct route_overlay *this, int node, int value, int parent, int via) {
+    struct route_overlay_node *n=&this->nodes[node];
+
+    if (value >= n->value)
+        return;
+    if (n->value == INT_MAX)
+        this->touched[this->touched_count++]=node;
+    n->value=value;
+    n->parent=parent;
+    n->via=via;
+    if (n->el)
+        route_heap_change_key(this->heap, n, value);
+    else
+        route_heap_insert(this->heap, n, value);
+}
+
+/**
+ * @brief Returns the level whose clique and arcs are followed from a node
+ *
+ * A search which is restricted to a cell uses the cells one level below. Otherwise the highest level is used on which
+ * the cell of the node contains neither the start nor the destination.
+ */
+static int route_overlay_search_level(struct route_overlay *this, struct route_overlay_node *n,
+                                      struct route_overlay_query *q) {
+    int top=0,level=0;
+
+    while (top < this->levels && n->pos[top] >= 0)
+        top++;
+    if (q->limit >= 0)
+        return MIN(top, this->cells[q->limit].level-1);
+    while (level < top && n->cell[level] != q->s_cell[level] && n->cell[level] != q->t_cell[level])
+        level++;
+    return level ? level : 1;
+}
+
+/**
+ * @brief Runs a search over the boundary nodes of the overlay, starting at the nodes with a cost set
+ */
+static void route_overlay_search(struct route_overlay *this, struct route_overlay_query *q) {
+    struct route_overlay_node *n;
+    int i,limit=q->limit >= 0 ? this->cells[q->limit].level : INT_MAX;
+
+    while ((n=route_heap_extract_min(this->heap))) {
+        struct route_overlay_cell *cell;
+        int node=n-this->nodes,level,*row;
+
+        if (q->target == node)
+            break;
+        if (q->limit < 0) {
+            if (n->value >= q->best)
+                break;
+            if (n->cell[0] == q->t_cell[0] && q->t_cost[n->pos[0]] != INT_MAX
+                    && route_value_add(n->value, q->t_cost[n->pos[0]]) < q->best) {
+                q->best=route_value_add(n->value, q->t_cost[n->pos[0]]);
+                q->best_node=node;
+            }
+        }
+        level=route_overlay_search_level(this, n, q);
+        cell=&this->cells[n->cell[level-1]];
+        row=cell->clique+n->pos[level-1]*cell->boundary_count;
+        for (i = 0 ; i < cell->boundary_count ; i++) {
+            if (row[i] != INT_MAX)
+                route_overlay_search_update(this, cell->boundary[i], route_value_add(n->value, row[i]), node,
+                                            n->cell[level-1]);
+        }
+        for (i = 0 ; i < n->arc_count ; i++) {
+            struct route_overlay_arc *arc=&n->arcs[i];
+            if (arc->weight != INT_MAX && arc->level >= level && arc->level < limit)
+                route_overlay_search_update(this, arc->to, route_value_add(n->value, arc->weight), node, -1);
+        }
+    }
+}
+
+/**
+ * @brief Computes the clique of a cell above level 1 from the cells it is made of
+ */
+static void route_overlay_customize_cell(struct route_overlay *this, int id) {
+    struct route_overlay_cell *cell=&this->cells[id];
+    struct route_overlay_query q;
+    int i,j,b=cell->boundary_count;
+
+    memset(&q, 0, sizeof(q));
+    q.limit=id;
+    q.target=-1;
+    for (i = 0 ; i < b ; i++) {
+        route_overlay_search_update(this, cell->boundary[i], 0, -1, -1);
+        route_overlay_search(this, &q);
+        for (j = 0 ; j < b ; j++)
+            cell->clique[i*b+j]=this->nodes[cell->boundary[j]].value;
+        route_overlay_search_reset(this);
+    }
+}
+
+/**
+ * @brief Customizes some of the dirty cells and the cells enclosing them
+ *
+ * Cells are customized level by level, so a cell is only customized once none of the cells it is made of is dirty.
+ *
+ * @param this The overlay
+ * @param ms The mapset from which the cells of level 1 are read
+ * @param profile The vehicle profile
+ * @param max The maximum number of cells to customize
+ * @return True if dirty cells remain
+ */
+static int route_overlay_customize(struct route_overlay *this, struct mapset *ms, struct vehicleprofile *profile,
+                                   int max) {
+    int i,level,count=0;
+
+    if (!this->dirty)
+        return 0;
+    for (level = 1 ; level <= this->levels ; level++) {
+        for (i = 0 ; i < this->cell_count ; i++) {
+            struct route_overlay_cell *cell=&this->cells[i];
+            if (cell->level != level || !cell->dirty)
+                continue;
+            if (count >= max)
+                return 1;
+            if (level == 1)
+                route_overlay_customize_graph(this, i, ms, profile);
+            else
+                route_overlay_customize_cell(this, i);
+            cell->dirty=0;
+            if (cell->parent >= 0)
+                this->cells[cell->parent].dirty=1;
+            count++;
+        }
+    }
+    this->dirty=0;
+    this->customized=1;
+    dbg(lvl_debug,"all cells customized");
+    return 0;
+}
+
+/**
+ * @brief Customizes one dirty cell of the overlay, called from the main loop
+ *
+ * Once all cells are customized, a route graph built from the overlay is extended by the cells through which the
+ * route now passes.
+ *
+ * @param this The route
+ */
+static void route_overlay_customize_idle(struct route *this) {
+    struct route_overlay *overlay=this->overlay;
+
+    route_overlay_check_profile(overlay, this->vehicleprofile);
+    if (route_overlay_customize(overlay, this->ms, this->vehicleprofile, 1))
+        return;
+    route_overlay_customize_stop(overlay);
+    if (this->graph && this->graph->overlay)
+        route_recalculate_partial(this);
+}
+
+/**
+ * @brief Starts customizing the dirty cells of the overlay in the background
+ *
+ * @param this The route
+ */
+static void route_overlay_customize_start(struct route *this) {
+    struct route_overlay *overlay=this->overlay;
+
+    if (overlay->idle_ev || !overlay->dirty)
+        return;
+    overlay->idle_cb=callback_new_1(callback_cast(route_overlay_customize_idle), this);
+    overlay->idle_ev=event_add_idle(50, overlay->idle_cb);
+}
+
+/**
+ * @brief Computes the cost between a position and the boundary nodes of its cell of level 1
+ *
+ * @param this The overlay
+ * @param cell The cell containing the position
+ * @param ms The mapset
+ * @param profile The vehicle profile
+ * @param ri The position
+ * @param forward True for the cost from the position, false for the cost to it
+ * @return The cost of each boundary node, INT_MAX if it cannot be reached within the cell
+ */
+static int *route_overlay_seed(struct route_overlay *this, int cell, struct mapset *ms,
+                               struct vehicleprofile *profile, struct route_info *ri, int forward) {
+    struct route_overlay_cell *c=&this->cells[cell];
+    struct route_graph *graph=route_overlay_cell_graph(c, ms, profile);
+    struct route_graph_segment *s=NULL;
+    int *ret=g_new(int, c->boundary_count);
+    int i,val;
+
+    while ((s=route_graph_get_segment(graph, ri->street, s))) {
+        val=route_value_seg(profile, NULL, s, forward ? -1 : 1);
+        if (val != INT_MAX)
+            route_overlay_flood_point(graph, s->start, val*ri->percent/100);
+        val=route_value_seg(profile, NULL, s, forward ? 1 : -1);
+        if (val != INT_MAX)
+            route_overlay_flood_point(graph, s->end, val*(100-ri->percent)/100);
+    }
+    route_overlay_flood(graph, profile, &c->r, forward);
+    for (i = 0 ; i < c->boundary_count ; i++)
+        ret[i]=route_overlay_flood_value(graph, &this->nodes[c->boundary[i]].c);
+    route_graph_destroy(graph);
+    return ret;
+}
+
+/**
+ * @brief Adds the cells of level 1 along the path of a search to a set of cells
+ *
+ * Clique edges of cells above level 1 are resolved by searching for the same cost within the cell.
+ *
+ * @param this The overlay
+ * @param node The last node of the path
+ * @param cells The set of cells, one flag per cell
+ */
+static void route_overlay_add_path(struct route_overlay *this, int node, char *cells) {
+    struct route_overlay_step *steps=NULL;
+    struct route_overlay_query q;
+    int count=0,size=0;
+
+    memset(&q, 0, sizeof(q));
+    for (;;) {
+        struct route_overlay_node *n;
+        for (n=&this->nodes[node] ; n->parent >= 0 ; n=&this->nodes[n->parent]) {
+            cells[n->cell[0]]=1;
+            cells[this->nodes[n->parent].cell[0]]=1;
+            if (n->via < 0 || this->cells[n->via].level == 1)
+                continue;
+            if (count == size) {
+                size=size ? size*2 : 16;
+                steps=g_renew(struct route_overlay_step, steps, size);
+            }
+            steps[count].from=n->parent;
+            steps[count].to=n-this->nodes;
+            steps[count].cell=n->via;
+            count++;
+        }
+        cells[n->cell[0]]=1;
+        route_overlay_search_reset(this);
+        if (!count)
+            break;
+        count--;
+        q.limit=steps[count].cell;
+        q.target=steps[count].to;
+        node=q.target;
+        route_overlay_search_update(this, steps[count].from, 0, -1, -1);
+        route_overlay_search(this, &q);
+        if (this->nodes[node].value == INT_MAX) {
+            dbg(lvl_error,"cannot resolve clique edge of cell %d", q.limit);
+            route_overlay_search_reset(this);
+            node=steps[count].from;
+        }
+    }
+    g_free(steps);
+}
+
+/**
+ * @brief Finds the cells of level 1 through which the route between two positions passes
+ *
+ * @param this The overlay
+ * @param ms The mapset
+ * @param profile The vehicle profile
+ * @param pos The start
+ * @param dst The destination
+ * @param cells The set of cells to which the cells are added, one flag per cell
+ * @return True on success, false if no path was found
+ */
+static int route_overlay_find_cells(struct route_overlay *this, struct mapset *ms, struct vehicleprofile *profile,
+                                    struct route_info *pos, struct route_info *dst, char *cells) {
+    struct route_overlay_query q;
+    int s_cell[ROUTE_OVERLAY_MAX_LEVELS],t_cell[ROUTE_OVERLAY_MAX_LEVELS];
+    int i,s,t,*s_cost;
+
+    s=route_overlay_find_cell(this, &pos->lp);
+    t=route_overlay_find_cell(this, &dst->lp);
+    if (s < 0 || t < 0)
+        return 0;
+    cells[s]=1;
+    cells[t]=1;
+    for (i = 0 ; i < ROUTE_OVERLAY_MAX_LEVELS ; i++) {
+        s_cell[i]=i ? (s_cell[i-1] >= 0 ? this->cells[s_cell[i-1]].parent : -1) : s;
+        t_cell[i]=i ? (t_cell[i-1] >= 0 ? this->cells[t_cell[i-1]].parent : -1) : t;
+    }
+    memset(&q, 0, sizeof(q));
+    q.limit=-1;
+    q.target=-1;
+    q.s_cell=s_cell;
+    q.t_cell=t_cell;
+    q.best=INT_MAX;
+    q.best_node=-1;
+    s_cost=route_overlay_seed(this, s, ms, profile, pos, 1);
+    q.t_cost=route_overlay_seed(this, t, ms, profile, dst, 0);
+    for (i = 0 ; i < this->cells[s].boundary_count ; i++) {
+        if (s_cost[i] != INT_MAX)
+            route_overlay_search_update(this, this->cells[s].boundary[i], s_cost[i], -1, -1);
+    }
+    route_overlay_search(this, &q);
+    dbg(lvl_debug,"cost %d, %d nodes visited", q.best, this->touched_count);
+    if (q.best_node >= 0)
+        route_overlay_add_path(this, q.best_node, cells);
+    route_overlay_search_reset(this);
+    g_free(s_cost);
+    g_free(q.t_cost);
+    return q.best_node >= 0 || s == t;
+}
+
+/**
+ * @brief Returns a selection of the cells of the overlay through which the route passes
+ *
+ * If the map of the current position holds an overlay (see {@code maptool --route-overlay}), the cells of level 1
+ * along the path to each destination are searched in it. Unlike the contraction hierarchy, the overlay is used with
+ * traffic distortions present. If the graph built from the selection does not contain a path for the vehicle profile,
+ * the full graph is built (see route_path_update_done()).
+ *
+ * The overlay can only be used once all cells are customized for the vehicle profile and traffic. If `async` is
+ * true, dirty cells are customized in the background and the overlay is not used until that has finished, otherwise
+ * they are customized right away.
+ *
+ * @param this The route
+ * @param async Whether dirty cells are customized in the background
+ * @return The selection, or NULL if the overlay cannot be used
+ */
+static struct map_selection *route_overlay_selection(struct route *this, int async) {
+    struct vehicleprofile *profile=this->vehicleprofile;
+    struct route_info *prev=this->pos;
+    struct map *map=this->pos->street->item.map;
+    struct map_selection *ret=NULL,*sel;
+    struct route_overlay *overlay;
+    GList *tmp;
+    char *cells;
+    int i,count=0;
+
+    if (!profile->route_overlay || profile->mode == 2)
+        return NULL;
+    for (tmp=this->destinations ; tmp ; tmp=g_list_next(tmp))
+        if (((struct route_info *)tmp->data)->street->item.map != map)
+            return NULL;
+    if (!(overlay=route_overlay_get(this, map)))
+        return NULL;
+    if (overlay->dirty && async) {
+        route_overlay_customize_start(this);
+        return NULL;
+    }
+    route_overlay_customize_stop(overlay);
+    route_overlay_customize(overlay, this->ms, profile, INT_MAX);
+    overlay->customized=0;
+    cells=g_new0(char, overlay->cell_count);
+    for (tmp=this->destinations ; tmp ; tmp=g_list_next(tmp)) {
+        struct route_info *dst=tmp->data;
+        if (!route_overlay_find_cells(overlay, this->ms, profile, prev, dst, cells)) {
+            dbg(lvl_debug,"no path in overlay");
+            g_free(cells);
+            return NULL;
+        }
+        prev=dst;
+    }
+    for (i = 0 ; i < overlay->cell_count ; i++) {
+        if (!cells[i])
+            continue;
+        sel=g_new0(struct map_selection, 1);
+        sel->order=18;
+        sel->range=item_range_all;
+        sel->u.c_rect=overlay->cells[i].r;
+        sel->next=ret;
+        ret=sel;
+        count++;
+    }
+    dbg(lvl_debug,"%d cells from overlay", count);
+    g_free(cells);
+    return ret;
+}
+
+/**
+ * @brief Adds the cells to a graph built from the overlay through which the route passes after traffic changed
+ *
+ * Dirty cells are customized in the background first, which calls route_recalculate_partial() again when finished.
+ *
+ * @param this The route
+ * @return The number of segments added to the graph
+ */
+static int route_overlay_extend(struct route *this) {
+    struct map_selection *sel;
+
+    if (!this->overlay || !this->pos || !this->destinations)
+        return 0;
+    if (this->overlay->dirty) {
+        route_overlay_customize_start(this);
+        return 0;
+    }
+    if (!this->overlay->customized)
+        return 0;
+    sel=route_selection_subtract(route_overlay_selection(this, 1), this->graph->extent);
+    if (!sel)
+        return 0;
+    return route_graph_add_selection(this->graph, this->ms, sel, this->vehicleprofile);
+}
+
+/**
+ * @brief Returns a selection along the path from a position to the destination of a flooded route graph
+ *
+ * The path is split into pieces no larger than four times the width of the corridor, and a rectangle is added
+ * around each piece.
+ *
+ * @param graph The flooded route graph
+ * @param pos The position
+ * @param order The order of the rectangles
+ * @param width The distance by which each rectangle extends beyond its piece of the path
+ * @param sel The selection to add the rectangles to
+ * @return The new selection, or `sel` if the graph holds no path from `pos`
+ */
+static struct map_selection *route_graph_corridor(struct route_graph *graph, struct route_info *pos, int order,
+        int width, struct map_selection *sel) {
+    struct route_graph_segment *s=NULL;
+    struct route_graph_point *p=NULL;
+    struct coord_rect r;
+    int steps=0;
+
+    while ((s=route_graph_get_segment(graph, pos->street, s))) {
+        if (s->end->value != INT_MAX && (!p || s->end->value < p->value))
+            p=s->end;
+        if (s->start->value != INT_MAX && (!p || s->start->value < p->value))
+            p=s->start;
+    }
+    if (!p)
+        return sel;
+    r.lu=r.rl=p->c;
+    for (;;) {
+        coord_rect_extend(&r, &p->c);
+        s=p->seg;
+        if (!s || (s == p->dst_seg && p->value == p->dst_val) || steps++ > graph->point_count)
+            break;
+        if (r.rl.x-r.lu.x > 4*width || r.lu.y-r.rl.y > 4*width) {
+            sel=route_rect_add(sel, order, &r.lu, &r.rl, 0, width);
+            r.lu=r.rl=p->c;
+        }
+        p=(s->start == p) ? s->end : s->start;
+    }
+    return route_rect_add(sel, order, &r.lu, &r.rl, 0, width);
+}
+
+/**
+ * @brief Adds the corridor along the route to a route graph which has been built from the coarse selection
+ *
+ * The `route_depth` of the vehicle profile selects large rectangles at low orders between start and destination,
+ * which hold the major roads, and smaller rectangles at higher orders around start and destination. The latter
+ * account for most of the items read for long routes. If the vehicle profile has a `route_corridor`, the graph is
+ * built in two passes instead:
+ *
+ * \li First, the graph is built from the rectangles relative to the bounding box of start and destination and the
+ * rectangle with the highest order around each of them, see route_calc_selection().
+ * \li This graph is flooded, and the path from the start is followed to the destination. Each entry `order:width` of
+ * `route_corridor` then adds rectangles of that order along the path, see route_graph_corridor(), and the items in
+ * the new parts of the selection are read.
+ *
+ * If the first pass finds no path, the full selection is read instead. The graph is reset, and the new items are
+ * read just like the first pass, on a worker thread or the main loop if the graph is built in the background (see
+ * route_graph_build_start()). The graph's done callback, route_graph_update_done(), is called again afterwards.
+ *
+ * @param this The route
+ * @return True if items are being read, false if there is nothing to add
+ */
+static int route_graph_add_corridor(struct route *this) {
+    struct route_graph *graph=this->graph;
+    struct vehicleprofile *profile=this->vehicleprofile;
+    struct map_selection *sel=NULL;
+    char *corridor, *str, *tok;
+
+    route_graph_set_start(graph, this->pos, profile, 1);
+    route_graph_init(graph, this->current_dst, profile);
+    route_graph_compute_shortest_path(graph, profile, NULL);
+    corridor=str=g_strdup(profile->route_corridor);
+    while ((tok=strtok(str,",")) != NULL) {
+        int order=0, width=0;
+        if (sscanf(tok,"%d:%d",&order,&width) == 2)
+            sel=route_graph_corridor(graph, this->pos, order, width, sel);
+        str=NULL;
+    }
+    g_free(corridor);
+    if (!sel || !graph->expanded) {
+        dbg(lvl_debug,"no path in coarse graph, reading full selection");
+        route_free_selection(sel);
+        sel=route_get_selection(this);
+    }
+    route_graph_reset(graph);
+    route_graph_heuristic_destroy(graph);
+    graph->expanded=0;
+    sel=route_selection_subtract(sel, graph->extent);
+    if (!sel)
+        return 0;
+    route_timing(this, route_timing_graph);
+    route_graph_build_start(graph, this->ms, sel, graph->async, profile);
+    return 1;
+}
+
+#define ROUTE_GRAPH_SNAPSHOT_VERSION 1
+
+/**
+ * @brief Header of a route graph snapshot
+ *
+ * The header is followed by:
+ * \li the key, see route_graph_snapshot_key(), padded to a multiple of 4 bytes
+ * \li `selection_count` times a {@code struct route_graph_snapshot_rect}, holding the extent of the graph
+ * \li `hash_size` indices of the first point in each hash bucket, -1 for an empty bucket
+ * \li `point_count` times a {@code struct route_graph_snapshot_point}
+ * \li `segments_size` bytes holding the segments in their frozen layout (see route_graph_freeze()), with the point
+ * pointers replaced by point indices plus one, the segment pointers by segment offsets plus one and the map of the
+ * item by its index in the mapset plus one (zero standing for NULL in all cases)
+ *
+ * All data is in the byte order and pointer size of the machine which wrote it, as a snapshot is only a cache.
+ */
+struct route_graph_snapshot_header {
+    char magic[4];              /**< "NRGS" */
+    int version;                /**< {@code ROUTE_GRAPH_SNAPSHOT_VERSION} */
+    int segment_size;           /**< Size of {@code struct route_graph_segment}, which implies the pointer size */
+    int key_size;               /**< Size of the key including its terminating zero, without padding */
+    int selection_count;        /**< Number of rectangles of the extent */
+    int hash_size;              /**< Number of hash buckets */
+    int point_count;            /**< Number of points */
+    int segments_size;          /**< Size of the segments in bytes */
+    int segment_count;          /**< Number of segments ever added to the graph, see `route_graph->segment_count` */
+    int item_count;             /**< Number of items read from the maps */
+    int maxspeed;               /**< Highest maxspeed of all segments */
+};
+
+struct route_graph_snapshot_rect {
+    int order;
+    struct coord_rect r;
+};
+
+struct route_graph_snapshot_point {
+    int hash_next;              /**< Index of the next point in the hash bucket, -1 for none */
+    int start;                  /**< Offset of the first segment starting at the point, -1 for none */
+    int end;                    /**< Offset of the first segment ending at the point, -1 for none */
+    struct coord c;
+    int flags;
+};
+
+/**
+ * @brief Returns the maps of the mapset which a route graph is built from, except for traffic maps
+ *
+ * @param ms The mapset
+ * @param count Receives the number of maps
+ * @return The maps, to be freed with g_free()
+ */
+static struct map **route_graph_snapshot_maps(struct mapset *ms, int *count) {
+    struct mapset_handle *h=mapset_open(ms);
+    struct map **ret=NULL,*m;
+    struct attr type;
+
+    *count=0;
+    while ((m=mapset_next(h, 2))) {
+        if (map_get_attr(m, attr_type, &type, NULL) && !strcmp(type.u.str, "traffic"))
+            continue;
+        ret=g_renew(struct map *, ret, *count+1);
+        ret[(*count)++]=m;
+    }
+    mapset_close(h);
+    return ret;
+}
+
+static unsigned int route_graph_snapshot_hash(unsigned int hash, int value) {
+    return (hash ^ (unsigned int)value)*16777619U;
+}
+
+static unsigned int route_graph_snapshot_hash_str(unsigned int hash, char *str) {
+    while (str && *str)
+        hash=route_graph_snapshot_hash(hash, *str++);
+    return route_graph_snapshot_hash(hash, 0);
+}
+
+static void route_graph_snapshot_hash_roadprofile(gpointer key, gpointer value, gpointer user_data) {
+    struct roadprofile *rp=value;
+    unsigned int *hash=user_data,h=2166136261U;
+    h=route_graph_snapshot_hash(h, (int)(long)key);
+    h=route_graph_snapshot_hash(h, rp->speed);
+    h=route_graph_snapshot_hash(h, rp->route_weight);
+    h=route_graph_snapshot_hash(h, rp->maxspeed);
+    /* the order of the hash table is arbitrary */
+    *hash+=h;
+}
+
+/**
+ * @brief Returns a hash of the settings of a vehicle profile which the route graph depends on
+ *
+ * @param profile The vehicle profile
+ * @return The hash
+ */
+static unsigned int route_graph_snapshot_profile_hash(struct vehicleprofile *profile) {
+    unsigned int ret=2166136261U,roadprofiles=0;
+
+    ret=route_graph_snapshot_hash(ret, profile->mode);
+    ret=route_graph_snapshot_hash(ret, profile->flags_forward_mask);
+    ret=route_graph_snapshot_hash(ret, profile->flags_reverse_mask);
+    ret=route_graph_snapshot_hash(ret, profile->flags);
+    ret=route_graph_snapshot_hash(ret, profile->maxspeed_handling);
+    ret=route_graph_snapshot_hash(ret, profile->width);
+    ret=route_graph_snapshot_hash(ret, profile->height);
+    ret=route_graph_snapshot_hash(ret, profile->length);
+    ret=route_graph_snapshot_hash(ret, profile->weight);
+    ret=route_graph_snapshot_hash(ret, profile->axle_weight);
+    ret=route_graph_snapshot_hash(ret, profile->dangerous_goods);
+    ret=route_graph_snapshot_hash(ret, profile->through_traffic_penalty);
+    ret=route_graph_snapshot_hash_str(ret, profile->route_depth);
+    ret=route_graph_snapshot_hash_str(ret, profile->route_corridor);
+    g_hash_table_foreach(profile->roadprofile_hash, route_graph_snapshot_hash_roadprofile, &roadprofiles);
+    return route_graph_snapshot_hash(ret, roadprofiles);
+}
+
+/**
+ * @brief Returns the key of a route graph snapshot for a route
+ *
+ * The key identifies the vehicle profile by its name and a hash of its settings, and the maps by their release and
+ * the modification time and size of their files, so that a snapshot is not used after the profile has been changed,
+ * a map has been replaced or the set of maps has changed.
+ *
+ * @param this The route
+ * @return The key, to be freed with g_free()
+ */
+static char *route_graph_snapshot_key(struct route *this) {
+    struct map **maps;
+    struct attr type,data,release;
+    struct stat st;
+    char *ret,*tmp;
+    int i,count;
+
+    ret=g_strdup_printf("profile=%s:%08x", this->vehicleprofile->name ? this->vehicleprofile->name : "",
+                        route_graph_snapshot_profile_hash(this->vehicleprofile));
+    maps=route_graph_snapshot_maps(this->ms, &count);
+    for (i = 0 ; i < count ; i++) {
+        if (!map_get_attr(maps[i], attr_type, &type, NULL))
+            type.u.str="";
+        if (!map_get_attr(maps[i], attr_data, &data, NULL))
+            data.u.str="";
+        if (!map_get_attr(maps[i], attr_map_release, &release, NULL))
+            release.u.str="";
+        if (stat(data.u.str, &st))
+            memset(&st, 0, sizeof(st));
+        tmp=g_strdup_printf("%s;%s:%s:%s:%ld:%lld", ret, type.u.str, data.u.str, release.u.str, (long)st.st_mtime,
+                            (long long)st.st_size);
+        g_free(ret);
+        ret=tmp;
+    }
+    g_free(maps);
+    return ret;
+}
+
+/**
+ * @brief Saves the route graph of a route to its snapshot file
+ *
+ * Only a graph which has just been frozen and holds no traffic distortions can be saved, as the snapshot contains the
+ * frozen layout only. The snapshot is written to a temporary file first, which then replaces the previous snapshot.
+ *
+ * @param this The route
+ */
+static void route_graph_snapshot_save(struct route *this) {
+    struct route_graph *graph=this->graph;
+    struct route_graph_snapshot_header header;
+    struct route_graph_snapshot_rect *rects;
+    struct route_graph_snapshot_point *points;
+    struct route_graph_segment *s;
+    struct map_selection *sel;
+    struct map **maps;
+    struct file *f;
+    struct attr readwrite= {attr_readwrite,{(void *)1}};
+    struct attr create= {attr_create,{(void *)1}};
+    struct attr cache= {attr_cache,{(void *)0}};
+    struct attr *options[]= {&readwrite,&create,&cache,NULL};
+    char *key,*tmpname,*segments,*pos;
+    int *hash;
+    int i,j,map_count,ok=1;
+    long long offset=0;
+
+    if (!graph || graph->ch || graph->speed_profiles || !graph->frozen_points
+            || graph->point_count != graph->frozen_point_count
+            || graph->route_segments != (struct route_graph_segment *)graph->frozen_segments)
+        return;
+    maps=route_graph_snapshot_maps(this->ms, &map_count);
+    segments=g_malloc(graph->frozen_segments_size);
+    memcpy(segments, graph->frozen_segments, graph->frozen_segments_size);
+#define SEGMENT_OFFSET(x) ((void *)(uintptr_t)((x) ? (char *)(x)-graph->frozen_segments+1 : 0))
+#define POINT_INDEX(x) ((void *)(uintptr_t)((x) ? (x)-graph->frozen_points+1 : 0))
+    for (pos = segments ; ok && pos < segments+graph->frozen_segments_size ; pos+=route_graph_frozen_segment_size(s)) {
+        s=(struct route_graph_segment *)pos;
+        if (s->data.item.type == type_traffic_distortion)
+            ok=0;
+        for (j = 0 ; j < map_count && maps[j] != s->data.item.map ; j++);
+        if (j == map_count && s->data.item.map)
+            ok=0;
+        s->next=NULL;
+        s->start_next=SEGMENT_OFFSET(s->start_next);
+        s->end_next=SEGMENT_OFFSET(s->end_next);
+        s->start=POINT_INDEX(s->start);
+        s->end=POINT_INDEX(s->end);
+        s->data.item.map=(void *)(uintptr_t)(s->data.item.map ? j+1 : 0);
+        s->data.item.meth=NULL;
+        s->data.item.priv_data=NULL;
+    }
+#undef SEGMENT_OFFSET
+#undef POINT_INDEX
+    g_free(maps);
+    if (!ok) {
+        dbg(lvl_debug,"graph holds traffic distortions or items of unknown maps, not saving");
+        g_free(segments);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "NRGS", 4);
+    header.version=ROUTE_GRAPH_SNAPSHOT_VERSION;
+    header.segment_size=sizeof(struct route_graph_segment);
+    key=route_graph_snapshot_key(this);
+    header.key_size=strlen(key)+1;
+    /* pad the key with zeros */
+    key=g_realloc(key, (header.key_size+3) & ~3);
+    memset(key+header.key_size, 0, ((header.key_size+3) & ~3)-header.key_size);
+    for (sel = graph->extent ; sel ; sel = sel->next)
+        header.selection_count++;
+    header.hash_size=graph->hash_size;
+    header.point_count=graph->point_count;
+    header.segments_size=graph->frozen_segments_size;
+    header.segment_count=graph->segment_count;
+    header.item_count=graph->item_count;
+    header.maxspeed=graph->maxspeed;
+
+    rects=g_new0(struct route_graph_snapshot_rect, header.selection_count);
+    for (i = 0, sel = graph->extent ; sel ; i++, sel = sel->next) {
+        rects[i].order=sel->order;
+        rects[i].r=sel->u.c_rect;
+    }
+    hash=g_new(int, graph->hash_size);
+    for (i = 0 ; i < graph->hash_size ; i++)
+        hash[i]=graph->hash[i] ? graph->hash[i]-graph->frozen_points : -1;
+    points=g_new(struct route_graph_snapshot_point, graph->point_count);
+    for (i = 0 ; i < graph->point_count ; i++) {
+        struct route_graph_point *p=&graph->frozen_points[i];
+        points[i].hash_next=p->hash_next ? p->hash_next-graph->frozen_points : -1;
+        points[i].start=p->start ? (char *)p->start-graph->frozen_segments : -1;
+        points[i].end=p->end ? (char *)p->end-graph->frozen_segments : -1;
+        points[i].c=p->c;
+        points[i].flags=p->flags;
+    }
+
+    tmpname=g_strdup_printf("%s.tmp", this->graph_snapshot);
+    f=file_create(tmpname, options);
+    if (f) {
+        ok=file_data_write(f, offset, sizeof(header), &header);
+        offset+=sizeof(header);
+        ok=ok && file_data_write(f, offset, (header.key_size+3) & ~3, key);
+        offset+=(header.key_size+3) & ~3;
+        ok=ok && file_data_write(f, offset, header.selection_count*sizeof(*rects), rects);
+        offset+=header.selection_count*sizeof(*rects);
+        ok=ok && file_data_write(f, offset, header.hash_size*sizeof(*hash), hash);
+        offset+=header.hash_size*sizeof(*hash);
+        ok=ok && file_data_write(f, offset, header.point_count*sizeof(*points), points);
+        offset+=header.point_count*sizeof(*points);
+        ok=ok && file_data_write(f, offset, header.segments_size, segments);
+        file_destroy(f);
+        if (ok && !rename(tmpname, this->graph_snapshot)) {
+            dbg(lvl_debug,"saved %d points and %d bytes of segments to %s", header.point_count, header.segments_size,
+                this->graph_snapshot);
+        } else {
+            dbg(lvl_error,"failed to write route graph snapshot %s", this->graph_snapshot);
+            remove(tmpname);
+        }
+    } else {
+        dbg(lvl_error,"failed to create %s", tmpname);
+    }
+    g_free(tmpname);
+    g_free(points);
+    g_free(hash);
+    g_free(rects);
+    g_free(key);
+    g_free(segments);
+}
+
+/**
+ * @brief Checks the links of the points and segments of a route graph snapshot
+ *
+ * Every point index must be below the number of points, and every segment offset must be the start of a segment,
+ * so that a damaged snapshot cannot make the graph point outside of its arenas.
+ *
+ * @param header The header of the snapshot
+ * @param hash The hash buckets of the snapshot
+ * @param points The points of the snapshot
+ * @param segments The segments of the snapshot, in the layout written by route_graph_snapshot_save()
+ * @return true if all links are valid, false if not
+ */
+static int route_graph_snapshot_check(struct route_graph_snapshot_header *header, int *hash,
+                                      struct route_graph_snapshot_point *points, char *segments) {
+    struct route_graph_segment *s;
+    char *starts;
+    ptrdiff_t pos,size;
+    int i,ret=1;
+
+#define VALID_POINT(x) ((x) >= -1 && (x) < header->point_count)
+#define VALID_SEGMENT(x) ((x) == -1 || ((x) >= 0 && (x) < header->segments_size && starts[(x)]))
+    /* the offsets at which segments start */
+    starts=g_new0(char, header->segments_size+1);
+    for (pos = 0 ; ret && pos < header->segments_size ; pos+=size) {
+        s=(struct route_graph_segment *)(segments+pos);
+        if (header->segments_size-pos < sizeof(struct route_graph_segment))
+            ret=0;
+        else if ((size=route_graph_frozen_segment_size(s)) > header->segments_size-pos)
+            ret=0;
+        else
+            starts[pos]=1;
+    }
+    for (i = 0 ; ret && i < header->hash_size ; i++)
+        ret=VALID_POINT(hash[i]);
+    for (i = 0 ; ret && i < header->point_count ; i++)
+        ret=VALID_POINT(points[i].hash_next) && VALID_SEGMENT(points[i].start) && VALID_SEGMENT(points[i].end);
+    for (pos = 0 ; ret && pos < header->segments_size ; pos+=route_graph_frozen_segment_size(s)) {
+        s=(struct route_graph_segment *)(segments+pos);
+        /* point indices and segment offsets are stored plus one, see route_graph_snapshot_save() */
+        ret=VALID_POINT((ptrdiff_t)(uintptr_t)s->start-1) && (uintptr_t)s->start > 0
+            && VALID_POINT((ptrdiff_t)(uintptr_t)s->end-1) && (uintptr_t)s->end > 0
+            && VALID_SEGMENT((ptrdiff_t)(uintptr_t)s->start_next-1) && VALID_SEGMENT((ptrdiff_t)(uintptr_t)s->end_next-1);
+    }
+#undef VALID_POINT
+#undef VALID_SEGMENT
+    g_free(starts);
+    return ret;
+}
+
+/**
+ * @brief Loads the route graph of a route from its snapshot file
+ *
+ * The snapshot is used if its key matches the route, its extent covers the selection and all of its links are valid
+ * (see route_graph_snapshot_check()). The points and segments are copied from the mapped file into the arenas of a
+ * new graph, which is frozen and ready to be flooded.
+ *
+ * @param this The route
+ * @param sel The selection from which the graph would be built, which is freed
+ * @return The graph, or NULL if there is no usable snapshot
+ */
+static struct route_graph *route_graph_snapshot_load(struct route *this, struct map_selection *sel) {
+    struct route_graph_snapshot_header *header;
+    struct route_graph_snapshot_rect *rects;
+    struct route_graph_snapshot_point *points;
+    struct route_graph_point *p;
+    struct route_graph_segment *s;
+    struct route_graph *ret=NULL;
+    struct map_selection *extent=NULL,*last=NULL,*curr;
+    struct map **maps=NULL;
+    struct file *f;
+    struct attr cache= {attr_cache,{(void *)0}};
+    struct attr *options[]= {&cache,NULL};
+    char *key=NULL,*data,*segments,*pos;
+    int *hash;
+    int i,map_count=0;
+    long long size;
+
+    f=file_create(this->graph_snapshot, options);
+    if (!f) {
+        route_free_selection(sel);
+        return NULL;
+    }
+    header=(struct route_graph_snapshot_header *)(f->size >= sizeof(*header) && file_mmap(f) ? f->begin : NULL);
+    if (!header || memcmp(header->magic, "NRGS", 4) || header->version != ROUTE_GRAPH_SNAPSHOT_VERSION
+            || header->segment_size != sizeof(struct route_graph_segment) || header->key_size < 1
+            || header->selection_count < 0 || header->hash_size < 1 || header->point_count < 0
+            || header->segments_size < 0)
+        goto out;
+    size=sizeof(*header)+((header->key_size+3) & ~3)+header->selection_count*sizeof(*rects)+
+         (long long)header->hash_size*sizeof(*hash)+(long long)header->point_count*sizeof(*points)+header->segments_size;
+    if (size != f->size)
+        goto out;
+    data=(char *)(header+1);
+    key=route_graph_snapshot_key(this);
+    if (header->key_size != strlen(key)+1 || memcmp(data, key, header->key_size))
+        goto out;
+    data+=(header->key_size+3) & ~3;
+    rects=(struct route_graph_snapshot_rect *)data;
+    for (i = 0 ; i < header->selection_count ; i++) {
+        curr=g_new0(struct map_selection, 1);
+        curr->order=rects[i].order;
+        curr->range=item_range_all;
+        curr->u.c_rect=rects[i].r;
+        if (last)
+            last->next=curr;
+        else
+            extent=curr;
+        last=curr;
+    }
+    sel=route_selection_subtract(sel, extent);
+    if (sel) {
+        dbg(lvl_debug,"snapshot does not cover the selection");
+        goto out;
+    }
+    data+=header->selection_count*sizeof(*rects);
+    hash=(int *)data;
+    data+=header->hash_size*sizeof(*hash);
+    points=(struct route_graph_snapshot_point *)data;
+    data+=header->point_count*sizeof(*points);
+    if (!route_graph_snapshot_check(header, hash, points, data)) {
+        dbg(lvl_error,"route graph snapshot %s is damaged", this->graph_snapshot);
+        goto out;
+    }
+
+    maps=route_graph_snapshot_maps(this->ms, &map_count);
+    ret=g_new0(struct route_graph, 1);
+    ret->heap=route_heap_new(offsetof(struct route_graph_point, el));
+    ret->extent=extent;
+    extent=NULL;
+    ret->hash_size=header->hash_size;
+    ret->point_count=header->point_count;
+    ret->segment_count=header->segment_count;
+    ret->item_count=header->item_count;
+    ret->maxspeed=header->maxspeed;
+    ret->hash=g_new(struct route_graph_point *, ret->hash_size);
+    p=route_graph_arena_alloc(ret, &ret->point_arena, ret->point_count*sizeof(struct route_graph_point));
+    segments=header->segments_size ? route_graph_arena_alloc(ret, &ret->segment_arena, header->segments_size) : NULL;
+    if (segments)
+        memcpy(segments, data, header->segments_size);
+    for (i = 0 ; i < ret->hash_size ; i++)
+        ret->hash[i]=hash[i] >= 0 ? &p[hash[i]] : NULL;
+    for (i = 0 ; i < ret->point_count ; i++) {
+        p[i].hash_next=points[i].hash_next >= 0 ? &p[points[i].hash_next] : NULL;
+        p[i].start=points[i].start >= 0 ? (struct route_graph_segment *)(segments+points[i].start) : NULL;
+        p[i].end=points[i].end >= 0 ? (struct route_graph_segment *)(segments+points[i].end) : NULL;
+        p[i].value=p[i].rhs=p[i].dst_val=INT_MAX;
+        p[i].c=points[i].c;
+        p[i].flags=points[i].flags;
+    }
+#define SEGMENT(x) ((x) ? (struct route_graph_segment *)(segments+(ptrdiff_t)(uintptr_t)(x)-1) : NULL)
+#define POINT(x) ((x) ? &p[(ptrdiff_t)(uintptr_t)(x)-1] : NULL)
+    for (pos = segments ; pos && pos < segments+header->segments_size ; pos+=route_graph_frozen_segment_size(s)) {
+        s=(struct route_graph_segment *)pos;
+        s->start_next=SEGMENT(s->start_next);
+        s->end_next=SEGMENT(s->end_next);
+        s->start=POINT(s->start);
+        s->end=POINT(s->end);
+        i=(ptrdiff_t)(uintptr_t)s->data.item.map-1;
+        s->data.item.map=(i >= 0 && i < map_count) ? maps[i] : NULL;
+        s->next=pos+route_graph_frozen_segment_size(s) < segments+header->segments_size ?
+                (struct route_graph_segment *)(pos+route_graph_frozen_segment_size(s)) : NULL;
+    }
+#undef SEGMENT
+#undef POINT
+    ret->route_segments=(struct route_graph_segment *)segments;
+    ret->frozen_points=p;
+    ret->frozen_point_count=ret->point_count;
+    ret->frozen_segments=segments;
+    ret->frozen_segments_size=header->segments_size;
+    dbg(lvl_debug,"loaded %d points and %d bytes of segments from %s", ret->point_count, header->segments_size,
+        this->graph_snapshot);
+out:
+    route_free_selection(sel);
+    route_free_selection(extent);
+    g_free(maps);
+    g_free(key);
+    file_destroy(f);
+    return ret;
+}
+
+/**
+ * @brief Sets the estimated arrival at the current destination for time-dependent costs
+ *
+ * Before the route is known, the travel time is estimated from the straight-line distance via all destinations up to
+ * the current one. Once the path to the destination has been found, route_path_update_done() corrects the arrival
+ * from its travel time if the two differ by more than {@code ROUTE_ARRIVAL_TOLERANCE}.
+ *
+ * @param this The route
+ * @param duration The travel time from now in seconds, -1 to estimate it
+ */
+static void route_graph_set_arrival(struct route *this, int duration) {
+    struct coord *c=&this->pos->c;
+    struct tm *tm;
+    time_t now;
+    double len=0;
+    GList *l;
+
+    if (!this->graph->time_dependent)
+        return;
+    if (duration < 0) {
+        for (l = this->destinations ; l ; l = g_list_next(l)) {
+            struct route_info *dst=l->data;
+            len+=transform_distance(projection_mg, c, &dst->c);
+            c=&dst->c;
+            if (dst == this->current_dst)
+                break;
+        }
+        duration=len*3.6/ROUTE_ARRIVAL_SPEED;
+        this->arrival_estimate=duration;
+    }
+    now=time(NULL);
+    tm=localtime(&now);
+    this->graph->arrival=(((tm->tm_wday+6)%7)*24*60*60+tm->tm_hour*60*60+tm->tm_min*60+tm->tm_sec+duration)%ROUTE_WEEK;
+    dbg(lvl_debug,"arrival in %d seconds, at %d seconds into the week", duration, this->graph->arrival);
+}
+
+static void route_graph_update_done(struct route *this, struct callback *cb) {
+    route_timing(this, route_timing_flood);
+    if (this->graph_coarse) {
+        this->graph_coarse=0;
+        /* called again once the corridor has been read */
+        if (route_graph_add_corridor(this))
+            return;
+    }
+    if (this->graph_snapshot_save) {
+        this->graph_snapshot_save=0;
+        route_graph_snapshot_save(this);
+    }
+    this->graph->time_dependent=(this->vehicleprofile->route_time_dependent && this->graph->speed_profiles);
+    route_graph_set_arrival(this, -1);
+    route_graph_set_start(this->graph, route_previous_destination(this), this->vehicleprofile, 1);
+    route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
+    route_graph_compute_shortest_path(this->graph, this->vehicleprofile, cb);
+}
+
+/**
+ * @brief Updates the route graph
+ *
+ * This updates the route graph after settings in the route have changed. It also
+ * adds routing information afterwards by calling route_graph_flood().
+ *
+ * @param this The route to update the graph for
+ * @param cb The callback function to call when the route graph update is complete (used only in asynchronous mode)
+ * @param async Set to nonzero in order to update the route graph asynchronously
+ */
+static void route_graph_update(struct route *this, struct callback *cb, int async) {
+    struct attr route_status;
+    struct coord *c=g_alloca(sizeof(struct coord)*(1+g_list_length(this->destinations)));
+    struct map_selection *sel;
+    int i=0;
+    GList *tmp;
+
+    route_status.type=attr_route_status;
+    if (!this->ch_failed)
+        memset(this->timing, 0, sizeof(this->timing));
+    route_timing(this, route_timing_graph);
+    route_graph_destroy(this->graph);
+    this->graph=NULL;
+    callback_destroy(this->route_graph_done_cb);
+    this->route_graph_done_cb=callback_new_2(callback_cast(route_graph_update_done), this, cb);
+    route_status.u.num=route_status_building_graph;
+    route_set_attr(this, &route_status);
+    if ((this->graph=route_graph_build_ch(this))) {
+        callback_call_0(this->route_graph_done_cb);
+        return;
+    }
+    sel=this->ch_failed ? NULL : route_overlay_selection(this, async);
+    this->ch_failed=0;
+    if (sel) {
+        this->graph_snapshot_save=0;
+        this->graph_coarse=0;
+        this->graph=route_graph_build(this->ms, sel, this->route_graph_done_cb, async, this->vehicleprofile);
+        this->graph->overlay=1;
+        if (! async) {
+            while (this->graph->busy)
+                route_graph_build_idle(this->graph, this->vehicleprofile);
+        }
+        return;
+    }
+    c[i++]=this->pos->c;
+    tmp=this->destinations;
+    while (tmp) {
+        struct route_info *dst=tmp->data;
+        c[i++]=dst->c;
+        tmp=g_list_next(tmp);
+    }
+    this->graph_snapshot_save=0;
+    if (this->graph_snapshot && !route_ch_traffic_active(this)) {
+        if ((this->graph=route_graph_snapshot_load(this, route_calc_selection(c, i, this->vehicleprofile, 0)))) {
+            this->graph_coarse=0;
+            callback_call_0(this->route_graph_done_cb);
+            return;
+        }
+        this->graph_snapshot_save=1;
+    }
+    /* with a single destination, the graph can be built along a corridor, see route_graph_add_corridor() */
+    this->graph_coarse=(this->vehicleprofile->route_corridor && i == 2);
+    this->graph=route_graph_build(this->ms, route_calc_selection(c, i, this->vehicleprofile, this->graph_coarse),
+                                  this->route_graph_done_cb, async, this->vehicleprofile);
+    if (! async) {
+        while (this->graph->busy)
+            route_graph_build_idle(this->graph, this->vehicleprofile);
+    }
+}
+
+/**
+ * @brief Returns travel time and length from a position to the destination of a flooded route graph
+ *
+ * The path is built with route_path_new(), so positions on the same street item and offroad shortcuts are handled
+ * as for a route. The time is the sum of the segment durations, as in the `destination_time` attribute of a route,
+ * and does not include penalties which only affect the choice of the path.
+ *
+ * @param this The route graph, flooded towards `dst`
+ * @param pos The start position
+ * @param dst The destination with which the graph was initialized
+ * @param profile The vehicle profile
+ * @param len Receives the length of the path in meters
+ * @return The travel time in tenths of a second, or `INT_MAX` if `dst` cannot be reached
+ */
+static int route_graph_get_travel(struct route_graph *this, struct route_info *pos, struct route_info *dst,
+                                  struct vehicleprofile *profile, int *len) {
+    struct route_graph_segment *s=NULL;
+    struct route_path *path;
+    int ret;
+
+    *len=0;
+    if (!pos->street || !dst->street)
+        return INT_MAX;
+    /* route_path_new() complains about blocked positions, which are nothing unusual in a matrix */
+    if (profile->mode != 2) {
+        while ((s=route_graph_get_segment(this, pos->street, s))) {
+            if ((s->end->value != INT_MAX && route_value_seg(profile, NULL, s, 2) != INT_MAX)
+                    || (s->start->value != INT_MAX && route_value_seg(profile, NULL, s, -2) != INT_MAX))
+                break;
+        }
+        if (!s && (profile->mode != 0 || pos->lenextra + dst->lenextra <= transform_distance(map_projection(
+                       pos->street->item.map), &pos->c, &dst->c)))
+            return INT_MAX;
+    }
+    path=route_path_new(this, NULL, pos, dst, profile);
+    if (!path)
+        return INT_MAX;
+    route_path_set_totals(path, profile);
+    *len=path->path_len;
+    ret=path->path_time;
+    route_path_destroy(path, 1);
+    return ret;
+}
+
+/**
+ * @brief Calculates travel times and distances between several origins and destinations
+ *
+ * All coordinates are snapped to the nearest street as for a route. A route graph covering all of them is built, and
+ * flooded once for each destination. Costs are calculated with the vehicle profile of the route, which must be set.
+ * The current route of `this_` is not affected.
+ *
+ * This function blocks until all results are available.
+ *
+ * @param this_ The route
+ * @param origins The origins
+ * @param origin_count Number of origins
+ * @param destinations The destinations
+ * @param destination_count Number of destinations
+ * @param times Receives the travel time in seconds for each pair of origin and destination, in rows of
+ * `destination_count` elements for each origin, or -1 if the destination cannot be reached from the origin
+ * @param lengths Receives the length of the path in meters for each pair, in the same layout as `times`, or -1. May
+ * be NULL.
+ * @return True on success, false if the route has no mapset or vehicle profile
+ */
+int route_get_travel_matrix(struct route *this_, struct pcoord *origins, int origin_count,
+                            struct pcoord *destinations, int destination_count, int *times, int *lengths) {
+    struct route_info **pos,**dst;
+    struct route_graph *graph;
+    struct coord *c;
+    int i,j,count=0,val,len;
+
+    if (!this_->ms || !this_->vehicleprofile)
+        return 0;
+    pos=g_new0(struct route_info *, origin_count);
+    dst=g_new0(struct route_info *, destination_count);
+    c=g_new(struct coord, origin_count+destination_count);
+    for (i = 0 ; i < origin_count ; i++)
+        if ((pos[i]=route_find_nearest_street(this_->vehicleprofile, this_->ms, &origins[i]))) {
+            route_info_distances(pos[i], origins[i].pro);
+            c[count++]=pos[i]->c;
+        }
+    for (j = 0 ; j < destination_count ; j++)
+        if ((dst[j]=route_find_nearest_street(this_->vehicleprofile, this_->ms, &destinations[j]))) {
+            route_info_distances(dst[j], destinations[j].pro);
+            c[count++]=dst[j]->c;
+        }
+    graph=count ? route_graph_build(this_->ms, route_calc_selection(c, count, this_->vehicleprofile, 0), NULL, 0,
+                                    this_->vehicleprofile) : NULL;
+    while (graph && graph->busy)
+        route_graph_build_idle(graph, this_->vehicleprofile);
+    for (j = 0 ; j < destination_count ; j++) {
+        if (graph && dst[j]) {
+            route_graph_reset(graph);
+            route_graph_init(graph, dst[j], this_->vehicleprofile);
+            route_graph_compute_shortest_path(graph, this_->vehicleprofile, NULL);
+        }
+        for (i = 0 ; i < origin_count ; i++) {
+            val=INT_MAX;
+            len=0;
+            if (graph && dst[j] && pos[i])
+                val=route_graph_get_travel(graph, pos[i], dst[j], this_->vehicleprofile, &len);
+            times[i*destination_count+j]=(val == INT_MAX) ? -1 : val/10;
+            if (lengths)
+                lengths[i*destination_count+j]=(val == INT_MAX) ? -1 : len;
+        }
+    }
+    dbg(lvl_debug,"%dx%d matrix from %d points", origin_count, destination_count, graph ? graph->point_count : 0);
+    route_graph_destroy(graph);
+    for (i = 0 ; i < origin_count ; i++)
+        route_info_free(pos[i]);
+    for (j = 0 ; j < destination_count ; j++)
+        route_info_free(dst[j]);
+    g_free(pos);
+    g_free(dst);
+    g_free(c);
+    return 1;
+}
+
+#define ROUTE_ORDER_UNREACHABLE (7*24*60*60)  /**< Travel time in seconds assumed between two destinations if one
+                                              *   cannot be reached from the other */
+
+/**
+ * @brief Returns the travel time along a part of a tour through the destinations
+ *
+ * @param times Travel times between all nodes, see route_optimize_destinations()
+ * @param count Number of columns of `times`, i.e. the number of nodes except the start
+ * @param tour The order of the nodes
+ * @param len Number of nodes in `tour` to take into account
+ * @return The travel time in seconds from `tour[0]` via all nodes to `tour[len-1]`
+ */
+static int route_order_cost(int *times, int count, int *tour, int len) {
+    int i,ret=0;
+
+    for (i = 1 ; i < len ; i++)
+        ret+=times[tour[i-1]*count+tour[i]-1];
+    return ret;
+}
+
+/**
+ * @brief Builds an initial tour through the destinations by nearest insertion
+ *
+ * Starting with the start node (and the end node, if it is fixed), the node closest to any node of the tour is
+ * inserted at the position where it adds the least travel time, until all nodes are part of the tour.
+ *
+ * @param times Travel times between all nodes, see route_optimize_destinations()
+ * @param n Number of nodes, including the start
+ * @param fixed_end The last node has to stay last
+ * @param tour Receives the order of the nodes
+ */
+static void route_order_insert(int *times, int n, int fixed_end, int *tour) {
+    char *used=g_new0(char, n);
+    int count=n-1,len=0,i,j,k,best,best_val,val,pos;
+
+    tour[len++]=0;
+    used[0]=1;
+    if (fixed_end && n > 1) {
+        tour[len++]=n-1;
+        used[n-1]=1;
+    }
+    while (len < n) {
+        best=-1;
+        best_val=INT_MAX;
+        for (k = 1 ; k < n ; k++) {
+            if (used[k])
+                continue;
+            for (i = 0 ; i < len ; i++) {
+                val=times[tour[i]*count+k-1];
+                if (tour[i] && times[k*count+tour[i]-1] < val)
+                    val=times[k*count+tour[i]-1];
+                if (val < best_val) {
+                    best_val=val;
+                    best=k;
+                }
+            }
+        }
+        /* insert after position pos, appending is allowed unless the end is fixed */
+        pos=len-1;
+        best_val=fixed_end ? INT_MAX : times[tour[len-1]*count+best-1];
+        for (i = 0 ; i < len-1 ; i++) {
+            val=times[tour[i]*count+best-1]+times[best*count+tour[i+1]-1]-times[tour[i]*count+tour[i+1]-1];
+            if (val < best_val) {
+                best_val=val;
+                pos=i;
+            }
+        }
+        for (j = len ; j > pos+1 ; j--)
+            tour[j]=tour[j-1];
+        tour[pos+1]=best;
+        used[best]=1;
+        len++;
+    }
+    g_free(used);
+}
+
+/**
+ * @brief Improves a tour through the destinations by 2-opt and Or-opt moves
+ *
+ * A 2-opt move reverses a part of the tour, an Or-opt move takes up to three consecutive nodes to another position.
+ * As travel times are not symmetric, each candidate is evaluated along the whole part of the tour it changes. Moves
+ * are applied as long as they shorten the tour and the time budget allows.
+ *
+ * @param times Travel times between all nodes, see route_optimize_destinations()
+ * @param n Number of nodes, including the start
+ * @param fixed_end The last node has to stay last
+ * @param tour The order of the nodes, which is improved in place
+ * @param deadline Time at which to stop improving the tour
+ * @return The number of moves applied
+ */
+static int route_order_improve(int *times, int n, int fixed_end, int *tour, struct timeval *deadline) {
+    int *tmp=g_new(int, n);
+    int count=n-1,last=fixed_end ? n-2 : n-1,improved=1,moves=0,i,j,k,len,seg,old,val;
+    struct timeval now;
+
+    while (improved) {
+        improved=0;
+        for (i = 1 ; i <= last ; i++) {
+            gettimeofday(&now, NULL);
+            if (now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_usec > deadline->tv_usec))
+                goto done;
+            /* 2-opt: reverse tour[i..j] */
+            for (j = i+1 ; j <= last ; j++) {
+                len=j+1-i+1+(j+1 < n);
+                old=route_order_cost(times, count, tour+i-1, len);
+                tmp[0]=tour[i-1];
+                for (k = 0 ; k <= j-i ; k++)
+                    tmp[k+1]=tour[j-k];
+                if (j+1 < n)
+                    tmp[j-i+2]=tour[j+1];
+                val=route_order_cost(times, count, tmp, len);
+                if (val < old) {
+                    memcpy(tour+i-1, tmp, len*sizeof(int));
+                    improved=1;
+                    moves++;
+                }
+            }
+            /* Or-opt: move tour[i..i+seg-1] behind tour[j] */
+            for (seg = 1 ; seg <= 3 && i+seg-1 <= last ; seg++) {
+                for (j = 0 ; j <= last ; j++) {
+                    int from,to;
+                    if (j >= i-1 && j <= i+seg-1)
+                        continue;
+                    from=j < i ? j : i-1;
+                    to=j < i ? i+seg-1 : j;
+                    len=to-from+1+(to+1 < n);
+                    old=route_order_cost(times, count, tour+from, len);
+                    k=0;
+                    if (j < i) {
+                        memcpy(tmp, tour+from, (j-from+1)*sizeof(int));
+                        k=j-from+1;
+                        memcpy(tmp+k, tour+i, seg*sizeof(int));
+                        k+=seg;
+                        memcpy(tmp+k, tour+j+1, (i-j-1)*sizeof(int));
+                        k+=i-j-1;
+                    } else {
+                        tmp[k++]=tour[i-1];
+                        memcpy(tmp+k, tour+i+seg, (j-i-seg+1)*sizeof(int));
+                        k+=j-i-seg+1;
+                        memcpy(tmp+k, tour+i, seg*sizeof(int));
+                        k+=seg;
+                    }
+                    if (to+1 < n)
+                        tmp[k++]=tour[to+1];
+                    val=route_order_cost(times, count, tmp, len);
+                    if (val < old) {
+                        memcpy(tour+from, tmp, len*sizeof(int));
+                        improved=1;
+                        moves++;
+                    }
+                }
+            }
+        }
     }
+done:
+    g_free(tmp);
+    return moves;
 }
 
 /**
- * @brief Builds a new route graph from a mapset
+ * @brief Reorders destinations so that visiting all of them takes the least time
  *
- * This function builds a new route graph from a map. Please note that this function does not
- * add any routing information to the route graph - this has to be done via the route_graph_flood()
- * function.
+ * This solves the open traveling salesman problem from the current position of the route (or, if the route has no
+ * position, from the first destination, which then stays first) through all destinations. Travel times between all
+ * of them are calculated over one route graph, see route_get_travel_matrix(). The order is built by nearest
+ * insertion and then improved by 2-opt and Or-opt moves until no move helps or the time budget is used up. This is
+ * a heuristic, which usually comes within a few percent of the best order.
  *
- * @param ms The mapset to build the route graph from
- * @param c An array of coordinates for the current position, waypoints (if any) and destination
- * @param count Number of coordinates in `c`
- * @param done_cb The callback which will be called when graph is complete
- * @return The new route graph.
- */
-static struct route_graph *route_graph_build(struct mapset *ms, struct coord *c, int count, struct callback *done_cb,
-        int async,
-        struct vehicleprofile *profile) {
-    struct route_graph *ret=g_new0(struct route_graph, 1);
-
-    dbg(lvl_debug,"enter");
-
-    ret->sel=route_calc_selection(c, count, profile);
-    ret->h=mapset_open(ms);
-    ret->done_cb=done_cb;
-    ret->busy=1;
-    ret->heap = fh_makekeyheap();
-    if (route_graph_build_next_map(ret)) {
-        if (async) {
-            ret->idle_cb=callback_new_2(callback_cast(route_graph_build_idle), ret, profile);
-            ret->idle_ev=event_add_idle(50, ret->idle_cb);
-        }
-    } else
-        route_graph_build_done(ret, 0);
-
-    return ret;
-}
-
-static void route_graph_update_done(struct route *this, struct callback *cb) {
-    route_graph_init(this->graph, this->current_dst, this->vehicleprofile);
-    route_graph_compute_shortest_path(this->graph, this->vehicleprofile, cb);
-}
-
-/**
- * @brief Updates the route graph
+ * The destinations of the route are not changed; pass the result to route_set_destinations() to route along them.
  *
- * This updates the route graph after settings in the route have changed. It also
- * adds routing information afterwards by calling route_graph_flood().
+ * This function blocks until the order has been calculated.
  *
- * @param this The route to update the graph for
- * @param cb The callback function to call when the route graph update is complete (used only in asynchronous mode)
- * @param async Set to nonzero in order to update the route graph asynchronously
+ * @param this_ The route
+ * @param dst The destinations, which are reordered in place
+ * @param count Number of destinations
+ * @param keep_last If true, the last destination stays the final destination
+ * @param budget Time in milliseconds allowed for improving the initial order, not including the calculation of the
+ * travel times
+ * @return True on success, false if the route has no mapset or vehicle profile
  */
-static void route_graph_update(struct route *this, struct callback *cb, int async) {
-    struct attr route_status;
-    struct coord *c=g_alloca(sizeof(struct coord)*(1+g_list_length(this->destinations)));
-    int i=0;
-    GList *tmp;
+int route_optimize_destinations(struct route *this_, struct pcoord *dst, int count, int keep_last, int budget) {
+    struct pcoord *pc,*sorted;
+    struct timeval deadline;
+    int *times,*tour,i,n,moves;
 
-    route_status.type=attr_route_status;
-    route_graph_destroy(this->graph);
-    this->graph=NULL;
-    callback_destroy(this->route_graph_done_cb);
-    this->route_graph_done_cb=callback_new_2(callback_cast(route_graph_update_done), this, cb);
-    route_status.u.num=route_status_building_graph;
-    route_set_attr(this, &route_status);
-    c[i++]=this->pos->c;
-    tmp=this->destinations;
-    while (tmp) {
-        struct route_info *dst=tmp->data;
-        c[i++]=dst->c;
-        tmp=g_list_next(tmp);
+    if (count < 2)
+        return 1;
+    n=count+(this_->pos ? 1 : 0);
+    pc=g_new(struct pcoord, n);
+    if (this_->pos) {
+        pc[0].pro=projection_mg;
+        pc[0].x=this_->pos->c.x;
+        pc[0].y=this_->pos->c.y;
     }
-    this->graph=route_graph_build(this->ms, c, i, this->route_graph_done_cb, async, this->vehicleprofile);
-    if (! async) {
-        while (this->graph->busy)
-            route_graph_build_idle(this->graph, this->vehicleprofile);
+    memcpy(pc+n-count, dst, count*sizeof(struct pcoord));
+    times=g_new(int, n*(n-1));
+    if (!route_get_travel_matrix(this_, pc, n, pc+1, n-1, times, NULL)) {
+        g_free(times);
+        g_free(pc);
+        return 0;
+    }
+    for (i = 0 ; i < n*(n-1) ; i++)
+        if (times[i] < 0)
+            times[i]=ROUTE_ORDER_UNREACHABLE;
+    tour=g_new(int, n);
+    route_order_insert(times, n, keep_last, tour);
+    gettimeofday(&deadline, NULL);
+    deadline.tv_sec+=budget/1000;
+    deadline.tv_usec+=(budget%1000)*1000;
+    if (deadline.tv_usec >= 1000000) {
+        deadline.tv_sec++;
+        deadline.tv_usec-=1000000;
     }
+    moves=route_order_improve(times, n, keep_last, tour, &deadline);
+    dbg(lvl_debug,"%d destinations, %d moves, travel time %d s", count, moves, route_order_cost(times, n-1, tour, n));
+    sorted=g_new(struct pcoord, n);
+    for (i = 0 ; i < n ; i++)
+        sorted[i]=pc[tour[i]];
+    memcpy(dst, sorted+n-count, count*sizeof(struct pcoord));
+    g_free(sorted);
+    g_free(tour);
+    g_free(times);
+    g_free(pc);
+    return 1;
 }
 
 /**
@@ -3464,6 +7697,7 @@ struct map_rect_priv {
     struct route_graph_point_iterator it;
     /* Pointer to current waypoint element of route->destinations */
     GList *dest;
+    struct map_selection *sel;  /**< Selection of the isochrone map rect in the projection of the route graph */
 };
 
 static void rm_coord_rewind(void *priv_data) {
@@ -3480,7 +7714,8 @@ static int rm_attr_get(void *priv_data, enum attr_type attr_type, struct attr *a
     struct map_rect_priv *mr = priv_data;
     struct route_path_segment *seg=mr->seg;
     struct route *route=mr->mpriv->route;
-    if (mr->item.type != type_street_route && mr->item.type != type_waypoint && mr->item.type != type_route_end)
+    if (mr->item.type != type_street_route && mr->item.type != type_street_route_alternative
+            && mr->item.type != type_waypoint && mr->item.type != type_route_end)
         return 0;
     attr->type=attr_type;
     switch (attr_type) {
@@ -3847,7 +8082,7 @@ static struct map_rect_priv *rp_rect_new(struct map_priv *priv, struct map_selec
     struct map_rect_priv * mr;
 
     dbg(lvl_debug,"enter");
-    if (! priv->route->graph)
+    if (! priv->route->graph || route_graph_build_thread_running(priv->route->graph))
         return NULL;
     mr=g_new0(struct map_rect_priv, 1);
     mr->mpriv = priv;
@@ -3866,6 +8101,7 @@ static struct map_rect_priv *rp_rect_new(struct map_priv *priv, struct map_selec
 static void rm_rect_destroy(struct map_rect_priv *mr) {
     if (mr->str)
         g_free(mr->str);
+    map_selection_destroy(mr->sel);
     if (mr->coord_sel) {
         g_free(mr->coord_sel);
     }
@@ -3902,12 +8138,12 @@ static struct item *rp_get_item(struct map_rect_priv *mr) {
         } else {
             if (!p) {
                 mr->hash_bucket=0;
-                p = r->graph->hash[0];
+                p = r->graph->hash ? r->graph->hash[0] : NULL;
             } else
                 p=p->hash_next;
             while (!p) {
                 mr->hash_bucket++;
-                if (mr->hash_bucket >= HASH_SIZE)
+                if (mr->hash_bucket >= r->graph->hash_size)
                     break;
                 p = r->graph->hash[mr->hash_bucket];
             }
@@ -4029,6 +8265,244 @@ static struct item *rm_get_item_byid(struct map_rect_priv *mr, int id_hi, int id
     return ret;
 }
 
+/**
+ * @brief Opens a new map rectangle on the alternatives map
+ *
+ * The alternatives map holds the segments of all alternative routes as items of
+ * {@code type_street_route_alternative}, one route after the other.
+ *
+ * @param priv The alternatives map's private data
+ * @param sel Not used
+ * @return A new map rect's private data
+ */
+static struct map_rect_priv *ra_rect_new(struct map_priv *priv, struct map_selection *sel) {
+    struct map_rect_priv * mr;
+    mr=g_new0(struct map_rect_priv, 1);
+    mr->mpriv = priv;
+    mr->item.priv_data = mr;
+    mr->item.type = type_street_route_alternative;
+    mr->item.meth = &methods_route_item;
+    if (priv->route->path2 && priv->route->alternative_paths) {
+        mr->path=priv->route->alternative_paths;
+        mr->seg_next=mr->path->path;
+        mr->path->in_use++;
+    }
+    return mr;
+}
+
+static void ra_rect_destroy(struct map_rect_priv *mr) {
+    struct route_path *path=mr->path;
+
+    mr->path=NULL;
+    if (path) {
+        path->in_use--;
+        if (!path->in_use)
+            g_free(path);
+        else if (path->update_required && path->in_use == 1) {
+            /* if the route has changed again in the meantime, the alternatives follow its new path */
+            struct route *route=mr->mpriv->route;
+            route_alternatives_update(route, route->route_status == route_status_path_done_new
+                                      || route->route_status == route_status_path_done_incremental);
+        }
+    }
+    rm_rect_destroy(mr);
+}
+
+static struct item *ra_get_item(struct map_rect_priv *mr) {
+    mr->seg=mr->seg_next;
+    while (!mr->seg && mr->path && mr->path->next) {
+        struct route_path *p=mr->path;
+        mr->path=p->next;
+        mr->path->in_use++;
+        if (!--p->in_use)
+            g_free(p);
+        mr->seg=mr->path->path;
+    }
+    if (!mr->seg)
+        return NULL;
+    mr->seg_next=mr->seg->next;
+    mr->last_coord = 0;
+    item_id_from_ptr(&mr->item,mr->seg);
+    rm_attr_rewind(mr);
+    return &mr->item;
+}
+
+static struct item *ra_get_item_byid(struct map_rect_priv *mr, int id_hi, int id_lo) {
+    struct item *ret=NULL;
+    do {
+        ret=ra_get_item(mr);
+    } while (ret && (ret->id_lo!=id_lo || ret->id_hi!=id_hi));
+    return ret;
+}
+
+/**
+ * @brief Whether a point is part of the isochrone
+ */
+static int ri_point_selected(struct map_rect_priv *mr, struct route_graph_point *p) {
+    return p->value != INT_MAX && p->value <= mr->mpriv->route->isochrone_time*10;
+}
+
+/**
+ * @brief Whether a segment is part of the isochrone, which is the case if both of its points are
+ */
+static int ri_segment_selected(struct map_rect_priv *mr, struct route_graph_segment *s) {
+    struct coord c[2];
+    if (s->start == s->end || s->data.item.type < route_item_first || s->data.item.type > route_item_last)
+        return 0;
+    if (!ri_point_selected(mr, s->start) || !ri_point_selected(mr, s->end))
+        return 0;
+    c[0]=s->start->c;
+    c[1]=s->end->c;
+    return map_selection_contains_polyline(mr->sel, c, 2);
+}
+
+static int ri_attr_get(void *priv_data, enum attr_type attr_type, struct attr *attr) {
+    struct map_rect_priv *mr = priv_data;
+    int value;
+
+    if (mr->item.type == type_isochrone_point)
+        value=mr->point->value;
+    else
+        value=MAX(mr->rseg->start->value, mr->rseg->end->value);
+    attr->type=attr_type;
+    switch (attr_type) {
+    case attr_any:
+        while (mr->attr_next != attr_none) {
+            if (ri_attr_get(priv_data, mr->attr_next, attr))
+                return 1;
+        }
+        return 0;
+    case attr_label:
+        mr->attr_next=attr_time;
+        g_free(mr->str);
+        mr->str=g_strdup_printf("%d min", value/600);
+        attr->u.str=mr->str;
+        return 1;
+    case attr_time:
+        mr->attr_next=attr_street_item;
+        attr->u.num=value/10;
+        return 1;
+    case attr_street_item:
+        mr->attr_next=attr_none;
+        if (mr->item.type != type_isochrone_segment || !mr->rseg->data.item.map)
+            return 0;
+        attr->u.item=&mr->rseg->data.item;
+        return 1;
+    default:
+        mr->attr_next=attr_none;
+        attr->type=attr_none;
+        return 0;
+    }
+}
+
+static int ri_coord_get(void *priv_data, struct coord *c, int count) {
+    struct map_rect_priv *mr = priv_data;
+    struct route_graph_point *p;
+    enum projection pro = route_projection(mr->mpriv->route);
+    int rc=0;
+
+    while (rc < count) {
+        if (mr->item.type == type_isochrone_point && mr->last_coord < 1)
+            p=mr->point;
+        else if (mr->item.type == type_isochrone_segment && mr->last_coord < 2)
+            p=mr->last_coord ? mr->rseg->end : mr->rseg->start;
+        else
+            break;
+        if (pro != projection_mg)
+            transform_from_to(&p->c, pro, &c[rc], projection_mg);
+        else
+            c[rc]=p->c;
+        mr->last_coord++;
+        rc++;
+    }
+    return rc;
+}
+
+static struct item_methods methods_isochrone_item = {
+    rm_coord_rewind,
+    ri_coord_get,
+    rp_attr_rewind,
+    ri_attr_get,
+};
+
+/**
+ * @brief Opens a new map rectangle on the isochrone map
+ *
+ * The isochrone holds all points of the route graph from which the next destination can be reached within the
+ * route's {@code isochrone_time}, and all segments between such points. Items are only returned if they are within
+ * `sel`. The map is empty while the route graph is being built.
+ *
+ * The values of the points are those calculated when flooding the graph for the current route, so no additional
+ * routing is done here. Note that with the A* heuristic, flooding stops once the path to the current position has
+ * been found, so the isochrone will only hold the points expanded until then.
+ *
+ * @param priv The isochrone map's private data
+ * @param sel The selection
+ * @return A new map rect's private data
+ */
+static struct map_rect_priv *ri_rect_new(struct map_priv *priv, struct map_selection *sel) {
+    struct map_rect_priv * mr;
+    struct route_graph *graph=priv->route->graph;
+    enum projection pro=route_projection(priv->route);
+
+    if (!graph || graph->busy || route_graph_build_thread_running(graph))
+        return NULL;
+    mr=g_new0(struct map_rect_priv, 1);
+    mr->mpriv = priv;
+    mr->item.priv_data = mr;
+    mr->item.type = type_isochrone_point;
+    mr->item.meth = &methods_isochrone_item;
+    mr->hash_bucket = -1;
+    if (sel)
+        mr->sel=(pro != projection_none && pro != projection_mg) ? map_selection_dup_pro(sel, projection_mg, pro) :
+                map_selection_dup(sel);
+    return mr;
+}
+
+static struct item *ri_get_item(struct map_rect_priv *mr) {
+    struct route_graph *graph = mr->mpriv->route->graph;
+    struct route_graph_point *p = mr->point;
+    struct route_graph_segment *seg = mr->rseg;
+
+    if (mr->item.type == type_isochrone_point) {
+        do {
+            p = p ? p->hash_next : NULL;
+            while (!p && ++mr->hash_bucket < graph->hash_size)
+                p = graph->hash[mr->hash_bucket];
+        } while (p && !(ri_point_selected(mr, p) && map_selection_contains_point(mr->sel, &p->c)));
+        if (p) {
+            mr->point = p;
+            mr->item.id_lo++;
+            rm_coord_rewind(mr);
+            rp_attr_rewind(mr);
+            return &mr->item;
+        }
+        mr->item.type = type_isochrone_segment;
+    }
+    if (mr->item.type != type_isochrone_segment)
+        return NULL;
+    do {
+        seg = seg ? seg->next : graph->route_segments;
+    } while (seg && !ri_segment_selected(mr, seg));
+    if (!seg) {
+        mr->item.type = type_none;
+        return NULL;
+    }
+    mr->rseg = seg;
+    mr->item.id_lo++;
+    rm_coord_rewind(mr);
+    rp_attr_rewind(mr);
+    return &mr->item;
+}
+
+static struct item *ri_get_item_byid(struct map_rect_priv *mr, int id_hi, int id_lo) {
+    struct item *ret=NULL;
+    do {
+        ret=ri_get_item(mr);
+    } while (ret && (ret->id_lo!=id_lo || ret->id_hi!=id_hi));
+    return ret;
+}
+
 static struct map_methods route_meth = {
     projection_mg,
     "utf-8",
@@ -4055,6 +8529,32 @@ static struct map_methods route_graph_meth = {
     NULL,
 };
 
+static struct map_methods route_isochrone_meth = {
+    projection_mg,
+    "utf-8",
+    rp_destroy,
+    ri_rect_new,
+    rm_rect_destroy,
+    ri_get_item,
+    ri_get_item_byid,
+    NULL,
+    NULL,
+    NULL,
+};
+
+static struct map_methods route_alternatives_meth = {
+    projection_mg,
+    "utf-8",
+    rp_destroy,
+    ra_rect_new,
+    ra_rect_destroy,
+    ra_get_item,
+    ra_get_item_byid,
+    NULL,
+    NULL,
+    NULL,
+};
+
 static struct map_priv *route_map_new_helper(struct map_methods *meth, struct attr **attrs, int graph) {
     struct map_priv *ret;
     struct attr *route_attr;
@@ -4063,7 +8563,11 @@ static struct map_priv *route_map_new_helper(struct map_methods *meth, struct at
     if (! route_attr)
         return NULL;
     ret=g_new0(struct map_priv, 1);
-    if (graph)
+    if (graph == 3)
+        *meth=route_alternatives_meth;
+    else if (graph == 2)
+        *meth=route_isochrone_meth;
+    else if (graph)
         *meth=route_graph_meth;
     else
         *meth=route_meth;
@@ -4080,6 +8584,16 @@ static struct map_priv *route_graph_map_new(struct map_methods *meth, struct att
     return route_map_new_helper(meth, attrs, 1);
 }
 
+static struct map_priv *route_isochrone_map_new(struct map_methods *meth, struct attr **attrs,
+        struct callback_list *cbl) {
+    return route_map_new_helper(meth, attrs, 2);
+}
+
+static struct map_priv *route_alternatives_map_new(struct map_methods *meth, struct attr **attrs,
+        struct callback_list *cbl) {
+    return route_map_new_helper(meth, attrs, 3);
+}
+
 static struct map *route_get_map_helper(struct route *this_, struct map **map, char *type, char *description) {
     struct attr *attrs[5];
     struct attr a_type,navigation,data,a_description;
@@ -4106,6 +8620,22 @@ static struct map *route_get_map_helper(struct route *this_, struct map **map, c
     return *map;
 }
 
+/**
+ * @brief Replaces a graph built from the contraction hierarchy with a full graph
+ *
+ * A graph built by route_graph_build_ch() only holds the streets along one path, so traffic distortions cannot be
+ * applied to it. Instead the route is recalculated on a full graph, which picks up all traffic distortions.
+ *
+ * @param this_ The route
+ * @return true if the graph was dropped, false if the route does not use a graph from the contraction hierarchy
+ */
+static int route_graph_drop_ch(struct route *this_) {
+    if (!this_->graph->ch)
+        return 0;
+    route_path_update(this_, 1, 1);
+    return 1;
+}
+
 /**
  * @brief Adds a traffic distortion item to the route
  *
@@ -4113,7 +8643,12 @@ static struct map *route_get_map_helper(struct route *this_, struct map **map, c
  * @param item The item to add, must be of {@code type_traffic_distortion}
  */
 void route_add_traffic_distortion(struct route *this_, struct item *item) {
-    if (route_has_graph(this_))
+    this_->traffic_active=1;
+    route_overlay_invalidate(this_->overlay, item);
+    /* a graph being built on a worker thread picks up the distortion when the traffic map is read */
+    if (route_graph_build_thread_running(this_->graph))
+        return;
+    if (route_has_graph(this_) && !route_graph_drop_ch(this_))
         route_graph_add_traffic_distortion(this_->graph, this_->vehicleprofile, item, 1);
 }
 
@@ -4126,7 +8661,11 @@ void route_add_traffic_distortion(struct route *this_, struct item *item) {
  * @param item The item to change, must be of {@code type_traffic_distortion}
  */
 void route_change_traffic_distortion(struct route *this_, struct item *item) {
-    if (route_has_graph(this_))
+    this_->traffic_active=1;
+    route_overlay_invalidate(this_->overlay, item);
+    if (route_graph_build_thread_running(this_->graph))
+        return;
+    if (route_has_graph(this_) && !route_graph_drop_ch(this_))
         route_graph_change_traffic_distortion(this_->graph, this_->vehicleprofile, item);
 }
 
@@ -4161,6 +8700,38 @@ route_get_graph_map(struct route *this_) {
     return route_get_map_helper(this_, &this_->graph_map, "route_graph","Route Graph");
 }
 
+/**
+ * @brief Returns a new map containing the isochrone of the route
+ *
+ * The isochrone holds the points and segments of the route graph from which the next destination can be reached
+ * within {@code isochrone_time}, as items of {@code type_isochrone_point} and {@code type_isochrone_segment}.
+ *
+ * @important Do not map_destroy() this!
+ *
+ * @param this_ The route to get the map of
+ * @return A new map containing the isochrone
+ */
+struct map *
+route_get_isochrone_map(struct route *this_) {
+    return route_get_map_helper(this_, &this_->isochrone_map, "route_isochrone","Route Isochrone");
+}
+
+/**
+ * @brief Returns a new map containing the alternative routes
+ *
+ * Up to {@code route_alternatives} alternatives to the route to the next destination are calculated whenever a new
+ * route has been found. Their segments are items of {@code type_street_route_alternative}.
+ *
+ * @important Do not map_destroy() this!
+ *
+ * @param this_ The route to get the map of
+ * @return A new map containing the alternative routes
+ */
+struct map *
+route_get_alternatives_map(struct route *this_) {
+    return route_get_map_helper(this_, &this_->alternatives_map, "route_alternatives","Route Alternatives");
+}
+
 
 /**
  * @brief Returns the flags for the route.
@@ -4196,7 +8767,10 @@ int route_has_graph(struct route *this_) {
  * @param item The item to remove, must be of {@code type_traffic_distortion}
  */
 void route_remove_traffic_distortion(struct route *this_, struct item *item) {
-    if (route_has_graph(this_))
+    /* other distortions may remain, which is checked on the next build */
+    this_->traffic_active=-1;
+    route_overlay_invalidate(this_->overlay, item);
+    if (route_has_graph(this_) && !route_graph_build_thread_running(this_->graph))
         route_graph_remove_traffic_distortion(this_->graph, this_->vehicleprofile, item);
 }
 
@@ -4218,6 +8792,14 @@ int route_set_attr(struct route *this_, struct attr *attr) {
         return 1;
     case attr_position_test:
         return route_set_position_flags(this_, attr->u.pcoord, route_path_flag_no_rebuild);
+    case attr_isochrone_time:
+        attr_updated = (this_->isochrone_time != attr->u.num);
+        this_->isochrone_time = attr->u.num;
+        break;
+    case attr_route_alternatives:
+        attr_updated = (this_->alternatives != attr->u.num);
+        this_->alternatives = attr->u.num;
+        break;
     case attr_vehicle:
         attr_updated = (this_->v != attr->u.vehicle);
         this_->v=attr->u.vehicle;
@@ -4322,6 +8904,41 @@ int route_get_attr(struct route *this_, enum attr_type type, struct attr *attr,
         } else
             ret=0;
         break;
+    case attr_route_expanded_points:
+        attr->u.num=this_->graph ? this_->graph->expanded : 0;
+        ret=(this_->graph != NULL);
+        break;
+    case attr_route_expanded_points_dijkstra:
+        attr->u.num=route_graph_expanded_without_heuristic(this_);
+        ret=(attr->u.num >= 0);
+        break;
+    case attr_route_graph_peak_size:
+        attr->u.num=this_->graph ? this_->graph->arena_peak : 0;
+        ret=(this_->graph != NULL);
+        break;
+    case attr_route_graph_items:
+        attr->u.num=this_->graph ? this_->graph->item_count : 0;
+        ret=(this_->graph != NULL);
+        break;
+    case attr_route_graph_segments:
+        attr->u.num=this_->graph ? this_->graph->segment_count : 0;
+        ret=(this_->graph != NULL);
+        break;
+    case attr_route_graph_points:
+        attr->u.num=this_->graph ? this_->graph->point_count : 0;
+        ret=(this_->graph != NULL);
+        break;
+    case attr_route_time_graph:
+    case attr_route_time_flood:
+    case attr_route_time_path:
+        attr->u.num=this_->timing[type-attr_route_time_graph];
+        break;
+    case attr_isochrone_time:
+        attr->u.num=this_->isochrone_time;
+        break;
+    case attr_route_alternatives:
+        attr->u.num=this_->alternatives;
+        break;
     case attr_destination_length:
         if (this_->path2 && (this_->route_status == route_status_path_done_new
                              || this_->route_status == route_status_path_done_incremental)) {
@@ -4351,8 +8968,11 @@ void route_attr_iter_destroy(struct attr_iter *iter) {
 }
 
 void route_init(void) {
+    route_heap_init();
     plugin_register_category_map("route", route_map_new);
     plugin_register_category_map("route_graph", route_graph_map_new);
+    plugin_register_category_map("route_isochrone", route_isochrone_map_new);
+    plugin_register_category_map("route_alternatives", route_alternatives_map_new);
 }
 
 void route_destroy(struct route *this_) {
@@ -4363,6 +8983,11 @@ void route_destroy(struct route *this_) {
     route_info_free(this_->pos);
     map_destroy(this_->map);
     map_destroy(this_->graph_map);
+    map_destroy(this_->isochrone_map);
+    map_destroy(this_->alternatives_map);
+    route_path_destroy(this_->alternative_paths,1);
+    g_free(this_->graph_snapshot);
+    route_overlay_destroy(this_->overlay);
     g_free(this_);
 }
 
@@ -0,0 +1,260 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Calculates routes without a GUI and prints timings and graph sizes as CSV
+ *
+ * Usage: `navit-route-bench [-c <navit.xml>] [-d <level>] [-o <budget>] [-r <repetitions>] <file>`
+ *
+ * The configuration is loaded as by Navit itself, so it should use the null graphics (`<graphics type="null"/>`)
+ * and no GUI (`<navit flags="2">`) in order to run headless. Routes are calculated synchronously with the mapset and
+ * the vehicle profile of the first navit object, using a copy of its route.
+ *
+ * Each line of `<file>` holds a start and one or more destinations, separated by semicolons, in any format understood
+ * by `coord_parse()`, e.g. `11.5755 48.1374; 13.3889 52.5170`. Empty lines and lines starting with `#` are ignored.
+ *
+ * For each route, one line is printed with the times spent building the graph, flooding it and building the path
+ * (in microseconds, as reported by the route), the total time of `route_set_destinations()`, the number of points,
+ * segments and items of the graph, the number of points expanded with and without the A* heuristic (the latter
+ * floods the graph twice more if the vehicle profile uses the heuristic), the peak size of the graph and of the process
+ * (in kilobytes), and the length (in meters) and travel time (in tenths of a second) of the route.
+ *
+ * With `-o`, the order of all destinations but the last is optimized before each route, see
+ * `route_optimize_destinations()`. This is not included in the times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "config.h"
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#else
+#include <XGetopt.h>
+#endif
+#include <sys/time.h>
+#ifndef HAVE_API_WIN32_BASE
+#include <sys/resource.h>
+#endif
+#include "config_.h"
+#include "item.h"
+#include "coord.h"
+#include "main.h"
+#include "navit.h"
+#include "route.h"
+#include "navigation.h"
+#include "track.h"
+#include "debug.h"
+#include "event.h"
+#include "event_glib.h"
+#include "xmlconfig.h"
+#include "file.h"
+#include "search.h"
+#include "linguistics.h"
+#include "atom.h"
+#include "geom.h"
+#include "traffic.h"
+#include "util.h"
+
+#ifndef USE_PLUGINS
+extern void builtin_init(void);
+#endif /* USE_PLUGINS*/
+
+#ifndef HAVE_GLIB
+extern void _g_slice_thread_init_nomessage(void);
+#endif
+
+static void print_usage(void) {
+    fprintf(stderr, "navit-route-bench usage:\n"
+            "navit-route-bench [options] <file>\n"
+            "\t-c <file>: use <file> as config file, instead of navit.xml.\n"
+            "\t-d <n>: set the global debug output level to <n>.\n"
+            "\t-o <ms>: optimize the order of the destinations, spending up to <ms> on improving it.\n"
+            "\t-r <n>: calculate each route <n> times.\n"
+            "\t-h: print this usage info and exit.\n");
+}
+
+/**
+ * @brief Returns the peak memory use of the process in kilobytes, 0 if unknown
+ */
+static long bench_peak_memory(void) {
+#ifndef HAVE_API_WIN32_BASE
+    struct rusage usage;
+    if (!getrusage(RUSAGE_SELF, &usage))
+#ifdef __APPLE__
+        return usage.ru_maxrss/1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    return 0;
+}
+
+static long bench_route_attr(struct route *route, enum attr_type type) {
+    struct attr attr;
+    if (route_get_attr(route, type, &attr, NULL))
+        return attr.u.num;
+    return 0;
+}
+
+/**
+ * @brief Calculates one route and prints its line
+ *
+ * @param route The route
+ * @param line The number of the line of the input file
+ * @param pc The start, followed by the destinations
+ * @param count The number of elements in `pc`
+ * @param optimize Time budget in milliseconds for optimizing the order of the destinations, -1 to keep it
+ */
+static void bench_route(struct route *route, int line, struct pcoord *pc, int count, int optimize) {
+    struct timeval start,end;
+    long status;
+    char *result;
+
+    route_set_destinations(route, NULL, 0, 0);
+    route_set_position(route, &pc[0]);
+    if (optimize >= 0)
+        route_optimize_destinations(route, pc+1, count-1, 1, optimize);
+    gettimeofday(&start, NULL);
+    route_set_destinations(route, pc+1, count-1, 0);
+    gettimeofday(&end, NULL);
+    status=bench_route_attr(route, attr_route_status);
+    if (status == route_status_path_done_new || status == route_status_path_done_incremental)
+        result="ok";
+    else if (status == route_status_not_found)
+        result="not_found";
+    else
+        result="failed";
+    printf("%d,%s,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n", line, result,
+           bench_route_attr(route, attr_route_time_graph),
+           bench_route_attr(route, attr_route_time_flood),
+           bench_route_attr(route, attr_route_time_path),
+           (end.tv_sec-start.tv_sec)*1000000L+end.tv_usec-start.tv_usec,
+           bench_route_attr(route, attr_route_graph_points),
+           bench_route_attr(route, attr_route_graph_segments),
+           bench_route_attr(route, attr_route_graph_items),
+           bench_route_attr(route, attr_route_expanded_points),
+           bench_route_attr(route, attr_route_expanded_points_dijkstra),
+           bench_route_attr(route, attr_route_graph_peak_size)/1024,
+           bench_peak_memory(),
+           bench_route_attr(route, attr_destination_length),
+           bench_route_attr(route, attr_destination_time));
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    xmlerror *error = NULL;
+    char *config_file="navit.xml";
+    char buffer[4096];
+    struct attr navit,route_attr;
+    struct route *route;
+    FILE *f;
+    int opt,i,line=0,repetitions=1,optimize=-1;
+
+#ifdef HAVE_GLIB
+    event_glib_init();
+#else
+    _g_slice_thread_init_nomessage();
+#endif
+    atom_init();
+    main_init(argv[0]);
+    debug_init(argv[0]);
+    file_init();
+#ifndef USE_PLUGINS
+    builtin_init();
+#endif
+    route_init();
+    navigation_init();
+    tracking_init();
+    search_init();
+    linguistics_init();
+    geom_init();
+    traffic_init();
+    while((opt = getopt(argc, argv, "hc:d:o:r:")) != -1) {
+        switch(opt) {
+        case 'c':
+            config_file=optarg;
+            break;
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'o':
+            optimize=atoi(optarg);
+            break;
+        case 'r':
+            repetitions=atoi(optarg);
+            break;
+        case 'h':
+        default:
+            print_usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc-1) {
+        print_usage();
+        return 2;
+    }
+    if (!(f=fopen(argv[optind], "r"))) {
+        fprintf(stderr, "Failed to open %s\n", argv[optind]);
+        return 3;
+    }
+    if (!config_load(config_file, &error)) {
+        fprintf(stderr, "Error parsing config file '%s': %s\n", config_file, error ? error->message : "");
+        return 4;
+    }
+    if (!config || !config_get_attr(config, attr_navit, &navit, NULL)
+            || !navit_get_attr(navit.u.navit, attr_route, &route_attr, NULL)) {
+        fprintf(stderr, "No navit with a route found in config file '%s'\n", config_file);
+        return 5;
+    }
+    route=route_dup(route_attr.u.route);
+    printf("line,result,time_graph,time_flood,time_path,time_total,points,segments,items,expanded,expanded_dijkstra,"
+           "graph_peak,process_peak,length,time\n");
+    while (fgets(buffer, sizeof(buffer), f)) {
+        struct pcoord *pc;
+        char **coords;
+        int count;
+
+        line++;
+        g_strstrip(buffer);
+        if (!buffer[0] || buffer[0] == '#')
+            continue;
+        coords=g_strsplit(buffer, ";", -1);
+        count=g_strv_length(coords);
+        pc=g_new(struct pcoord, count);
+        for (i = 0 ; i < count ; i++) {
+            g_strstrip(coords[i]);
+            if (!pcoord_parse(coords[i], projection_mg, &pc[i])) {
+                fprintf(stderr, "Invalid coordinate '%s' in line %d\n", coords[i], line);
+                break;
+            }
+        }
+        if (i == count && count >= 2) {
+            for (i = 0 ; i < repetitions ; i++)
+                bench_route(route, line, pc, count, optimize);
+        } else if (count < 2)
+            fprintf(stderr, "Line %d needs a start and a destination\n", line);
+        g_free(pc);
+        g_strfreev(coords);
+    }
+    fclose(f);
+    route_destroy(route);
+    return 0;
+}
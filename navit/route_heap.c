@@ -0,0 +1,520 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Priority queue used for flooding the route graph
+ *
+ * The default implementation is an indexed 4-ary heap kept in a single array of key/data pairs. Compared to the
+ * Fibonacci heap it has a lower constant factor, as it does not allocate memory for each insertion and sifting
+ * touches only a few adjacent cache lines. Decreasing a key, which is the most frequent operation when flooding the
+ * route graph, is a sift-up of a few levels at most.
+ *
+ * The Fibonacci heap from fib-1.1 is kept as an alternative implementation. Since its elements are pointers, the
+ * index stored in the element refers to a slot table which holds the pointer to the Fibonacci heap element.
+ *
+ * If the environment variable `NAVIT_ROUTE_HEAP_LOG` is set to a file name, all operations on queues created
+ * afterwards are appended to that file, one per line. The `route_heap_bench` tool replays such a log against all
+ * implementations. The format of the lines is:
+ *
+ * \li `n <heap>`: a queue was created
+ * \li `i <heap> <element> <key>`: an element was inserted
+ * \li `c <heap> <element> <key>`: the key of an element was changed
+ * \li `r <heap> <element>`: an element was removed
+ * \li `m <heap>`: the minimum was queried
+ * \li `x <heap>`: the minimum was extracted
+ * \li `k <heap>`: the queue was cleared
+ * \li `d <heap>`: the queue was destroyed
+ *
+ * Queues and elements are identified by sequence numbers, not by addresses, so that logs can be replayed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <glib.h>
+#include "config.h"
+#include "debug.h"
+#include "fib.h"
+#include "thread.h"
+#include "route_heap.h"
+
+/** Arity of the d-ary heap */
+#define ROUTE_HEAP_ARITY 4
+
+/** Accesses the index member of an element */
+#define ROUTE_HEAP_INDEX(heap, data) (*(int *)((char *)(data) + (heap)->index_offset))
+
+/** Implementation of a queue */
+struct route_heap_methods {
+    void (*init)(struct route_heap *this_);
+    void (*destroy)(struct route_heap *this_);
+    void (*insert)(struct route_heap *this_, void *data, int key);
+    void (*change_key)(struct route_heap *this_, void *data, int key);
+    void (*remove)(struct route_heap *this_, void *data);
+    void *(*min)(struct route_heap *this_, int *key);
+    void *(*extract_min)(struct route_heap *this_);
+    void (*clear)(struct route_heap *this_);
+};
+
+/** An entry in the d-ary heap */
+struct route_heap_entry {
+    int key;                                /**< The key */
+    void *data;                             /**< The element */
+};
+
+/** A slot of the Fibonacci heap implementation */
+struct route_heap_fib_slot {
+    struct fibheap_el *el;                  /**< The Fibonacci heap element, NULL for free slots */
+    int key;                                /**< The key of the element, or the next free slot for free slots */
+};
+
+/** Records operations for replaying them with `route_heap_bench` */
+struct route_heap_log {
+    FILE *f;                                /**< The log file */
+    int id;                                 /**< Sequence number of the queue */
+    GHashTable *elements;                   /**< Sequence numbers of the elements, keyed by address */
+};
+
+struct route_heap {
+    struct route_heap_methods *meth;        /**< The implementation */
+    int index_offset;                       /**< Offset of the index member in the elements */
+    int size;                               /**< Number of elements on the queue */
+    int capacity;                           /**< Number of entries or slots allocated */
+    struct route_heap_entry *entries;       /**< Entries of the d-ary heap, the minimum is at index 0 */
+    struct fibheap *fib;                    /**< The Fibonacci heap */
+    struct route_heap_fib_slot *slots;      /**< Slots of the Fibonacci heap implementation */
+    int free_slot;                          /**< First free slot (1-based), 0 if none */
+    struct route_heap_log *log;             /**< Operation log, NULL if not logging */
+};
+
+static FILE *route_heap_log_file;
+static int route_heap_log_count;
+static struct thread_lock *route_heap_log_lock;   /**< Protects the two above, as queues are also created on threads */
+
+static void route_heap_grow(struct route_heap *this_) {
+    this_->capacity=this_->capacity ? this_->capacity*2 : 1024;
+    if (this_->fib)
+        this_->slots=g_renew(struct route_heap_fib_slot, this_->slots, this_->capacity);
+    else
+        this_->entries=g_renew(struct route_heap_entry, this_->entries, this_->capacity);
+}
+
+/* d-ary heap */
+
+static inline void route_heap_dary_set(struct route_heap *this_, int pos, struct route_heap_entry *e) {
+    this_->entries[pos]=*e;
+    ROUTE_HEAP_INDEX(this_, e->data)=pos+1;
+}
+
+static void route_heap_dary_sift_up(struct route_heap *this_, int pos) {
+    struct route_heap_entry e=this_->entries[pos];
+    while (pos > 0) {
+        int parent=(pos-1)/ROUTE_HEAP_ARITY;
+        if (this_->entries[parent].key <= e.key)
+            break;
+        route_heap_dary_set(this_, pos, &this_->entries[parent]);
+        pos=parent;
+    }
+    route_heap_dary_set(this_, pos, &e);
+}
+
+static void route_heap_dary_sift_down(struct route_heap *this_, int pos) {
+    struct route_heap_entry e=this_->entries[pos];
+    int size=this_->size;
+    for (;;) {
+        int first=pos*ROUTE_HEAP_ARITY+1;
+        int last=first+ROUTE_HEAP_ARITY;
+        int i,best;
+        if (first >= size)
+            break;
+        if (last > size)
+            last=size;
+        best=first;
+        for (i = first+1 ; i < last ; i++)
+            if (this_->entries[i].key < this_->entries[best].key)
+                best=i;
+        if (this_->entries[best].key >= e.key)
+            break;
+        route_heap_dary_set(this_, pos, &this_->entries[best]);
+        pos=best;
+    }
+    route_heap_dary_set(this_, pos, &e);
+}
+
+static void route_heap_dary_init(struct route_heap *this_) {
+}
+
+static void route_heap_dary_destroy(struct route_heap *this_) {
+    g_free(this_->entries);
+}
+
+static void route_heap_dary_insert(struct route_heap *this_, void *data, int key) {
+    int pos=this_->size++;
+    if (pos >= this_->capacity)
+        route_heap_grow(this_);
+    this_->entries[pos].key=key;
+    this_->entries[pos].data=data;
+    route_heap_dary_sift_up(this_, pos);
+}
+
+static void route_heap_dary_change_key(struct route_heap *this_, void *data, int key) {
+    int pos=ROUTE_HEAP_INDEX(this_, data)-1;
+    int old=this_->entries[pos].key;
+    this_->entries[pos].key=key;
+    if (key < old)
+        route_heap_dary_sift_up(this_, pos);
+    else if (key > old)
+        route_heap_dary_sift_down(this_, pos);
+}
+
+static void route_heap_dary_remove(struct route_heap *this_, void *data) {
+    int pos=ROUTE_HEAP_INDEX(this_, data)-1;
+    int old=this_->entries[pos].key;
+    ROUTE_HEAP_INDEX(this_, data)=0;
+    if (pos == --this_->size)
+        return;
+    this_->entries[pos]=this_->entries[this_->size];
+    if (this_->entries[pos].key < old)
+        route_heap_dary_sift_up(this_, pos);
+    else
+        route_heap_dary_sift_down(this_, pos);
+}
+
+static void *route_heap_dary_min(struct route_heap *this_, int *key) {
+    if (!this_->size)
+        return NULL;
+    *key=this_->entries[0].key;
+    return this_->entries[0].data;
+}
+
+static void *route_heap_dary_extract_min(struct route_heap *this_) {
+    void *ret;
+    if (!this_->size)
+        return NULL;
+    ret=this_->entries[0].data;
+    ROUTE_HEAP_INDEX(this_, ret)=0;
+    if (--this_->size) {
+        this_->entries[0]=this_->entries[this_->size];
+        route_heap_dary_sift_down(this_, 0);
+    }
+    return ret;
+}
+
+static void route_heap_dary_clear(struct route_heap *this_) {
+    int i;
+    for (i = 0 ; i < this_->size ; i++)
+        ROUTE_HEAP_INDEX(this_, this_->entries[i].data)=0;
+    this_->size=0;
+}
+
+static struct route_heap_methods route_heap_dary_meth = {
+    route_heap_dary_init,
+    route_heap_dary_destroy,
+    route_heap_dary_insert,
+    route_heap_dary_change_key,
+    route_heap_dary_remove,
+    route_heap_dary_min,
+    route_heap_dary_extract_min,
+    route_heap_dary_clear,
+};
+
+/* Fibonacci heap */
+
+static void route_heap_fib_free_slot(struct route_heap *this_, void *data) {
+    int slot=ROUTE_HEAP_INDEX(this_, data);
+    this_->slots[slot-1].el=NULL;
+    this_->slots[slot-1].key=this_->free_slot;
+    this_->free_slot=slot;
+    ROUTE_HEAP_INDEX(this_, data)=0;
+    this_->size--;
+}
+
+static void route_heap_fib_init(struct route_heap *this_) {
+    this_->fib=fh_makekeyheap();
+}
+
+static void route_heap_fib_destroy(struct route_heap *this_) {
+    fh_deleteheap(this_->fib);
+    g_free(this_->slots);
+}
+
+static void route_heap_fib_insert(struct route_heap *this_, void *data, int key) {
+    int slot=this_->free_slot;
+    if (slot)
+        this_->free_slot=this_->slots[slot-1].key;
+    else {
+        if (this_->size >= this_->capacity)
+            route_heap_grow(this_);
+        slot=this_->size+1;
+    }
+    this_->slots[slot-1].el=fh_insertkey(this_->fib, key, data);
+    this_->slots[slot-1].key=key;
+    ROUTE_HEAP_INDEX(this_, data)=slot;
+    this_->size++;
+}
+
+static void route_heap_fib_change_key(struct route_heap *this_, void *data, int key) {
+    struct route_heap_fib_slot *slot=&this_->slots[ROUTE_HEAP_INDEX(this_, data)-1];
+    if (key < slot->key)
+        fh_replacekey(this_->fib, slot->el, key);
+    else if (key > slot->key) {
+        /* fh_replacekey() cannot increase a key, thus delete and reinsert the element */
+        fh_delete(this_->fib, slot->el);
+        slot->el=fh_insertkey(this_->fib, key, data);
+    }
+    slot->key=key;
+}
+
+static void route_heap_fib_remove(struct route_heap *this_, void *data) {
+    fh_delete(this_->fib, this_->slots[ROUTE_HEAP_INDEX(this_, data)-1].el);
+    route_heap_fib_free_slot(this_, data);
+}
+
+static void *route_heap_fib_min(struct route_heap *this_, int *key) {
+    void *ret=fh_min(this_->fib);
+    if (ret)
+        *key=fh_minkey(this_->fib);
+    return ret;
+}
+
+static void *route_heap_fib_extract_min(struct route_heap *this_) {
+    void *ret=fh_extractmin(this_->fib);
+    if (ret)
+        route_heap_fib_free_slot(this_, ret);
+    return ret;
+}
+
+static void route_heap_fib_clear(struct route_heap *this_) {
+    void *data;
+    while ((data=fh_extractmin(this_->fib)))
+        ROUTE_HEAP_INDEX(this_, data)=0;
+    this_->size=0;
+    this_->free_slot=0;
+}
+
+static struct route_heap_methods route_heap_fib_meth = {
+    route_heap_fib_init,
+    route_heap_fib_destroy,
+    route_heap_fib_insert,
+    route_heap_fib_change_key,
+    route_heap_fib_remove,
+    route_heap_fib_min,
+    route_heap_fib_extract_min,
+    route_heap_fib_clear,
+};
+
+/* Operation log */
+
+static struct route_heap_log *route_heap_log_new(void) {
+    struct route_heap_log *ret;
+    char *name=getenv("NAVIT_ROUTE_HEAP_LOG");
+    if (!name || !*name)
+        return NULL;
+    thread_lock_acquire(route_heap_log_lock);
+    if (!route_heap_log_file) {
+        route_heap_log_file=fopen(name, "a");
+        if (!route_heap_log_file) {
+            thread_lock_release(route_heap_log_lock);
+            dbg(lvl_error, "failed to open route heap log %s", name);
+            return NULL;
+        }
+    }
+    ret=g_new0(struct route_heap_log, 1);
+    ret->f=route_heap_log_file;
+    ret->id=++route_heap_log_count;
+    thread_lock_release(route_heap_log_lock);
+    ret->elements=g_hash_table_new(g_direct_hash, g_direct_equal);
+    fprintf(ret->f, "n %d\n", ret->id);
+    return ret;
+}
+
+static int route_heap_log_element(struct route_heap_log *log, void *data) {
+    int ret=GPOINTER_TO_INT(g_hash_table_lookup(log->elements, data));
+    if (!ret) {
+        ret=g_hash_table_size(log->elements)+1;
+        g_hash_table_insert(log->elements, data, GINT_TO_POINTER(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief Initializes the route heap module
+ *
+ * This must be called on the main thread before queues are created on other threads. Without it, queues can only be
+ * created on one thread at a time.
+ */
+void route_heap_init(void) {
+    if (!route_heap_log_lock)
+        route_heap_log_lock=thread_lock_new();
+}
+
+/**
+ * @brief Creates a new queue of the implementation selected at build time
+ *
+ * @param index_offset Offset of the `int` member of the elements in which the queue stores their position
+ *
+ * @return The new queue
+ */
+struct route_heap *route_heap_new(int index_offset) {
+    return route_heap_new_type(route_heap_type_default, index_offset);
+}
+
+/**
+ * @brief Creates a new queue
+ *
+ * @param type The implementation to use
+ * @param index_offset Offset of the `int` member of the elements in which the queue stores their position
+ *
+ * @return The new queue
+ */
+struct route_heap *route_heap_new_type(enum route_heap_type type, int index_offset) {
+    struct route_heap *ret=g_new0(struct route_heap, 1);
+    if (type == route_heap_type_default)
+#ifdef ROUTE_HEAP_FIB
+        type=route_heap_type_fib;
+#else
+        type=route_heap_type_dary;
+#endif
+    ret->meth=(type == route_heap_type_fib) ? &route_heap_fib_meth : &route_heap_dary_meth;
+    ret->index_offset=index_offset;
+    ret->meth->init(ret);
+    ret->log=route_heap_log_new();
+    return ret;
+}
+
+/**
+ * @brief Destroys a queue
+ *
+ * The index members of elements still on the queue are not reset.
+ *
+ * @param this_ The queue
+ */
+void route_heap_destroy(struct route_heap *this_) {
+    if (this_->log) {
+        fprintf(this_->log->f, "d %d\n", this_->log->id);
+        fflush(this_->log->f);
+        g_hash_table_destroy(this_->log->elements);
+        g_free(this_->log);
+    }
+    this_->meth->destroy(this_);
+    g_free(this_);
+}
+
+/**
+ * @brief Inserts an element which is not on the queue
+ *
+ * @param this_ The queue
+ * @param data The element
+ * @param key The key
+ */
+void route_heap_insert(struct route_heap *this_, void *data, int key) {
+    if (this_->log)
+        fprintf(this_->log->f, "i %d %d %d\n", this_->log->id, route_heap_log_element(this_->log, data), key);
+    this_->meth->insert(this_, data, key);
+}
+
+/**
+ * @brief Changes the key of an element on the queue
+ *
+ * Unlike `fh_replacekey()`, the key may be increased as well as decreased.
+ *
+ * @param this_ The queue
+ * @param data The element
+ * @param key The new key
+ */
+void route_heap_change_key(struct route_heap *this_, void *data, int key) {
+    if (this_->log)
+        fprintf(this_->log->f, "c %d %d %d\n", this_->log->id, route_heap_log_element(this_->log, data), key);
+    this_->meth->change_key(this_, data, key);
+}
+
+/**
+ * @brief Removes an element from the queue
+ *
+ * @param this_ The queue
+ * @param data The element, which must be on the queue
+ */
+void route_heap_remove(struct route_heap *this_, void *data) {
+    if (this_->log)
+        fprintf(this_->log->f, "r %d %d\n", this_->log->id, route_heap_log_element(this_->log, data));
+    this_->meth->remove(this_, data);
+}
+
+/**
+ * @brief Returns the element with the lowest key without removing it
+ *
+ * @param this_ The queue
+ *
+ * @return The element, or NULL if the queue is empty
+ */
+void *route_heap_min(struct route_heap *this_) {
+    int key;
+    if (this_->log)
+        fprintf(this_->log->f, "m %d\n", this_->log->id);
+    return this_->meth->min(this_, &key);
+}
+
+/**
+ * @brief Returns the lowest key on the queue
+ *
+ * @param this_ The queue
+ *
+ * @return The key, or `INT_MAX` if the queue is empty
+ */
+int route_heap_min_key(struct route_heap *this_) {
+    int key;
+    if (this_->log)
+        fprintf(this_->log->f, "m %d\n", this_->log->id);
+    if (!this_->meth->min(this_, &key))
+        return INT_MAX;
+    return key;
+}
+
+/**
+ * @brief Removes and returns the element with the lowest key
+ *
+ * @param this_ The queue
+ *
+ * @return The element, or NULL if the queue is empty
+ */
+void *route_heap_extract_min(struct route_heap *this_) {
+    if (this_->log)
+        fprintf(this_->log->f, "x %d\n", this_->log->id);
+    return this_->meth->extract_min(this_);
+}
+
+/**
+ * @brief Removes all elements from the queue
+ *
+ * @param this_ The queue
+ */
+void route_heap_clear(struct route_heap *this_) {
+    if (this_->log)
+        fprintf(this_->log->f, "k %d\n", this_->log->id);
+    this_->meth->clear(this_);
+}
+
+/**
+ * @brief Returns the number of elements on the queue
+ *
+ * @param this_ The queue
+ */
+int route_heap_size(struct route_heap *this_) {
+    return this_->size;
+}
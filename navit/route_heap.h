@@ -0,0 +1,67 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Priority queue used for flooding the route graph
+ *
+ * The queue is indexed: each element carries an `int` member in which the queue stores the position of the element,
+ * so that keys can be changed without searching. The offset of that member is passed to `route_heap_new()`. A value
+ * of 0 means that the element is not on the queue; callers must initialize the member to 0 and may test it, but must
+ * not change it while the element is on the queue.
+ *
+ * Two implementations are available: an indexed 4-ary heap, which is the default, and the Fibonacci heap from
+ * fib-1.1, which is the default if Navit is built with `ROUTE_HEAP_FIB`.
+ */
+
+#ifndef NAVIT_ROUTE_HEAP_H
+#define NAVIT_ROUTE_HEAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Implementations of the queue */
+enum route_heap_type {
+    route_heap_type_default,                /**< The implementation selected at build time */
+    route_heap_type_dary,                   /**< Indexed 4-ary heap */
+    route_heap_type_fib,                    /**< Fibonacci heap from fib-1.1 */
+};
+
+struct route_heap;
+
+/* prototypes */
+void route_heap_init(void);
+struct route_heap *route_heap_new(int index_offset);
+struct route_heap *route_heap_new_type(enum route_heap_type type, int index_offset);
+void route_heap_destroy(struct route_heap *this_);
+void route_heap_insert(struct route_heap *this_, void *data, int key);
+void route_heap_change_key(struct route_heap *this_, void *data, int key);
+void route_heap_remove(struct route_heap *this_, void *data);
+void *route_heap_min(struct route_heap *this_);
+int route_heap_min_key(struct route_heap *this_);
+void *route_heap_extract_min(struct route_heap *this_);
+void route_heap_clear(struct route_heap *this_);
+int route_heap_size(struct route_heap *this_);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Replays the priority queue operations of route calculations against all queue implementations
+ *
+ * To obtain a log, run Navit with the environment variable `NAVIT_ROUTE_HEAP_LOG` set to a file name and calculate
+ * a route, then run `route_heap_bench <file> [<repetitions>]`. See route_heap.c for the format of the log.
+ *
+ * Queues which use keys of equal value may return elements in a different order than during recording. In order to
+ * replay such logs anyway, an insertion of an element which is already on the queue changes its key instead, a key
+ * change of an element which is not on the queue inserts it and removal of an element which is not on the queue is
+ * ignored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include "route_heap.h"
+
+/** A recorded operation */
+struct bench_op {
+    char op;                            /**< Operation, see route_heap.c */
+    int heap;                           /**< Index of the queue */
+    int element;                        /**< Index of the element */
+    int key;                            /**< Key of the element */
+};
+
+/** An element, corresponding to a route graph point */
+struct bench_element {
+    int el;                             /**< Position on the queue */
+    int value;                          /**< Padding to the size of a typical element */
+};
+
+struct bench_log {
+    struct bench_op *ops;               /**< The operations */
+    int count;                          /**< Number of operations */
+    int heaps;                          /**< Number of queues */
+    int *elements;                      /**< Number of elements of each queue */
+};
+
+static int bench_log_read(struct bench_log *log, char *filename) {
+    FILE *f=fopen(filename, "r");
+    char line[128];
+    int size=0;
+    if (!f) {
+        fprintf(stderr, "Failed to open %s\n", filename);
+        return 0;
+    }
+    memset(log, 0, sizeof(*log));
+    while (fgets(line, sizeof(line), f)) {
+        struct bench_op op;
+        memset(&op, 0, sizeof(op));
+        if (sscanf(line, "%c %d %d %d", &op.op, &op.heap, &op.element, &op.key) < 2 || op.heap <= 0) {
+            fprintf(stderr, "Invalid line: %s", line);
+            continue;
+        }
+        if (op.heap > log->heaps) {
+            log->elements=g_renew(int, log->elements, op.heap);
+            memset(log->elements+log->heaps, 0, (op.heap-log->heaps)*sizeof(int));
+            log->heaps=op.heap;
+        }
+        op.heap--;
+        if (op.element > log->elements[op.heap])
+            log->elements[op.heap]=op.element;
+        op.element--;
+        if (log->count >= size) {
+            size=size ? size*2 : 65536;
+            log->ops=g_renew(struct bench_op, log->ops, size);
+        }
+        log->ops[log->count++]=op;
+    }
+    fclose(f);
+    return 1;
+}
+
+static double bench_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/**
+ * @brief Replays a log
+ *
+ * @return The number of elements extracted, which serves as a checksum
+ */
+static int bench_replay(struct bench_log *log, enum route_heap_type type, struct bench_element **elements) {
+    struct route_heap **heaps=g_new0(struct route_heap *, log->heaps);
+    struct bench_element *e;
+    int i,ret=0;
+
+    for (i = 0 ; i < log->count ; i++) {
+        struct bench_op *op=&log->ops[i];
+        struct route_heap *heap=heaps[op->heap];
+        if (op->op == 'n') {
+            /* sequence numbers restart if several runs of Navit were recorded to the same log */
+            if (heap)
+                route_heap_destroy(heap);
+            heaps[op->heap]=route_heap_new_type(type, offsetof(struct bench_element, el));
+            memset(elements[op->heap], 0, log->elements[op->heap]*sizeof(struct bench_element));
+            continue;
+        }
+        if (!heap)
+            continue;
+        e=op->element >= 0 ? &elements[op->heap][op->element] : NULL;
+        switch (op->op) {
+        case 'i':
+        case 'c':
+            if (e->el)
+                route_heap_change_key(heap, e, op->key);
+            else
+                route_heap_insert(heap, e, op->key);
+            break;
+        case 'r':
+            if (e->el)
+                route_heap_remove(heap, e);
+            break;
+        case 'm':
+            route_heap_min_key(heap);
+            break;
+        case 'x':
+            if (route_heap_extract_min(heap))
+                ret++;
+            break;
+        case 'k':
+            route_heap_clear(heap);
+            break;
+        case 'd':
+            route_heap_destroy(heap);
+            heaps[op->heap]=NULL;
+            break;
+        }
+    }
+    for (i = 0 ; i < log->heaps ; i++)
+        if (heaps[i])
+            route_heap_destroy(heaps[i]);
+    g_free(heaps);
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    struct {
+        char *name;
+        enum route_heap_type type;
+    } types[]= {
+        {"4-ary", route_heap_type_dary},
+        {"fibonacci", route_heap_type_fib},
+    };
+    struct bench_log log;
+    struct bench_element **elements;
+    int i,j,repetitions=10;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <log> [<repetitions>]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2)
+        repetitions=atoi(argv[2]);
+    /* do not record the replay itself */
+    putenv("NAVIT_ROUTE_HEAP_LOG=");
+    if (!bench_log_read(&log, argv[1]))
+        return 1;
+    elements=g_new(struct bench_element *, log.heaps);
+    for (i = 0 ; i < log.heaps ; i++)
+        elements[i]=g_new0(struct bench_element, log.elements[i]);
+    printf("%d operations on %d queues\n", log.count, log.heaps);
+    for (i = 0 ; i < sizeof(types)/sizeof(types[0]) ; i++) {
+        double start,best=0;
+        int extracted=0;
+        for (j = 0 ; j < repetitions ; j++) {
+            start=bench_time();
+            extracted=bench_replay(&log, types[i].type, elements);
+            start=bench_time()-start;
+            if (!j || start < best)
+                best=start;
+        }
+        printf("%-10s %10.3f ms %8.1f ns/op %d extracted\n", types[i].name, best*1000,
+               log.count ? best*1e9/log.count : 0, extracted);
+    }
+    for (i = 0 ; i < log.heaps ; i++)
+        g_free(elements[i]);
+    g_free(elements);
+    g_free(log.elements);
+    g_free(log.ops);
+    return 0;
+}
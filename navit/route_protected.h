@@ -55,8 +55,8 @@ struct route_graph_point {
 	                                      *  of this linked-list are in route_graph_segment->end_next. */
 	struct route_graph_segment *seg;     /**< Pointer to the segment one should use to reach the destination at
 	                                      *  least costs */
-	struct fibheap_el *el;				 /**< When this point is put on a Fibonacci heap, this is a pointer
-	                                      *  to this point's heap element */
+	int el;                              /**< When this point is on the heap of the route graph, this is its
+	                                      *  position on the heap as maintained by route_heap.c, else 0 */
 	int value;                           /**< The cost at which one can reach the destination from this point on.
 	                                      *  {@code INT_MAX} indicates that the destination is unreachable from this
 	                                      *  point, or that this point has not yet been examined. */
@@ -117,6 +117,17 @@ struct route_graph_segment_data {
 	                                       *   segments over others */
 };
 
+/**
+ * @brief Historic speeds on a segment over the week
+ *
+ * The week, starting on Monday 00:00 local time, is divided into `count` intervals of equal length. This is the
+ * layout of the {@code speed_profile} attribute of streets.
+ */
+struct route_speed_profile {
+	int count;                            /**< Number of intervals */
+	unsigned char speed[0];               /**< Speed in km/h for each interval, 0 if not known */
+};
+
 /**
  * @brief A segment in the route graph
  *
@@ -130,9 +141,23 @@ struct route_graph_segment {
 	                                         *  same point. Start of this list is in route_graph_point->end. */
 	struct route_graph_point *start;		/**< Pointer to the point this segment starts at. */
 	struct route_graph_point *end;			/**< Pointer to the point this segment ends at. */
+	int index;								/**< Position of the segment in the cost cache of the graph, see
+	                                         *  route_graph_costs_update() */
 	struct route_segment_data data;			/**< The segment data */
 };
 
+/**
+ * @brief Memory from which the points or the segments of a route graph are allocated
+ *
+ * Memory is taken from large chunks and cannot be released individually. All chunks are released at once when the
+ * points or segments of the graph are freed.
+ */
+struct route_graph_arena {
+	struct route_graph_arena_chunk *chunks;     /**< All chunks, the one currently allocated from first */
+	int size;                                   /**< Total size of all chunks in bytes */
+	int chunk_size;                             /**< Size of the next chunk in bytes, 0 for the minimum size */
+};
+
 /**
  * @brief A complete route graph
  *
@@ -144,6 +169,8 @@ struct route_graph {
 	                                             *   flooded or the path is being built (a more detailed status can be
 	                                             *   obtained from the route’s status attribute) */
 	struct map_selection *sel;                  /**< The rectangle selection for the graph */
+	struct map_selection *extent;               /**< The selection from which the graph has been built, including
+	                                             *   any extensions, see route_graph_extend() */
 	struct mapset_handle *h;                    /**< Handle to the mapset */
 	struct map *m;                              /**< Pointer to the currently active map */
 	struct map_rect *mr;                        /**< Pointer to the currently active map rectangle */
@@ -151,11 +178,58 @@ struct route_graph {
 	struct callback *idle_cb;                   /**< Idle callback to process the graph */
 	struct callback *done_cb;                   /**< Callback when graph is done */
 	struct event_idle *idle_ev;                 /**< The pointer to the idle event */
+	int async;                                  /**< The graph is being built in the background, see
+	                                             *   route_graph_build() */
 	struct route_graph_segment *route_segments; /**< Pointer to the first route_graph_segment in the linked list of all segments */
 	struct route_graph_segment *avoid_seg;      /**< Segment to which a turnaround penalty (if active) applies */
-	struct fibheap *heap;                       /**< Priority queue for points to be expanded */
+	struct route_heap *heap;                    /**< Priority queue for points to be expanded */
+	int ch;                                     /**< The graph only holds the streets along a path found in the
+	                                             *   contraction hierarchy of the map, see route_graph_build_ch() */
+	int overlay;                                /**< The graph only holds the cells of the overlay of the map along the
+	                                             *   path, see route_overlay_selection() */
+	struct route_graph_heuristic *heuristic;    /**< State of the A* heuristic, NULL if no heuristic is used */
+	int maxspeed;                               /**< Highest maxspeed of all segments in km/h, 0 if none has one */
+	int expanded;                               /**< Number of points expanded since the graph was built */
+	int item_count;                             /**< Number of items read from the maps */
+	int segment_count;                          /**< Number of segments added to the graph */
+	int *costs;                                 /**< Cost of each segment in both directions for `costs_profile`,
+	                                             *   indexed by twice the index of the segment (plus one against its
+	                                             *   direction), -1 if the cost needs to be recalculated */
+	int costs_count;                            /**< Number of segments covered by `costs` */
+	struct vehicleprofile *costs_profile;       /**< Vehicle profile for which `costs` has been filled, NULL if
+	                                             *   it needs to be filled again */
+	unsigned int costs_generation;              /**< Generation of `costs_profile` when `costs` was filled, see
+	                                             *   `struct vehicleprofile` */
+	struct route_speed_profile **speed_profiles; /**< Historic speeds of each segment, indexed by the index of the
+	                                             *   segment, NULL for segments without one */
+	int speed_profiles_size;                    /**< Number of segments `speed_profiles` can hold */
+	int **speed_delays;                         /**< Delay of each segment with historic speeds for each of their
+	                                             *   intervals with `costs_profile`, indexed like `speed_profiles`,
+	                                             *   -1 if the delay needs to be recalculated */
+	int time_dependent;                         /**< Costs take the historic speeds into account, see
+	                                             *   route_graph_speed_delay() */
+	int arrival;                                /**< Estimated time of arrival at the destination in seconds since
+	                                             *   Monday 00:00 local time, used if `time_dependent` is set */
 #define HASH_SIZE 8192
-	struct route_graph_point *hash[HASH_SIZE];  /**< A hashtable containing all route_graph_points in this graph */
+	struct route_graph_point **hash;            /**< A hashtable containing all route_graph_points in this graph */
+	int hash_size;                              /**< Number of buckets in `hash`, a power of two which grows with
+	                                             *   the number of points, starting at {@code HASH_SIZE} */
+	int point_count;                            /**< Number of points in `hash` */
+	struct route_graph_point *frozen_points;    /**< Array holding the points present when the graph was frozen, see
+	                                             *   route_graph_freeze(); NULL if the graph has not been frozen */
+	int frozen_point_count;                     /**< Number of points in `frozen_points` */
+	char *frozen_segments;                      /**< Buffer holding the segments present when the graph was frozen,
+	                                             *   grouped by start point in the order of `frozen_points` */
+	int frozen_segments_size;                   /**< Size of `frozen_segments` in bytes */
+	struct route_graph_point **restrictions;    /**< Points with turn restrictions which have not been resolved yet,
+	                                             *   see route_graph_process_restrictions() */
+	int restriction_count;                      /**< Number of points in `restrictions` */
+	int restriction_size;                       /**< Number of points `restrictions` can hold */
+	struct route_graph_arena point_arena;       /**< Memory holding the points */
+	struct route_graph_arena segment_arena;     /**< Memory holding the segments */
+	int arena_peak;                             /**< Highest combined size of both arenas in bytes */
+	struct route_graph_build_thread *build_thread; /**< State of building the graph on a worker thread, NULL if the
+	                                             *   graph is built on the main loop only */
 };
 
 
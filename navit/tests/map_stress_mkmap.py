@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Writes a small binfile map for the navit-map-stress test
+#
+# Usage: map_stress_mkmap.py <map.bin>
+#
+# The map is a zip file with 64 tiles of random streets below one parent tile, which is laid out like the maps written
+# by maptool, see navit/maptool/zip.c. Tiles are deflated, so the test also covers inflating them on several threads.
+# The random numbers are seeded, so the map is the same on every run.
+
+import random
+import struct
+import sys
+import zlib
+
+TYPE_SUBMAP = 0xc000001b     # type_submap
+TYPE_STREET = 0x80000009     # type_street_2_city
+ATTR_ORDER = 0x40001         # attr_order
+ATTR_ZIPFILE_REF = 0x20009   # attr_zipfile_ref
+
+PREFIX = 'cabdaca'           # the parent tile
+DEPTH = 10                   # length of the names of the tiles holding the streets
+STREETS = 4                  # streets per tile
+
+
+def cdiv(a, b):
+    """Integer division rounding towards zero, as in C"""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b > 0) else -q
+
+
+def tile_bbox(name, overlap=1):
+    """Bounding box of a tile as in tile_bbox() of maptool"""
+    lux, luy, rlx, rly = -20000000, 20000000, 20000000, -20000000
+    for ch in name:
+        cx = cdiv(lux + rlx, 2)
+        cy = cdiv(luy + rly, 2)
+        xo = cdiv((rlx - lux) * overlap, 100)
+        yo = cdiv((luy - rly) * overlap, 100)
+        if ch == 'a':
+            lux, rly = cx - xo, cy - yo
+        elif ch == 'b':
+            rlx, rly = cx + xo, cy - yo
+        elif ch == 'c':
+            lux, luy = cx - xo, cy + yo
+        elif ch == 'd':
+            rlx, luy = cx + xo, cy + yo
+    return lux, luy, rlx, rly
+
+
+def item(type, coords, attrs=()):
+    body = [type, len(coords) * 2] + [v for c in coords for v in c]
+    for a in attrs:
+        body += [len(a)] + list(a)
+    return struct.pack('<%dI' % (len(body) + 1), *[v & 0xffffffff for v in [len(body)] + body])
+
+
+def submap(name, zipfile_ref):
+    lux, luy, rlx, rly = tile_bbox(name)
+    order = (255 << 16) | max(len(name) - 4, 0)
+    return item(TYPE_SUBMAP, [(lux, rly), (rlx, luy)], [(ATTR_ORDER, order), (ATTR_ZIPFILE_REF, zipfile_ref)])
+
+
+def main():
+    random.seed(5)
+    names = [PREFIX]
+    for i in range(DEPTH - len(PREFIX)):
+        names = [n + c for n in names for c in 'abcd']
+    members = []
+    for n in names:
+        lux, luy, rlx, rly = tile_bbox(n, 0)
+        members.append((n, b''.join(item(TYPE_STREET, [(random.randint(lux, rlx), random.randint(rly, luy))
+                                                        for k in range(random.randint(2, 40))])
+                                    for j in range(STREETS))))
+    members.append((PREFIX, b''.join(submap(n, i) for i, (n, data) in enumerate(members))))
+    members.append(('index', submap(PREFIX, len(members) - 1)))
+    out = bytearray()
+    directory = bytearray()
+    for n, data in members:
+        name = n.encode() if n == 'index' else n.encode().ljust(14, b'_')
+        compressor = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+        compressed = compressor.compress(data) + compressor.flush()
+        method = 8
+        if len(compressed) >= len(data):
+            compressed = data
+            method = 0
+        crc = zlib.crc32(data) & 0xffffffff
+        offset = len(out)
+        out += struct.pack('<IHHHHHIIIHH', 0x04034b50, 20, 0, method, 0, 0, crc, len(compressed), len(data),
+                           len(name), 0) + name + compressed
+        directory += struct.pack('<IBBBBHHHHIIIHHHHHII', 0x02014b50, 0x17, 0, 20, 0, 0, method, 0, 0, crc,
+                                 len(compressed), len(data), len(name), 0, 0, 0, 0, 0, offset) + name
+    offset = len(out)
+    out += directory
+    out += struct.pack('<IHHHHIIH', 0x06054b50, 0, 0, len(members), len(members), len(directory), offset, 0)
+    with open(sys.argv[1], 'wb') as f:
+        f.write(out)
+
+
+if __name__ == '__main__':
+    main()
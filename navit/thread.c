@@ -0,0 +1,186 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+#ifdef HAVE_API_WIN32_BASE
+#include <windows.h>
+#elif defined(HAVE_PTHREAD)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include <glib.h>
+#include "debug.h"
+#include "thread.h"
+
+struct thread {
+#ifdef HAVE_API_WIN32_BASE
+    HANDLE handle;
+#elif defined(HAVE_PTHREAD)
+    pthread_t handle;
+#endif
+    int (*main)(void *);
+    void *data;
+    char *name;
+    int ret;
+};
+
+struct thread_lock {
+#ifdef HAVE_API_WIN32_BASE
+    CRITICAL_SECTION cs;
+#elif defined(HAVE_PTHREAD)
+    pthread_mutex_t mutex;
+#else
+    int dummy;
+#endif
+};
+
+/**
+ * @brief Whether threads can be created on this platform
+ *
+ * @return True if `thread_new()` can succeed
+ */
+int thread_supported(void) {
+#if defined(HAVE_API_WIN32_BASE) || defined(HAVE_PTHREAD)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Returns the number of processors available to run threads
+ *
+ * @return The number of processors, 1 if unknown or if threads are not supported
+ */
+int thread_cpu_count(void) {
+#ifdef HAVE_API_WIN32_BASE
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#elif defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    long ret=sysconf(_SC_NPROCESSORS_ONLN);
+    return ret > 0 ? ret : 1;
+#else
+    return 1;
+#endif
+}
+
+#ifdef HAVE_API_WIN32_BASE
+static DWORD WINAPI thread_main(LPVOID arg) {
+#else
+static void *thread_main(void *arg) {
+#endif
+    struct thread *this_=arg;
+    dbg(lvl_debug,"thread %s started", this_->name);
+    this_->ret=this_->main(this_->data);
+    dbg(lvl_debug,"thread %s finished with %d", this_->name, this_->ret);
+    return 0;
+}
+
+/**
+ * @brief Starts a new thread
+ *
+ * @param main The function to run on the thread, its return value is returned by `thread_join()`
+ * @param data The argument passed to `main`
+ * @param name The name of the thread, used for debugging
+ * @return The new thread, or NULL if threads are not supported or the thread could not be created
+ */
+struct thread *thread_new(int (*main)(void *), void *data, char *name) {
+#if defined(HAVE_API_WIN32_BASE) || defined(HAVE_PTHREAD)
+    struct thread *ret=g_new0(struct thread, 1);
+    ret->main=main;
+    ret->data=data;
+    ret->name=g_strdup(name);
+#ifdef HAVE_API_WIN32_BASE
+    ret->handle=CreateThread(NULL, 0, thread_main, ret, 0, NULL);
+    if (ret->handle)
+        return ret;
+#else
+    if (!pthread_create(&ret->handle, NULL, thread_main, ret))
+        return ret;
+#endif
+    dbg(lvl_error,"failed to create thread %s", name);
+    g_free(ret->name);
+    g_free(ret);
+#endif
+    return NULL;
+}
+
+/**
+ * @brief Waits for a thread to finish and frees it
+ *
+ * @param this_ The thread
+ * @return The return value of the thread's main function
+ */
+int thread_join(struct thread *this_) {
+    int ret;
+    if (!this_)
+        return 0;
+#ifdef HAVE_API_WIN32_BASE
+    WaitForSingleObject(this_->handle, INFINITE);
+    CloseHandle(this_->handle);
+#elif defined(HAVE_PTHREAD)
+    pthread_join(this_->handle, NULL);
+#endif
+    ret=this_->ret;
+    g_free(this_->name);
+    g_free(this_);
+    return ret;
+}
+
+struct thread_lock *thread_lock_new(void) {
+    struct thread_lock *ret=g_new0(struct thread_lock, 1);
+#ifdef HAVE_API_WIN32_BASE
+    InitializeCriticalSection(&ret->cs);
+#elif defined(HAVE_PTHREAD)
+    pthread_mutex_init(&ret->mutex, NULL);
+#endif
+    return ret;
+}
+
+void thread_lock_destroy(struct thread_lock *this_) {
+    if (!this_)
+        return;
+#ifdef HAVE_API_WIN32_BASE
+    DeleteCriticalSection(&this_->cs);
+#elif defined(HAVE_PTHREAD)
+    pthread_mutex_destroy(&this_->mutex);
+#endif
+    g_free(this_);
+}
+
+void thread_lock_acquire(struct thread_lock *this_) {
+    if (!this_)
+        return;
+#ifdef HAVE_API_WIN32_BASE
+    EnterCriticalSection(&this_->cs);
+#elif defined(HAVE_PTHREAD)
+    pthread_mutex_lock(&this_->mutex);
+#endif
+}
+
+void thread_lock_release(struct thread_lock *this_) {
+    if (!this_)
+        return;
+#ifdef HAVE_API_WIN32_BASE
+    LeaveCriticalSection(&this_->cs);
+#elif defined(HAVE_PTHREAD)
+    pthread_mutex_unlock(&this_->mutex);
+#endif
+}
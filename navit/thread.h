@@ -0,0 +1,55 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Minimal portable threads and locks
+ *
+ * Navit runs on platforms with POSIX threads, on Windows and on platforms without any thread support. Callers must
+ * be prepared for `thread_new()` to return NULL, in which case the work has to be done on the main loop. Locks are
+ * always available, but do nothing if threads are not supported. All lock functions accept NULL as lock.
+ *
+ * Code running on a thread other than the main thread must not call into the event system, graphics or callbacks.
+ */
+
+#ifndef NAVIT_THREAD_H
+#define NAVIT_THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct thread;
+struct thread_lock;
+
+/* prototypes */
+int thread_supported(void);
+int thread_cpu_count(void);
+struct thread *thread_new(int (*main)(void *), void *data, char *name);
+int thread_join(struct thread *this_);
+struct thread_lock *thread_lock_new(void);
+void thread_lock_destroy(struct thread_lock *this_);
+void thread_lock_acquire(struct thread_lock *this_);
+void thread_lock_release(struct thread_lock *this_);
+/* end of prototypes */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
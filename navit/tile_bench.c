@@ -0,0 +1,267 @@
+/**
+ * Navit, a modular navigation system.
+ * Copyright (C) 2005-2018 Navit Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/** @file
+ * @brief Decodes all tiles of binfile maps and prints sizes and decoding throughput as CSV
+ *
+ * Usage: `navit-tile-bench [-d <level>] [-r <repetitions>] <map.bin>...`
+ *
+ * Every member of each map is read into memory and then decoded with `file_data_uncompress()`, the function binfile
+ * uses itself, so only the decoding is timed. For each compression method found in a map, one line is printed with
+ * the size of the map file (in bytes), the number of members, their compressed and uncompressed size (in bytes), the
+ * time spent decoding them (in microseconds) and the resulting throughput (in megabytes of uncompressed data per
+ * second), and the number of members which failed to decode or had a wrong CRC.
+ *
+ * To compare codecs, build the same map with and without `maptool --zstd` and pass both to this tool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <zlib.h>
+#include "config.h"
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#else
+#include <XGetopt.h>
+#endif
+#include <sys/time.h>
+#include "debug.h"
+#include "file.h"
+#include "main.h"
+#include "types.h"
+#include "zipfile.h"
+
+#ifndef HAVE_GLIB
+extern void _g_slice_thread_init_nomessage(void);
+#endif
+
+struct bench_method {
+    int method;
+    int members;
+    long long compressed;
+    long long uncompressed;
+    long long time;
+    int errors;
+};
+
+static void print_usage(void) {
+    fprintf(stderr, "navit-tile-bench usage:\n"
+            "navit-tile-bench [options] <map.bin>...\n"
+            "\t-d <n>: set the global debug output level to <n>.\n"
+            "\t-r <n>: decode each member <n> times.\n"
+            "\t-h: print this usage info and exit.\n");
+}
+
+static char *bench_method_name(int method) {
+    switch (method) {
+    case zip_method_stored:
+        return "stored";
+    case zip_method_deflate:
+        return "deflate";
+    case zip_method_zstd:
+        return "zstd";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * @brief Reads the central directory of a map
+ *
+ * @param fi The map file
+ * @param size Receives the size of the central directory
+ * @return The central directory, to be freed with `file_data_free()`, or NULL if the file is not a zip file
+ */
+static unsigned char *bench_read_cd(struct file *fi, int *size) {
+    struct zip_eoc *eoc;
+    struct zip64_eocl *eocl;
+    struct zip64_eoc *eoc64;
+    long long offset=-1;
+    unsigned char *ret=NULL;
+
+    eoc=(struct zip_eoc *)file_data_read(fi, fi->size-sizeof(*eoc), sizeof(*eoc));
+    if (!eoc)
+        return NULL;
+    if (eoc->zipesig == zip_eoc_sig) {
+        offset=eoc->zipeofst;
+        *size=eoc->zipecsz;
+    }
+    file_data_free(fi, (unsigned char *)eoc);
+    eocl=(struct zip64_eocl *)file_data_read(fi, fi->size-sizeof(*eoc)-sizeof(*eocl), sizeof(*eocl));
+    if (eocl) {
+        if (eocl->zip64lsig == zip64_eocl_sig) {
+            eoc64=(struct zip64_eoc *)file_data_read(fi, eocl->zip64lofst, sizeof(*eoc64));
+            if (eoc64 && eoc64->zip64esig == zip64_eoc_sig) {
+                offset=eoc64->zip64eofst;
+                *size=eoc64->zip64ecsz;
+            }
+            file_data_free(fi, (unsigned char *)eoc64);
+        }
+        file_data_free(fi, (unsigned char *)eocl);
+    }
+    if (offset >= 0)
+        ret=file_data_read(fi, offset, *size);
+    return ret;
+}
+
+/**
+ * @brief Decodes one member of a map
+ *
+ * @param fi The map file
+ * @param cd The central directory entry of the member
+ * @param offset The offset of the local file header of the member
+ * @param repetitions How often to decode the member
+ * @param stats The statistics of the compression method of the member, updated by this function
+ */
+static void bench_member(struct file *fi, struct zip_cd *cd, long long offset, int repetitions,
+                         struct bench_method *stats) {
+    struct zip_lfh *lfh;
+    unsigned char *data,*buffer;
+    struct timeval start,end;
+    int i,ok=1;
+
+    stats->members++;
+    stats->compressed+=cd->zipcsiz;
+    stats->uncompressed+=(long long)cd->zipcunc*repetitions;
+    lfh=(struct zip_lfh *)file_data_read(fi, offset, sizeof(*lfh));
+    if (!lfh || lfh->ziplocsig != zip_lfh_sig) {
+        file_data_free(fi, (unsigned char *)lfh);
+        stats->errors++;
+        return;
+    }
+    data=file_data_read(fi, offset+sizeof(*lfh)+lfh->zipfnln+lfh->zipxtraln, cd->zipcsiz);
+    file_data_free(fi, (unsigned char *)lfh);
+    if (!data) {
+        stats->errors++;
+        return;
+    }
+    if (cd->zipcmthd == zip_method_stored) {
+        buffer=data;
+    } else {
+        buffer=g_malloc(cd->zipcunc);
+        gettimeofday(&start, NULL);
+        for (i = 0 ; i < repetitions && ok ; i++)
+            ok=file_data_uncompress(buffer, cd->zipcunc, data, cd->zipcsiz, cd->zipcmthd);
+        gettimeofday(&end, NULL);
+        stats->time+=(end.tv_sec-start.tv_sec)*1000000LL+end.tv_usec-start.tv_usec;
+    }
+    if (!ok || crc32(crc32(0, NULL, 0), buffer, cd->zipcunc) != (unsigned int)cd->zipccrc)
+        stats->errors++;
+    if (buffer != data)
+        g_free(buffer);
+    file_data_free(fi, data);
+}
+
+/**
+ * @brief Decodes all members of a map and prints one line per compression method
+ *
+ * @return 0 on success, nonzero if the map could not be read or some of its members could not be decoded
+ */
+static int bench_map(char *filename, int repetitions) {
+    struct bench_method stats[4];
+    struct file *fi;
+    unsigned char *cd_data;
+    int i,size,pos=0,count=0,errors=0;
+
+    memset(stats, 0, sizeof(stats));
+    stats[0].method=zip_method_stored;
+    stats[1].method=zip_method_deflate;
+    stats[2].method=zip_method_zstd;
+    stats[3].method=-1;
+    fi=file_create(filename, NULL);
+    if (!fi) {
+        fprintf(stderr, "Failed to open %s\n", filename);
+        return 1;
+    }
+    fi->cache=0;
+    cd_data=bench_read_cd(fi, &size);
+    if (!cd_data) {
+        fprintf(stderr, "%s is not a zip file\n", filename);
+        file_destroy(fi);
+        return 1;
+    }
+    while (pos+(int)sizeof(struct zip_cd) <= size) {
+        struct zip_cd *cd=(struct zip_cd *)(cd_data+pos);
+        long long offset=cd->zipofst;
+        if (cd->zipcensig != zip_cd_sig)
+            break;
+        if (offset == zip_size_64bit_placeholder && cd->zipcxtl >= sizeof(struct zip_cd_ext)) {
+            struct zip_cd_ext *ext=(struct zip_cd_ext *)(cd_data+pos+sizeof(*cd)+cd->zipcfnl);
+            if (ext->tag == zip_extra_header_id_zip64)
+                offset=ext->zipofst;
+        }
+        for (i = 0 ; i < 3 && stats[i].method != cd->zipcmthd ; i++);
+        if (cd->zipcunc)
+            bench_member(fi, cd, offset, repetitions, &stats[i]);
+        pos+=sizeof(*cd)+cd->zipcfnl+cd->zipcxtl+cd->zipccml;
+        count++;
+    }
+    file_data_free(fi, cd_data);
+    for (i = 0 ; i < 4 ; i++) {
+        if (!stats[i].members)
+            continue;
+        errors+=stats[i].errors;
+        printf("%s,"LONGLONG_FMT",%s,%d,"LONGLONG_FMT","LONGLONG_FMT","LONGLONG_FMT",%.1f,%d\n", filename, fi->size,
+               bench_method_name(stats[i].method), stats[i].members, stats[i].compressed,
+               stats[i].uncompressed/repetitions, stats[i].time,
+               stats[i].time ? (double)stats[i].uncompressed/stats[i].time : 0, stats[i].errors);
+    }
+    fflush(stdout);
+    file_destroy(fi);
+    if (!count) {
+        fprintf(stderr, "%s has no members\n", filename);
+        return 1;
+    }
+    return errors != 0;
+}
+
+int main(int argc, char **argv) {
+    int opt,i,repetitions=1,ret=0;
+
+#ifndef HAVE_GLIB
+    _g_slice_thread_init_nomessage();
+#endif
+    main_init(argv[0]);
+    debug_init(argv[0]);
+    file_init();
+    while((opt = getopt(argc, argv, "hd:r:")) != -1) {
+        switch(opt) {
+        case 'd':
+            debug_set_global_level(atoi(optarg), 1);
+            break;
+        case 'r':
+            repetitions=atoi(optarg);
+            break;
+        case 'h':
+        default:
+            print_usage();
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind >= argc || repetitions < 1) {
+        print_usage();
+        return 2;
+    }
+    printf("map,map_size,method,members,compressed,uncompressed,time_decode,throughput,errors\n");
+    for (i = optind ; i < argc ; i++)
+        ret|=bench_map(argv[i], repetitions);
+    return ret ? 3 : 0;
+}
@@ -25,6 +25,7 @@
  * Traffic distortions are used by Navit to route around traffic problems.
  */
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -47,7 +48,7 @@
 #include "xmlconfig.h"
 #include "traffic.h"
 #include "plugin.h"
-#include "fib.h"
+#include "route_heap.h"
 #include "event.h"
 #include "callback.h"
 #include "vehicleprofile.h"
@@ -2180,7 +2181,7 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
     GList * existing = NULL;
 
     /* This heap will hold all points with "temporarily" calculated costs */
-    struct fibheap *heap;
+    struct route_heap *heap;
 
     /* Cost of the start position */
     int start_value;
@@ -2215,24 +2216,23 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
     }
 
     /* prime the route graph */
-    heap = fh_makekeyheap();
+    heap = route_heap_new(offsetof(struct route_graph_point, el));
 
     start_value = PENALTY_OFFROAD * transform_distance(projection_mg, c_start, c_dst);
     ret = NULL;
 
     dbg(lvl_debug, "start flooding route graph, start_value=%d", start_value);
 
-    for (i = 0; i < HASH_SIZE; i++) {
+    for (i = 0; i < rg->hash_size; i++) {
         p = rg->hash[i];
         while (p) {
             if (!g_list_find(existing, p)) {
                 if (!(p->flags & RP_TURN_RESTRICTION)) {
                     p->value = PENALTY_OFFROAD * transform_distance(projection_mg, &p->c, c_dst);
-                    p->el = fh_insertkey(heap, p->value, p);
+                    route_heap_insert(heap, p, p->value);
                 } else {
                     /* ignore points which are part of turn restrictions */
                     p->value = INT_MAX;
-                    p->el = NULL;
                 }
                 p->seg = NULL;
             }
@@ -2242,14 +2242,13 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
 
     /* flood the route graph */
     for (;;) {
-        p = fh_extractmin(heap); /* Starting Dijkstra by selecting the point with the minimum costs on the heap */
+        p = route_heap_extract_min(heap); /* Starting Dijkstra by selecting the point with the minimum costs on the heap */
         if (!p) /* There are no more points with temporarily calculated costs, Dijkstra has finished */
             break;
 
         dbg(lvl_debug, "p=%p, value=%d", p, p->value);
 
-        min = p->value;
-        p->el = NULL; /* This point is permanently calculated now, we've taken it out of the heap */
+        min = p->value; /* This point is permanently calculated now, we've taken it out of the heap */
         s = p->start;
         while (s) { /* Iterating all the segments leading away from our point to update the points at their ends */
             val = traffic_route_get_seg_cost(s, data, -1);
@@ -2262,9 +2261,9 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                     s->end->value = new;
                     s->end->seg = s;
                     if (!s->end->el) {
-                        s->end->el = fh_insertkey(heap, new, s->end);
+                        route_heap_insert(heap, s->end, new);
                     } else {
-                        fh_replacekey(heap, s->end->el, new);
+                        route_heap_change_key(heap, s->end, new);
                     }
                     new += PENALTY_OFFROAD * transform_distance(projection_mg, &s->end->c, c_start);
                     if (new < start_value) { /* We've found a less costly way from the start point, update */
@@ -2287,9 +2286,9 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
                     s->start->value = new;
                     s->start->seg = s;
                     if (!s->start->el) {
-                        s->start->el = fh_insertkey(heap, new, s->start);
+                        route_heap_insert(heap, s->start, new);
                     } else {
-                        fh_replacekey(heap, s->start->el, new);
+                        route_heap_change_key(heap, s->start, new);
                     }
                     new += PENALTY_OFFROAD * transform_distance(projection_mg, &s->start->c, c_start);
                     if (new < start_value) {
@@ -2302,7 +2301,7 @@ static struct route_graph_point * traffic_route_flood_graph(struct route_graph *
         }
     }
 
-    fh_deleteheap(heap);
+    route_heap_destroy(heap);
     g_list_free(existing);
     return ret;
 }
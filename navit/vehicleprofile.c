@@ -56,6 +56,10 @@ static void vehicleprofile_set_attr_do(struct vehicleprofile *this_, struct attr
             g_free(this_->route_depth);
         this_->route_depth = g_strdup(attr->u.str);
         break;
+    case attr_route_corridor:
+        g_free(this_->route_corridor);
+        this_->route_corridor = (attr->u.str && *attr->u.str) ? g_strdup(attr->u.str) : NULL;
+        break;
     case attr_vehicle_axle_weight:
         this_->axle_weight=attr->u.num;
         break;
@@ -89,6 +93,18 @@ static void vehicleprofile_set_attr_do(struct vehicleprofile *this_, struct attr
     case attr_turn_around_penalty2:
         this_->turn_around_penalty2=attr->u.num;
         break;
+    case attr_contraction_hierarchies:
+        this_->contraction_hierarchies=attr->u.num;
+        break;
+    case attr_route_heuristic:
+        this_->route_heuristic=attr->u.num;
+        break;
+    case attr_route_overlay:
+        this_->route_overlay=attr->u.num;
+        break;
+    case attr_route_time_dependent:
+        this_->route_time_dependent=attr->u.num;
+        break;
     default:
         break;
     }
@@ -118,6 +134,8 @@ static void vehicleprofile_clear(struct vehicleprofile *this_) {
     this_->name=NULL;
     g_free(this_->route_depth);
     this_->route_depth=NULL;
+    g_free(this_->route_corridor);
+    this_->route_corridor=NULL;
     this_->dangerous_goods=0;
     this_->length=-1;
     this_->width=-1;
@@ -125,6 +143,10 @@ static void vehicleprofile_clear(struct vehicleprofile *this_) {
     this_->weight=-1;
     this_->axle_weight=-1;
     this_->through_traffic_penalty=9000;
+    this_->contraction_hierarchies=0;
+    this_->route_heuristic=0;
+    this_->route_overlay=0;
+    this_->route_time_dependent=0;
     vehicleprofile_free_hash(this_);
     this_->roadprofile_hash=g_hash_table_new(NULL, NULL);
 }
@@ -185,6 +207,7 @@ static void vehicleprofile_update(struct vehicleprofile *this_) {
     struct attr_iter *iter=vehicleprofile_attr_iter_new(NULL);
     struct attr profile_option;
     dbg(lvl_debug,"enter");
+    this_->generation++;
     vehicleprofile_clear(this_);
     vehicleprofile_apply_attrs(this_, (struct navit_object *)this_, 0);
     while (vehicleprofile_get_attr(this_, attr_profile_option, &profile_option, iter)) {
@@ -242,12 +265,14 @@ int vehicleprofile_get_attr(struct vehicleprofile *this_, enum attr_type type, s
 }
 
 int vehicleprofile_set_attr(struct vehicleprofile *this_, struct attr *attr) {
+    this_->generation++;
     vehicleprofile_set_attr_do(this_, attr);
     this_->attrs=attr_generic_set_attr(this_->attrs, attr);
     return 1;
 }
 
 int vehicleprofile_add_attr(struct vehicleprofile *this_, struct attr *attr) {
+    this_->generation++;
     this_->attrs=attr_generic_add_attr(this_->attrs, attr);
     switch (attr->type) {
     case attr_roadprofile:
@@ -263,6 +288,7 @@ int vehicleprofile_add_attr(struct vehicleprofile *this_, struct attr *attr) {
 }
 
 int vehicleprofile_remove_attr(struct vehicleprofile *this_, struct attr *attr) {
+    this_->generation++;
     this_->attrs=attr_generic_remove_attr(this_->attrs, attr);
     return 1;
 }
@@ -272,6 +298,28 @@ vehicleprofile_get_roadprofile(struct vehicleprofile *this_, enum item_type type
     return g_hash_table_lookup(this_->roadprofile_hash, (void *)(long)type);
 }
 
+static void vehicleprofile_max_route_weight(gpointer key, gpointer value, gpointer user_data) {
+    struct roadprofile *rp=value;
+    int *max=user_data;
+    if (rp->route_weight > *max)
+        *max=rp->route_weight;
+}
+
+/**
+ * @brief Returns the highest route weight of all road profiles
+ *
+ * As the route weight is the speed assumed for routing, this is the fastest speed at which the vehicle can
+ * travel on any road, unless a segment's maxspeed overrides it.
+ *
+ * @param this_ The vehicle profile
+ * @return The route weight in km/h, 0 if there are no road profiles
+ */
+int vehicleprofile_get_max_route_weight(struct vehicleprofile *this_) {
+    int ret=0;
+    g_hash_table_foreach(this_->roadprofile_hash, vehicleprofile_max_route_weight, &ret);
+    return ret;
+}
+
 char *vehicleprofile_get_name(struct vehicleprofile *this_) {
     return this_->name;
 }
@@ -41,6 +41,8 @@ struct vehicleprofile {
     int static_distance;			/**< Maximum distance of previous position of vehicle to consider it stationary */
     char *name;				/**< the vehicle profile name */
     char *route_depth;			/**< the route depth attribute */
+    char *route_corridor;			/**< the route corridor attribute, NULL to build the route graph from
+					 *   `route_depth` only */
     int width;				/**< Width of the vehicle in cm */
     int height;				/**< Height of the vehicle in cm */
     int length;				/**< Length of the vehicle in cm */
@@ -52,6 +54,12 @@ struct vehicleprofile {
     struct attr active_callback;
     int turn_around_penalty;		/**< Penalty when turning around */
     int turn_around_penalty2;		/**< Penalty when turning around, for planned turn arounds */
+    int contraction_hierarchies;		/**< Use the contraction hierarchy of the map (if any) to find the route */
+    int route_heuristic;			/**< Guide route calculation by the straight-line distance to the start (A*) */
+    int route_overlay;			/**< Use the multi-level overlay of the map (if any) to select the route graph */
+    int route_time_dependent;		/**< Take historic speeds of streets at the expected time of passing into account */
+    unsigned int generation;		/**< Incremented whenever the settings change, so that values derived from them
+					 *   can be recalculated */
 };
 
 struct vehicleprofile * vehicleprofile_new(struct attr *parent, struct attr **attrs);
@@ -63,6 +71,7 @@ int vehicleprofile_set_attr(struct vehicleprofile *this_, struct attr *attr);
 int vehicleprofile_add_attr(struct vehicleprofile *this_, struct attr *attr);
 int vehicleprofile_remove_attr(struct vehicleprofile *this_, struct attr *attr);
 struct roadprofile * vehicleprofile_get_roadprofile(struct vehicleprofile *this_, enum item_type type);
+int vehicleprofile_get_max_route_weight(struct vehicleprofile *this_);
 
 //! Returns the vehicle profile's name.
 char * vehicleprofile_get_name(struct vehicleprofile *this_);
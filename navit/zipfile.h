@@ -61,6 +61,13 @@ struct zip_lfh {
 	char zipname[0];           //!< file name (length as given above)
 } ATTRIBUTE_PACKED;
 
+/**
+* @brief Compression methods of zip members, as registered in the ZIP specification.
+*/
+#define zip_method_stored 0
+#define zip_method_deflate 8
+#define zip_method_zstd 93
+
 #define zip_cd_sig 0x02014b50
 #define zip_cd_sig_rev 0x504b0102
 
@@ -167,6 +174,36 @@ struct zip64_eocl {
 	int zip74lnum;
 } ATTRIBUTE_PACKED;
 
+#define zip_tiledir_sig 0x72696474
+#define zip_tiledir_version 1
+#define zip_tiledir_name "tiledir"
+
+//! Header of the tile directory of binfile maps.
+
+//! The tile directory is the member written by maptool just before
+//! the index. It lists the members belonging to a tile, sorted by
+//! tile name, so each tile is followed by the tiles inside of it.
+//! Tiles missing in the map are listed with a zip member of -1 if
+//! they contain tiles present in the map, so the entries form a
+//! quadtree which can be walked by skipping the subtrees outside
+//! of a selection.
+struct zip_tiledir {
+	int ziptdsig;    //!< tile directory signature
+	int ziptdver;    //!< version of the tile directory format
+	int ziptdnum;    //!< number of entries following the header
+} ATTRIBUTE_PACKED;
+
+struct zip_tiledir_entry {
+	int ziptdlx;     //!< lower x coordinate of the bounding box
+	int ziptdly;     //!< lower y coordinate of the bounding box
+	int ziptdhx;     //!< higher x coordinate of the bounding box
+	int ziptdhy;     //!< higher y coordinate of the bounding box
+	int ziptdfile;   //!< zip member, -1 if the tile is not in the map
+	unsigned short ziptddepth; //!< length of the tile name
+	unsigned short ziptdorder; //!< minimum order at which the member is used, 255 for members which are no map tiles
+	int ziptdnext;   //!< index of the first entry not inside of this tile
+} ATTRIBUTE_PACKED;
+
 struct zip_alignment_check {
 	int x[sizeof(struct zip_cd) == 46 ? 1:-1];
 };